@@ -0,0 +1,156 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+#include "perf_benchmark/allocation_counter.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+
+namespace google {
+namespace grpc {
+namespace transcoding {
+
+namespace perf_benchmark {
+namespace {
+// Constant-initialized, so that they can be used by the allocations made
+// during static initialization.
+std::atomic<bool> enabled{false};
+std::atomic<int64_t> allocations{0};
+std::atomic<int64_t> allocated_bytes{0};
+std::atomic<int64_t> live_bytes{0};
+std::atomic<int64_t> peak_live_bytes{0};
+
+// Return the usable size of the allocation at ptr, or 0 if the platform
+// doesn't tell it.
+int64_t UsableSize(void* ptr) {
+#if defined(__GLIBC__)
+  return static_cast<int64_t>(malloc_usable_size(ptr));
+#else
+  return 0;
+#endif
+}
+}  // namespace
+
+namespace internal {
+// Allocates size bytes with malloc() and counts the allocation if counting is
+// enabled. Returns nullptr if the allocation fails.
+void* CountedAllocate(std::size_t size) noexcept {
+  // malloc(0) may return nullptr, while operator new must return a unique
+  // pointer.
+  void* ptr = std::malloc(size == 0 ? 1 : size);
+  if (ptr == nullptr || !enabled.load(std::memory_order_relaxed)) {
+    return ptr;
+  }
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  allocated_bytes.fetch_add(static_cast<int64_t>(size),
+                            std::memory_order_relaxed);
+  const int64_t usable_size = UsableSize(ptr);
+  const int64_t live =
+      live_bytes.fetch_add(usable_size, std::memory_order_relaxed) +
+      usable_size;
+  int64_t peak = peak_live_bytes.load(std::memory_order_relaxed);
+  while (live > peak && !peak_live_bytes.compare_exchange_weak(
+                            peak, live, std::memory_order_relaxed)) {
+  }
+  return ptr;
+}
+
+// Frees an allocation of CountedAllocate().
+void CountedFree(void* ptr) noexcept {
+  if (ptr != nullptr && enabled.load(std::memory_order_relaxed)) {
+    live_bytes.fetch_sub(UsableSize(ptr), std::memory_order_relaxed);
+  }
+  std::free(ptr);
+}
+}  // namespace internal
+
+void SetAllocationCountingEnabled(bool enable) {
+  enabled.store(enable, std::memory_order_relaxed);
+}
+
+bool AllocationCountingEnabled() {
+  return enabled.load(std::memory_order_relaxed);
+}
+
+bool LiveBytesTracked() {
+#if defined(__GLIBC__)
+  return true;
+#else
+  return false;
+#endif
+}
+
+AllocationStats GetAllocationStats() {
+  AllocationStats stats;
+  stats.allocations = allocations.load(std::memory_order_relaxed);
+  stats.allocated_bytes = allocated_bytes.load(std::memory_order_relaxed);
+  stats.live_bytes = live_bytes.load(std::memory_order_relaxed);
+  stats.peak_live_bytes = peak_live_bytes.load(std::memory_order_relaxed);
+  return stats;
+}
+
+void ResetPeakLiveBytes() {
+  peak_live_bytes.store(live_bytes.load(std::memory_order_relaxed),
+                        std::memory_order_relaxed);
+}
+
+}  // namespace perf_benchmark
+
+}  // namespace transcoding
+}  // namespace grpc
+}  // namespace google
+
+using ::google::grpc::transcoding::perf_benchmark::internal::CountedAllocate;
+using ::google::grpc::transcoding::perf_benchmark::internal::CountedFree;
+
+void* operator new(std::size_t size) {
+  void* ptr = CountedAllocate(size);
+  if (ptr == nullptr) {
+    throw std::bad_alloc();
+  }
+  return ptr;
+}
+
+void* operator new[](std::size_t size) { return operator new(size); }
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+  return CountedAllocate(size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+  return CountedAllocate(size);
+}
+
+void operator delete(void* ptr) noexcept { CountedFree(ptr); }
+
+void operator delete[](void* ptr) noexcept { CountedFree(ptr); }
+
+void operator delete(void* ptr, std::size_t) noexcept { CountedFree(ptr); }
+
+void operator delete[](void* ptr, std::size_t) noexcept { CountedFree(ptr); }
+
+void operator delete(void* ptr, const std::nothrow_t&) noexcept {
+  CountedFree(ptr);
+}
+
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept {
+  CountedFree(ptr);
+}
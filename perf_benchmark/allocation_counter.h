@@ -0,0 +1,69 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+#ifndef PERF_BENCHMARK_ALLOCATION_COUNTER_H_
+#define PERF_BENCHMARK_ALLOCATION_COUNTER_H_
+
+#include <cstdint>
+
+namespace google {
+namespace grpc {
+namespace transcoding {
+
+namespace perf_benchmark {
+// The heap allocations made through the global operator new, which the
+// allocation_counter library replaces in the binaries that link it. The
+// allocations made with malloc() directly, or with an alignment larger than
+// the default one, are not counted.
+//
+// The allocations are only counted while counting is enabled, so that the
+// binaries that don't need the counts don't pay for the shared counters
+// (e.g. in benchmarks running on many threads).
+struct AllocationStats {
+  // The number of allocations.
+  int64_t allocations = 0;
+  // The number of bytes requested by the allocations.
+  int64_t allocated_bytes = 0;
+  // The number of bytes of the allocations not freed yet, and the largest
+  // it's been since the last ResetPeakLiveBytes(). They are the usable sizes
+  // of the allocations, as reported by malloc_usable_size(), and are only
+  // tracked where the platform has it (glibc); see LiveBytesTracked().
+  int64_t live_bytes = 0;
+  int64_t peak_live_bytes = 0;
+};
+
+// Enable or disable counting the allocations. It's disabled by default.
+void SetAllocationCountingEnabled(bool enable);
+bool AllocationCountingEnabled();
+
+// Return whether the live bytes are tracked on this platform.
+bool LiveBytesTracked();
+
+// Return the allocations counted so far on all threads. Take the difference
+// of two calls to count the allocations of the code in between.
+AllocationStats GetAllocationStats();
+
+// Reset the peak live bytes to the current live bytes, so that the next
+// GetAllocationStats() returns the peak since this call.
+void ResetPeakLiveBytes();
+
+}  // namespace perf_benchmark
+
+}  // namespace transcoding
+}  // namespace grpc
+}  // namespace google
+
+#endif  // PERF_BENCHMARK_ALLOCATION_COUNTER_H_
@@ -0,0 +1,93 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+#include "perf_benchmark/allocation_counter.h"
+#include <new>
+#include "gtest/gtest.h"
+
+namespace google {
+namespace grpc {
+namespace transcoding {
+
+namespace perf_benchmark {
+namespace {
+// Allocates through operator new without the compiler eliding the allocation.
+void* volatile allocation;
+
+class AllocationCounterTest : public ::testing::Test {
+ protected:
+  void TearDown() override { SetAllocationCountingEnabled(false); }
+};
+
+TEST_F(AllocationCounterTest, DisabledByDefault) {
+  EXPECT_FALSE(AllocationCountingEnabled());
+  const AllocationStats before = GetAllocationStats();
+  allocation = ::operator new(100);
+  ::operator delete(allocation);
+  const AllocationStats after = GetAllocationStats();
+  EXPECT_EQ(after.allocations, before.allocations);
+  EXPECT_EQ(after.allocated_bytes, before.allocated_bytes);
+}
+
+TEST_F(AllocationCounterTest, CountAllocations) {
+  SetAllocationCountingEnabled(true);
+  EXPECT_TRUE(AllocationCountingEnabled());
+  const AllocationStats before = GetAllocationStats();
+  allocation = ::operator new(100);
+  ::operator delete(allocation);
+  allocation = ::operator new[](28);
+  ::operator delete[](allocation);
+  allocation = ::operator new(0, std::nothrow);
+  ::operator delete(allocation, std::nothrow);
+  const AllocationStats after = GetAllocationStats();
+  EXPECT_EQ(after.allocations - before.allocations, 3);
+  EXPECT_EQ(after.allocated_bytes - before.allocated_bytes, 128);
+}
+
+TEST_F(AllocationCounterTest, PeakLiveBytes) {
+  if (!LiveBytesTracked()) {
+    GTEST_SKIP() << "The live bytes are not tracked on this platform";
+  }
+  SetAllocationCountingEnabled(true);
+  ResetPeakLiveBytes();
+  const AllocationStats before = GetAllocationStats();
+  EXPECT_EQ(before.peak_live_bytes, before.live_bytes);
+
+  void* first = ::operator new(1000);
+  void* second = ::operator new(1000);
+  ::operator delete(first);
+  ::operator delete(second);
+  void* third = ::operator new(1000);
+  const AllocationStats during = GetAllocationStats();
+  ::operator delete(third);
+  const AllocationStats after = GetAllocationStats();
+
+  // The usable sizes are at least the requested ones.
+  EXPECT_GE(during.live_bytes - before.live_bytes, 1000);
+  EXPECT_GE(during.peak_live_bytes - before.live_bytes, 2000);
+  EXPECT_EQ(after.live_bytes, before.live_bytes);
+  EXPECT_EQ(after.peak_live_bytes, during.peak_live_bytes);
+
+  ResetPeakLiveBytes();
+  EXPECT_EQ(GetAllocationStats().peak_live_bytes, after.live_bytes);
+}
+
+}  // namespace
+}  // namespace perf_benchmark
+
+}  // namespace transcoding
+}  // namespace grpc
+}  // namespace google
@@ -0,0 +1,344 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+#include "perf_benchmark/benchmark_comparator.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <random>
+#include <utility>
+
+#include "absl/container/flat_hash_set.h"
+#include "absl/random/random.h"
+#include "absl/strings/match.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_format.h"
+#include "nlohmann/json.hpp"
+
+namespace google {
+namespace grpc {
+namespace transcoding {
+
+namespace perf_benchmark {
+namespace {
+// The fields of a benchmark run in the JSON output that aren't metrics. The
+// other numeric fields are the custom counters.
+const absl::flat_hash_set<std::string>& NonMetricFields() {
+  static const auto* const kFields = new absl::flat_hash_set<std::string>{
+      "name",           "family_index",   "per_family_instance_index",
+      "run_name",       "run_type",       "repetitions",
+      "repetition_index", "threads",      "iterations",
+      "real_time",      "cpu_time",       "time_unit",
+      "aggregate_name", "aggregate_unit", "label",
+      "error_occurred", "error_message"};
+  return *kFields;
+}
+
+// Return the number of nanoseconds in time_unit, or 0 if it's unknown.
+double NanosecondsPerUnit(absl::string_view time_unit) {
+  if (time_unit == "ns") {
+    return 1;
+  }
+  if (time_unit == "us") {
+    return 1e3;
+  }
+  if (time_unit == "ms") {
+    return 1e6;
+  }
+  if (time_unit == "s") {
+    return 1e9;
+  }
+  return 0;
+}
+
+// Return the given quantile, between 0 and 1, of the sorted vector v.
+double SortedQuantile(const std::vector<double>& v, double q) {
+  const double position = q * (v.size() - 1);
+  const size_t lower = static_cast<size_t>(std::floor(position));
+  const size_t upper = std::min(lower + 1, v.size() - 1);
+  return v[lower] + (v[upper] - v[lower]) * (position - lower);
+}
+
+// Return the relative change from baseline to contender.
+double RelativeChange(double baseline, double contender) {
+  if (baseline == 0) {
+    if (contender == 0) {
+      return 0;
+    }
+    return std::copysign(std::numeric_limits<double>::infinity(), contender);
+  }
+  return (contender - baseline) / std::abs(baseline);
+}
+
+// Return the median of a resample with replacement of v.
+double ResampleMedian(const std::vector<double>& v, std::mt19937_64& gen,
+                      std::vector<double>* resample) {
+  resample->resize(v.size());
+  for (double& x : *resample) {
+    x = v[absl::Uniform<size_t>(gen, 0, v.size())];
+  }
+  return Median(*resample);
+}
+
+// Sets the confidence interval of comparison->change, by bootstrapping the
+// difference of the medians of baseline and contender. The interval is left
+// as is if the change isn't relative to a non-zero baseline median.
+void SetChangeInterval(const std::vector<double>& baseline,
+                       const std::vector<double>& contender,
+                       const ComparisonOptions& options,
+                       MetricComparison* comparison) {
+  if (comparison->baseline_median == 0 || options.bootstrap_resamples <= 0) {
+    return;
+  }
+  std::mt19937_64 gen(options.seed);
+  std::vector<double> resample;
+  std::vector<double> changes;
+  changes.reserve(options.bootstrap_resamples);
+  for (int i = 0; i < options.bootstrap_resamples; ++i) {
+    const double difference = ResampleMedian(contender, gen, &resample) -
+                              ResampleMedian(baseline, gen, &resample);
+    changes.push_back(difference / std::abs(comparison->baseline_median));
+  }
+  std::sort(changes.begin(), changes.end());
+  const double tail = (1 - options.confidence) / 2;
+  comparison->change_lower = SortedQuantile(changes, tail);
+  comparison->change_upper = SortedQuantile(changes, 1 - tail);
+}
+
+MetricComparison CompareMetric(const std::string& benchmark,
+                               const std::string& metric,
+                               const std::vector<double>& baseline,
+                               const std::vector<double>& contender,
+                               const ComparisonOptions& options) {
+  MetricComparison comparison;
+  comparison.benchmark = benchmark;
+  comparison.metric = metric;
+  comparison.baseline_samples = baseline.size();
+  comparison.contender_samples = contender.size();
+  comparison.baseline_median = Median(baseline);
+  comparison.contender_median = Median(contender);
+  comparison.change =
+      RelativeChange(comparison.baseline_median, comparison.contender_median);
+  comparison.change_lower = comparison.change;
+  comparison.change_upper = comparison.change;
+
+  comparison.tested = baseline.size() >= options.min_samples &&
+                      contender.size() >= options.min_samples;
+  if (!comparison.tested) {
+    return comparison;
+  }
+  SetChangeInterval(baseline, contender, options, &comparison);
+  comparison.p_value = MannWhitneyPValue(baseline, contender);
+  comparison.significant = comparison.p_value <= options.alpha;
+  const double worse_change =
+      HigherIsBetter(metric) ? -comparison.change : comparison.change;
+  comparison.regression = comparison.significant &&
+                          worse_change >= options.regression_threshold;
+  return comparison;
+}
+
+// Return the verdict of a comparison for the report.
+const char* Verdict(const MetricComparison& comparison) {
+  if (!comparison.tested) {
+    return "too few samples";
+  }
+  if (!comparison.significant) {
+    return "";
+  }
+  if (comparison.regression) {
+    return "REGRESSION";
+  }
+  const bool better = HigherIsBetter(comparison.metric)
+                          ? comparison.change > 0
+                          : comparison.change < 0;
+  return better ? "improvement" : "worse";
+}
+
+}  // namespace
+
+absl::StatusOr<BenchmarkSamples> ParseBenchmarkJson(absl::string_view json) {
+  const nlohmann::json output =
+      nlohmann::json::parse(json.begin(), json.end(), nullptr,
+                            /*allow_exceptions=*/false);
+  if (output.is_discarded() || !output.is_object()) {
+    return absl::InvalidArgumentError("The benchmark output is not JSON");
+  }
+  const auto benchmarks = output.find("benchmarks");
+  if (benchmarks == output.end() || !benchmarks->is_array()) {
+    return absl::InvalidArgumentError(
+        "The benchmark output has no \"benchmarks\" array");
+  }
+
+  BenchmarkSamples samples;
+  for (const nlohmann::json& run : *benchmarks) {
+    if (!run.is_object() || run.value("run_type", "iteration") != "iteration" ||
+        run.value("error_occurred", false)) {
+      continue;
+    }
+    const std::string name = run.value("run_name", run.value("name", ""));
+    if (name.empty()) {
+      return absl::InvalidArgumentError(
+          "A benchmark run of the benchmark output has no name");
+    }
+    const std::string time_unit = run.value("time_unit", "ns");
+    const double unit = NanosecondsPerUnit(time_unit);
+    if (unit == 0) {
+      return absl::InvalidArgumentError(absl::StrCat(
+          "Unknown time unit \"", time_unit, "\" of benchmark ", name));
+    }
+
+    auto& metrics = samples[name];
+    for (const char* time : {"real_time", "cpu_time"}) {
+      const auto value = run.find(time);
+      if (value != run.end() && value->is_number()) {
+        metrics[time].push_back(value->get<double>() * unit);
+      }
+    }
+    for (const auto& field : run.items()) {
+      if (field.value().is_number() &&
+          !NonMetricFields().contains(field.key())) {
+        metrics[field.key()].push_back(field.value().get<double>());
+      }
+    }
+  }
+  return samples;
+}
+
+bool HigherIsBetter(absl::string_view metric) {
+  return absl::EndsWith(metric, "_throughput") || metric == "ipc";
+}
+
+double Median(std::vector<double> v) {
+  std::sort(v.begin(), v.end());
+  return SortedQuantile(v, 0.5);
+}
+
+double MannWhitneyPValue(const std::vector<double>& a,
+                         const std::vector<double>& b) {
+  // Rank the samples of both together, giving tied samples the average of
+  // their ranks.
+  std::vector<std::pair<double, bool>> all;
+  all.reserve(a.size() + b.size());
+  for (double x : a) {
+    all.emplace_back(x, true);
+  }
+  for (double x : b) {
+    all.emplace_back(x, false);
+  }
+  std::sort(all.begin(), all.end(),
+            [](const std::pair<double, bool>& lhs,
+               const std::pair<double, bool>& rhs) {
+              return lhs.first < rhs.first;
+            });
+
+  const double n1 = a.size();
+  const double n2 = b.size();
+  const double n = n1 + n2;
+  double rank_sum_a = 0;
+  // The sum of t^3 - t over the groups of t tied samples.
+  double ties = 0;
+  for (size_t i = 0; i < all.size();) {
+    size_t j = i;
+    while (j < all.size() && all[j].first == all[i].first) {
+      ++j;
+    }
+    // The samples i to j - 1 have ranks i + 1 to j.
+    const double rank = (i + 1 + j) / 2.0;
+    for (size_t k = i; k < j; ++k) {
+      if (all[k].second) {
+        rank_sum_a += rank;
+      }
+    }
+    const double t = j - i;
+    ties += t * t * t - t;
+    i = j;
+  }
+
+  const double u = rank_sum_a - n1 * (n1 + 1) / 2;
+  const double mean = n1 * n2 / 2;
+  const double variance =
+      n1 * n2 / 12 * ((n + 1) - ties / (n * (n - 1)));
+  if (variance <= 0) {
+    // All the samples are equal.
+    return 1;
+  }
+  const double z =
+      std::max(0.0, std::abs(u - mean) - 0.5) / std::sqrt(variance);
+  return std::erfc(z / std::sqrt(2.0));
+}
+
+std::vector<MetricComparison> CompareBenchmarks(
+    const BenchmarkSamples& baseline, const BenchmarkSamples& contender,
+    const ComparisonOptions& options) {
+  std::vector<MetricComparison> comparisons;
+  for (const auto& benchmark : baseline) {
+    const auto contender_benchmark = contender.find(benchmark.first);
+    if (contender_benchmark == contender.end()) {
+      continue;
+    }
+    for (const auto& metric : benchmark.second) {
+      const auto contender_metric =
+          contender_benchmark->second.find(metric.first);
+      if (contender_metric == contender_benchmark->second.end() ||
+          metric.second.empty() || contender_metric->second.empty()) {
+        continue;
+      }
+      comparisons.push_back(CompareMetric(benchmark.first, metric.first,
+                                          metric.second,
+                                          contender_metric->second, options));
+    }
+  }
+  return comparisons;
+}
+
+std::string FormatComparisons(const std::vector<MetricComparison>& comparisons,
+                              const ComparisonOptions& options, bool all) {
+  std::string table = absl::StrFormat(
+      "%-48s %-28s %11s %11s %9s %19s %8s\n", "Benchmark", "Metric",
+      "Baseline", "Contender", "Change",
+      absl::StrFormat("%g%% CI", options.confidence * 100), "p-value");
+  for (const MetricComparison& comparison : comparisons) {
+    if (!all && !comparison.significant) {
+      continue;
+    }
+    std::string interval = "-";
+    std::string p_value = "-";
+    if (comparison.tested) {
+      interval = absl::StrFormat("[%+.1f%%, %+.1f%%]",
+                                 comparison.change_lower * 100,
+                                 comparison.change_upper * 100);
+      p_value = absl::StrFormat("%.4f", comparison.p_value);
+    }
+    absl::StrAppendFormat(
+        &table, "%-48s %-28s %11.4g %11.4g %+8.1f%% %19s %8s",
+        comparison.benchmark, comparison.metric, comparison.baseline_median,
+        comparison.contender_median, comparison.change * 100, interval,
+        p_value);
+    const absl::string_view verdict = Verdict(comparison);
+    if (!verdict.empty()) {
+      absl::StrAppend(&table, " ", verdict);
+    }
+    absl::StrAppend(&table, "\n");
+  }
+  return table;
+}
+
+}  // namespace perf_benchmark
+
+}  // namespace transcoding
+}  // namespace grpc
+}  // namespace google
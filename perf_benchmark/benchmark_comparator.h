@@ -0,0 +1,120 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+#ifndef PERF_BENCHMARK_BENCHMARK_COMPARATOR_H_
+#define PERF_BENCHMARK_BENCHMARK_COMPARATOR_H_
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+
+namespace google {
+namespace grpc {
+namespace transcoding {
+
+namespace perf_benchmark {
+
+// The samples of the metrics of each benchmark, by benchmark name and then by
+// metric name, e.g. samples["BM_GrpcToJsonByteArray/1"]["cpu_time"]. Each
+// repetition of a benchmark adds one sample to each of its metrics.
+using BenchmarkSamples =
+    std::map<std::string, std::map<std::string, std::vector<double>>>;
+
+// Parses the output of a benchmark binary run with --benchmark_format=json.
+// The metrics are the real and CPU times, in nanoseconds, and the custom
+// counters, e.g. "message_latency" or "allocations". Only the runs of the
+// repetitions are kept; the aggregates (mean, percentiles, ...) and the
+// benchmarks that failed are left out.
+absl::StatusOr<BenchmarkSamples> ParseBenchmarkJson(absl::string_view json);
+
+// Return whether a larger value of the metric is better, e.g. for the
+// throughputs, rather than a smaller one, e.g. for the times, latencies and
+// allocations.
+bool HigherIsBetter(absl::string_view metric);
+
+// Return the median of v, which must not be empty.
+double Median(std::vector<double> v);
+
+// Return the two-sided p-value of the Mann-Whitney U test of whether the
+// samples of a and b come from the same distribution, using the normal
+// approximation with tie and continuity corrections. a and b must not be
+// empty.
+double MannWhitneyPValue(const std::vector<double>& a,
+                         const std::vector<double>& b);
+
+struct ComparisonOptions {
+  // The largest p-value for a change to be significant.
+  double alpha = 0.05;
+  // The smallest relative change of the median, in the worse direction, for a
+  // significant change to be a regression, e.g. 0.05 for 5%.
+  double regression_threshold = 0.05;
+  // The confidence level of the confidence intervals of the changes.
+  double confidence = 0.95;
+  // The number of bootstrap resamples of the confidence intervals, and the
+  // seed of their random generator, so that reports are reproducible.
+  int bootstrap_resamples = 2000;
+  uint64_t seed = 1;
+  // The fewest samples on each side for a change to be tested; a benchmark
+  // run without --benchmark_repetitions only has one.
+  size_t min_samples = 5;
+};
+
+// The comparison of one metric of one benchmark between two runs.
+struct MetricComparison {
+  std::string benchmark;
+  std::string metric;
+  size_t baseline_samples = 0;
+  size_t contender_samples = 0;
+  double baseline_median = 0;
+  double contender_median = 0;
+  // The relative change of the median, e.g. 0.1 for 10% more, and its
+  // bootstrap confidence interval. The change is infinite if the baseline
+  // median is 0 but the contender one isn't.
+  double change = 0;
+  double change_lower = 0;
+  double change_upper = 0;
+  // Whether both runs have enough samples for the change to be tested. If
+  // not, the confidence interval is just the change and the p-value is 1.
+  bool tested = false;
+  // The p-value of the Mann-Whitney U test.
+  double p_value = 1;
+  bool significant = false;
+  // Significant changes in the worse direction past the regression threshold.
+  bool regression = false;
+};
+
+// Compares the metrics of the benchmarks in both baseline and contender.
+// The comparisons are sorted by benchmark and metric.
+std::vector<MetricComparison> CompareBenchmarks(
+    const BenchmarkSamples& baseline, const BenchmarkSamples& contender,
+    const ComparisonOptions& options);
+
+// Return a table of the comparisons, one per line. Unless all is true, only
+// the significant changes are listed.
+std::string FormatComparisons(const std::vector<MetricComparison>& comparisons,
+                              const ComparisonOptions& options, bool all);
+
+}  // namespace perf_benchmark
+
+}  // namespace transcoding
+}  // namespace grpc
+}  // namespace google
+
+#endif  // PERF_BENCHMARK_BENCHMARK_COMPARATOR_H_
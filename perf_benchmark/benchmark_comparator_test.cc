@@ -0,0 +1,190 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+#include "perf_benchmark/benchmark_comparator.h"
+#include <cmath>
+#include "gtest/gtest.h"
+
+namespace google {
+namespace grpc {
+namespace transcoding {
+
+namespace perf_benchmark {
+namespace {
+// Return n samples around value, spread by +/- 1%.
+std::vector<double> Samples(double value, int n) {
+  std::vector<double> samples;
+  for (int i = 0; i < n; ++i) {
+    samples.push_back(value * (0.99 + 0.02 * i / (n - 1)));
+  }
+  return samples;
+}
+
+TEST(BenchmarkComparatorTest, ParseBenchmarkJson) {
+  absl::StatusOr<BenchmarkSamples> samples = ParseBenchmarkJson(R"({
+    "context": {"count_allocations": "true"},
+    "benchmarks": [
+      {"name": "BM_A/1", "run_name": "BM_A/1", "run_type": "iteration",
+       "repetitions": 2, "repetition_index": 0, "threads": 1,
+       "iterations": 1000, "real_time": 2.0, "cpu_time": 1.5,
+       "time_unit": "us", "message_latency": 1.5e-6, "label": "a label"},
+      {"name": "BM_A/1", "run_name": "BM_A/1", "run_type": "iteration",
+       "repetitions": 2, "repetition_index": 1, "threads": 1,
+       "iterations": 1000, "real_time": 3.0, "cpu_time": 2.5,
+       "time_unit": "us", "message_latency": 2.5e-6},
+      {"name": "BM_A/1_p50", "run_name": "BM_A/1", "run_type": "aggregate",
+       "aggregate_name": "p50", "real_time": 2.5, "cpu_time": 2.0,
+       "time_unit": "us"},
+      {"name": "BM_B", "run_name": "BM_B", "run_type": "iteration",
+       "error_occurred": true, "error_message": "failed"}
+    ]
+  })");
+  ASSERT_TRUE(samples.ok()) << samples.status();
+  ASSERT_EQ(samples->size(), 1);
+  const auto& metrics = samples->at("BM_A/1");
+  EXPECT_EQ(metrics.size(), 3);
+  EXPECT_EQ(metrics.at("real_time"), std::vector<double>({2000, 3000}));
+  EXPECT_EQ(metrics.at("cpu_time"), std::vector<double>({1500, 2500}));
+  EXPECT_EQ(metrics.at("message_latency"),
+            std::vector<double>({1.5e-6, 2.5e-6}));
+}
+
+TEST(BenchmarkComparatorTest, ParseInvalidBenchmarkJson) {
+  EXPECT_EQ(ParseBenchmarkJson("{").status().code(),
+            absl::StatusCode::kInvalidArgument);
+  EXPECT_EQ(ParseBenchmarkJson(R"({"context": {}})").status().code(),
+            absl::StatusCode::kInvalidArgument);
+  EXPECT_EQ(ParseBenchmarkJson(R"({"benchmarks": [
+                {"name": "BM_A", "cpu_time": 1, "time_unit": "days"}]})")
+                .status()
+                .code(),
+            absl::StatusCode::kInvalidArgument);
+}
+
+TEST(BenchmarkComparatorTest, HigherIsBetter) {
+  EXPECT_TRUE(HigherIsBetter("message_throughput"));
+  EXPECT_TRUE(HigherIsBetter("ipc"));
+  EXPECT_FALSE(HigherIsBetter("cpu_time"));
+  EXPECT_FALSE(HigherIsBetter("message_latency"));
+  EXPECT_FALSE(HigherIsBetter("allocations"));
+}
+
+TEST(BenchmarkComparatorTest, Median) {
+  EXPECT_EQ(Median({3, 1, 2}), 2);
+  EXPECT_EQ(Median({4, 1, 3, 2}), 2.5);
+  EXPECT_EQ(Median({7}), 7);
+}
+
+TEST(BenchmarkComparatorTest, MannWhitneyPValue) {
+  // U = 0, z = (12.5 - 0.5) / sqrt(25 * 11 / 12).
+  EXPECT_NEAR(MannWhitneyPValue({1, 2, 3, 4, 5}, {6, 7, 8, 9, 10}), 0.01219,
+              1e-4);
+  EXPECT_NEAR(MannWhitneyPValue({6, 7, 8, 9, 10}, {1, 2, 3, 4, 5}), 0.01219,
+              1e-4);
+  EXPECT_EQ(MannWhitneyPValue({1, 1, 1}, {1, 1}), 1);
+  EXPECT_GT(MannWhitneyPValue({1, 3, 5, 7, 9}, {2, 4, 6, 8, 10}), 0.5);
+}
+
+TEST(BenchmarkComparatorTest, CompareBenchmarks) {
+  BenchmarkSamples baseline;
+  baseline["BM_A"]["cpu_time"] = Samples(100, 20);
+  baseline["BM_A"]["message_throughput"] = Samples(1000, 20);
+  baseline["BM_A"]["allocations"] = Samples(10, 20);
+  baseline["BM_B"]["cpu_time"] = Samples(100, 20);
+  baseline["BM_OnlyBaseline"]["cpu_time"] = Samples(100, 20);
+  BenchmarkSamples contender;
+  contender["BM_A"]["cpu_time"] = Samples(120, 20);
+  contender["BM_A"]["message_throughput"] = Samples(1200, 20);
+  contender["BM_A"]["allocations"] = Samples(10, 20);
+  contender["BM_B"]["cpu_time"] = Samples(102, 20);
+
+  ComparisonOptions options;
+  const std::vector<MetricComparison> comparisons =
+      CompareBenchmarks(baseline, contender, options);
+  ASSERT_EQ(comparisons.size(), 4);
+
+  const MetricComparison& allocations = comparisons[0];
+  EXPECT_EQ(allocations.benchmark, "BM_A");
+  EXPECT_EQ(allocations.metric, "allocations");
+  EXPECT_TRUE(allocations.tested);
+  EXPECT_FALSE(allocations.significant);
+  EXPECT_FALSE(allocations.regression);
+
+  const MetricComparison& cpu_time = comparisons[1];
+  EXPECT_EQ(cpu_time.metric, "cpu_time");
+  EXPECT_NEAR(cpu_time.change, 0.2, 1e-9);
+  EXPECT_LE(cpu_time.change_lower, cpu_time.change);
+  EXPECT_GE(cpu_time.change_upper, cpu_time.change);
+  EXPECT_GT(cpu_time.change_lower, 0.15);
+  EXPECT_LT(cpu_time.change_upper, 0.25);
+  EXPECT_LT(cpu_time.p_value, 0.001);
+  EXPECT_TRUE(cpu_time.significant);
+  EXPECT_TRUE(cpu_time.regression);
+
+  // A higher throughput is an improvement.
+  const MetricComparison& throughput = comparisons[2];
+  EXPECT_EQ(throughput.metric, "message_throughput");
+  EXPECT_TRUE(throughput.significant);
+  EXPECT_FALSE(throughput.regression);
+
+  // A significant change under the threshold is not a regression.
+  const MetricComparison& small_change = comparisons[3];
+  EXPECT_EQ(small_change.benchmark, "BM_B");
+  EXPECT_TRUE(small_change.significant);
+  EXPECT_FALSE(small_change.regression);
+
+  const std::string table = FormatComparisons(comparisons, options, false);
+  EXPECT_NE(table.find("REGRESSION"), std::string::npos);
+  EXPECT_NE(table.find("improvement"), std::string::npos);
+  EXPECT_EQ(table.find("allocations"), std::string::npos);
+  EXPECT_NE(FormatComparisons(comparisons, options, true).find("allocations"),
+            std::string::npos);
+}
+
+TEST(BenchmarkComparatorTest, CompareTooFewSamples) {
+  BenchmarkSamples baseline;
+  baseline["BM_A"]["cpu_time"] = {100};
+  BenchmarkSamples contender;
+  contender["BM_A"]["cpu_time"] = {200};
+
+  const std::vector<MetricComparison> comparisons =
+      CompareBenchmarks(baseline, contender, ComparisonOptions());
+  ASSERT_EQ(comparisons.size(), 1);
+  EXPECT_FALSE(comparisons[0].tested);
+  EXPECT_EQ(comparisons[0].change, 1);
+  EXPECT_EQ(comparisons[0].p_value, 1);
+  EXPECT_FALSE(comparisons[0].regression);
+}
+
+TEST(BenchmarkComparatorTest, CompareFromZero) {
+  BenchmarkSamples baseline;
+  baseline["BM_A"]["allocations"] = std::vector<double>(10, 0);
+  BenchmarkSamples contender;
+  contender["BM_A"]["allocations"] = Samples(2, 10);
+
+  const std::vector<MetricComparison> comparisons =
+      CompareBenchmarks(baseline, contender, ComparisonOptions());
+  ASSERT_EQ(comparisons.size(), 1);
+  EXPECT_TRUE(std::isinf(comparisons[0].change));
+  EXPECT_TRUE(comparisons[0].regression);
+}
+
+}  // namespace
+}  // namespace perf_benchmark
+
+}  // namespace transcoding
+}  // namespace grpc
+}  // namespace google
@@ -14,7 +14,10 @@
 //
 ////////////////////////////////////////////////////////////////////////////////
 //
+#include <algorithm>
+
 #include "benchmark/benchmark.h"
+#include "absl/container/flat_hash_set.h"
 #include "absl/memory/memory.h"
 #include "absl/status/statusor.h"
 #include "absl/strings/escaping.h"
@@ -22,15 +25,27 @@
 #include "absl/strings/string_view.h"
 #include "absl/log/absl_check.h"
 #include "google/api/service.pb.h"
+#include "google/protobuf/descriptor.h"
 #include "google/protobuf/text_format.h"
+#include "google/protobuf/util/type_resolver_util.h"
+#include "grpc_transcoding/http_template.h"
 #include "grpc_transcoding/json_request_translator.h"
+#include "grpc_transcoding/json_tokenizer.h"
+#include "grpc_transcoding/path_matcher.h"
+#include "grpc_transcoding/percent_encoding.h"
 #include "grpc_transcoding/request_message_translator.h"
 #include "grpc_transcoding/response_to_json_translator.h"
+#include "grpc_transcoding/transcoder.h"
+#include "grpc_transcoding/transcoding_plan.h"
 #include "grpc_transcoding/type_helper.h"
 
 #include "absl/random/random.h"
+#include "perf_benchmark/allocation_counter.h"
 #include "perf_benchmark/benchmark.pb.h"
 #include "perf_benchmark/benchmark_input_stream.h"
+#include "perf_benchmark/benchmark_transcoder.h"
+#include "perf_benchmark/echo_backend.h"
+#include "perf_benchmark/hardware_counters.h"
 #include "perf_benchmark/utils.h"
 
 namespace google {
@@ -56,6 +71,8 @@ constexpr absl::string_view kStringArrayPayloadMessageType =
     "StringArrayPayload";
 constexpr absl::string_view kMultiStringFieldPayloadMessageType =
     "MultiStringFieldPayload";
+constexpr absl::string_view kLazyNestedPayloadMessageType =
+    "google.grpc.transcoding.perf_benchmark.NestedPayload";
 
 // Used for NestedPayload and StructPayload.
 // It has to be 31 because gRPC to JSON transcoding has a limit of 32 layers.
@@ -75,6 +92,17 @@ constexpr uint64_t kSegmentedStringStreamingNumChunksPerMsg = 1 << 8;  // 256
 // Used for MultiStringFieldPayload
 constexpr uint64_t kNumFieldsInMultiStringFieldPayload = 8;
 constexpr absl::string_view kMultiStringFieldPrefix = "f";
+// Used for the path matcher benchmarks with query parameters
+constexpr uint64_t kNumRoutesForQueryParams = 1000;
+constexpr absl::string_view kQueryParamFieldPrefix = "book.author.f";
+constexpr absl::string_view kQueryParamValue = "Neal%20Stephenson";
+// Used for the transcoding pipeline benchmarks. The echo route is registered
+// among kNumRoutesForPipeline generated routes.
+constexpr uint64_t kNumRoutesForPipeline = 1000;
+constexpr absl::string_view kEchoRouteTemplate = "/v1/echo/{f1}:echo";
+constexpr absl::string_view kEchoRequestPath = "/v1/echo/hello:echo";
+constexpr absl::string_view kEchoRequestQueryParams = "f2=Neal%20Stephenson";
+constexpr uint64_t kPipelinePayloadLengthForStreaming = 1 << 10;  // 1 KiB
 
 // Global type helper containing the type information of the benchmark_service
 // service config object.
@@ -96,6 +124,16 @@ constexpr absl::string_view kMultiStringFieldPrefix = "f";
   }();
   return *kTypeHelper;
 }
+
+// Global type helper that lazily resolves the benchmark types from the
+// generated descriptor pool on first use instead of indexing them upfront.
+// The type names are fully qualified, e.g. kLazyNestedPayloadMessageType.
+[[nodiscard]] const TypeHelper& GetLazyBenchmarkTypeHelper() {
+  static const auto* const kTypeHelper = new TypeHelper(
+      google::protobuf::util::NewTypeResolverForDescriptorPool(
+          "type.googleapis.com", pb::DescriptorPool::generated_pool()));
+  return *kTypeHelper;
+}
 }  // namespace
 
 // Helper function to check status. It will call state.SkipWithError if the
@@ -128,6 +166,101 @@ void AddBenchmarkCounters(::benchmark::State& state, uint64_t num_message,
       Counter(message_processed, Counter::kIsRate | Counter::kInvert);
 }
 
+// Whether the benchmarks record the hardware counters, see
+// --hardware_counters.
+bool hardware_counters_enabled = false;
+
+// Helper class that records what the iterations of a benchmark cost besides
+// time: the allocations, if they are counted (see --count_allocations), and the
+// hardware counters, if they are enabled (see --hardware_counters) and
+// available. Construct it right before the benchmark loop and call
+// AddCounters() right after it. Benchmarks running on several threads are not
+// recorded, as the allocations of all the threads are counted together and the
+// hardware counters only count the thread that opened them.
+class IterationRecorder {
+ public:
+  explicit IterationRecorder(const ::benchmark::State& state)
+      : record_allocations_(AllocationCountingEnabled() &&
+                            state.threads() == 1) {
+    if (hardware_counters_enabled && state.threads() == 1) {
+      hardware_counters_ = absl::make_unique<HardwareCounters>();
+    }
+    if (record_allocations_) {
+      ResetPeakLiveBytes();
+      allocation_start_ = GetAllocationStats();
+    }
+    if (hardware_counters_ != nullptr) {
+      hardware_start_ = hardware_counters_->Read();
+    }
+  }
+
+  // Adds the recorded costs to the custom benchmark counters:
+  // - The allocations and the allocated bytes per iteration, and the peak live
+  //   bytes. The peak live bytes are the most memory held at once during the
+  //   iterations, on top of what was held before them; it's the peak of a
+  //   single iteration unless the iterations keep memory around.
+  // - Each available hardware counter per message and, if total_bytes isn't 0,
+  //   per byte, and the instructions per cycle, e.g. "cycles_per_message" and
+  //   "ipc". num_message and total_bytes are the messages and bytes processed
+  //   per iteration, as passed to AddBenchmarkCounters(); an iteration counts
+  //   as one message by default.
+  void AddCounters(::benchmark::State& state, uint64_t num_message = 1,
+                   uint64_t total_bytes = 0) const {
+    if (hardware_counters_ != nullptr) {
+      AddHardwareCounters(state, num_message, total_bytes);
+    }
+    if (!record_allocations_) {
+      return;
+    }
+    const AllocationStats end = GetAllocationStats();
+    state.counters["allocations"] = Counter(
+        static_cast<double>(end.allocations - allocation_start_.allocations),
+        Counter::kAvgIterations);
+    state.counters["allocated_bytes"] =
+        Counter(static_cast<double>(end.allocated_bytes -
+                                    allocation_start_.allocated_bytes),
+                Counter::kAvgIterations, Counter::kIs1024);
+    if (LiveBytesTracked()) {
+      state.counters["peak_live_bytes"] = Counter(
+          static_cast<double>(end.peak_live_bytes -
+                              allocation_start_.live_bytes),
+          Counter::kDefaults, Counter::kIs1024);
+    }
+  }
+
+ private:
+  void AddHardwareCounters(::benchmark::State& state, uint64_t num_message,
+                           uint64_t total_bytes) const {
+    const HardwareCounters::Values end = hardware_counters_->Read();
+    HardwareCounters::Values delta;
+    for (int event = 0; event < HardwareCounters::kNumEvents; ++event) {
+      delta[event] = end[event] - hardware_start_[event];
+      const auto e = static_cast<HardwareCounters::Event>(event);
+      if (!hardware_counters_->Available(e)) {
+        continue;
+      }
+      const std::string name = HardwareCounters::EventName(e);
+      state.counters[name + "_per_message"] =
+          Counter(delta[event] / num_message, Counter::kAvgIterations);
+      if (total_bytes != 0) {
+        state.counters[name + "_per_byte"] =
+            Counter(delta[event] / total_bytes, Counter::kAvgIterations);
+      }
+    }
+    if (hardware_counters_->Available(HardwareCounters::kInstructions) &&
+        hardware_counters_->Available(HardwareCounters::kCycles) &&
+        delta[HardwareCounters::kCycles] > 0) {
+      state.counters["ipc"] = delta[HardwareCounters::kInstructions] /
+                              delta[HardwareCounters::kCycles];
+    }
+  }
+
+  const bool record_allocations_;
+  AllocationStats allocation_start_;
+  std::unique_ptr<HardwareCounters> hardware_counters_;
+  HardwareCounters::Values hardware_start_;
+};
+
 // Helper function to run Json Translation benchmark.
 //
 // state - ::benchmark::State& variable used for collecting metrics.
@@ -140,12 +273,12 @@ void AddBenchmarkCounters(::benchmark::State& state, uint64_t num_message,
 // request_info - RequestInfo object specifies the URI mapping and bindings.
 //                body_field_path and message_type field of the object will be
 //                filled in from this method.
-absl::Status BenchmarkJsonTranslation(::benchmark::State& state,
-                                      absl::string_view msg_type,
-                                      absl::string_view json_msg,
-                                      bool streaming, uint64_t stream_size,
-                                      uint64_t num_checks,
-                                      RequestInfo request_info = {}) {
+// tokenizer - JsonTokenizer implementation that parses the JSON input.
+absl::Status BenchmarkJsonTranslation(
+    ::benchmark::State& state, absl::string_view msg_type,
+    absl::string_view json_msg, bool streaming, uint64_t stream_size,
+    uint64_t num_checks, RequestInfo request_info = {},
+    JsonTokenizer::Kind tokenizer = JsonTokenizer::kProtobuf) {
   // Retrieve global type helper
   const TypeHelper& type_helper = GetBenchmarkTypeHelper();
 
@@ -174,9 +307,11 @@ absl::Status BenchmarkJsonTranslation(::benchmark::State& state,
 
   // Benchmark the transcoding process
   std::string message;
+  IterationRecorder recorder(state);
   for (auto s : state) {
     JsonRequestTranslator translator(type_helper.Resolver(), is.get(),
-                                     request_info, streaming, false);
+                                     request_info, streaming, false,
+                                     tokenizer);
     MessageStream& out = translator.Output();
 
     if (!out.Status().ok()) {
@@ -189,6 +324,7 @@ absl::Status BenchmarkJsonTranslation(::benchmark::State& state,
   }
 
   // Add custom benchmark counters.
+  recorder.AddCounters(state, streaming ? stream_size : 1, is->TotalBytes());
   AddBenchmarkCounters(state, streaming ? stream_size : 1, is->TotalBytes());
 
   return absl::OkStatus();
@@ -234,6 +370,7 @@ absl::Status BenchmarkGrpcTranslation(::benchmark::State& state,
   std::string message;
   const JsonResponseTranslateOptions options{pb::util::JsonPrintOptions(),
                                              true};
+  IterationRecorder recorder(state);
   for (auto s : state) {
     ResponseToJsonTranslator translator(
         GetBenchmarkTypeHelper().Resolver(),
@@ -251,6 +388,7 @@ absl::Status BenchmarkGrpcTranslation(::benchmark::State& state,
   }
 
   // Add custom benchmark counters.
+  recorder.AddCounters(state, streaming ? stream_size : 1, is.TotalBytes());
   AddBenchmarkCounters(state, streaming ? stream_size : 1, is.TotalBytes());
 
   return absl::OkStatus();
@@ -297,13 +435,16 @@ static void BM_SinglePayloadFromGrpcStreaming(::benchmark::State& state) {
 }
 
 // Helper function for benchmarking int32 array payload translation from JSON.
-void Int32ArrayPayloadFromJson(::benchmark::State& state, uint64_t array_length,
-                               bool streaming, uint64_t stream_size) {
+void Int32ArrayPayloadFromJson(
+    ::benchmark::State& state, uint64_t array_length, bool streaming,
+    uint64_t stream_size,
+    JsonTokenizer::Kind tokenizer = JsonTokenizer::kProtobuf) {
   std::string json_msg = absl::StrFormat(
       R"({"payload" : %s})", GetRandomInt32ArrayString(array_length));
 
-  auto status = BenchmarkJsonTranslation(state, kInt32ArrayPayloadMessageType,
-                                         json_msg, streaming, stream_size, 1);
+  auto status =
+      BenchmarkJsonTranslation(state, kInt32ArrayPayloadMessageType, json_msg,
+                               streaming, stream_size, 1, {}, tokenizer);
   SkipWithErrorIfNotOk(state, status);
 }
 
@@ -327,6 +468,12 @@ static void BM_Int32ArrayPayloadFromJsonNonStreaming(
   Int32ArrayPayloadFromJson(state, state.range(0), false, 0);
 }
 
+static void BM_Int32ArrayPayloadFromJsonNonStreamingVectorized(
+    ::benchmark::State& state) {
+  Int32ArrayPayloadFromJson(state, state.range(0), false, 0,
+                            JsonTokenizer::kVectorized);
+}
+
 static void BM_Int32ArrayPayloadFromJsonStreaming(::benchmark::State& state) {
   Int32ArrayPayloadFromJson(state, kInt32ArrayPayloadLengthForStreaming, true,
                             state.range(0));
@@ -408,15 +555,16 @@ static void BM_StringArrayTypePayloadFromGrpcNonStreaming(
 }
 
 // Helper function for benchmarking translation from nested JSON values.
-void NestedPayloadFromJson(::benchmark::State& state, uint64_t layers,
-                           bool streaming, uint64_t stream_size,
-                           absl::string_view msg_type) {
+void NestedPayloadFromJson(
+    ::benchmark::State& state, uint64_t layers, bool streaming,
+    uint64_t stream_size, absl::string_view msg_type,
+    JsonTokenizer::Kind tokenizer = JsonTokenizer::kProtobuf) {
   const std::string json_msg = GetNestedJsonString(
       layers, kNestedFieldName, std::string(kInnerMostNestedFieldName),
       kInnerMostNestedFieldValue);
 
   auto status = BenchmarkJsonTranslation(state, msg_type, json_msg, streaming,
-                                         stream_size, 1);
+                                         stream_size, 1, {}, tokenizer);
   SkipWithErrorIfNotOk(state, status);
 }
 
@@ -451,6 +599,12 @@ static void BM_NestedProtoPayloadFromJsonNonStreaming(
                         kNestedPayloadMessageType);
 }
 
+static void BM_NestedProtoPayloadFromJsonNonStreamingVectorized(
+    ::benchmark::State& state) {
+  NestedPayloadFromJson(state, state.range(0), false, 0,
+                        kNestedPayloadMessageType, JsonTokenizer::kVectorized);
+}
+
 static void BM_NestedProtoPayloadFromJsonStreaming(::benchmark::State& state) {
   NestedPayloadFromJson(state, kNumNestedLayersForStreaming, true,
                         state.range(0), kNestedPayloadMessageType);
@@ -490,9 +644,10 @@ static void BM_StructProtoPayloadFromGrpcStreaming(::benchmark::State& state) {
 }
 
 // Helper function for benchmarking translation from segmented JSON input
-void SegmentedStringPayloadFromJson(::benchmark::State& state,
-                                    uint64_t payload_length, bool streaming,
-                                    uint64_t stream_size, uint64_t num_checks) {
+void SegmentedStringPayloadFromJson(
+    ::benchmark::State& state, uint64_t payload_length, bool streaming,
+    uint64_t stream_size, uint64_t num_checks,
+    JsonTokenizer::Kind tokenizer = JsonTokenizer::kProtobuf) {
   // We are using GetRandomAlphanumericString instead of GetRandomBytesString
   // because JSON format reserves characters such as `"` and `\`.
   // We could generate `"` and `\` and escape them, but for simplicity, we are
@@ -503,7 +658,8 @@ void SegmentedStringPayloadFromJson(::benchmark::State& state,
 
   auto status =
       BenchmarkJsonTranslation(state, kStringPayloadMessageType, json_msg,
-                               streaming, stream_size, num_checks);
+                               streaming, stream_size, num_checks, {},
+                               tokenizer);
   SkipWithErrorIfNotOk(state, status);
 }
 
@@ -513,6 +669,12 @@ static void BM_SegmentedStringPayloadFromJsonNonStreaming(
                                  state.range(0));
 }
 
+static void BM_SegmentedStringPayloadFromJsonNonStreamingVectorized(
+    ::benchmark::State& state) {
+  SegmentedStringPayloadFromJson(state, kSegmentedStringPayloadLength, false, 0,
+                                 state.range(0), JsonTokenizer::kVectorized);
+}
+
 static void BM_SegmentedStringPayloadFromJsonStreaming(
     ::benchmark::State& state) {
   // due to streaming, num_chunks_per_msg will be multiplied with the
@@ -617,6 +779,410 @@ static void BM_NumVariableBindingsPayloadFromJsonNonStreaming(
   NumVariableBindingsPayloadFromJson(state, state.range(0), false, 0);
 }
 
+// Helper function for benchmarking concurrent type lookups, which every
+// request performs while resolving its field paths and bindings. Each thread
+// repeatedly resolves the field path of the innermost payload in a
+// NestedPayload with kNumNestedLayersForStreaming layers.
+void TypeInfoLookupFromThreads(::benchmark::State& state,
+                               const TypeHelper& type_helper,
+                               absl::string_view msg_type) {
+  std::string field_path_str;
+  for (uint64_t i = 0; i < kNumNestedLayersForStreaming; ++i) {
+    absl::StrAppend(&field_path_str, kNestedFieldName, ".");
+  }
+  absl::StrAppend(&field_path_str, kInnerMostNestedFieldName);
+
+  const pb::Type* type = type_helper.Info()->GetTypeByTypeUrl(
+      absl::StrCat("type.googleapis.com/", msg_type));
+  if (type == nullptr) {
+    state.SkipWithError("Cannot resolve the benchmark message type");
+    return;
+  }
+
+  std::vector<const pb::Field*> field_path;
+  IterationRecorder recorder(state);
+  for (auto s : state) {
+    absl::Status status =
+        type_helper.ResolveFieldPath(*type, field_path_str, &field_path);
+    if (!status.ok()) {
+      state.SkipWithError(status.ToString().c_str());
+      return;
+    }
+    ::benchmark::DoNotOptimize(field_path);
+  }
+  // Each iteration looks up one field per layer.
+  state.counters["lookup_throughput"] =
+      Counter(static_cast<double>(state.iterations() *
+                                  (kNumNestedLayersForStreaming + 1)),
+              Counter::kIsRate);
+  recorder.AddCounters(state);
+}
+
+static void BM_TypeInfoLookupFromThreads(::benchmark::State& state) {
+  TypeInfoLookupFromThreads(state, GetBenchmarkTypeHelper(),
+                            kNestedPayloadMessageType);
+}
+
+static void BM_LazyTypeInfoLookupFromThreads(::benchmark::State& state) {
+  TypeInfoLookupFromThreads(state, GetLazyBenchmarkTypeHelper(),
+                            kLazyNestedPayloadMessageType);
+}
+
+// Helper function for benchmarking the unescaping of a URL path binding or
+// query parameter value of `length` characters with an escaped character every
+// `escape_interval` characters, or none if escape_interval is 0.
+void UrlUnescape(::benchmark::State& state, uint64_t length,
+                 uint64_t escape_interval) {
+  std::string part = GetRandomAlphanumericString(length);
+  if (escape_interval > 0) {
+    for (uint64_t i = 0; i + 3 <= part.size(); i += escape_interval) {
+      part.replace(i, 3, "%2F");
+    }
+  }
+
+  std::string buffer;
+  IterationRecorder recorder(state);
+  for (auto s : state) {
+    absl::string_view unescaped = UrlUnescapeString(
+        part, UrlUnescapeSpec::kAllCharacters, false, &buffer);
+    ::benchmark::DoNotOptimize(unescaped);
+  }
+  recorder.AddCounters(state, 1, part.size());
+  AddBenchmarkCounters(state, 1, part.size());
+}
+
+static void BM_UrlUnescapeNoEscapes(::benchmark::State& state) {
+  UrlUnescape(state, state.range(0), 0);
+}
+
+static void BM_UrlUnescapeSparseEscapes(::benchmark::State& state) {
+  UrlUnescape(state, state.range(0), 64);
+}
+
+static void BM_UrlUnescapeDenseEscapes(::benchmark::State& state) {
+  UrlUnescape(state, state.range(0), 4);
+}
+
+// Helper function that registers the routes to a PathMatcherBuilder. The
+// methods of the routes are pointers to them.
+absl::Status RegisterRoutes(
+    const std::vector<BenchmarkRoute>& routes,
+    PathMatcherBuilder<const BenchmarkRoute*>* builder) {
+  for (const auto& route : routes) {
+    if (!builder->Register(route.http_method, route.http_template, "",
+                           &route)) {
+      return absl::InvalidArgumentError(
+          absl::StrCat("Could not register ", route.http_template));
+    }
+  }
+  return absl::OkStatus();
+}
+
+// Helper function for benchmarking HTTP template parsing of a route table.
+void HttpTemplateParse(::benchmark::State& state, uint64_t num_routes) {
+  const std::vector<BenchmarkRoute> routes = GenerateRouteTable(num_routes);
+  IterationRecorder recorder(state);
+  for (auto s : state) {
+    for (const auto& route : routes) {
+      std::unique_ptr<HttpTemplate> ht =
+          HttpTemplate::Parse(route.http_template);
+      ::benchmark::DoNotOptimize(ht);
+    }
+  }
+  state.counters["route_throughput"] = Counter(
+      static_cast<double>(state.iterations() * num_routes), Counter::kIsRate);
+  recorder.AddCounters(state);
+}
+
+// Helper function for benchmarking building a PathMatcher from a route table,
+// which includes parsing the templates. Also reports the heap bytes the built
+// PathMatcher takes per route, if the platform tells them.
+void PathMatcherBuild(::benchmark::State& state, uint64_t num_routes) {
+  const std::vector<BenchmarkRoute> routes = GenerateRouteTable(num_routes);
+  IterationRecorder recorder(state);
+  for (auto s : state) {
+    PathMatcherBuilder<const BenchmarkRoute*> builder;
+    absl::Status status = RegisterRoutes(routes, &builder);
+    if (!status.ok()) {
+      state.SkipWithError(status.ToString().c_str());
+      return;
+    }
+    PathMatcherPtr<const BenchmarkRoute*> matcher = builder.Build();
+    // Only the build is measured, not the destruction.
+    state.PauseTiming();
+    matcher.reset();
+    state.ResumeTiming();
+  }
+  state.counters["route_throughput"] = Counter(
+      static_cast<double>(state.iterations() * num_routes), Counter::kIsRate);
+  recorder.AddCounters(state);
+
+  int64_t heap_bytes_before = GetHeapBytesInUse();
+  PathMatcherPtr<const BenchmarkRoute*> matcher;
+  {
+    PathMatcherBuilder<const BenchmarkRoute*> builder;
+    RegisterRoutes(routes, &builder).IgnoreError();
+    matcher = builder.Build();
+  }
+  int64_t heap_bytes_after = GetHeapBytesInUse();
+  if (heap_bytes_before >= 0 && heap_bytes_after >= 0) {
+    state.counters["bytes_per_route"] =
+        static_cast<double>(heap_bytes_after - heap_bytes_before) / num_routes;
+  }
+}
+
+// Helper function for benchmarking lookups in a PathMatcher of a route table.
+// Each iteration looks up the path of the next route, in a random order so
+// that consecutive lookups don't walk the same trie nodes.
+// hit - Whether to look up paths that the routes match, or paths that none of
+//       them matches.
+// lookup_cache - Whether to cache the lookup results of all the routes, see
+//                PathMatcherBuilder::SetLookupCache().
+// query_params - Query parameters of each lookup, bound to variables.
+void PathMatcherLookup(::benchmark::State& state, uint64_t num_routes,
+                       bool hit, bool lookup_cache,
+                       absl::string_view query_params = "") {
+  const std::vector<BenchmarkRoute> routes = GenerateRouteTable(num_routes);
+  PathMatcherBuilder<const BenchmarkRoute*> builder;
+  absl::Status status = RegisterRoutes(routes, &builder);
+  if (!status.ok()) {
+    state.SkipWithError(status.ToString().c_str());
+    return;
+  }
+  if (lookup_cache) {
+    builder.SetLookupCache(num_routes);
+  }
+  PathMatcherPtr<const BenchmarkRoute*> matcher = builder.Build();
+
+  std::vector<const BenchmarkRoute*> order;
+  order.reserve(routes.size());
+  for (const auto& route : routes) {
+    order.push_back(&route);
+  }
+  std::shuffle(order.begin(), order.end(), absl::BitGen());
+
+  std::vector<VariableBinding> bindings;
+  std::string body_field_path;
+  size_t next = 0;
+  IterationRecorder recorder(state);
+  for (auto s : state) {
+    const BenchmarkRoute& route = *order[next];
+    next = next + 1 == order.size() ? 0 : next + 1;
+    bindings.clear();
+    const BenchmarkRoute* method = matcher->Lookup(
+        route.http_method, hit ? route.hit_path : route.miss_path,
+        query_params, &bindings, &body_field_path);
+    if (method != (hit ? &route : nullptr)) {
+      state.SkipWithError("Unexpected lookup result");
+      return;
+    }
+  }
+  state.counters["lookup_throughput"] =
+      Counter(static_cast<double>(state.iterations()), Counter::kIsRate);
+  state.counters["lookup_latency"] =
+      Counter(static_cast<double>(state.iterations()),
+              Counter::kIsRate | Counter::kInvert);
+  recorder.AddCounters(state);
+}
+
+// Helper function for benchmarking the variable bindings of the query
+// parameters of a request, with and without the lookup of its path.
+void QueryParamBindings(::benchmark::State& state, uint64_t num_params,
+                        bool lookup) {
+  const std::string query_params =
+      GenerateQueryParams(num_params, kQueryParamFieldPrefix, kQueryParamValue);
+  if (lookup) {
+    PathMatcherLookup(state, kNumRoutesForQueryParams, true, false,
+                      query_params);
+  } else {
+    const absl::flat_hash_set<std::string> system_params;
+    std::vector<VariableBinding> bindings;
+    IterationRecorder recorder(state);
+    for (auto s : state) {
+      bindings.clear();
+      ExtractBindingsFromQueryParameters(query_params, system_params, false,
+                                         &bindings);
+      ::benchmark::DoNotOptimize(bindings);
+    }
+    recorder.AddCounters(state, 1, query_params.size());
+  }
+  AddBenchmarkCounters(state, 1, query_params.size());
+}
+
+static void BM_HttpTemplateParse(::benchmark::State& state) {
+  HttpTemplateParse(state, state.range(0));
+}
+
+static void BM_PathMatcherBuild(::benchmark::State& state) {
+  PathMatcherBuild(state, state.range(0));
+}
+
+static void BM_PathMatcherLookupHit(::benchmark::State& state) {
+  PathMatcherLookup(state, state.range(0), true, false);
+}
+
+static void BM_PathMatcherLookupMiss(::benchmark::State& state) {
+  PathMatcherLookup(state, state.range(0), false, false);
+}
+
+static void BM_PathMatcherLookupHitCached(::benchmark::State& state) {
+  PathMatcherLookup(state, state.range(0), true, true);
+}
+
+static void BM_PathMatcherLookupQueryParams(::benchmark::State& state) {
+  QueryParamBindings(state, state.range(0), true);
+}
+
+static void BM_ExtractBindingsFromQueryParameters(::benchmark::State& state) {
+  QueryParamBindings(state, state.range(0), false);
+}
+
+// The shape of the methods of the transcoding pipeline benchmarks.
+enum class PipelineShape { kUnary, kClientStreaming, kServerStreaming };
+
+// Helper function that sends the translated request of transcoder to the
+// backend, copying it the way a gateway copies it into its transport buffers.
+// Adds the number of bytes copied to *bytes_copied.
+absl::Status SendRequest(Transcoder* transcoder, EchoBackend* backend,
+                         uint64_t* bytes_copied) {
+  const void* data = nullptr;
+  int size = 0;
+  while (transcoder->RequestOutput()->Next(&data, &size)) {
+    if (size == 0) {
+      // The whole request body is available, so the request translation can't
+      // wait for more of it.
+      return absl::InternalError("The request translation stalled.");
+    }
+    absl::Status status = backend->Receive(data, size);
+    if (!status.ok()) {
+      return status;
+    }
+    *bytes_copied += size;
+  }
+  if (!transcoder->RequestStatus().ok()) {
+    return transcoder->RequestStatus();
+  }
+  return backend->HalfClose();
+}
+
+// Helper function that reads the translated response of transcoder into
+// *response, copying it the way a gateway copies it into its transport
+// buffers. Adds the number of bytes copied to *bytes_copied.
+absl::Status ReceiveResponse(Transcoder* transcoder, std::string* response,
+                             uint64_t* bytes_copied) {
+  const void* data = nullptr;
+  int size = 0;
+  while (transcoder->ResponseOutput()->Next(&data, &size)) {
+    if (size == 0) {
+      // The backend has sent the whole response, so the response translation
+      // can't wait for more of it.
+      return absl::InternalError("The response translation stalled.");
+    }
+    response->append(static_cast<const char*>(data), size);
+    *bytes_copied += size;
+  }
+  return transcoder->ResponseStatus();
+}
+
+// Helper function for benchmarking requests through the whole transcoding
+// pipeline: the route lookup and the binding extraction, the JSON to gRPC
+// translation of the request, an in-process echo backend reflecting the gRPC
+// messages, and the gRPC to JSON translation of the response. Each iteration
+// is a request of an echo method of the given shape, whose path and query
+// parameters bind f1 and f2 of a MultiStringFieldPayload while the JSON body
+// sets f3 to a payload of `payload_length` characters.
+// stream_size - Number of request messages of a client-streaming method, or of
+//               response messages of a server-streaming method.
+void TranscoderPipeline(::benchmark::State& state, PipelineShape shape,
+                        uint64_t payload_length, uint64_t stream_size) {
+  const TypeHelper& type_helper = GetBenchmarkTypeHelper();
+  TranscodingPlan::Spec spec;
+  spec.request_type_url = absl::StrCat("type.googleapis.com/",
+                                       kMultiStringFieldPayloadMessageType);
+  spec.response_type_url = spec.request_type_url;
+  spec.http_template = std::string(kEchoRouteTemplate);
+  spec.body_field_path = "*";
+  absl::StatusOr<std::shared_ptr<const TranscodingPlan>> plan =
+      TranscodingPlan::Create(type_helper, spec);
+  if (!plan.ok()) {
+    state.SkipWithError(plan.status().ToString().c_str());
+    return;
+  }
+
+  // The generated routes have no plan, as only the echo route is requested.
+  PathMatcherBuilder<const TranscodingPlan*> builder;
+  for (const auto& route : GenerateRouteTable(kNumRoutesForPipeline)) {
+    builder.Register(route.http_method, route.http_template, "", nullptr);
+  }
+  if (!builder.Register("POST", spec.http_template, spec.body_field_path,
+                        plan->get())) {
+    state.SkipWithError("Could not register the echo route");
+    return;
+  }
+  PathMatcherPtr<const TranscodingPlan*> matcher = builder.Build();
+
+  const bool client_streaming = shape == PipelineShape::kClientStreaming;
+  const bool server_streaming = shape == PipelineShape::kServerStreaming;
+  const std::string json_msg = absl::StrFormat(
+      R"({"f3" : "%s"})", GetRandomAlphanumericString(payload_length));
+  BenchmarkZeroCopyInputStream body(
+      client_streaming ? GetStreamedJson(json_msg, stream_size) : json_msg, 1);
+  EchoBackend backend(client_streaming ? EchoBackend::Mode::kLastMessage
+                                       : EchoBackend::Mode::kEachMessage,
+                      server_streaming ? stream_size : 1);
+
+  std::string response;
+  uint64_t bytes_copied = 0;
+  uint64_t response_bytes = 0;
+  IterationRecorder recorder(state);
+  for (auto s : state) {
+    absl::StatusOr<std::unique_ptr<BenchmarkTranscoder>> transcoder =
+        BenchmarkTranscoder::Create(*matcher, type_helper.Resolver(), "POST",
+                                    kEchoRequestPath, kEchoRequestQueryParams,
+                                    &body, backend.Response(),
+                                    client_streaming, server_streaming);
+    absl::Status status = transcoder.status();
+    if (status.ok()) {
+      status = SendRequest(transcoder->get(), &backend, &bytes_copied);
+    }
+    if (status.ok()) {
+      status = ReceiveResponse(transcoder->get(), &response, &bytes_copied);
+    }
+    if (!status.ok()) {
+      state.SkipWithError(status.ToString().c_str());
+      return;
+    }
+    response_bytes = response.size();
+    // The buffers keep their capacity for the next request, low overhead.
+    response.clear();
+    backend.Reset();
+    body.Reset();
+  }
+
+  // Add custom benchmark counters. The bytes are the JSON of the request and
+  // of the response.
+  recorder.AddCounters(state, stream_size,
+                       body.TotalBytes() + response_bytes);
+  AddBenchmarkCounters(state, stream_size, body.TotalBytes() + response_bytes);
+  state.counters["bytes_copied_per_request"] =
+      Counter(static_cast<double>(bytes_copied), Counter::kAvgIterations,
+              Counter::kIs1024);
+}
+
+static void BM_TranscoderPipelineUnary(::benchmark::State& state) {
+  TranscoderPipeline(state, PipelineShape::kUnary, state.range(0), 1);
+}
+
+static void BM_TranscoderPipelineClientStreaming(::benchmark::State& state) {
+  TranscoderPipeline(state, PipelineShape::kClientStreaming,
+                     kPipelinePayloadLengthForStreaming, state.range(0));
+}
+
+static void BM_TranscoderPipelineServerStreaming(::benchmark::State& state) {
+  TranscoderPipeline(state, PipelineShape::kServerStreaming,
+                     kPipelinePayloadLengthForStreaming, state.range(0));
+}
+
 //
 // Independent benchmark variable: JSON body length.
 //
@@ -641,6 +1207,11 @@ BENCHMARK_WITH_PERCENTILE(BM_Int32ArrayPayloadFromJsonNonStreaming)
     ->Arg(1 << 8)    // 256 vals
     ->Arg(1 << 10)   // 1024 vals
     ->Arg(1 << 14);  // 16384 vals
+BENCHMARK_WITH_PERCENTILE(BM_Int32ArrayPayloadFromJsonNonStreamingVectorized)
+    ->Arg(1)         // 1 val
+    ->Arg(1 << 8)    // 256 vals
+    ->Arg(1 << 10)   // 1024 vals
+    ->Arg(1 << 14);  // 16384 vals
 BENCHMARK_WITH_PERCENTILE(BM_Int32ArrayPayloadFromGrpcNonStreaming)
     ->Arg(1)         // 1 val
     ->Arg(1 << 8)    // 256 vals
@@ -673,6 +1244,11 @@ BENCHMARK_WITH_PERCENTILE(BM_NestedProtoPayloadFromJsonNonStreaming)
                 // More than 32 layers would fail the parsing for struct proto.
                 // To be consistent for all nested cases, we set to 31.
     ->Arg(31);  // nested with 31 layers
+BENCHMARK_WITH_PERCENTILE(BM_NestedProtoPayloadFromJsonNonStreamingVectorized)
+    ->Arg(0)    // flat JSON
+    ->Arg(1)    // nested with 1 layer
+    ->Arg(8)    // nested with 8 layers
+    ->Arg(31);  // nested with 31 layers
 BENCHMARK_WITH_PERCENTILE(BM_NestedProtoPayloadFromGrpcNonStreaming)
     ->Arg(0)    // flat JSON
     ->Arg(1)    // nested with 1 layer
@@ -710,6 +1286,12 @@ BENCHMARK_WITH_PERCENTILE(BM_SegmentedStringPayloadFromJsonNonStreaming)
     ->Arg(1 << 4)    // 16 chunks per message
     ->Arg(1 << 8)    // 256 chunks per message
     ->Arg(1 << 12);  // 4096 chunks per message
+BENCHMARK_WITH_PERCENTILE(
+    BM_SegmentedStringPayloadFromJsonNonStreamingVectorized)
+    ->Arg(1)         // 1 chunk per message
+    ->Arg(1 << 4)    // 16 chunks per message
+    ->Arg(1 << 8)    // 256 chunks per message
+    ->Arg(1 << 12);  // 4096 chunks per message
 BENCHMARK_STREAMING_WITH_PERCENTILE(BM_SegmentedStringPayloadFromJsonStreaming);
 
 //
@@ -736,11 +1318,125 @@ BENCHMARK_WITH_PERCENTILE(BM_NumVariableBindingsPayloadFromJsonNonStreaming)
     ->Arg(4)   // 4 bound variables
     ->Arg(8);  // 8 bound variables
 
-// Benchmark Main function
-BENCHMARK_MAIN();
+//
+// Independent benchmark variable: URL parameter length.
+// This only applies to JSON -> gRPC since the URL is only parsed for requests.
+//
+BENCHMARK_WITH_PERCENTILE(BM_UrlUnescapeNoEscapes)
+    ->Arg(16)        // 16 chars
+    ->Arg(1 << 8)    // 256 chars
+    ->Arg(1 << 12);  // 4096 chars
+BENCHMARK_WITH_PERCENTILE(BM_UrlUnescapeSparseEscapes)
+    ->Arg(16)        // 16 chars
+    ->Arg(1 << 8)    // 256 chars
+    ->Arg(1 << 12);  // 4096 chars
+BENCHMARK_WITH_PERCENTILE(BM_UrlUnescapeDenseEscapes)
+    ->Arg(16)        // 16 chars
+    ->Arg(1 << 8)    // 256 chars
+    ->Arg(1 << 12);  // 4096 chars
+
+//
+// Independent benchmark variable: Number of threads.
+// Type lookups are shared between all the requests, so they should scale with
+// the number of threads instead of serializing them.
+//
+BENCHMARK_WITH_PERCENTILE(BM_TypeInfoLookupFromThreads)
+    ->ThreadRange(1, 64)
+    ->UseRealTime();
+BENCHMARK_WITH_PERCENTILE(BM_LazyTypeInfoLookupFromThreads)
+    ->ThreadRange(1, 64)
+    ->UseRealTime();
+
+//
+// Independent benchmark variable: Number of routes.
+// The route tables are shaped like the HTTP rules of googleapis, see
+// GenerateRouteTable().
+//
+BENCHMARK_ROUTE_TABLE_WITH_PERCENTILE(BM_HttpTemplateParse)
+    ->Unit(kMillisecond);
+BENCHMARK_ROUTE_TABLE_WITH_PERCENTILE(BM_PathMatcherBuild)
+    ->Unit(kMillisecond);
+BENCHMARK_ROUTE_TABLE_WITH_PERCENTILE(BM_PathMatcherLookupHit);
+BENCHMARK_ROUTE_TABLE_WITH_PERCENTILE(BM_PathMatcherLookupMiss);
+BENCHMARK_ROUTE_TABLE_WITH_PERCENTILE(BM_PathMatcherLookupHitCached);
+
+//
+// Independent benchmark variable: Number of query parameters.
+// The lookups are in a table of kNumRoutesForQueryParams routes.
+//
+BENCHMARK_WITH_PERCENTILE(BM_PathMatcherLookupQueryParams)
+    ->Arg(0)    // no query parameters
+    ->Arg(4)    // 4 query parameters
+    ->Arg(16);  // 16 query parameters
+BENCHMARK_WITH_PERCENTILE(BM_ExtractBindingsFromQueryParameters)
+    ->Arg(0)    // no query parameters
+    ->Arg(4)    // 4 query parameters
+    ->Arg(16);  // 16 query parameters
+
+//
+// Independent benchmark variable: Method shape of the transcoding pipeline.
+// Each request goes through the route lookup, the request translation, an
+// in-process echo backend and the response translation, see
+// TranscoderPipeline().
+//
+BENCHMARK_WITH_PERCENTILE(BM_TranscoderPipelineUnary)
+    ->Arg(1)         // 1 byte
+    ->Arg(1 << 10)   // 1 KiB
+    ->Arg(1 << 20);  // 1 MiB
+BENCHMARK_STREAMING_WITH_PERCENTILE(BM_TranscoderPipelineClientStreaming);
+BENCHMARK_STREAMING_WITH_PERCENTILE(BM_TranscoderPipelineServerStreaming);
+
+// Removes the boolean flag --<name>, which Google Benchmark would reject, from
+// the command line. Returns whether it's set.
+bool TakeBoolFlag(absl::string_view name, int* argc, char** argv) {
+  const std::string flag = absl::StrCat("--", name);
+  bool value = false;
+  int num_args = 1;
+  for (int i = 1; i < *argc; ++i) {
+    absl::string_view arg = argv[i];
+    if (arg == flag || arg == absl::StrCat(flag, "=true")) {
+      value = true;
+    } else if (arg == absl::StrCat(flag, "=false")) {
+      value = false;
+    } else {
+      argv[num_args++] = argv[i];
+    }
+  }
+  *argc = num_args;
+  return value;
+}
 
 }  // namespace perf_benchmark
 
 }  // namespace transcoding
 }  // namespace grpc
 }  // namespace google
+
+// Benchmark Main function. Besides the Google Benchmark flags, it takes
+// --count_allocations to record the allocations of the benchmarks, and
+// --hardware_counters to record their hardware counters, see
+// IterationRecorder.
+int main(int argc, char** argv) {
+  namespace perf_benchmark = ::google::grpc::transcoding::perf_benchmark;
+  if (argc > 0 &&
+      perf_benchmark::TakeBoolFlag("count_allocations", &argc, argv)) {
+    perf_benchmark::SetAllocationCountingEnabled(true);
+    ::benchmark::AddCustomContext("count_allocations", "true");
+  }
+  if (argc > 0 &&
+      perf_benchmark::TakeBoolFlag("hardware_counters", &argc, argv)) {
+    // The counters not available here are left out of the results, so record
+    // which ones are.
+    const std::string available_counters =
+        perf_benchmark::HardwareCounters().AvailableEventNames();
+    perf_benchmark::hardware_counters_enabled = true;
+    ::benchmark::AddCustomContext("hardware_counters", available_counters);
+  }
+  ::benchmark::Initialize(&argc, argv);
+  if (::benchmark::ReportUnrecognizedArguments(argc, argv)) {
+    return 1;
+  }
+  ::benchmark::RunSpecifiedBenchmarks();
+  ::benchmark::Shutdown();
+  return 0;
+}
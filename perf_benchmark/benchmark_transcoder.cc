@@ -0,0 +1,78 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+#include "perf_benchmark/benchmark_transcoder.h"
+
+#include <string>
+#include <utility>
+
+#include "absl/memory/memory.h"
+#include "absl/strings/str_cat.h"
+
+namespace google {
+namespace grpc {
+namespace transcoding {
+
+namespace perf_benchmark {
+BenchmarkTranscoder::BenchmarkTranscoder(
+    const TranscodingPlan& plan,
+    ::google::protobuf::util::TypeResolver* type_resolver,
+    std::vector<RequestWeaver::BindingInfo> variable_bindings,
+    ::google::protobuf::io::ZeroCopyInputStream* request_body,
+    TranscoderInputStream* response_grpc, bool client_streaming,
+    bool server_streaming,
+    const JsonResponseTranslateOptions& response_options)
+    : request_translator_(plan, request_body, std::move(variable_bindings),
+                          client_streaming, /*output_delimiters=*/true),
+      request_output_(request_translator_.Output().CreateInputStream()),
+      response_translator_(type_resolver, plan.response_type_url(),
+                           server_streaming, response_grpc, response_options),
+      response_output_(response_translator_.CreateInputStream()) {}
+
+absl::StatusOr<std::unique_ptr<BenchmarkTranscoder>>
+BenchmarkTranscoder::Create(
+    const PathMatcher<const TranscodingPlan*>& matcher,
+    ::google::protobuf::util::TypeResolver* type_resolver,
+    absl::string_view http_method, absl::string_view path,
+    absl::string_view query_params,
+    ::google::protobuf::io::ZeroCopyInputStream* request_body,
+    TranscoderInputStream* response_grpc, bool client_streaming,
+    bool server_streaming) {
+  std::vector<VariableBinding> bindings;
+  std::string body_field_path;
+  const TranscodingPlan* plan = matcher.Lookup(http_method, path, query_params,
+                                               &bindings, &body_field_path);
+  if (plan == nullptr) {
+    return absl::NotFoundError(
+        absl::StrCat("No route matches ", http_method, " ", path));
+  }
+
+  std::vector<RequestWeaver::BindingInfo> variable_bindings;
+  absl::Status status =
+      plan->ResolveBindings(std::move(bindings), &variable_bindings);
+  if (!status.ok()) {
+    return status;
+  }
+  return absl::make_unique<BenchmarkTranscoder>(
+      *plan, type_resolver, std::move(variable_bindings), request_body,
+      response_grpc, client_streaming, server_streaming);
+}
+
+}  // namespace perf_benchmark
+
+}  // namespace transcoding
+}  // namespace grpc
+}  // namespace google
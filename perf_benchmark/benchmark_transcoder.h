@@ -0,0 +1,119 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+#ifndef PERF_BENCHMARK_BENCHMARK_TRANSCODER_H_
+#define PERF_BENCHMARK_BENCHMARK_TRANSCODER_H_
+
+#include <memory>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "google/protobuf/io/zero_copy_stream.h"
+#include "google/protobuf/util/type_resolver.h"
+#include "grpc_transcoding/json_request_translator.h"
+#include "grpc_transcoding/path_matcher.h"
+#include "grpc_transcoding/request_weaver.h"
+#include "grpc_transcoding/response_to_json_translator.h"
+#include "grpc_transcoding/transcoder.h"
+#include "grpc_transcoding/transcoder_input_stream.h"
+#include "grpc_transcoding/transcoding_plan.h"
+
+namespace google {
+namespace grpc {
+namespace transcoding {
+
+namespace perf_benchmark {
+// A Transcoder for benchmarking the whole transcoding pipeline, put together
+// the way a gateway does for each request: the request is looked up in a
+// PathMatcher of the routes to their TranscodingPlans, its variable bindings
+// are resolved by the plan of the route, then the JSON request body is
+// translated to gRPC by a JsonRequestTranslator and the gRPC response back to
+// JSON by a ResponseToJsonTranslator.
+//
+// Example:
+//   auto transcoder = BenchmarkTranscoder::Create(
+//       *matcher, type_resolver, "POST", "/v1/echo/hello:unary", "", &body,
+//       backend.Response(), /*client_streaming=*/false,
+//       /*server_streaming=*/false);
+//   // Send (*transcoder)->RequestOutput() to the backend, then read the
+//   // response from (*transcoder)->ResponseOutput().
+class BenchmarkTranscoder : public Transcoder {
+ public:
+  // plan - the plan of the route. BenchmarkTranscoder doesn't maintain the
+  //        ownership of plan.
+  // type_resolver - resolves the response type. BenchmarkTranscoder doesn't
+  //                 maintain the ownership of type_resolver.
+  // variable_bindings - come from TranscodingPlan::ResolveBindings().
+  // request_body - the JSON request body. BenchmarkTranscoder doesn't maintain
+  //                the ownership of request_body.
+  // response_grpc - the gRPC frames of the response. BenchmarkTranscoder
+  //                 doesn't maintain the ownership of response_grpc.
+  // client_streaming, server_streaming - the streaming of the method
+  // response_options - control the JSON of the response
+  BenchmarkTranscoder(
+      const TranscodingPlan& plan,
+      ::google::protobuf::util::TypeResolver* type_resolver,
+      std::vector<RequestWeaver::BindingInfo> variable_bindings,
+      ::google::protobuf::io::ZeroCopyInputStream* request_body,
+      TranscoderInputStream* response_grpc, bool client_streaming,
+      bool server_streaming,
+      const JsonResponseTranslateOptions& response_options = {});
+
+  // Looks up the route of the request in matcher and resolves its bindings,
+  // then creates the BenchmarkTranscoder of the request. Returns kNotFound if
+  // no route matches the request.
+  static absl::StatusOr<std::unique_ptr<BenchmarkTranscoder>> Create(
+      const PathMatcher<const TranscodingPlan*>& matcher,
+      ::google::protobuf::util::TypeResolver* type_resolver,
+      absl::string_view http_method, absl::string_view path,
+      absl::string_view query_params,
+      ::google::protobuf::io::ZeroCopyInputStream* request_body,
+      TranscoderInputStream* response_grpc, bool client_streaming,
+      bool server_streaming);
+
+  // Transcoder implementation
+  TranscoderInputStream* RequestOutput() override {
+    return request_output_.get();
+  }
+  absl::Status RequestStatus() override {
+    return request_translator_.Output().Status();
+  }
+  ::google::protobuf::io::ZeroCopyInputStream* ResponseOutput() override {
+    return response_output_.get();
+  }
+  absl::Status ResponseStatus() override {
+    return response_translator_.Status();
+  }
+
+ private:
+  JsonRequestTranslator request_translator_;
+  std::unique_ptr<TranscoderInputStream> request_output_;
+  ResponseToJsonTranslator response_translator_;
+  std::unique_ptr<TranscoderInputStream> response_output_;
+
+  BenchmarkTranscoder(const BenchmarkTranscoder&) = delete;
+  BenchmarkTranscoder& operator=(const BenchmarkTranscoder&) = delete;
+};
+
+}  // namespace perf_benchmark
+
+}  // namespace transcoding
+}  // namespace grpc
+}  // namespace google
+
+#endif  // PERF_BENCHMARK_BENCHMARK_TRANSCODER_H_
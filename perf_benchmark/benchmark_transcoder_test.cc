@@ -0,0 +1,173 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+#include "perf_benchmark/benchmark_transcoder.h"
+#include "absl/log/absl_check.h"
+#include "google/api/service.pb.h"
+#include "grpc_transcoding/path_matcher.h"
+#include "grpc_transcoding/transcoding_plan.h"
+#include "grpc_transcoding/type_helper.h"
+#include "gtest/gtest.h"
+#include "perf_benchmark/benchmark_input_stream.h"
+#include "perf_benchmark/echo_backend.h"
+#include "perf_benchmark/utils.h"
+
+namespace google {
+namespace grpc {
+namespace transcoding {
+
+namespace perf_benchmark {
+namespace {
+constexpr absl::string_view kServiceConfigTextProtoFile =
+    "benchmark_service.textproto";
+
+// Global type helper containing the type information of the benchmark_service
+// service config object.
+[[nodiscard]] const TypeHelper& GetBenchmarkTypeHelper() {
+  static const auto* const kTypeHelper = [] {
+    // Construct the objects on the heap without calling their dtors to avoid
+    // destruction issue with static variables.
+    auto* service = new google::api::Service();
+    ABSL_CHECK_OK(
+        LoadService(std::string(kServiceConfigTextProtoFile), service));
+    return new TypeHelper(service->types(), service->enums());
+  }();
+  return *kTypeHelper;
+}
+
+class BenchmarkTranscoderTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    TranscodingPlan::Spec spec;
+    spec.request_type_url = "type.googleapis.com/MultiStringFieldPayload";
+    spec.response_type_url = spec.request_type_url;
+    spec.http_template = "/v1/echo/{f1}:echo";
+    spec.body_field_path = "*";
+    auto plan = TranscodingPlan::Create(GetBenchmarkTypeHelper(), spec);
+    ASSERT_TRUE(plan.ok()) << plan.status();
+    plan_ = *std::move(plan);
+
+    PathMatcherBuilder<const TranscodingPlan*> builder;
+    ASSERT_TRUE(builder.Register("POST", spec.http_template,
+                                 spec.body_field_path, plan_.get()));
+    matcher_ = builder.Build();
+  }
+
+  // Transcodes a request through backend and returns the JSON response.
+  absl::StatusOr<std::string> Transcode(absl::string_view path,
+                                        absl::string_view query_params,
+                                        absl::string_view json_body,
+                                        EchoBackend* backend,
+                                        bool client_streaming,
+                                        bool server_streaming) {
+    BenchmarkZeroCopyInputStream body(std::string(json_body), 1);
+    absl::StatusOr<std::unique_ptr<BenchmarkTranscoder>> transcoder =
+        BenchmarkTranscoder::Create(
+            *matcher_, GetBenchmarkTypeHelper().Resolver(), "POST", path,
+            query_params, &body, backend->Response(), client_streaming,
+            server_streaming);
+    if (!transcoder.ok()) {
+      return transcoder.status();
+    }
+
+    const void* data = nullptr;
+    int size = 0;
+    while ((*transcoder)->RequestOutput()->Next(&data, &size) && size > 0) {
+      absl::Status status = backend->Receive(data, size);
+      if (!status.ok()) {
+        return status;
+      }
+    }
+    if (!(*transcoder)->RequestStatus().ok()) {
+      return (*transcoder)->RequestStatus();
+    }
+    absl::Status status = backend->HalfClose();
+    if (!status.ok()) {
+      return status;
+    }
+
+    std::string response;
+    while ((*transcoder)->ResponseOutput()->Next(&data, &size) && size > 0) {
+      response.append(static_cast<const char*>(data), size);
+    }
+    if (!(*transcoder)->ResponseStatus().ok()) {
+      return (*transcoder)->ResponseStatus();
+    }
+    return response;
+  }
+
+  std::shared_ptr<const TranscodingPlan> plan_;
+  PathMatcherPtr<const TranscodingPlan*> matcher_;
+};
+
+TEST_F(BenchmarkTranscoderTest, Unary) {
+  EchoBackend backend(EchoBackend::Mode::kEachMessage, 1);
+  absl::StatusOr<std::string> response =
+      Transcode("/v1/echo/hello:echo", "f2=Neal%20Stephenson",
+                R"({"f3" : "payload"})", &backend, false, false);
+  ASSERT_TRUE(response.ok()) << response.status();
+  EXPECT_EQ(*response,
+            R"({"f1":"hello","f2":"Neal Stephenson","f3":"payload"})");
+  EXPECT_EQ(backend.messages_received(), 1);
+}
+
+TEST_F(BenchmarkTranscoderTest, ClientStreaming) {
+  EchoBackend backend(EchoBackend::Mode::kLastMessage, 1);
+  absl::StatusOr<std::string> response =
+      Transcode("/v1/echo/hello:echo", "",
+                R"([{"f3" : "first"}, {"f3" : "last"}])", &backend, true,
+                false);
+  ASSERT_TRUE(response.ok()) << response.status();
+  // Only the first request message gets the variable bindings.
+  EXPECT_EQ(*response, R"({"f3":"last"})");
+  EXPECT_EQ(backend.messages_received(), 2);
+}
+
+TEST_F(BenchmarkTranscoderTest, ServerStreaming) {
+  EchoBackend backend(EchoBackend::Mode::kEachMessage, 3);
+  absl::StatusOr<std::string> response =
+      Transcode("/v1/echo/hello:echo", "", R"({"f3" : "payload"})", &backend,
+                false, true);
+  ASSERT_TRUE(response.ok()) << response.status();
+  EXPECT_EQ(*response,
+            R"([{"f1":"hello","f3":"payload"},)"
+            R"({"f1":"hello","f3":"payload"},)"
+            R"({"f1":"hello","f3":"payload"}])");
+  EXPECT_EQ(backend.messages_received(), 1);
+}
+
+TEST_F(BenchmarkTranscoderTest, RouteNotFound) {
+  EchoBackend backend(EchoBackend::Mode::kEachMessage, 1);
+  absl::StatusOr<std::string> response = Transcode(
+      "/v1/unknown/hello:echo", "", R"({"f3" : "payload"})", &backend, false,
+      false);
+  EXPECT_EQ(response.status().code(), absl::StatusCode::kNotFound);
+}
+
+TEST_F(BenchmarkTranscoderTest, InvalidRequestBody) {
+  EchoBackend backend(EchoBackend::Mode::kEachMessage, 1);
+  absl::StatusOr<std::string> response =
+      Transcode("/v1/echo/hello:echo", "", R"({"f3" : )", &backend, false,
+                false);
+  EXPECT_FALSE(response.ok());
+}
+
+}  // namespace
+}  // namespace perf_benchmark
+
+}  // namespace transcoding
+}  // namespace grpc
+}  // namespace google
@@ -0,0 +1,153 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+// Compares two runs of a benchmark binary, e.g. benchmark_main before and after
+// a change, from their --benchmark_format=json outputs:
+//
+//   compare_benchmarks [--alpha=0.05] [--regression_threshold=0.05]
+//       [--all] baseline.json contender.json
+//
+// It prints the significant changes of the metrics of the benchmarks in both
+// runs, and exits with 1 if any of them is a regression, 2 if the outputs
+// can't be read, and 0 otherwise.
+//
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "absl/flags/usage.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "perf_benchmark/benchmark_comparator.h"
+
+ABSL_FLAG(double, alpha, 0.05,
+          "The largest p-value of the Mann-Whitney U test for a change to be "
+          "significant.");
+ABSL_FLAG(double, regression_threshold, 0.05,
+          "The smallest relative change of the median, in the worse "
+          "direction, for a significant change to be a regression.");
+ABSL_FLAG(double, confidence, 0.95,
+          "The confidence level of the confidence intervals of the changes.");
+ABSL_FLAG(int, min_samples, 5,
+          "The fewest repetitions in each run for a change to be tested.");
+ABSL_FLAG(bool, all, false,
+          "List all the compared metrics, not only the significant changes.");
+
+namespace google {
+namespace grpc {
+namespace transcoding {
+
+namespace perf_benchmark {
+namespace {
+absl::StatusOr<BenchmarkSamples> LoadBenchmarkJson(const std::string& path) {
+  std::ifstream ifs(path);
+  if (!ifs) {
+    return absl::InvalidArgumentError(absl::StrCat("Could not open ", path));
+  }
+  std::stringstream content;
+  content << ifs.rdbuf();
+  absl::StatusOr<BenchmarkSamples> samples =
+      ParseBenchmarkJson(content.str());
+  if (!samples.ok()) {
+    return absl::InvalidArgumentError(
+        absl::StrCat(path, ": ", samples.status().message()));
+  }
+  return samples;
+}
+
+// Prints the benchmarks of samples that other doesn't have, which aren't
+// compared.
+void PrintMissingBenchmarks(const BenchmarkSamples& samples,
+                            const BenchmarkSamples& other,
+                            absl::string_view description) {
+  for (const auto& benchmark : samples) {
+    if (other.find(benchmark.first) == other.end()) {
+      std::cout << "Only in " << description << ": " << benchmark.first
+                << std::endl;
+    }
+  }
+}
+
+}  // namespace
+
+int CompareBenchmarksMain(int argc, char** argv) {
+  absl::SetProgramUsageMessage(
+      "Compares two --benchmark_format=json outputs of a benchmark binary.\n"
+      "Usage: compare_benchmarks [flags] baseline.json contender.json");
+  const std::vector<char*> args = absl::ParseCommandLine(argc, argv);
+  if (args.size() != 3) {
+    std::cerr << "Usage: " << args[0] << " [flags] baseline.json "
+              << "contender.json" << std::endl;
+    return 2;
+  }
+
+  const absl::StatusOr<BenchmarkSamples> baseline = LoadBenchmarkJson(args[1]);
+  if (!baseline.ok()) {
+    std::cerr << baseline.status() << std::endl;
+    return 2;
+  }
+  const absl::StatusOr<BenchmarkSamples> contender =
+      LoadBenchmarkJson(args[2]);
+  if (!contender.ok()) {
+    std::cerr << contender.status() << std::endl;
+    return 2;
+  }
+
+  ComparisonOptions options;
+  options.alpha = absl::GetFlag(FLAGS_alpha);
+  options.regression_threshold = absl::GetFlag(FLAGS_regression_threshold);
+  options.confidence = absl::GetFlag(FLAGS_confidence);
+  options.min_samples = absl::GetFlag(FLAGS_min_samples);
+  const std::vector<MetricComparison> comparisons =
+      CompareBenchmarks(*baseline, *contender, options);
+
+  PrintMissingBenchmarks(*baseline, *contender, "the baseline");
+  PrintMissingBenchmarks(*contender, *baseline, "the contender");
+  std::cout << FormatComparisons(comparisons, options,
+                                 absl::GetFlag(FLAGS_all));
+
+  int num_regressions = 0;
+  int num_untested = 0;
+  for (const MetricComparison& comparison : comparisons) {
+    num_regressions += comparison.regression;
+    num_untested += !comparison.tested;
+  }
+  if (num_untested > 0) {
+    std::cout << num_untested << " metrics have fewer than "
+              << options.min_samples
+              << " samples and were not tested; run the benchmarks with "
+                 "--benchmark_repetitions."
+              << std::endl;
+  }
+  std::cout << num_regressions << " regressions in " << comparisons.size()
+            << " compared metrics." << std::endl;
+  return num_regressions > 0 ? 1 : 0;
+}
+
+}  // namespace perf_benchmark
+
+}  // namespace transcoding
+}  // namespace grpc
+}  // namespace google
+
+int main(int argc, char** argv) {
+  return ::google::grpc::transcoding::perf_benchmark::CompareBenchmarksMain(
+      argc, argv);
+}
@@ -0,0 +1,160 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+#include "perf_benchmark/echo_backend.h"
+
+namespace google {
+namespace grpc {
+namespace transcoding {
+
+namespace perf_benchmark {
+namespace {
+// The compressed-flag byte and the 4-byte big-endian message length.
+constexpr uint64_t kGrpcFrameHeaderSize = 5;
+
+uint64_t GetFrameMessageSize(const char* header) {
+  const auto* bytes = reinterpret_cast<const unsigned char*>(header);
+  return (static_cast<uint64_t>(bytes[1]) << 24) |
+         (static_cast<uint64_t>(bytes[2]) << 16) |
+         (static_cast<uint64_t>(bytes[3]) << 8) |
+         static_cast<uint64_t>(bytes[4]);
+}
+}  // namespace
+
+EchoBackend::EchoBackend(Mode mode, uint64_t num_echoes)
+    : mode_(mode),
+      num_echoes_(num_echoes),
+      response_stream_(this),
+      messages_received_(0),
+      half_closed_(false) {}
+
+absl::Status EchoBackend::Receive(const void* data, int size) {
+  if (half_closed_) {
+    return absl::FailedPreconditionError(
+        "Received request bytes after the half-close.");
+  }
+  absl::string_view input(static_cast<const char*>(data), size);
+  // The frames are read from the input as it is unless a frame of the last
+  // input is incomplete.
+  if (!request_.empty()) {
+    request_.append(input.data(), input.size());
+    input = request_;
+  }
+
+  uint64_t pos = 0;
+  while (input.size() - pos >= kGrpcFrameHeaderSize) {
+    if (input[pos] != 0 && input[pos] != 1) {
+      return absl::InvalidArgumentError(
+          "Invalid compressed-flag byte of a gRPC frame.");
+    }
+    const uint64_t frame_size =
+        kGrpcFrameHeaderSize + GetFrameMessageSize(input.data() + pos);
+    if (input.size() - pos < frame_size) {
+      break;
+    }
+    absl::string_view frame = input.substr(pos, frame_size);
+    if (mode_ == Mode::kEachMessage) {
+      Echo(frame);
+    } else {
+      last_frame_.assign(frame.data(), frame.size());
+    }
+    ++messages_received_;
+    pos += frame_size;
+  }
+
+  // Keep the incomplete frame for the next input.
+  if (input.data() == request_.data()) {
+    request_.erase(0, pos);
+  } else {
+    request_.assign(input.data() + pos, input.size() - pos);
+  }
+  return absl::OkStatus();
+}
+
+absl::Status EchoBackend::HalfClose() {
+  if (!request_.empty()) {
+    return absl::InvalidArgumentError(
+        "The request ends inside a gRPC frame.");
+  }
+  if (mode_ == Mode::kLastMessage) {
+    if (messages_received_ == 0) {
+      return absl::InvalidArgumentError("The request has no message to echo.");
+    }
+    Echo(last_frame_);
+  }
+  half_closed_ = true;
+  return absl::OkStatus();
+}
+
+void EchoBackend::Reset() {
+  request_.clear();
+  last_frame_.clear();
+  response_.clear();
+  response_stream_.Reset();
+  messages_received_ = 0;
+  half_closed_ = false;
+}
+
+void EchoBackend::Echo(absl::string_view frame) {
+  for (uint64_t i = 0; i < num_echoes_; ++i) {
+    response_.append(frame.data(), frame.size());
+  }
+}
+
+bool EchoBackend::ResponseStream::Next(const void** data, int* size) {
+  const std::string& response = backend_->response_;
+  if (pos_ >= response.size()) {
+    *size = 0;
+    // No data at this point; the end of the data if the response has
+    // finished.
+    return !Finished();
+  }
+  *data = response.data() + pos_;
+  *size = static_cast<int>(response.size() - pos_);
+  pos_ = response.size();
+  return true;
+}
+
+void EchoBackend::ResponseStream::BackUp(int count) {
+  if (count > 0 && static_cast<uint64_t>(count) <= pos_) {
+    pos_ -= count;
+  }
+  // Otherwise, BackUp has been called illegaly, so we ignore it.
+}
+
+bool EchoBackend::ResponseStream::Skip(int count) {
+  const uint64_t size = backend_->response_.size();
+  if (count < 0 || pos_ + count > size) {
+    pos_ = size;
+    return false;
+  }
+  pos_ += count;
+  return true;
+}
+
+int64_t EchoBackend::ResponseStream::BytesAvailable() const {
+  return backend_->response_.size() - pos_;
+}
+
+bool EchoBackend::ResponseStream::Finished() const {
+  return backend_->half_closed_ && pos_ >= backend_->response_.size();
+}
+
+}  // namespace perf_benchmark
+
+}  // namespace transcoding
+}  // namespace grpc
+}  // namespace google
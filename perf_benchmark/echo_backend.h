@@ -0,0 +1,118 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+#ifndef PERF_BENCHMARK_ECHO_BACKEND_H_
+#define PERF_BENCHMARK_ECHO_BACKEND_H_
+
+#include <cstdint>
+#include <string>
+
+#include "absl/status/status.h"
+#include "absl/strings/string_view.h"
+#include "grpc_transcoding/transcoder_input_stream.h"
+
+namespace google {
+namespace grpc {
+namespace transcoding {
+
+namespace perf_benchmark {
+// An in-process fake gRPC backend for benchmarking the whole transcoding
+// pipeline. It receives the gRPC frames of a request, as a gateway would send
+// them, and reflects them as the frames of the response without parsing the
+// messages, so that the response translates back to the JSON of the request.
+//
+// The frames are copied into buffers that keep their capacity across
+// requests, so that the backend doesn't allocate once it has served a request
+// of the same size.
+//
+// After each request, Reset() needs to be called.
+class EchoBackend {
+ public:
+  enum class Mode {
+    // Each request message is echoed num_echoes times as soon as it's
+    // received, e.g. for unary and server-streaming methods.
+    kEachMessage,
+    // The last request message is echoed num_echoes times once the request is
+    // half-closed, e.g. for client-streaming methods.
+    kLastMessage,
+  };
+
+  EchoBackend(Mode mode, uint64_t num_echoes);
+
+  // Receives the next bytes of the request. Returns an error if they don't
+  // continue the gRPC frames of the request.
+  absl::Status Receive(const void* data, int size);
+
+  // Half-closes the request. Returns an error if the request ends inside a
+  // frame, or has no message in kLastMessage mode.
+  absl::Status HalfClose();
+
+  // The gRPC frames of the response. The stream is finished once the request
+  // is half-closed and all of the response has been read. The data it returns
+  // is valid until the next call to Receive().
+  TranscoderInputStream* Response() { return &response_stream_; }
+
+  // Reset the backend for the next request.
+  void Reset();
+
+  // The number of request messages received since the last Reset().
+  uint64_t messages_received() const { return messages_received_; }
+
+ private:
+  class ResponseStream : public TranscoderInputStream {
+   public:
+    explicit ResponseStream(const EchoBackend* backend)
+        : backend_(backend), pos_(0) {}
+
+    bool Next(const void** data, int* size) override;
+    void BackUp(int count) override;
+    bool Skip(int count) override;
+    int64_t ByteCount() const override { return pos_; }
+    int64_t BytesAvailable() const override;
+    bool Finished() const override;
+
+    void Reset() { pos_ = 0; }
+
+   private:
+    const EchoBackend* backend_;
+    uint64_t pos_;
+  };
+
+  // Appends frame to the response num_echoes_ times.
+  void Echo(absl::string_view frame);
+
+  const Mode mode_;
+  const uint64_t num_echoes_;
+  // The received request bytes that aren't a complete frame yet.
+  std::string request_;
+  // The last complete request frame in kLastMessage mode.
+  std::string last_frame_;
+  std::string response_;
+  ResponseStream response_stream_;
+  uint64_t messages_received_;
+  bool half_closed_;
+
+  EchoBackend(const EchoBackend&) = delete;
+  EchoBackend& operator=(const EchoBackend&) = delete;
+};
+
+}  // namespace perf_benchmark
+
+}  // namespace transcoding
+}  // namespace grpc
+}  // namespace google
+
+#endif  // PERF_BENCHMARK_ECHO_BACKEND_H_
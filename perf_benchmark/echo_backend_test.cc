@@ -0,0 +1,167 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+#include "perf_benchmark/echo_backend.h"
+#include "gtest/gtest.h"
+#include "perf_benchmark/utils.h"
+
+namespace google {
+namespace grpc {
+namespace transcoding {
+
+namespace perf_benchmark {
+namespace {
+// Reads the response of backend until it has no more data available.
+std::string ReadResponse(EchoBackend* backend) {
+  std::string response;
+  const void* data = nullptr;
+  int size = 0;
+  while (backend->Response()->Next(&data, &size) && size > 0) {
+    response.append(static_cast<const char*>(data), size);
+  }
+  return response;
+}
+}  // namespace
+
+TEST(EchoBackendTest, EachMessage) {
+  const std::string frames = WrapGrpcMessageWithDelimiter("Hello") +
+                             WrapGrpcMessageWithDelimiter("World!");
+  EchoBackend backend(EchoBackend::Mode::kEachMessage, 1);
+
+  EXPECT_TRUE(backend.Receive(frames.data(), frames.size()).ok());
+  EXPECT_EQ(backend.messages_received(), 2);
+  // The messages are echoed as soon as they're received.
+  EXPECT_EQ(backend.Response()->BytesAvailable(), frames.size());
+  EXPECT_EQ(ReadResponse(&backend), frames);
+  EXPECT_FALSE(backend.Response()->Finished());
+
+  EXPECT_TRUE(backend.HalfClose().ok());
+  EXPECT_TRUE(backend.Response()->Finished());
+  const void* data = nullptr;
+  int size = 0;
+  EXPECT_FALSE(backend.Response()->Next(&data, &size));
+}
+
+TEST(EchoBackendTest, EachMessageMultipleEchoes) {
+  const std::string hello = WrapGrpcMessageWithDelimiter("Hello");
+  const std::string world = WrapGrpcMessageWithDelimiter("World!");
+  const std::string frames = hello + world;
+  EchoBackend backend(EchoBackend::Mode::kEachMessage, 3);
+
+  EXPECT_TRUE(backend.Receive(frames.data(), frames.size()).ok());
+  EXPECT_TRUE(backend.HalfClose().ok());
+  EXPECT_EQ(ReadResponse(&backend), hello + hello + hello + world + world +
+                                       world);
+  EXPECT_TRUE(backend.Response()->Finished());
+}
+
+TEST(EchoBackendTest, SplitFrames) {
+  const std::string frames = WrapGrpcMessageWithDelimiter("Hello") +
+                             WrapGrpcMessageWithDelimiter("") +
+                             WrapGrpcMessageWithDelimiter("World!");
+  EchoBackend backend(EchoBackend::Mode::kEachMessage, 1);
+
+  // Receive the frames one byte at a time.
+  std::string response;
+  for (char c : frames) {
+    EXPECT_TRUE(backend.Receive(&c, 1).ok());
+    response += ReadResponse(&backend);
+  }
+  EXPECT_EQ(backend.messages_received(), 3);
+  EXPECT_TRUE(backend.HalfClose().ok());
+  EXPECT_EQ(response, frames);
+  EXPECT_TRUE(backend.Response()->Finished());
+}
+
+TEST(EchoBackendTest, LastMessage) {
+  const std::string world = WrapGrpcMessageWithDelimiter("World!");
+  const std::string frames = WrapGrpcMessageWithDelimiter("Hello") + world;
+  EchoBackend backend(EchoBackend::Mode::kLastMessage, 2);
+
+  EXPECT_TRUE(backend.Receive(frames.data(), 7).ok());
+  EXPECT_TRUE(backend.Receive(frames.data() + 7, frames.size() - 7).ok());
+  EXPECT_EQ(backend.messages_received(), 2);
+  // Nothing is echoed until the request is half-closed.
+  EXPECT_EQ(backend.Response()->BytesAvailable(), 0);
+  EXPECT_FALSE(backend.Response()->Finished());
+
+  EXPECT_TRUE(backend.HalfClose().ok());
+  EXPECT_EQ(ReadResponse(&backend), world + world);
+  EXPECT_TRUE(backend.Response()->Finished());
+}
+
+TEST(EchoBackendTest, ResponseBackUpAndSkip) {
+  const std::string frame = WrapGrpcMessageWithDelimiter("Hello");
+  EchoBackend backend(EchoBackend::Mode::kEachMessage, 1);
+  EXPECT_TRUE(backend.Receive(frame.data(), frame.size()).ok());
+  EXPECT_TRUE(backend.HalfClose().ok());
+
+  const void* data = nullptr;
+  int size = 0;
+  EXPECT_TRUE(backend.Response()->Next(&data, &size));
+  EXPECT_EQ(size, frame.size());
+  backend.Response()->BackUp(5);
+  EXPECT_EQ(backend.Response()->ByteCount(), frame.size() - 5);
+  EXPECT_TRUE(backend.Response()->Skip(1));
+  EXPECT_EQ(ReadResponse(&backend), "ello");
+  EXPECT_FALSE(backend.Response()->Skip(1));
+}
+
+TEST(EchoBackendTest, Reset) {
+  const std::string hello = WrapGrpcMessageWithDelimiter("Hello");
+  const std::string world = WrapGrpcMessageWithDelimiter("World!");
+  EchoBackend backend(EchoBackend::Mode::kEachMessage, 1);
+  EXPECT_TRUE(backend.Receive(hello.data(), hello.size()).ok());
+  EXPECT_TRUE(backend.HalfClose().ok());
+  EXPECT_EQ(ReadResponse(&backend), hello);
+
+  backend.Reset();
+  EXPECT_EQ(backend.messages_received(), 0);
+  EXPECT_FALSE(backend.Response()->Finished());
+  EXPECT_TRUE(backend.Receive(world.data(), world.size()).ok());
+  EXPECT_TRUE(backend.HalfClose().ok());
+  EXPECT_EQ(ReadResponse(&backend), world);
+  EXPECT_TRUE(backend.Response()->Finished());
+}
+
+TEST(EchoBackendTest, Errors) {
+  const std::string frame = WrapGrpcMessageWithDelimiter("Hello");
+
+  EchoBackend incomplete(EchoBackend::Mode::kEachMessage, 1);
+  EXPECT_TRUE(incomplete.Receive(frame.data(), frame.size() - 1).ok());
+  EXPECT_EQ(incomplete.HalfClose().code(), absl::StatusCode::kInvalidArgument);
+
+  EchoBackend invalid_flag(EchoBackend::Mode::kEachMessage, 1);
+  std::string invalid_frame = frame;
+  invalid_frame[0] = 2;
+  EXPECT_EQ(invalid_flag.Receive(invalid_frame.data(), invalid_frame.size())
+                .code(),
+            absl::StatusCode::kInvalidArgument);
+
+  EchoBackend no_message(EchoBackend::Mode::kLastMessage, 1);
+  EXPECT_EQ(no_message.HalfClose().code(), absl::StatusCode::kInvalidArgument);
+
+  EchoBackend half_closed(EchoBackend::Mode::kEachMessage, 1);
+  EXPECT_TRUE(half_closed.HalfClose().ok());
+  EXPECT_EQ(half_closed.Receive(frame.data(), frame.size()).code(),
+            absl::StatusCode::kFailedPrecondition);
+}
+
+}  // namespace perf_benchmark
+
+}  // namespace transcoding
+}  // namespace grpc
+}  // namespace google
@@ -0,0 +1,154 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+#include "perf_benchmark/hardware_counters.h"
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <cstring>
+#endif
+
+namespace google {
+namespace grpc {
+namespace transcoding {
+
+namespace perf_benchmark {
+namespace {
+#if defined(__linux__)
+// The perf_event_attr type and config of each Event.
+struct EventConfig {
+  uint32_t type;
+  uint64_t config;
+};
+
+constexpr EventConfig kEventConfigs[HardwareCounters::kNumEvents] = {
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+    {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D |
+                             (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                             (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+    // The kernel documents the generic cache misses as usually being the last
+    // level cache misses, and has them on more CPUs than the LL cache event.
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+};
+
+// Opens the counter of config for the calling thread on any CPU, and returns
+// its file descriptor, or -1 if it's not available.
+int OpenCounter(const EventConfig& config) {
+  perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = config.type;
+  attr.config = config.config;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  attr.read_format =
+      PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+  return static_cast<int>(syscall(SYS_perf_event_open, &attr, /*pid=*/0,
+                                  /*cpu=*/-1, /*group_fd=*/-1,
+                                  PERF_FLAG_FD_CLOEXEC));
+}
+
+// Reads the counter of fd, scaled to the time it's been enabled, or returns 0
+// if it can't be read.
+double ReadCounter(int fd) {
+  // The value, time enabled and time running, as per read_format.
+  uint64_t data[3];
+  if (read(fd, data, sizeof(data)) != sizeof(data) || data[2] == 0) {
+    return 0;
+  }
+  if (data[2] == data[1]) {
+    return static_cast<double>(data[0]);
+  }
+  return static_cast<double>(data[0]) * data[1] / data[2];
+}
+#endif
+
+constexpr const char* kEventNames[HardwareCounters::kNumEvents] = {
+    "instructions", "cycles", "branch_misses", "l1d_misses", "llc_misses",
+};
+
+}  // namespace
+
+HardwareCounters::HardwareCounters() {
+  fds_.fill(-1);
+#if defined(__linux__)
+  for (int event = 0; event < kNumEvents; ++event) {
+    fds_[event] = OpenCounter(kEventConfigs[event]);
+  }
+#endif
+}
+
+HardwareCounters::~HardwareCounters() {
+#if defined(__linux__)
+  for (int fd : fds_) {
+    if (fd >= 0) {
+      close(fd);
+    }
+  }
+#endif
+}
+
+const char* HardwareCounters::EventName(Event event) {
+  return kEventNames[event];
+}
+
+bool HardwareCounters::AnyAvailable() const {
+  for (int fd : fds_) {
+    if (fd >= 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+std::string HardwareCounters::AvailableEventNames() const {
+  std::string names;
+  for (int event = 0; event < kNumEvents; ++event) {
+    if (!Available(static_cast<Event>(event))) {
+      continue;
+    }
+    if (!names.empty()) {
+      names += ",";
+    }
+    names += kEventNames[event];
+  }
+  return names.empty() ? "unavailable" : names;
+}
+
+HardwareCounters::Values HardwareCounters::Read() const {
+  Values values;
+  values.fill(0);
+#if defined(__linux__)
+  for (int event = 0; event < kNumEvents; ++event) {
+    if (fds_[event] >= 0) {
+      values[event] = ReadCounter(fds_[event]);
+    }
+  }
+#endif
+  return values;
+}
+
+}  // namespace perf_benchmark
+
+}  // namespace transcoding
+}  // namespace grpc
+}  // namespace google
@@ -0,0 +1,96 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+#ifndef PERF_BENCHMARK_HARDWARE_COUNTERS_H_
+#define PERF_BENCHMARK_HARDWARE_COUNTERS_H_
+
+#include <array>
+#include <string>
+
+namespace google {
+namespace grpc {
+namespace transcoding {
+
+namespace perf_benchmark {
+// The hardware performance counters of the calling thread, read through
+// perf_event_open(2) on Linux. The counters only count in user space, so that
+// they're available with the default perf_event_paranoid setting.
+//
+// Each counter is opened on its own, so that the ones the CPU, the kernel
+// (e.g. in a VM or a container) or the permissions don't allow are just not
+// available, while the others still are. On other platforms, none of them is
+// available.
+//
+// Example:
+//   HardwareCounters counters;
+//   HardwareCounters::Values start = counters.Read();
+//   // The code to measure, on the same thread
+//   HardwareCounters::Values end = counters.Read();
+//   if (counters.Available(HardwareCounters::kInstructions)) {
+//     double instructions = end[HardwareCounters::kInstructions] -
+//                           start[HardwareCounters::kInstructions];
+//   }
+class HardwareCounters {
+ public:
+  enum Event {
+    kInstructions,
+    kCycles,
+    kBranchMisses,
+    // L1 data cache read misses.
+    kL1dMisses,
+    // Last level cache misses.
+    kLlcMisses,
+    kNumEvents,
+  };
+
+  // The values of the counters, by Event. The values of the counters that
+  // aren't available are 0.
+  using Values = std::array<double, kNumEvents>;
+
+  // Opens the counters, which count from then on.
+  HardwareCounters();
+  ~HardwareCounters();
+
+  // Return the name of the event, e.g. "branch_misses".
+  static const char* EventName(Event event);
+
+  bool Available(Event event) const { return fds_[event] >= 0; }
+  bool AnyAvailable() const;
+
+  // Return the names of the available counters separated by commas, or
+  // "unavailable" if none of them is.
+  std::string AvailableEventNames() const;
+
+  // Return the current values of the counters. If there are more counters
+  // than the CPU can count at once, the kernel counts them in turns and the
+  // values are scaled to the whole time they've been open.
+  Values Read() const;
+
+ private:
+  // The file descriptors of the counters, -1 for the ones not available.
+  std::array<int, kNumEvents> fds_;
+
+  HardwareCounters(const HardwareCounters&) = delete;
+  HardwareCounters& operator=(const HardwareCounters&) = delete;
+};
+
+}  // namespace perf_benchmark
+
+}  // namespace transcoding
+}  // namespace grpc
+}  // namespace google
+
+#endif  // PERF_BENCHMARK_HARDWARE_COUNTERS_H_
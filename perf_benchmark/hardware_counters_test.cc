@@ -0,0 +1,76 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+#include "perf_benchmark/hardware_counters.h"
+#include "gtest/gtest.h"
+
+namespace google {
+namespace grpc {
+namespace transcoding {
+
+namespace perf_benchmark {
+namespace {
+// Runs some instructions the compiler can't elide.
+volatile int sink;
+void Spin() {
+  for (int i = 0; i < 100000; ++i) {
+    sink = i;
+  }
+}
+
+TEST(HardwareCountersTest, EventNames) {
+  EXPECT_STREQ(HardwareCounters::EventName(HardwareCounters::kInstructions),
+               "instructions");
+  EXPECT_STREQ(HardwareCounters::EventName(HardwareCounters::kLlcMisses),
+               "llc_misses");
+}
+
+TEST(HardwareCountersTest, UnavailableCountersReadZero) {
+  HardwareCounters counters;
+  Spin();
+  const HardwareCounters::Values values = counters.Read();
+  for (int event = 0; event < HardwareCounters::kNumEvents; ++event) {
+    if (!counters.Available(static_cast<HardwareCounters::Event>(event))) {
+      EXPECT_EQ(values[event], 0);
+    }
+  }
+  if (!counters.AnyAvailable()) {
+    EXPECT_EQ(counters.AvailableEventNames(), "unavailable");
+  }
+}
+
+TEST(HardwareCountersTest, CountInstructions) {
+  HardwareCounters counters;
+  if (!counters.Available(HardwareCounters::kInstructions)) {
+    GTEST_SKIP() << "The instruction counter is not available";
+  }
+  EXPECT_NE(counters.AvailableEventNames().find("instructions"),
+            std::string::npos);
+  const HardwareCounters::Values start = counters.Read();
+  Spin();
+  const HardwareCounters::Values end = counters.Read();
+  // The loop runs at least one store per iteration.
+  EXPECT_GE(end[HardwareCounters::kInstructions] -
+                start[HardwareCounters::kInstructions],
+            100000);
+}
+
+}  // namespace
+}  // namespace perf_benchmark
+
+}  // namespace transcoding
+}  // namespace grpc
+}  // namespace google
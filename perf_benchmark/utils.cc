@@ -15,12 +15,16 @@
 ////////////////////////////////////////////////////////////////////////////////
 //
 #include "perf_benchmark/utils.h"
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
 #include <fstream>
 #include <limits>
 #include <sstream>
 #include "absl/random/random.h"
 #include "absl/status/statusor.h"
 #include "absl/strings/escaping.h"
+#include "absl/strings/str_cat.h"
 #include "absl/strings/str_format.h"
 #include "absl/strings/str_split.h"
 #include "google/protobuf/text_format.h"
@@ -244,6 +248,128 @@ std::string GenerateMultiStringFieldPayloadJsonStr(
   return to_string(message);
 }
 
+namespace {
+
+// The number of routes of each service, with a collection for each
+// kRoutesPerCollection of them.
+constexpr uint64_t kRoutesPerService = 64;
+constexpr uint64_t kRoutesPerCollection = 8;
+
+constexpr absl::string_view kApiVersions[] = {"v1", "v1beta1", "v2"};
+constexpr absl::string_view kCustomVerbs[] = {"cancel", "batchGet", "undelete",
+                                              "move"};
+
+}  // namespace
+
+std::vector<BenchmarkRoute> GenerateRouteTable(uint64_t num_routes) {
+  std::vector<BenchmarkRoute> routes;
+  routes.reserve(num_routes);
+  for (uint64_t i = 0; i < num_routes; ++i) {
+    uint64_t service = i / kRoutesPerService;
+    uint64_t collection_index = i % kRoutesPerService / kRoutesPerCollection;
+    absl::string_view version = kApiVersions[service % 3];
+    absl::string_view verb = kCustomVerbs[collection_index % 4];
+    std::string collection =
+        absl::StrFormat("service%dcollection%d", service, collection_index);
+    // The path of a resource of the collection, and of a missing one.
+    std::string resource = absl::StrFormat(
+        "projects/project-%d/locations/us-east1/%s/resource-%d", i, collection,
+        i);
+    std::string missing_resource = absl::StrFormat(
+        "projects/project-%d/locations/us-east1/missing%s/resource-%d", i,
+        collection, i);
+
+    BenchmarkRoute route;
+    // The methods of each collection, like the standard methods of the API
+    // design guide plus a custom method and a file download.
+    switch (i % kRoutesPerCollection) {
+      case 0:
+      case 1:
+        // List and Create.
+        route.http_method = i % kRoutesPerCollection == 0 ? "GET" : "POST";
+        route.http_template = absl::StrFormat(
+            "/%s/projects/{project}/locations/{location}/%s", version,
+            collection);
+        route.hit_path = absl::StrFormat(
+            "/%s/projects/project-%d/locations/us-east1/%s", version, i,
+            collection);
+        route.miss_path = absl::StrFormat(
+            "/%s/projects/project-%d/locations/us-east1/missing%s", version,
+            i, collection);
+        break;
+      case 2:
+      case 3:
+      case 4:
+        // Get, Update and Delete.
+        route.http_method = i % kRoutesPerCollection == 2   ? "GET"
+                            : i % kRoutesPerCollection == 3 ? "PATCH"
+                                                            : "DELETE";
+        route.http_template = absl::StrFormat(
+            "/%s/{%s=projects/*/locations/*/%s/*}", version,
+            i % kRoutesPerCollection == 3 ? "resource.name" : "name",
+            collection);
+        route.hit_path = absl::StrFormat("/%s/%s", version, resource);
+        route.miss_path = absl::StrFormat("/%s/%s", version, missing_resource);
+        break;
+      case 5:
+        // A custom method.
+        route.http_method = "POST";
+        route.http_template =
+            absl::StrFormat("/%s/{name=projects/*/locations/*/%s/*}:%s",
+                            version, collection, verb);
+        route.hit_path = absl::StrFormat("/%s/%s:%s", version, resource, verb);
+        route.miss_path =
+            absl::StrFormat("/%s/%s:%s", version, missing_resource, verb);
+        break;
+      case 6:
+        // A custom method on the collection.
+        route.http_method = "POST";
+        route.http_template =
+            absl::StrFormat("/%s/%s:%s", version, collection, verb);
+        route.hit_path = route.http_template;
+        route.miss_path =
+            absl::StrFormat("/%s/missing%s:%s", version, collection, verb);
+        break;
+      default:
+        // A file download, with a path of any number of segments.
+        route.http_method = "GET";
+        route.http_template = absl::StrFormat(
+            "/%s/%s/{resource}/files/{path=**}", version, collection);
+        route.hit_path = absl::StrFormat(
+            "/%s/%s/resource-%d/files/images/2024/photo.jpg", version,
+            collection, i);
+        route.miss_path = absl::StrFormat(
+            "/%s/missing%s/resource-%d/files/images/2024/photo.jpg", version,
+            collection, i);
+        break;
+    }
+    routes.push_back(std::move(route));
+  }
+  return routes;
+}
+
+std::string GenerateQueryParams(uint64_t num_params,
+                                absl::string_view field_prefix,
+                                absl::string_view val) {
+  std::string query_params;
+  for (uint64_t i = 1; i <= num_params; ++i) {
+    if (i > 1) {
+      query_params += '&';
+    }
+    absl::StrAppend(&query_params, field_prefix, i, "=", val);
+  }
+  return query_params;
+}
+
+int64_t GetHeapBytesInUse() {
+#if defined(__GLIBC__) && \
+    (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+  return static_cast<int64_t>(mallinfo2().uordblks);
+#else
+  return -1;
+#endif
+}
+
 }  // namespace perf_benchmark
 
 }  // namespace transcoding
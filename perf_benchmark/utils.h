@@ -18,6 +18,7 @@
 #define PERF_BENCHMARK_UTILS_H_
 
 #include <string>
+#include <vector>
 
 #include "absl/status/status.h"
 #include "absl/strings/string_view.h"
@@ -110,6 +111,32 @@ std::string GenerateMultiStringFieldPayloadJsonStr(
     uint64_t num_fields_exist, absl::string_view field_prefix,
     absl::string_view val);
 
+// A route of a generated route table: an HTTP rule along with a request path
+// that it matches and one that no route of the table matches.
+struct BenchmarkRoute {
+  std::string http_method;
+  std::string http_template;
+  std::string hit_path;
+  std::string miss_path;
+};
+
+// Return a route table of num_routes distinct routes shaped like the HTTP
+// rules of googleapis. The routes are grouped by service, each with a few
+// resource collections under projects and locations, and mix literal
+// segments, `{var}` and `{var=projects/*/...}` variables, `{var=**}`
+// variables and custom verbs. The table is the same for each call.
+std::vector<BenchmarkRoute> GenerateRouteTable(uint64_t num_routes);
+
+// Return query parameters binding `num_params` fields, e.g.
+// "f1=val&f2=val&f3=val" for GenerateQueryParams(3, "f", "val").
+std::string GenerateQueryParams(uint64_t num_params,
+                                absl::string_view field_prefix,
+                                absl::string_view val);
+
+// Return the number of bytes of the heap in use, or -1 if it isn't available
+// on this platform.
+int64_t GetHeapBytesInUse();
+
 }  // namespace perf_benchmark
 
 }  // namespace transcoding
@@ -150,4 +177,9 @@ std::string GenerateMultiStringFieldPayloadJsonStr(
 #define BENCHMARK_STREAMING_WITH_PERCENTILE(func) \
   BENCHMARK_WITH_PERCENTILE(func)->Arg(1)->Arg(1 << 2)->Arg(1 << 4)->Arg(1 << 6)
 
+// Runs the benchmark with route tables of 1k, 10k and 50k routes (about the
+// number of HTTP rules in all of googleapis).
+#define BENCHMARK_ROUTE_TABLE_WITH_PERCENTILE(func) \
+  BENCHMARK_WITH_PERCENTILE(func)->Arg(1000)->Arg(10000)->Arg(50000)
+
 #endif  // PERF_BENCHMARK_UTILS_H_
@@ -16,9 +16,11 @@
 //
 #include "perf_benchmark/utils.h"
 #include <memory>
+#include <set>
 #include "absl/strings/ascii.h"
 #include "absl/strings/escaping.h"
 #include "absl/strings/str_split.h"
+#include "grpc_transcoding/path_matcher.h"
 #include "gtest/gtest.h"
 
 namespace google {
@@ -155,6 +157,48 @@ TEST(UtilsTest, GetNestedStructPayload) {
   }
 }
 
+TEST(UtilsTest, GenerateRouteTable) {
+  std::vector<BenchmarkRoute> routes = GenerateRouteTable(1000);
+  ASSERT_EQ(routes.size(), 1000);
+
+  PathMatcherBuilder<const BenchmarkRoute*> builder;
+  builder.SetFailRegistrationOnDuplicate(true);
+  for (const auto& route : routes) {
+    EXPECT_TRUE(builder.Register(route.http_method, route.http_template, "",
+                                 &route))
+        << route.http_method << " " << route.http_template;
+  }
+  auto matcher = builder.Build();
+
+  // Each hit path matches its own route, and the miss paths match none.
+  for (const auto& route : routes) {
+    EXPECT_EQ(matcher->Lookup(route.http_method, route.hit_path), &route)
+        << route.hit_path;
+    EXPECT_EQ(matcher->Lookup(route.http_method, route.miss_path), nullptr)
+        << route.miss_path;
+  }
+}
+
+TEST(UtilsTest, GenerateRouteTableMix) {
+  std::set<std::string> templates;
+  int num_custom_verbs = 0;
+  int num_wildcards = 0;
+  for (const auto& route : GenerateRouteTable(64)) {
+    templates.insert(route.http_template);
+    num_custom_verbs += route.http_template.find(':') != std::string::npos;
+    num_wildcards += route.http_template.find("**") != std::string::npos;
+  }
+  // List and Create share their templates, as do Get and Delete.
+  EXPECT_EQ(templates.size(), 48);
+  EXPECT_EQ(num_custom_verbs, 16);
+  EXPECT_EQ(num_wildcards, 8);
+}
+
+TEST(UtilsTest, GenerateQueryParams) {
+  EXPECT_EQ(GenerateQueryParams(0, "f", "val"), "");
+  EXPECT_EQ(GenerateQueryParams(3, "f", "val"), "f1=val&f2=val&f3=val");
+}
+
 }  // namespace perf_benchmark
 
 }  // namespace transcoding
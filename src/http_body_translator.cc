@@ -0,0 +1,398 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+#include "grpc_transcoding/http_body_translator.h"
+
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "absl/strings/str_cat.h"
+#include "google/protobuf/io/coded_stream.h"
+#include "google/protobuf/wire_format_lite.h"
+#include "grpc_transcoding/request_message_translator.h"
+
+namespace google {
+namespace grpc {
+
+namespace transcoding {
+
+namespace pb = ::google::protobuf;
+namespace pbio = ::google::protobuf::io;
+
+namespace {
+
+using ::google::protobuf::internal::WireFormatLite;
+
+// The tags of the google.api.HttpBody fields:
+//   string content_type = 1;
+//   bytes data = 2;
+const uint32_t kContentTypeTag =
+    WireFormatLite::MakeTag(1, WireFormatLite::WIRETYPE_LENGTH_DELIMITED);
+const uint32_t kDataTag =
+    WireFormatLite::MakeTag(2, WireFormatLite::WIRETYPE_LENGTH_DELIMITED);
+
+void WriteVarint(uint64_t value, std::string* output) {
+  uint8_t buffer[10];
+  uint8_t* end = pbio::CodedOutputStream::WriteVarint64ToArray(value, buffer);
+  output->append(reinterpret_cast<char*>(buffer), end - buffer);
+}
+
+void WriteDelimiter(uint32_t size, std::string* output) {
+  char delimiter[kGrpcDelimiterByteSize];
+  // Not compressed, then the big-endian 32-bit size.
+  delimiter[0] = 0;
+  delimiter[1] = static_cast<char>(size >> 24);
+  delimiter[2] = static_cast<char>(size >> 16);
+  delimiter[3] = static_cast<char>(size >> 8);
+  delimiter[4] = static_cast<char>(size);
+  output->append(delimiter, sizeof(delimiter));
+}
+
+// Skips count bytes of stream through Next() and BackUp().
+bool SkipBytes(pbio::ZeroCopyInputStream* stream, int count) {
+  const void* data = nullptr;
+  int size = 0;
+  while (count > 0) {
+    if (!stream->Next(&data, &size) || size == 0) {
+      return false;
+    }
+    if (size > count) {
+      stream->BackUp(size - count);
+      size = count;
+    }
+    count -= size;
+  }
+  return true;
+}
+
+absl::Status InvalidHttpBody(absl::string_view reason) {
+  return absl::Status(
+      absl::StatusCode::kInternal,
+      absl::StrCat("Invalid google.api.HttpBody message: ", reason));
+}
+
+}  // namespace
+
+HttpBodyRequestTranslator::HttpBodyRequestTranslator(
+    const TranscodingPlan& plan, TranscoderInputStream* body,
+    std::vector<RequestWeaver::BindingInfo> variable_bindings,
+    std::string content_type, bool streaming, bool output_delimiters)
+    : plan_(plan),
+      body_(body),
+      streaming_(streaming),
+      output_delimiters_(output_delimiters),
+      content_type_(std::move(content_type)),
+      header_position_(0),
+      body_left_(0),
+      last_from_body_(false),
+      started_(false),
+      done_(false),
+      byte_count_(0) {
+  if (variable_bindings.empty()) {
+    return;
+  }
+  // The bindings are encoded once, as a message with no body. The fields
+  // around the HttpBody are then appended to them, which protobuf merges with
+  // the message fields the bindings go into.
+  RequestMessageTranslator translator(plan, /*output_delimiter=*/false,
+                                      std::move(variable_bindings));
+  translator.Input().StartObject("");
+  translator.Input().EndObject();
+  status_ = translator.Status();
+  if (status_.ok()) {
+    translator.NextMessage(&bindings_);
+  }
+}
+
+bool HttpBodyRequestTranslator::StartMessage() {
+  if (done_ || !status_.ok()) {
+    return false;
+  }
+  int64_t body_size = body_->BytesAvailable();
+  if (!streaming_) {
+    // The length of the data is only known once the whole body has arrived.
+    if (!body_->Finished()) {
+      return false;
+    }
+    done_ = true;
+  } else if (body_size == 0) {
+    done_ = body_->Finished();
+    return false;
+  }
+  EncodeHeader(body_size);
+  started_ = true;
+  return status_.ok();
+}
+
+void HttpBodyRequestTranslator::EncodeHeader(int64_t body_size) {
+  // The HttpBody fields before the data bytes.
+  std::string http_body;
+  if (!started_ && !content_type_.empty()) {
+    WriteVarint(kContentTypeTag, &http_body);
+    WriteVarint(content_type_.size(), &http_body);
+    http_body.append(content_type_);
+  }
+  if (body_size > 0) {
+    WriteVarint(kDataTag, &http_body);
+    WriteVarint(body_size, &http_body);
+  }
+
+  // The body fields wrap the HttpBody, so their lengths are computed from the
+  // innermost one out.
+  const std::vector<const pb::Field*>& body_fields = plan_.body_fields();
+  std::vector<uint64_t> lengths(body_fields.size());
+  uint64_t size = http_body.size() + body_size;
+  for (size_t i = body_fields.size(); i-- > 0;) {
+    lengths[i] = size;
+    size += pbio::CodedOutputStream::VarintSize32(WireFormatLite::MakeTag(
+                body_fields[i]->number(),
+                WireFormatLite::WIRETYPE_LENGTH_DELIMITED)) +
+            pbio::CodedOutputStream::VarintSize64(size);
+  }
+  if (!started_) {
+    size += bindings_.size();
+  }
+
+  header_.clear();
+  header_position_ = 0;
+  if (output_delimiters_) {
+    if (size > std::numeric_limits<uint32_t>::max()) {
+      status_ = absl::Status(absl::StatusCode::kInvalidArgument,
+                             "The HTTP body is too large for a gRPC message.");
+      return;
+    }
+    WriteDelimiter(static_cast<uint32_t>(size), &header_);
+  }
+  if (!started_) {
+    header_.append(bindings_);
+  }
+  for (size_t i = 0; i < body_fields.size(); ++i) {
+    WriteVarint(WireFormatLite::MakeTag(
+                    body_fields[i]->number(),
+                    WireFormatLite::WIRETYPE_LENGTH_DELIMITED),
+                &header_);
+    WriteVarint(lengths[i], &header_);
+  }
+  header_.append(http_body);
+  body_left_ = body_size;
+}
+
+bool HttpBodyRequestTranslator::Next(const void** data, int* size) {
+  if (MessageDone() && !StartMessage()) {
+    *size = 0;
+    // No data at this point; the end of the data if the translator has
+    // finished.
+    return !Finished();
+  }
+
+  if (header_position_ < header_.size()) {
+    *data = header_.data() + header_position_;
+    *size = static_cast<int>(header_.size() - header_position_);
+    header_position_ = header_.size();
+    last_from_body_ = false;
+    byte_count_ += *size;
+    return true;
+  }
+
+  // The body bytes are returned from the chunks of the body stream.
+  if (!body_->Next(data, size)) {
+    status_ = absl::Status(absl::StatusCode::kInternal,
+                           "The HTTP body ended unexpectedly.");
+    *size = 0;
+    return false;
+  }
+  if (*size > body_left_) {
+    body_->BackUp(static_cast<int>(*size - body_left_));
+    *size = static_cast<int>(body_left_);
+  }
+  body_left_ -= *size;
+  last_from_body_ = true;
+  byte_count_ += *size;
+  return true;
+}
+
+void HttpBodyRequestTranslator::BackUp(int count) {
+  if (count <= 0) {
+    return;
+  }
+  if (last_from_body_) {
+    body_->BackUp(count);
+    body_left_ += count;
+  } else if (static_cast<size_t>(count) <= header_position_) {
+    header_position_ -= count;
+  } else {
+    // BackUp has been called illegaly, so we ignore it.
+    return;
+  }
+  byte_count_ -= count;
+}
+
+bool HttpBodyRequestTranslator::Skip(int count) {
+  return SkipBytes(this, count);
+}
+
+int64_t HttpBodyRequestTranslator::BytesAvailable() const {
+  if (MessageDone()) {
+    // Start the next message to make sure we return the correct byte count.
+    const_cast<HttpBodyRequestTranslator*>(this)->StartMessage();
+  }
+  return static_cast<int64_t>(header_.size() - header_position_) + body_left_;
+}
+
+bool HttpBodyRequestTranslator::Finished() const {
+  return !status_.ok() || (done_ && MessageDone());
+}
+
+HttpBodyResponseTranslator::HttpBodyResponseTranslator(
+    TranscoderInputStream* in, bool streaming,
+    const MessageDecompressor* decompressor)
+    : reader_(in, decompressor),
+      streaming_(streaming),
+      message_(nullptr),
+      message_data_read_(false),
+      messages_read_(0),
+      data_left_(0),
+      done_(false),
+      byte_count_(0) {}
+
+bool HttpBodyResponseTranslator::ReadMessage() {
+  if (!status_.ok()) {
+    return false;
+  }
+  if (message_ == nullptr) {
+    if (done_) {
+      return false;
+    }
+    message_ = reader_.NextMessageView();
+    if (message_ == nullptr) {
+      status_ = reader_.Status();
+      done_ = reader_.Finished();
+      return false;
+    }
+    message_data_read_ = false;
+    ++messages_read_;
+    // A non-streaming response is a single message.
+    done_ = !streaming_;
+  }
+
+  {
+    // The input backs up to its position when it's destroyed, which is then
+    // the start of the data when the data is found.
+    pbio::CodedInputStream input(message_);
+    while (true) {
+      uint32_t tag = input.ReadTag();
+      if (tag == 0) {
+        if (!input.ConsumedEntireMessage()) {
+          status_ = InvalidHttpBody("invalid tag");
+          return false;
+        }
+        break;
+      }
+      if (tag == kContentTypeTag) {
+        std::string content_type;
+        if (!WireFormatLite::ReadString(&input, &content_type)) {
+          status_ = InvalidHttpBody("truncated content_type");
+          return false;
+        }
+        if (messages_read_ == 1) {
+          content_type_ = std::move(content_type);
+        }
+      } else if (tag == kDataTag) {
+        // Serializers encode it once; the data of several occurrences would
+        // have to be merged, which passing it through can't do.
+        if (message_data_read_) {
+          status_ = absl::Status(absl::StatusCode::kUnimplemented,
+                                 "The data field of google.api.HttpBody is "
+                                 "encoded more than once.");
+          return false;
+        }
+        uint32_t length = 0;
+        if (!input.ReadVarint32(&length)) {
+          status_ = InvalidHttpBody("truncated data");
+          return false;
+        }
+        message_data_read_ = true;
+        data_left_ = length;
+        return true;
+      } else if (!WireFormatLite::SkipField(&input, tag)) {
+        status_ = InvalidHttpBody("truncated field");
+        return false;
+      }
+    }
+  }
+  // The message has been read entirely, so its view is released now, which
+  // backs the input up to the start of the next message.
+  message_ = nullptr;
+  reader_.ReleaseMessageView();
+  return true;
+}
+
+bool HttpBodyResponseTranslator::Next(const void** data, int* size) {
+  while (data_left_ == 0) {
+    if (!ReadMessage()) {
+      *size = 0;
+      // No data at this point; the end of the data if the translator has
+      // finished.
+      return !Finished();
+    }
+  }
+
+  // The data is returned from the chunks of the message as it is.
+  if (!message_->Next(data, size)) {
+    status_ = InvalidHttpBody("truncated data");
+    *size = 0;
+    return false;
+  }
+  if (*size > data_left_) {
+    message_->BackUp(static_cast<int>(*size - data_left_));
+    *size = static_cast<int>(data_left_);
+  }
+  data_left_ -= *size;
+  byte_count_ += *size;
+  return true;
+}
+
+void HttpBodyResponseTranslator::BackUp(int count) {
+  if (count <= 0 || message_ == nullptr) {
+    // BackUp has been called illegaly, so we ignore it.
+    return;
+  }
+  message_->BackUp(count);
+  data_left_ += count;
+  byte_count_ -= count;
+}
+
+bool HttpBodyResponseTranslator::Skip(int count) {
+  return SkipBytes(this, count);
+}
+
+int64_t HttpBodyResponseTranslator::BytesAvailable() const {
+  // Read on to the next data to make sure we return the correct byte count.
+  auto* self = const_cast<HttpBodyResponseTranslator*>(this);
+  while (data_left_ == 0 && self->ReadMessage()) {
+  }
+  return data_left_;
+}
+
+bool HttpBodyResponseTranslator::Finished() const {
+  return !status_.ok() || (done_ && message_ == nullptr && data_left_ == 0);
+}
+
+}  // namespace transcoding
+
+}  // namespace grpc
+}  // namespace google
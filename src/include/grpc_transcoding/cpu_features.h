@@ -0,0 +1,59 @@
+/* Copyright 2016 Google Inc. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef GRPC_TRANSCODING_CPU_FEATURES_H_
+#define GRPC_TRANSCODING_CPU_FEATURES_H_
+
+// The CPU feature detection shared by the SIMD implementations, e.g. of
+// JsonScanner and of the URL unescaping.
+//
+// GRPC_TRANSCODING_X86 is defined when the SSE2 and AVX2 implementations can
+// be compiled, i.e. for x86-64 with a compiler that supports the target
+// attribute. They are only to be called when the matching CpuSupports*()
+// returns true.
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+#define GRPC_TRANSCODING_X86 1
+#endif
+
+namespace google {
+namespace grpc {
+
+namespace transcoding {
+
+// Whether the CPU runs SSE2 code. SSE2 is part of x86-64, so it needs no
+// runtime check.
+inline bool CpuSupportsSse2() {
+#ifdef GRPC_TRANSCODING_X86
+  return true;
+#else
+  return false;
+#endif
+}
+
+// Whether the CPU runs AVX2 code.
+inline bool CpuSupportsAvx2() {
+#ifdef GRPC_TRANSCODING_X86
+  return __builtin_cpu_supports("avx2");
+#else
+  return false;
+#endif
+}
+
+}  // namespace transcoding
+
+}  // namespace grpc
+}  // namespace google
+
+#endif  // GRPC_TRANSCODING_CPU_FEATURES_H_
@@ -0,0 +1,202 @@
+/* Copyright 2016 Google Inc. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef GRPC_TRANSCODING_HTTP_BODY_TRANSLATOR_H_
+#define GRPC_TRANSCODING_HTTP_BODY_TRANSLATOR_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "google/protobuf/io/zero_copy_stream.h"
+#include "message_compression.h"
+#include "message_reader.h"
+#include "request_weaver.h"
+#include "transcoder_input_stream.h"
+#include "transcoding_plan.h"
+
+namespace google {
+namespace grpc {
+
+namespace transcoding {
+
+// HttpBodyRequestTranslator translates the HTTP body of a method whose body is
+// a google.api.HttpBody (see TranscodingPlan::http_body_request()) into gRPC
+// message(s), without parsing it as JSON: the body bytes are the `data` field
+// of the HttpBody and the Content-Type header is its `content_type` field.
+//
+// Only the fields around the body are encoded: the variable bindings, the tags
+// and the lengths of the body fields, the content_type and the tag and the
+// length of the data. The body bytes are then returned from the chunks of the
+// body stream as they are, without copying.
+//
+// Example:
+//   HttpBodyRequestTranslator translator(plan, body, std::move(bindings),
+//                                        content_type, /*streaming=*/false,
+//                                        /*output_delimiters=*/true);
+//   const void* data;
+//   int size;
+//   while (translator.Next(&data, &size)) {
+//     // Send the request message bytes
+//   }
+//   if (!translator.Status().ok()) {
+//     ...
+//   }
+//
+// The length of the data must be encoded before it, so in the non-streaming
+// case the message is only returned once the body stream is finished (the
+// body is still not copied, the body stream buffers it). In the streaming case
+// the body bytes available at a time are sent as a message, and the bindings
+// and the content_type are only set in the first message.
+class HttpBodyRequestTranslator : public TranscoderInputStream {
+ public:
+  // plan - the plan of the method. HttpBodyRequestTranslator doesn't maintain
+  //        the ownership of plan.
+  // body - the HTTP body. HttpBodyRequestTranslator doesn't maintain the
+  //        ownership of body.
+  // variable_bindings - come from TranscodingPlan::ResolveBindings().
+  // content_type - the Content-Type header of the request.
+  // streaming - whether this is a streaming call or not
+  // output_delimiters - whether to output gRPC message delimiters or not
+  HttpBodyRequestTranslator(
+      const TranscodingPlan& plan, TranscoderInputStream* body,
+      std::vector<RequestWeaver::BindingInfo> variable_bindings,
+      std::string content_type, bool streaming, bool output_delimiters);
+
+  absl::Status Status() const { return status_; }
+
+  // TranscoderInputStream implementation
+  bool Next(const void** data, int* size) override;
+  void BackUp(int count) override;
+  bool Skip(int count) override;
+  int64_t ByteCount() const override { return byte_count_; }
+  int64_t BytesAvailable() const override;
+  bool Finished() const override;
+
+ private:
+  // Whether all of the current message has been read.
+  bool MessageDone() const {
+    return header_position_ == header_.size() && body_left_ == 0;
+  }
+
+  // Starts the next message if the body bytes for it are available. Returns
+  // false otherwise.
+  bool StartMessage();
+
+  // Encodes header_ for a message with body_size bytes of data.
+  void EncodeHeader(int64_t body_size);
+
+  const TranscodingPlan& plan_;
+  TranscoderInputStream* body_;
+  bool streaming_;
+  bool output_delimiters_;
+  std::string content_type_;
+  // The encoded variable bindings, woven into the first message.
+  std::string bindings_;
+
+  // The bytes of the current message before the body bytes.
+  std::string header_;
+  size_t header_position_;
+  // The number of body bytes of the current message left to read.
+  int64_t body_left_;
+  // Whether the last Next() returned body bytes, for BackUp().
+  bool last_from_body_;
+  // Whether a message has been started.
+  bool started_;
+  // Whether no more messages will be started.
+  bool done_;
+  int64_t byte_count_;
+  absl::Status status_;
+
+  HttpBodyRequestTranslator(const HttpBodyRequestTranslator&) = delete;
+  HttpBodyRequestTranslator& operator=(const HttpBodyRequestTranslator&) =
+      delete;
+};
+
+// HttpBodyResponseTranslator translates the gRPC response message(s) of a
+// method whose response is a google.api.HttpBody (see
+// TranscodingPlan::http_body_response()) into the HTTP response body, without
+// printing them as JSON: the body is the `data` field, which is returned from
+// the message bytes as it is, without copying, and content_type() is the
+// Content-Type header. In the streaming case the body is the data of all the
+// messages, and the content type is the one of the first message.
+//
+// Example:
+//   HttpBodyResponseTranslator translator(grpc_input, /*streaming=*/false);
+//   const void* data;
+//   int size;
+//   while (translator.Next(&data, &size)) {
+//     // Send translator.content_type() with the first bytes, then the bytes.
+//   }
+//   if (!translator.Status().ok()) {
+//     ...
+//   }
+//
+// The messages are read when they are complete, so that the fields before the
+// data can be read first. Other fields (e.g. extensions) are skipped.
+class HttpBodyResponseTranslator : public TranscoderInputStream {
+ public:
+  // in - the gRPC response stream. HttpBodyResponseTranslator doesn't maintain
+  //      the ownership of in.
+  // streaming - whether this is a streaming call or not
+  // decompressor - decompresses the compressed messages, see MessageReader.
+  HttpBodyResponseTranslator(TranscoderInputStream* in, bool streaming,
+                             const MessageDecompressor* decompressor = nullptr);
+
+  // The content_type of the first message, empty until its data is returned.
+  const std::string& content_type() const { return content_type_; }
+
+  absl::Status Status() const { return status_; }
+
+  // TranscoderInputStream implementation
+  bool Next(const void** data, int* size) override;
+  void BackUp(int count) override;
+  bool Skip(int count) override;
+  int64_t ByteCount() const override { return byte_count_; }
+  int64_t BytesAvailable() const override;
+  bool Finished() const override;
+
+ private:
+  // Reads the current message up to its data, or to its end, reading the next
+  // message first if there is no current message. Returns false if no message
+  // is available or there was an error.
+  bool ReadMessage();
+
+  MessageReader reader_;
+  bool streaming_;
+  // The current message, positioned at the data if data_left_ isn't 0.
+  ::google::protobuf::io::ZeroCopyInputStream* message_;
+  // Whether the data of the current message has been read.
+  bool message_data_read_;
+  int64_t messages_read_;
+  // The number of data bytes of the current message left to read.
+  int64_t data_left_;
+  // Whether no more messages will be read.
+  bool done_;
+  int64_t byte_count_;
+  std::string content_type_;
+  absl::Status status_;
+
+  HttpBodyResponseTranslator(const HttpBodyResponseTranslator&) = delete;
+  HttpBodyResponseTranslator& operator=(const HttpBodyResponseTranslator&) =
+      delete;
+};
+
+}  // namespace transcoding
+
+}  // namespace grpc
+}  // namespace google
+
+#endif  // GRPC_TRANSCODING_HTTP_BODY_TRANSLATOR_H_
@@ -0,0 +1,274 @@
+/* Copyright 2016 Google Inc. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef GRPC_TRANSCODING_INCREMENTAL_JSON_PRINTER_H_
+#define GRPC_TRANSCODING_INCREMENTAL_JSON_PRINTER_H_
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "google/protobuf/io/zero_copy_stream.h"
+#include "google/protobuf/type.pb.h"
+#include "google/protobuf/util/json_util.h"
+#include "google/protobuf/util/type_resolver.h"
+
+namespace google {
+namespace grpc {
+
+namespace transcoding {
+
+// JsonPrinterPlan is a message type compiled for printing as JSON with given
+// JsonPrintOptions: for each message type reachable from the root type, a
+// table from the field numbers to the quoted JSON keys of the fields, the
+// compiled type of message fields and the names of the values of enum fields.
+// It's compiled once per type and options, e.g. by JsonPrinterCache, and is
+// immutable and thread-safe afterwards.
+//
+// The well-known types (Any, Struct, Timestamp, the wrappers, ...) are not
+// compiled, as they have special JSON representations; the fields of these
+// types are printed with ::google::protobuf::util::BinaryToJsonStream().
+class JsonPrinterPlan {
+ public:
+  struct Message;
+
+  struct Enum {
+    absl::flat_hash_map<int32_t, std::string> names;
+    // Whether it's google.protobuf.NullValue, which is printed as null.
+    bool null_value;
+  };
+
+  struct Field {
+    const ::google::protobuf::Field* field;
+    // The quoted JSON name of the field followed by ':'.
+    std::string key;
+    // Whether it's a field of a well-known type, printed by
+    // BinaryToJsonStream().
+    bool well_known;
+    // The compiled type of a TYPE_MESSAGE field that isn't well_known, null
+    // otherwise.
+    const Message* message;
+    // The compiled type of a TYPE_ENUM field, null otherwise.
+    const Enum* enum_type;
+  };
+
+  struct Message {
+    std::unique_ptr<::google::protobuf::Type> type;
+    bool map_entry;
+    // The fields by their numbers.
+    absl::flat_hash_map<int32_t, Field> fields;
+  };
+
+  // Compiles type_url and the types of its fields, recursively. Returns
+  // kUnimplemented if type_url is a well-known type or the options add
+  // whitespace or print the fields with default values, which the printer
+  // doesn't support. type_resolver isn't owned and needs to outlive the plan.
+  static absl::StatusOr<std::shared_ptr<const JsonPrinterPlan>> Compile(
+      ::google::protobuf::util::TypeResolver* type_resolver,
+      const std::string& type_url,
+      const ::google::protobuf::util::JsonPrintOptions& options);
+
+  const Message& root() const { return *root_; }
+  const ::google::protobuf::util::JsonPrintOptions& options() const {
+    return options_;
+  }
+  ::google::protobuf::util::TypeResolver* type_resolver() const {
+    return type_resolver_;
+  }
+
+ private:
+  JsonPrinterPlan(::google::protobuf::util::TypeResolver* type_resolver,
+                  const ::google::protobuf::util::JsonPrintOptions& options);
+
+  absl::StatusOr<const Message*> CompileMessage(const std::string& type_url);
+  absl::StatusOr<const Enum*> CompileEnum(const std::string& type_url);
+
+  ::google::protobuf::util::TypeResolver* type_resolver_;
+  ::google::protobuf::util::JsonPrintOptions options_;
+  // The compiled types by their URLs.
+  absl::flat_hash_map<std::string, std::unique_ptr<Message>> messages_;
+  absl::flat_hash_map<std::string, std::unique_ptr<Enum>> enums_;
+  const Message* root_;
+
+  JsonPrinterPlan(const JsonPrinterPlan&) = delete;
+  JsonPrinterPlan& operator=(const JsonPrinterPlan&) = delete;
+};
+
+// IncrementalJsonPrinter translates messages in the protobuf wire format to
+// JSON as their bytes arrive, instead of waiting for the entire message like
+// ::google::protobuf::util::BinaryToJsonStream() does. The JSON of a large
+// message can then be sent while the rest of it is still being received, and
+// only the field being received needs to be buffered. The types are looked up
+// in a JsonPrinterPlan, so nothing is resolved while printing.
+//
+// Example:
+//   auto plan = JsonPrinterPlan::Compile(type_resolver,
+//                                        "type.googleapis.com/Shelf", options);
+//   IncrementalJsonPrinter printer(*plan);
+//   std::string json;
+//   // For each part of the message, in order:
+//   status = printer.Print(part, last, &json);
+//
+// The JSON is the same as BinaryToJsonStream() prints, except for the order of
+// the fields, which is the order in which they are encoded, and it has no
+// whitespace.
+//
+// Printing a field as soon as it's read requires it to be encoded once, so
+// the message must be encoded the way protobuf serializers do: each field that
+// isn't repeated at most once, and all the values of a repeated field one after
+// another. Otherwise Print() fails with kUnimplemented, as it can't merge the
+// occurrences of a field anymore. Two fields of the same oneof are both
+// printed, unless set_require_canonical_encoding() is set. Groups are not
+// supported.
+class IncrementalJsonPrinter {
+ public:
+  explicit IncrementalJsonPrinter(std::shared_ptr<const JsonPrinterPlan> plan);
+
+  // Returns a printer for the messages of type_url, or nullptr if
+  // JsonPrinterPlan::Compile() fails.
+  static std::unique_ptr<IncrementalJsonPrinter> Create(
+      ::google::protobuf::util::TypeResolver* type_resolver,
+      const std::string& type_url,
+      const ::google::protobuf::util::JsonPrintOptions& options);
+
+  // Translates the next part of a message, which is the entire input stream,
+  // and appends the JSON to *json. last is whether the part is the last one of
+  // the message, after which the next part starts a new message.
+  // Returns an error if the message is invalid; the printer can't be used
+  // after that.
+  absl::Status Print(::google::protobuf::io::ZeroCopyInputStream* input,
+                     bool last, std::string* json);
+
+  // If set, Print() also fails with kUnimplemented unless the fields of each
+  // message are encoded in the order of their numbers and at most one field of
+  // each oneof is, which makes the JSON the same as BinaryToJsonStream()
+  // prints. The message can then be printed with BinaryToJsonStream()
+  // instead. False by default.
+  void set_require_canonical_encoding(bool require) {
+    require_canonical_encoding_ = require;
+  }
+
+ private:
+  typedef JsonPrinterPlan::Field Field;
+  typedef JsonPrinterPlan::Message Message;
+
+  enum class FrameKind {
+    // A message, printed as a JSON object.
+    kMessage,
+    // A map entry, printed as a member of the JSON object of the map.
+    kMapEntry,
+    // The packed values of a repeated field, printed as elements of the JSON
+    // array of the field.
+    kPacked,
+  };
+
+  // A length-delimited field that is being read.
+  struct Frame {
+    FrameKind kind;
+    const Message* message;
+    // The packed field of a kPacked frame.
+    const Field* packed_field;
+    // The position in the message where the frame ends.
+    int64_t end;
+    // Whether nothing has been printed in the JSON object of a kMessage frame.
+    bool empty;
+    // The repeated field of a kMessage frame whose JSON array or object is
+    // open, or nullptr.
+    const Field* open_field;
+    // Whether the JSON array or object of open_field is empty.
+    bool open_field_empty;
+    // The numbers of the fields read in a kMessage frame, or of the key and
+    // the value in a kMapEntry frame.
+    std::vector<int32_t> seen;
+    // The oneof_index of the oneofs of which a field was read in a kMessage
+    // frame, with require_canonical_encoding_.
+    std::vector<int32_t> oneofs;
+  };
+
+  // Consumes the bytes of the message, buffering them in pending_ if they end
+  // inside a field.
+  absl::Status Consume(const char* data, const char* end);
+
+  // Reads and prints the next field, or the next value of a kPacked frame, from
+  // [data, end). Sets *consumed to the number of bytes read, which is 0 if the
+  // field doesn't end in [data, end); need_ is then set to the number of bytes
+  // needed (or that might be needed) to read it.
+  absl::Status ParseItem(const char* data, const char* end, int64_t* consumed);
+
+  // Prints the value of a field, or the key of a map entry, from its encoded
+  // value: the varint or fixed value, or the length-delimited bytes.
+  absl::Status PrintValue(const Field& field, uint64_t value);
+  absl::Status PrintBytesValue(const Field& field, absl::string_view bytes);
+  void PrintMapKey(const Field& field, uint64_t value);
+  void PrintDefaultMapKey(const Message& entry);
+  absl::Status PrintDefaultValue(const Field& field);
+
+  // Prints what comes before a value of field in the top frame. packed is
+  // whether the values are packed, in which case they are printed later.
+  absl::Status BeginValue(const Field& field, bool packed);
+
+  // Prints what comes before a field in the JSON object of frame: the ',' and
+  // the key, and opens the JSON array or object of a repeated field.
+  absl::Status BeginField(Frame* frame, const Field& field);
+  // Prints the ',' before the element of the open repeated field of frame.
+  void BeginElement(Frame* frame);
+  void CloseOpenField(Frame* frame);
+  static absl::Status NotEncodedOnce(const Field& field);
+  static absl::Status NotCanonical(const Field& field);
+
+  void PushFrame(FrameKind kind, const Message* message,
+                 const Field* packed_field, int64_t end);
+  absl::Status CloseFrame();
+  // Closes the frames that end at the current position.
+  absl::Status CloseEndedFrames();
+  absl::Status Finish();
+
+  Frame& Top() { return frames_[depth_ - 1]; }
+
+  std::shared_ptr<const JsonPrinterPlan> plan_;
+  bool require_canonical_encoding_;
+
+  // The output of the current Print() call.
+  std::string* json_;
+  // Whether a message is being printed.
+  bool in_message_;
+  // The number of bytes of the message read.
+  int64_t position_;
+  // The bytes of the field at position_ that have been received, if it's not
+  // complete.
+  std::string pending_;
+  // The number of bytes needed for the field at position_.
+  int64_t need_;
+  // The number of bytes of an unknown field to skip.
+  int64_t skip_;
+  // The stack of the frames. The vector isn't shrunk, so that the frames are
+  // reused.
+  std::vector<Frame> frames_;
+  size_t depth_;
+
+  IncrementalJsonPrinter(const IncrementalJsonPrinter&) = delete;
+  IncrementalJsonPrinter& operator=(const IncrementalJsonPrinter&) = delete;
+};
+
+}  // namespace transcoding
+
+}  // namespace grpc
+}  // namespace google
+
+#endif  // GRPC_TRANSCODING_INCREMENTAL_JSON_PRINTER_H_
@@ -0,0 +1,83 @@
+/* Copyright 2016 Google Inc. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef GRPC_TRANSCODING_JSON_PRINTER_CACHE_H_
+#define GRPC_TRANSCODING_JSON_PRINTER_CACHE_H_
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <utility>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/container/flat_hash_map.h"
+#include "absl/synchronization/mutex.h"
+#include "google/protobuf/util/json_util.h"
+#include "google/protobuf/util/type_resolver.h"
+#include "incremental_json_printer.h"
+
+namespace google {
+namespace grpc {
+namespace transcoding {
+
+// JsonPrinterCache holds the JsonPrinterPlans compiled for the response types,
+// keyed on the type URL and the JsonPrintOptions, so that the translators of
+// all the requests share them and the types are resolved and compiled only
+// once. The cache is unbounded: it's meant for the response types of the
+// service, which are known upfront.
+//
+// Example:
+//   JsonPrinterCache cache(type_resolver);
+//
+//   // For each response
+//   JsonResponseTranslateOptions options;
+//   options.json_printer_cache = &cache;
+//   ResponseToJsonTranslator translator(type_resolver, type_url, streaming,
+//                                       input, options);
+//
+// Thread safe.
+class JsonPrinterCache {
+ public:
+  // type_resolver isn't owned and needs to outlive the cache and the plans.
+  explicit JsonPrinterCache(
+      ::google::protobuf::util::TypeResolver* type_resolver);
+
+  // Returns the plan of type_url for the options, compiling it on the first
+  // call. Returns nullptr if JsonPrinterPlan::Compile() fails, which is cached
+  // too.
+  std::shared_ptr<const JsonPrinterPlan> Get(
+      const std::string& type_url,
+      const ::google::protobuf::util::JsonPrintOptions& options);
+
+  // The number of the cached type URL and options pairs.
+  size_t size() const;
+
+ private:
+  // The type URL and the options as bits.
+  typedef std::pair<std::string, int> Key;
+
+  ::google::protobuf::util::TypeResolver* type_resolver_;
+  mutable absl::Mutex mu_;
+  absl::flat_hash_map<Key, std::shared_ptr<const JsonPrinterPlan>> plans_
+      ABSL_GUARDED_BY(mu_);
+
+  JsonPrinterCache(const JsonPrinterCache&) = delete;
+  JsonPrinterCache& operator=(const JsonPrinterCache&) = delete;
+};
+
+}  // namespace transcoding
+}  // namespace grpc
+}  // namespace google
+
+#endif  // GRPC_TRANSCODING_JSON_PRINTER_CACHE_H_
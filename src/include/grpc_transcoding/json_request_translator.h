@@ -18,8 +18,10 @@
 #include <memory>
 
 #include "google/protobuf/io/zero_copy_stream.h"
-#include "google/protobuf/util/converter/json_stream_parser.h"
+#include "google/protobuf/util/converter/type_info.h"
 #include "google/protobuf/util/type_resolver.h"
+#include "json_tokenizer.h"
+#include "message_compression.h"
 #include "message_stream.h"
 #include "request_message_translator.h"
 #include "request_stream_translator.h"
@@ -55,10 +57,10 @@ namespace transcoding {
 //     printf("Message=%s\n", message.c_str());
 //   }
 //
-// The implementation uses JsonStreamParser to parse the incoming JSON and
+// The implementation uses a JsonTokenizer to parse the incoming JSON and
 // RequestMessageTranslator or RequestStreamTranslator to translate it into
 // protobuf message(s).
-//      - JsonStreamParser converts the incoming JSON into ObjectWriter events,
+//      - JsonTokenizer converts the incoming JSON into ObjectWriter events,
 //      - in a non-streaming case RequestMessageTranslator translates these
 //        events into a protobuf message,
 //      - in a streaming case RequestStreamTranslator translates these events
@@ -77,18 +79,50 @@ class JsonRequestTranslator {
   //                RequestStreamTranslator).
   // streaming - whether this is a streaming call or not
   // output_delimiters - whether to ouptut gRPC message delimiters or not
-  JsonRequestTranslator(::google::protobuf::util::TypeResolver* type_resolver,
-                        ::google::protobuf::io::ZeroCopyInputStream* json_input,
-                        RequestInfo request_info, bool streaming,
-                        bool output_delimiters);
+  // tokenizer - the JsonTokenizer implementation that parses json_input
+  JsonRequestTranslator(
+      ::google::protobuf::util::TypeResolver* type_resolver,
+      ::google::protobuf::io::ZeroCopyInputStream* json_input,
+      RequestInfo request_info, bool streaming, bool output_delimiters,
+      JsonTokenizer::Kind tokenizer = JsonTokenizer::kProtobuf);
+
+  // Same as above, but takes a TypeInfo instead of a TypeResolver. Passing a
+  // long-lived and already populated TypeInfo (e.g. TypeHelper::Info()) saves
+  // resolving the request types over again for each request. Note that
+  // JsonRequestTranslator doesn't maintain the ownership of type_info.
+  JsonRequestTranslator(
+      const ::google::protobuf::util::converter::TypeInfo* type_info,
+      ::google::protobuf::io::ZeroCopyInputStream* json_input,
+      RequestInfo request_info, bool streaming, bool output_delimiters,
+      JsonTokenizer::Kind tokenizer = JsonTokenizer::kProtobuf);
+
+  // Same as above, but the underlying translators are constructed from the
+  // plan (see TranscodingPlan), so nothing is resolved per request.
+  // variable_bindings come from TranscodingPlan::ResolveBindings(). Note that
+  // JsonRequestTranslator doesn't maintain the ownership of plan.
+  JsonRequestTranslator(
+      const TranscodingPlan& plan,
+      ::google::protobuf::io::ZeroCopyInputStream* json_input,
+      std::vector<RequestWeaver::BindingInfo> variable_bindings,
+      bool streaming, bool output_delimiters,
+      JsonTokenizer::Kind tokenizer = JsonTokenizer::kProtobuf);
 
   // The translated output stream
   MessageStream& Output() { return *output_; }
 
+  // Compresses the output messages if output_delimiters is true, see
+  // RequestMessageTranslator::set_compressor(). Must be called before reading
+  // the output. JsonRequestTranslator doesn't maintain the ownership of
+  // compressor.
+  void set_compressor(const MessageCompressor* compressor);
+
  private:
+  // Creates the JSON parser and the output stream on top of the translator.
+  void Initialize(::google::protobuf::io::ZeroCopyInputStream* json_input,
+                  bool streaming, JsonTokenizer::Kind tokenizer);
+
   // The JSON parser
-  std::unique_ptr<::google::protobuf::util::converter::JsonStreamParser>
-      parser_;
+  std::unique_ptr<JsonTokenizer> parser_;
 
   // The output stream
   std::unique_ptr<MessageStream> output_;
@@ -0,0 +1,88 @@
+/* Copyright 2016 Google Inc. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef GRPC_TRANSCODING_JSON_SCANNER_H_
+#define GRPC_TRANSCODING_JSON_SCANNER_H_
+
+namespace google {
+namespace grpc {
+
+namespace transcoding {
+
+// JsonScanner classifies JSON text in bulk: it finds the end of string runs
+// and skips whitespace 16 or 32 bytes at a time with SSE2 or AVX2, falling
+// back to a scalar loop on other CPUs. The implementation is chosen at runtime
+// by Get().
+//
+// The scanner has no state and is thread-safe.
+class JsonScanner {
+ public:
+  // The instruction sets of the implementations.
+  enum Isa {
+    kScalar,
+    kSse2,
+    kAvx2,
+  };
+
+  // The best implementation supported by the CPU.
+  static const JsonScanner& Get();
+
+  // Whether the CPU supports the implementation for isa.
+  static bool IsSupported(Isa isa);
+
+  // The implementation for isa, which must be supported.
+  static const JsonScanner& ForIsa(Isa isa);
+
+  Isa isa() const { return isa_; }
+
+  // Returns the first character in [begin, end) that is either quote or a
+  // backslash, or end if there is none. Sets *non_ascii if any character
+  // before the returned one is not ASCII; leaves it unchanged otherwise.
+  const char* FindStringSpecial(const char* begin, const char* end, char quote,
+                                bool* non_ascii) const {
+    return find_string_special_(begin, end, quote, non_ascii);
+  }
+
+  // Returns the first character in [begin, end) that is not JSON whitespace,
+  // or end if there is none.
+  const char* SkipWhitespace(const char* begin, const char* end) const {
+    return skip_whitespace_(begin, end);
+  }
+
+ private:
+  typedef const char* (*FindStringSpecialFn)(const char* begin,
+                                             const char* end, char quote,
+                                             bool* non_ascii);
+  typedef const char* (*SkipWhitespaceFn)(const char* begin, const char* end);
+
+  constexpr JsonScanner(Isa isa, FindStringSpecialFn find_string_special,
+                        SkipWhitespaceFn skip_whitespace)
+      : isa_(isa),
+        find_string_special_(find_string_special),
+        skip_whitespace_(skip_whitespace) {}
+
+  Isa isa_;
+  FindStringSpecialFn find_string_special_;
+  SkipWhitespaceFn skip_whitespace_;
+
+  JsonScanner(const JsonScanner&) = delete;
+  JsonScanner& operator=(const JsonScanner&) = delete;
+};
+
+}  // namespace transcoding
+
+}  // namespace grpc
+}  // namespace google
+
+#endif  // GRPC_TRANSCODING_JSON_SCANNER_H_
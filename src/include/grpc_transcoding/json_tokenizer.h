@@ -0,0 +1,74 @@
+/* Copyright 2016 Google Inc. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef GRPC_TRANSCODING_JSON_TOKENIZER_H_
+#define GRPC_TRANSCODING_JSON_TOKENIZER_H_
+
+#include <memory>
+
+#include "absl/status/status.h"
+#include "absl/strings/string_view.h"
+#include "google/protobuf/util/converter/object_writer.h"
+
+namespace google {
+namespace grpc {
+
+namespace transcoding {
+
+// JsonTokenizer is the front end of the JSON request translation: it parses
+// JSON text that arrives in chunks and renders it as ObjectWriter events.
+// Parse() can be called with any split of the input, e.g. in the middle of a
+// string or a number; the events are rendered as soon as the tokens are
+// complete. FinishParse() is called after the last chunk.
+//
+// There are two implementations:
+//   - kProtobuf uses protobuf's JsonStreamParser,
+//   - kVectorized scans the string contents and the whitespace with SIMD
+//     instructions (see JsonScanner) and passes the strings without escapes
+//     to the writer without copying them.
+// Both accept the same input (including the JsonStreamParser extensions such
+// as single-quoted strings and unquoted keys) and render the same events.
+//
+// Example:
+//   auto tokenizer = JsonTokenizer::Create(JsonTokenizer::kVectorized,
+//                                          &writer);
+//   absl::Status status = tokenizer->Parse("{\"a\": [1, ");
+//   if (status.ok()) status = tokenizer->Parse("2]}");
+//   if (status.ok()) status = tokenizer->FinishParse();
+class JsonTokenizer {
+ public:
+  enum Kind {
+    kProtobuf,
+    kVectorized,
+  };
+
+  // Creates a tokenizer rendering to writer, which must outlive it.
+  static std::unique_ptr<JsonTokenizer> Create(
+      Kind kind, ::google::protobuf::util::converter::ObjectWriter* writer);
+
+  virtual ~JsonTokenizer() {}
+
+  // Parses the next chunk of the input.
+  virtual absl::Status Parse(absl::string_view json) = 0;
+
+  // Finishes parsing: fails if the input ends before the JSON value does.
+  virtual absl::Status FinishParse() = 0;
+};
+
+}  // namespace transcoding
+
+}  // namespace grpc
+}  // namespace google
+
+#endif  // GRPC_TRANSCODING_JSON_TOKENIZER_H_
@@ -0,0 +1,86 @@
+/* Copyright 2016 Google Inc. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef GRPC_TRANSCODING_MESSAGE_COMPRESSION_H_
+#define GRPC_TRANSCODING_MESSAGE_COMPRESSION_H_
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "absl/status/status.h"
+#include "absl/strings/string_view.h"
+#include "google/protobuf/io/zero_copy_stream.h"
+
+namespace google {
+namespace grpc {
+
+namespace transcoding {
+
+// MessageDecompressor decompresses the messages of gRPC frames with the
+// compressed flag set (http://www.grpc.io/docs/guides/wire.html). The encoding
+// of the messages is the one in the "grpc-encoding" header of the stream.
+//
+// The implementations must be thread-safe, so that a single instance can be
+// shared by all the streams.
+class MessageDecompressor {
+ public:
+  virtual ~MessageDecompressor() {}
+
+  // Returns a stream of the decompressed message, where compressed is a stream
+  // of the compressed message only. The message is decompressed as it's read,
+  // so the memory used doesn't depend on the message size.
+  // If the compressed message turns out to be invalid or too large, the
+  // returned stream ends early and *status is set to the error; status must
+  // outlive the returned stream. When the returned stream is destroyed,
+  // compressed is advanced to its end even if the message hasn't been read
+  // entirely.
+  virtual std::unique_ptr<::google::protobuf::io::ZeroCopyInputStream>
+  Decompress(
+      std::unique_ptr<::google::protobuf::io::ZeroCopyInputStream> compressed,
+      absl::Status* status) const = 0;
+};
+
+// MessageCompressor compresses the messages of outgoing gRPC frames. The
+// implementations must be thread-safe.
+class MessageCompressor {
+ public:
+  virtual ~MessageCompressor() {}
+
+  // Compresses message into *compressed.
+  virtual absl::Status Compress(absl::string_view message,
+                                std::string* compressed) const = 0;
+};
+
+// The default limit of the size of a decompressed message, the default
+// maximum size of the messages a gRPC client receives.
+constexpr int64_t kDefaultMaxDecompressedMessageSize = 4 * 1024 * 1024;
+
+// Return the built-in decompressor or compressor for the given gRPC message
+// encoding, either "gzip" or "deflate", or nullptr if it's not supported.
+// A message that decompresses to more than max_decompressed_size bytes ends its
+// decompressed stream early with a kResourceExhausted status, so that a small
+// compressed message can't expand without bound.
+std::unique_ptr<MessageDecompressor> CreateMessageDecompressor(
+    absl::string_view encoding,
+    int64_t max_decompressed_size = kDefaultMaxDecompressedMessageSize);
+std::unique_ptr<MessageCompressor> CreateMessageCompressor(
+    absl::string_view encoding);
+
+}  // namespace transcoding
+
+}  // namespace grpc
+}  // namespace google
+
+#endif  // GRPC_TRANSCODING_MESSAGE_COMPRESSION_H_
@@ -18,6 +18,9 @@
 #include <memory>
 
 #include "absl/status/status.h"
+#include "absl/types/optional.h"
+#include "google/protobuf/io/zero_copy_stream_impl.h"
+#include "message_compression.h"
 #include "transcoder_input_stream.h"
 
 namespace google {
@@ -35,14 +38,17 @@ struct MessageAndGrpcFrame {
   std::unique_ptr<::google::protobuf::io::ZeroCopyInputStream> message;
   unsigned char grpc_frame[kGrpcDelimiterByteSize];
   // The size (in bytes) of the full gRPC message, excluding the frame header.
+  // For a compressed frame this is the size of the compressed message, as in
+  // grpc_frame, while message is decompressed.
   uint32_t message_size;
 };
 
 // MessageReader helps extract full messages from a ZeroCopyInputStream of
 // messages in gRPC wire format (http://www.grpc.io/docs/guides/wire.html). Each
 // message is returned in a ZeroCopyInputStream. MessageReader doesn't advance
-// the underlying ZeroCopyInputStream unless there is a full message available.
-// This is done to avoid copying while buffering.
+// the underlying ZeroCopyInputStream unless there is a full message available
+// (or unless the message is read in parts with NextMessagePart()). This is done
+// to avoid copying while buffering.
 //
 // Example:
 //   MessageReader reader(&input);
@@ -62,6 +68,10 @@ struct MessageAndGrpcFrame {
 //     }
 //   }
 //
+// Frames with the compressed flag set are accepted if a MessageDecompressor is
+// given; their messages are decompressed as they are read. Otherwise they fail
+// with an "Unsupported gRPC frame flag" error.
+//
 // NOTE: MessageReader is unable to recognize the case when there is an
 //       incomplete message at the end of the input. The callers will need to
 //       detect it and act appropriately.
@@ -72,7 +82,11 @@ struct MessageAndGrpcFrame {
 //
 class MessageReader {
  public:
-  MessageReader(TranscoderInputStream* in);
+  // decompressor - decompresses the messages of the compressed frames, can be
+  //                nullptr if they aren't expected. MessageReader doesn't
+  //                maintain the ownership of decompressor.
+  MessageReader(TranscoderInputStream* in,
+                const MessageDecompressor* decompressor = nullptr);
 
   // If a full message is available, NextMessage() returns a ZeroCopyInputStream
   // over the message. Otherwise returns nullptr - this might be temporary, the
@@ -92,6 +106,31 @@ class MessageReader {
   //       is OK before consuming the `grpc_frame`.
   MessageAndGrpcFrame NextMessageAndGrpcFrame();
 
+  // Same as NextMessage(), but the returned stream is owned by the
+  // MessageReader and reused for every message, so that reading a message
+  // doesn't allocate (except for a compressed message). The stream is valid
+  // until the next call to NextMessageView(), NextMessage() or
+  // NextMessageAndGrpcFrame().
+  ::google::protobuf::io::ZeroCopyInputStream* NextMessageView();
+
+  // Same as NextMessageView(), but returns the message in parts as its bytes
+  // arrive instead of waiting for all of them, for the callers that process
+  // the message incrementally. Returns a stream over the part of the current
+  // message that is available, or nullptr if none is, and sets *last to
+  // whether the part ends the message. An empty message is returned in a single
+  // empty part. A compressed message is returned in a single part once it's
+  // complete, as it's decompressed as a whole.
+  // NOTE: the caller must consume the entire part before calling any of the
+  //       methods again, and shouldn't mix parts with whole messages.
+  ::google::protobuf::io::ZeroCopyInputStream* NextMessagePart(bool* last);
+
+  // Destroys the stream returned by NextMessageView() or NextMessagePart().
+  // The stream reads ahead of the message and only backs up to the end of it
+  // when it's destroyed, so until then the input is past the message and its
+  // BytesAvailable() understates what is left. Callers that are done with the
+  // message should call it rather than wait for the next read.
+  void ReleaseMessageView();
+
   absl::Status Status() const { return status_; }
 
   // Returns true if the stream has ended (this is permanent); otherwise returns
@@ -100,7 +139,9 @@ class MessageReader {
 
  private:
   TranscoderInputStream* in_;
-  // The size of the current message.
+  const MessageDecompressor* decompressor_;
+  // The size of the current message, less the parts of it returned by
+  // NextMessagePart().
   uint32_t current_message_size_;
   // Whether we have read the current message size or not
   bool have_current_message_size_;
@@ -111,6 +152,23 @@ class MessageReader {
   // Buffer to store the current delimiter value.
   unsigned char delimiter_[kGrpcDelimiterByteSize];
 
+  // Reads the next frame header if it hasn't been read. Returns false if it's
+  // not available.
+  bool ReadFrameHeader();
+
+  // Reads the next frame header if needed and returns true if the full message
+  // is available, in which case the caller must read it.
+  bool NextFrame();
+
+  // Sets status_ to the error of a stream that ends inside a message.
+  void SetIncompleteFrameStatus();
+
+  // The stream returned by NextMessageView() or NextMessagePart(), either
+  // message_view_ or, for a compressed message, decompressed_view_.
+  absl::optional<::google::protobuf::io::LimitingInputStream> message_view_;
+  std::unique_ptr<::google::protobuf::io::ZeroCopyInputStream>
+      decompressed_view_;
+
   MessageReader(const MessageReader&) = delete;
   MessageReader& operator=(const MessageReader&) = delete;
 };
@@ -15,17 +15,31 @@
 #ifndef GRPC_TRANSCODING_PATH_MATCHER_H_
 #define GRPC_TRANSCODING_PATH_MATCHER_H_
 
+#include <algorithm>
 #include <cstddef>
+#include <cstdint>
+#include <functional>
 #include <memory>
 #include <sstream>
 #include <string>
 #include <unordered_map>
 #include <unordered_set>
+#include <vector>
 
+#include "absl/base/thread_annotations.h"
+#include "absl/container/flat_hash_map.h"
+#include "absl/container/flat_hash_set.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
 #include "absl/strings/str_split.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
 #include "http_template.h"
+#include "path_matcher_cache.h"
 #include "path_matcher_node.h"
+#include "path_matcher_trie.h"
 #include "percent_encoding.h"
+#include "snapshot.h"
 
 namespace google {
 namespace grpc {
@@ -33,6 +47,8 @@ namespace transcoding {
 
 template <class Method>
 class PathMatcherBuilder;  // required for PathMatcher constructor
+template <class Method>
+class PathMatcherUpdate;  // required for PathMatcher::Update
 
 // The immutable, thread safe PathMatcher stores a mapping from a combination of
 // a service (host) name and a HTTP path to your method (MethodInfo*). It is
@@ -50,49 +66,248 @@ class PathMatcherBuilder;  // required for PathMatcher constructor
 //      MethodInfo * method = matcher.Lookup(service_name, http_method,
 //                                           url_path);
 //      if (method == nullptr)  failed to find it.
+// 3) changing the routes of running servers:
+//     PathMatcherHandle<MethodInfo*> handle(builder.Build());
+//     PathMatcherUpdate<MethodInfo*> update;
+//     update.Unregister(http_method, url_path);
+//     update.Register(http_method, url_path, body_field_path, data);
+//     handle.Update(update);
+//   and in the request threads:
+//     MethodInfo * method = handle.Get()->Lookup(http_method, url_path);
 //
 template <class Method>
 class PathMatcher {
  public:
   ~PathMatcher(){};
 
-  Method Lookup(const std::string& http_method, const std::string& path,
-                const std::string& query_params,
+  // The lookup works on views into the given strings and doesn't allocate
+  // except for the returned variable bindings and body field path (and the
+  // entries added to the lookup cache if it's enabled).
+  Method Lookup(absl::string_view http_method, absl::string_view path,
+                absl::string_view query_params,
                 std::vector<VariableBinding>* variable_bindings,
                 std::string* body_field_path) const;
 
-  Method Lookup(const std::string& http_method, const std::string& path) const;
+  Method Lookup(absl::string_view http_method, absl::string_view path) const;
+
+  // Returns the counters of the lookup cache. They are all zero if the cache
+  // is not enabled, see PathMatcherBuilder::SetLookupCache().
+  PathMatcherLookupCache::Stats GetLookupCacheStats() const;
+
+  // Returns a new version of this PathMatcher with the changes of the update
+  // applied in order. The new version shares the trie nodes and the method
+  // data not affected by the changes with this one, which remains unchanged.
+  // Returns nullptr if the builder was set to fail the registration of
+  // duplicates and a change registers a duplicate.
+  std::unique_ptr<PathMatcher> Update(
+      const PathMatcherUpdate<Method>& update) const;
+
+  // The version of the routes, 1 for a PathMatcher built by a
+  // PathMatcherBuilder and incremented by each Update().
+  uint64_t version() const { return version_; }
+
+  // Writes the routes and the settings to a kPathMatcherSection of the
+  // snapshot. method_name returns the name to find the method by when the
+  // snapshot is loaded.
+  void WriteSnapshot(
+      const std::function<std::string(const Method&)>& method_name,
+      SnapshotWriter* writer) const;
+
+  // Loads a PathMatcher written by WriteSnapshot(). find_method returns the
+  // method by its name. The compiled trie is used in place in the snapshot, so
+  // no templates are parsed and no trie is built.
+  static absl::StatusOr<std::unique_ptr<PathMatcher>> LoadSnapshot(
+      const Snapshot& snapshot,
+      const std::function<absl::StatusOr<Method>(absl::string_view)>&
+          find_method);
 
  private:
+  // Creates an empty Path Matcher to load a snapshot into.
+  PathMatcher();
+
   // Creates a Path Matcher with a Builder by moving the builder's root node.
   explicit PathMatcher(PathMatcherBuilder<Method>&& builder);
 
-  // A root node shared by all services, i.e. paths of all services will be
-  // registered to this node.
-  std::unique_ptr<PathMatcherNode> root_ptr_;
-  // Holds the set of custom verbs found in configured templates.
-  std::unordered_set<std::string> custom_verbs_;
   // Data we store per each registered method
   struct MethodData {
     Method method;
     std::vector<HttpTemplate::Variable> variables;
     std::string body_field_path;
-    std::unordered_set<std::string> system_query_parameter_names;
+    absl::flat_hash_set<std::string> system_query_parameter_names;
   };
+
+  // Creates the MethodData of a registration.
+  static std::shared_ptr<MethodData> NewMethodData(
+      HttpTemplate* ht, const std::string& body_field_path,
+      const std::unordered_set<std::string>& system_query_parameter_names,
+      Method method);
+
+  // Creates the next version of base with the given routes. changed_routes
+  // holds the templates registered or unregistered since base.
+  PathMatcher(const PathMatcher& base,
+              std::shared_ptr<const PathMatcherNode> root,
+              absl::flat_hash_map<std::string, int> custom_verbs,
+              std::vector<std::shared_ptr<MethodData>> methods,
+              std::unique_ptr<PathMatcherNode> changed_routes);
+
+  // Splits the path into parts and looks up the method registered for the
+  // http_method and the parts. Returns nullptr if no method or more than one
+  // method is registered.
+  const MethodData* LookupMethodData(
+      absl::string_view http_method, absl::string_view path,
+      PathMatcherNode::RequestPathParts* parts) const;
+
+  // Returns the cached lookup result for the http_method and the path, looking
+  // it up and caching it on a miss. Returns nullptr if no method is found.
+  std::shared_ptr<const PathMatcherLookupCache::Entry> LookupCached(
+      absl::string_view http_method, absl::string_view path) const;
+
+  // Returns whether the path matches a template changed since the previous
+  // version, so that its lookup result may have changed too.
+  bool MatchesChangedRoute(absl::string_view http_method,
+                           absl::string_view path) const;
+
+  // The trie of the paths of all services, kept to create the next versions.
+  // nullptr if loaded from a snapshot, then it's decompiled from trie_.
+  std::shared_ptr<const PathMatcherNode> root_;
+  // The trie compiled from root_ for the lookups. Its blocks are shared with
+  // the previous and the next versions.
+  std::shared_ptr<const PathMatcherTrie> trie_;
+  // Holds the custom verbs found in configured templates along with the number
+  // of templates with each of them.
+  absl::flat_hash_map<std::string, int> custom_verbs_;
   // The info associated with each method. The path matcher nodes
   // will hold pointers to MethodData objects in this vector.
-  std::vector<std::unique_ptr<MethodData>> methods_;
+  std::vector<std::shared_ptr<MethodData>> methods_;
   UrlUnescapeSpec path_unescape_spec_;
   bool query_param_unescape_plus_;
   bool match_unregistered_custom_verb_;
+  bool fail_registration_on_duplicate_;
+  size_t lookup_cache_capacity_;
+  size_t lookup_cache_shards_;
+  // The cache of the lookup results, nullptr if not enabled.
+  std::shared_ptr<PathMatcherLookupCache> cache_;
+  // The cache of the previous version and the templates changed since. The
+  // entries of the paths that don't match any of the changed templates are
+  // carried over to cache_ when they are first looked up. nullptr if there is
+  // no previous version or if the changes also changed the custom verbs, which
+  // the splitting of the paths depends on.
+  std::shared_ptr<const PathMatcherLookupCache> previous_cache_;
+  std::unique_ptr<const PathMatcherNode> changed_routes_;
+  uint64_t version_;
 
  private:
   friend class PathMatcherBuilder<Method>;
+  friend class PathMatcherUpdate<Method>;
 };
 
 template <class Method>
 using PathMatcherPtr = std::unique_ptr<PathMatcher<Method>>;
 
+// PathMatcherUpdate is a batch of route changes to create a new version of a
+// PathMatcher with PathMatcher::Update() or PathMatcherHandle::Update().
+// The templates are parsed when the changes are added, so an update can be
+// prepared ahead of applying it.
+//
+// The PathMatcherUpdate itself is NOT THREAD SAFE.
+template <class Method>
+class PathMatcherUpdate {
+ public:
+  PathMatcherUpdate() {}
+  ~PathMatcherUpdate() {}
+
+  // Registers a method, see PathMatcherBuilder::Register(). A template
+  // registered again without unregistering it first is a duplicate.
+  // Returns false if path is an invalid http template.
+  bool Register(
+      const std::string& http_method, const std::string& path,
+      const std::string& body_field_path,
+      const std::unordered_set<std::string>& system_query_parameter_names,
+      Method method);
+  bool Register(const std::string& http_method, const std::string& path,
+                const std::string& body_field_path, Method method);
+
+  // Unregisters the method registered for the http_method and the path, if
+  // any. The template is matched as registered, e.g. "/a/{x}" also unregisters
+  // "/a/{y}". Returns false if path is an invalid http template.
+  bool Unregister(const std::string& http_method, const std::string& path);
+
+ private:
+  typedef typename PathMatcher<Method>::MethodData MethodData;
+
+  struct Change {
+    // The `http_method + verb` key of the template.
+    std::string http_method;
+    std::string verb;
+    PathMatcherNode::PathInfo path_info;
+    // nullptr for Unregister().
+    std::shared_ptr<MethodData> method_data;
+  };
+
+  std::vector<Change> changes_;
+
+  friend class PathMatcher<Method>;
+};
+
+// PathMatcherHandle publishes the current version of a PathMatcher to the
+// threads doing the lookups. A new version, created by Update() or built from
+// scratch, replaces the current one for the following Get() calls, while the
+// threads that got the previous version keep using it until they drop it.
+//
+// The current version is a shared pointer guarded by a reader-writer lock.
+// Get() holds the lock shared only while it copies the pointer, so the lookups
+// don't wait for each other, and Publish() holds it exclusively only while it
+// swaps the pointer, not while a new version is created. The replaced version
+// is destroyed by the last thread that drops it, outside of the lock.
+//
+// Thread safe.
+template <class Method>
+class PathMatcherHandle {
+ public:
+  explicit PathMatcherHandle(PathMatcherPtr<Method> matcher)
+      : current_(std::move(matcher)) {}
+  ~PathMatcherHandle() {}
+
+  // Returns the current version.
+  std::shared_ptr<const PathMatcher<Method>> Get() const {
+    absl::ReaderMutexLock lock(&mu_);
+    return current_;
+  }
+
+  // Makes the matcher the current version.
+  void Publish(PathMatcherPtr<Method> matcher) {
+    std::shared_ptr<const PathMatcher<Method>> previous(std::move(matcher));
+    {
+      absl::MutexLock lock(&mu_);
+      current_.swap(previous);
+    }
+    // The previous version is released here, unless other threads still use
+    // it.
+  }
+
+  // Applies the update to the current version and publishes the result.
+  // Concurrent updates are applied one after the other. Returns false and
+  // keeps the current version if the update fails.
+  bool Update(const PathMatcherUpdate<Method>& update) {
+    absl::MutexLock lock(&update_mu_);
+    PathMatcherPtr<Method> next = Get()->Update(update);
+    if (next == nullptr) {
+      return false;
+    }
+    Publish(std::move(next));
+    return true;
+  }
+
+ private:
+  mutable absl::Mutex mu_;
+  std::shared_ptr<const PathMatcher<Method>> current_ ABSL_GUARDED_BY(mu_);
+  // Serializes the updates so that none of them is lost. Acquired before mu_.
+  absl::Mutex update_mu_;
+
+  PathMatcherHandle(const PathMatcherHandle&) = delete;
+  PathMatcherHandle& operator=(const PathMatcherHandle&) = delete;
+};
+
 // This PathMatcherBuilder is used to register path-WrapperGraph pairs and
 // instantiate an immutable, thread safe PathMatcher.
 //
@@ -140,31 +355,44 @@ class PathMatcherBuilder {
     fail_registration_on_duplicate_ = fail_registration_on_duplicate;
   }
 
+  // Enables caching the lookup results of up to capacity distinct
+  // (http method, path) pairs, split over num_shards independently locked
+  // shards. The cache pays off when a small set of paths makes up most of the
+  // requests. Only successful lookups are cached; the query parameters are
+  // still parsed on every lookup. Disabled by default.
+  void SetLookupCache(size_t capacity, size_t num_shards = 16) {
+    lookup_cache_capacity_ = capacity;
+    lookup_cache_shards_ = num_shards;
+  }
+
   // Returns a unique_ptr to a thread safe PathMatcher that contains all
   // registered path-WrapperGraph pairs. Note the PathMatchBuilder instance
   // will be moved so cannot use after invoking Build().
   PathMatcherPtr<Method> Build();
 
  private:
-  // Inserts a path to a PathMatcherNode.
+  // Inserts a path to a PathMatcherNode. Sets *inserted to whether the path
+  // wasn't registered yet.
   bool InsertPathToNode(const PathMatcherNode::PathInfo& path,
                         void* method_data, std::string http_method,
-                        PathMatcherNode* root_ptr);
+                        PathMatcherNode* root_ptr, bool* inserted);
   // A root node shared by all services, i.e. paths of all services will be
   // registered to this node.
-  std::unique_ptr<PathMatcherNode> root_ptr_;
-  // The set of custom verbs configured.
+  std::shared_ptr<PathMatcherNode> root_ptr_;
+  // The custom verbs configured along with the number of templates with each.
   // TODO: Perhaps this should not be at this level because there will
   // be multiple templates in different services on a server. Consider moving
   // this to PathMatcherNode.
-  std::unordered_set<std::string> custom_verbs_;
+  absl::flat_hash_map<std::string, int> custom_verbs_;
   typedef typename PathMatcher<Method>::MethodData MethodData;
-  std::vector<std::unique_ptr<MethodData>> methods_;
+  std::vector<std::shared_ptr<MethodData>> methods_;
   UrlUnescapeSpec path_unescape_spec_ =
       UrlUnescapeSpec::kAllCharactersExceptReserved;
   bool query_param_unescape_plus_ = false;
   bool match_unregistered_custom_verb_ = false;
   bool fail_registration_on_duplicate_ = false;
+  size_t lookup_cache_capacity_ = 0;
+  size_t lookup_cache_shards_ = 0;
 
   friend class PathMatcher<Method>;
 };
@@ -172,7 +400,7 @@ class PathMatcherBuilder {
 namespace {
 
 void ExtractBindingsFromPath(const std::vector<HttpTemplate::Variable>& vars,
-                             const std::vector<std::string>& parts,
+                             const PathMatcherNode::RequestPathParts& parts,
                              UrlUnescapeSpec unescape_spec,
                              std::vector<VariableBinding>* bindings) {
   for (const auto& var : vars) {
@@ -184,43 +412,50 @@ void ExtractBindingsFromPath(const std::vector<HttpTemplate::Variable>& vars,
     VariableBinding binding;
     binding.field_path = var.field_path;
     // Calculate the absolute index of the ending segment in case it's negative.
-    size_t end_segment = (var.end_segment >= 0)
-                             ? var.end_segment
-                             : parts.size() + var.end_segment + 1;
+    // The range is clamped to the parts, as the variables loaded from a
+    // snapshot don't come from the template the path matched.
+    const int64_t end = (var.end_segment >= 0)
+                            ? var.end_segment
+                            : static_cast<int64_t>(parts.size()) +
+                                  var.end_segment + 1;
+    const size_t end_segment =
+        std::min(static_cast<size_t>(std::max<int64_t>(end, 0)), parts.size());
+    const size_t start_segment = std::min(
+        static_cast<size_t>(std::max(var.start_segment, 0)), end_segment);
     // It is multi-part match if we have more than one segment. We also make
     // sure that a single URL segment match with ** is also considered a
     // multi-part match by checking if it->second.end_segment is negative.
     bool is_multipart =
-        (end_segment - var.start_segment) > 1 || var.end_segment < 0;
+        (end_segment - start_segment) > 1 || var.end_segment < 0;
     const UrlUnescapeSpec var_unescape_spec =
         is_multipart ? unescape_spec : UrlUnescapeSpec::kAllCharacters;
 
     // Joins parts with "/"  to form a path string.
-    for (size_t i = var.start_segment; i < end_segment; ++i) {
-      // For multipart matches only unescape non-reserved characters.
-      binding.value += UrlUnescapeString(parts[i], var_unescape_spec, false);
+    for (size_t i = start_segment; i < end_segment; ++i) {
+      // For multipart matches only unescape non-reserved characters. The
+      // parts are unescaped in place, without a temporary string.
+      UrlUnescapeAppend(parts[i], var_unescape_spec, false, &binding.value);
       if (i < end_segment - 1) {
         binding.value += "/";
       }
     }
-    bindings->emplace_back(binding);
+    bindings->emplace_back(std::move(binding));
   }
 }
 
 void ExtractBindingsFromQueryParameters(
-    const std::string& query_params,
-    const std::unordered_set<std::string>& system_params,
+    absl::string_view query_params,
+    const absl::flat_hash_set<std::string>& system_params,
     bool query_param_unescape_plus, std::vector<VariableBinding>* bindings) {
   // The bindings in URL the query parameters have the following form:
   //      <field_path1>=value1&<field_path2>=value2&...&<field_pathN>=valueN
   // Query parameters may also contain system parameters such as `api_key`.
   // We'll need to ignore these. Example:
   //      book.id=123&book.author=Neal%20Stephenson&api_key=AIzaSyAz7fhBkC35D2M
-  std::vector<std::string> params = absl::StrSplit(query_params, '&');
-  for (const auto& param : params) {
+  for (absl::string_view param : absl::StrSplit(query_params, '&')) {
     size_t pos = param.find('=');
-    if (pos != 0 && pos != std::string::npos) {
-      auto name = param.substr(0, pos);
+    if (pos != 0 && pos != absl::string_view::npos) {
+      absl::string_view name = param.substr(0, pos);
       // Make sure the query parameter is not a system parameter (e.g.
       // `api_key`) before adding the binding.
       if (system_params.find(name) == std::end(system_params)) {
@@ -229,9 +464,9 @@ void ExtractBindingsFromQueryParameters(
         // in the request, e.g. `book.author.name`.
         VariableBinding binding;
         binding.field_path = absl::StrSplit(name, '.');
-        binding.value = UrlUnescapeString(param.substr(pos + 1),
-                                          UrlUnescapeSpec::kAllCharacters,
-                                          query_param_unescape_plus);
+        UrlUnescapeAppend(param.substr(pos + 1),
+                          UrlUnescapeSpec::kAllCharacters,
+                          query_param_unescape_plus, &binding.value);
         bindings->emplace_back(std::move(binding));
       }
     }
@@ -240,18 +475,20 @@ void ExtractBindingsFromQueryParameters(
 
 // Converts a request path into a format that can be used to perform a request
 // lookup in the PathMatcher trie. This utility method sanitizes the request
-// path and then splits the path into slash separated parts. Returns an empty
-// vector if the sanitized path is "/".
+// path and then splits the path into slash separated parts. The parts are empty
+// if the sanitized path is "/". The parts and the verb point into path.
 //
-// custom_verbs is a set of configured custom verbs that are used to match
+// custom_verbs holds the configured custom verbs that are used to match
 // against any custom verbs in request path. If the request_path contains a
 // custom verb not found in custom_verbs, it is treated as a part of the path.
 //
 // - Strips off query string: "/a?foo=bar" --> "/a"
 // - Collapses extra slashes: "///" --> "/"
-std::vector<std::string> ExtractRequestParts(
-    std::string path, const std::unordered_set<std::string>& custom_verbs,
-    std::string& verb, bool match_unregistered_custom_verb) {
+void ExtractRequestParts(
+    absl::string_view path,
+    const absl::flat_hash_map<std::string, int>& custom_verbs,
+    bool match_unregistered_custom_verb, absl::string_view* verb,
+    PathMatcherNode::RequestPathParts* parts) {
   // Remove query parameters.
   path = path.substr(0, path.find_first_of('?'));
 
@@ -259,35 +496,28 @@ std::vector<std::string> ExtractRequestParts(
   // But not for /foo:bar/const.
   std::size_t last_colon_pos = path.find_last_of(':');
   std::size_t last_slash_pos = path.find_last_of('/');
-  if (last_colon_pos != std::string::npos && last_colon_pos > last_slash_pos) {
-    std::string tmp_verb = path.substr(last_colon_pos + 1);
+  if (last_colon_pos != absl::string_view::npos &&
+      last_colon_pos > last_slash_pos) {
+    absl::string_view tmp_verb = path.substr(last_colon_pos + 1);
     // Only when chek_unregistered_custom_verb=true or the verb is in the
     // configured custom verbs, treat it as verb
     if (match_unregistered_custom_verb ||
         custom_verbs.find(tmp_verb) != custom_verbs.end()) {
-      verb = tmp_verb;
+      *verb = tmp_verb;
       path = path.substr(0, last_colon_pos);
     }
   }
 
-  std::vector<std::string> result;
+  parts->clear();
   if (path.size() > 0) {
-    result = absl::StrSplit(path.substr(1), '/');
+    for (absl::string_view part : absl::StrSplit(path.substr(1), '/')) {
+      parts->push_back(part);
+    }
   }
   // Removes all trailing empty parts caused by extra "/".
-  while (!result.empty() && (*(--result.end())).empty()) {
-    result.pop_back();
+  while (!parts->empty() && parts->back().empty()) {
+    parts->pop_back();
   }
-  return result;
-}
-
-// Looks up on a PathMatcherNode.
-PathMatcherLookupResult LookupInPathMatcherNode(
-    const PathMatcherNode& root, const std::vector<std::string>& parts,
-    const HttpMethod& http_method) {
-  PathMatcherLookupResult result;
-  root.LookupPath(parts.begin(), parts.end(), http_method, &result);
-  return result;
 }
 
 PathMatcherNode::PathInfo TransformHttpTemplate(const HttpTemplate& ht) {
@@ -304,49 +534,192 @@ PathMatcherNode::PathInfo TransformHttpTemplate(const HttpTemplate& ht) {
 
 template <class Method>
 PathMatcher<Method>::PathMatcher(PathMatcherBuilder<Method>&& builder)
-    : root_ptr_(std::move(builder.root_ptr_)),
+    : root_(std::move(builder.root_ptr_)),
+      trie_(PathMatcherTrie::Compile(root_, nullptr)),
       custom_verbs_(std::move(builder.custom_verbs_)),
       methods_(std::move(builder.methods_)),
       path_unescape_spec_(builder.path_unescape_spec_),
       query_param_unescape_plus_(builder.query_param_unescape_plus_),
-      match_unregistered_custom_verb_(builder.match_unregistered_custom_verb_) {
+      match_unregistered_custom_verb_(builder.match_unregistered_custom_verb_),
+      fail_registration_on_duplicate_(builder.fail_registration_on_duplicate_),
+      lookup_cache_capacity_(builder.lookup_cache_capacity_),
+      lookup_cache_shards_(builder.lookup_cache_shards_),
+      version_(1) {
+  if (lookup_cache_capacity_ > 0) {
+    cache_.reset(new PathMatcherLookupCache(lookup_cache_capacity_,
+                                            lookup_cache_shards_));
+  }
 }
 
-// Lookup is a wrapper method for the recursive node Lookup. First, the wrapper
-// splits the request path into slash-separated path parts. Next, the method
-// checks that the |http_method| is supported. If not, then it returns an empty
-// WrapperGraph::SharedPtr. Next, this method invokes the node's Lookup on
-// the extracted |parts|. Finally, it fills the mapping from variables to their
-// values parsed from the path.
-// TODO: cache results by adding get/put methods here (if profiling reveals
-// benefit)
+// Only the blocks of the trie with nodes on the changed paths are compiled, the
+// others are shared with base. The entries of base's lookup cache are carried
+// over lazily by LookupCached().
 template <class Method>
-Method PathMatcher<Method>::Lookup(
-    const std::string& http_method, const std::string& path,
-    const std::string& query_params,
-    std::vector<VariableBinding>* variable_bindings,
-    std::string* body_field_path) const {
-  std::string verb;
-  const std::vector<std::string> parts = ExtractRequestParts(
-      path, custom_verbs_, verb, match_unregistered_custom_verb_);
+PathMatcher<Method>::PathMatcher(
+    const PathMatcher& base, std::shared_ptr<const PathMatcherNode> root,
+    absl::flat_hash_map<std::string, int> custom_verbs,
+    std::vector<std::shared_ptr<MethodData>> methods,
+    std::unique_ptr<PathMatcherNode> changed_routes)
+    : root_(std::move(root)),
+      trie_(PathMatcherTrie::Compile(root_, base.trie_)),
+      custom_verbs_(std::move(custom_verbs)),
+      methods_(std::move(methods)),
+      path_unescape_spec_(base.path_unescape_spec_),
+      query_param_unescape_plus_(base.query_param_unescape_plus_),
+      match_unregistered_custom_verb_(base.match_unregistered_custom_verb_),
+      fail_registration_on_duplicate_(base.fail_registration_on_duplicate_),
+      lookup_cache_capacity_(base.lookup_cache_capacity_),
+      lookup_cache_shards_(base.lookup_cache_shards_),
+      version_(base.version_ + 1) {
+  if (lookup_cache_capacity_ > 0) {
+    cache_.reset(new PathMatcherLookupCache(lookup_cache_capacity_,
+                                            lookup_cache_shards_));
+  }
+  bool same_custom_verbs = custom_verbs_.size() == base.custom_verbs_.size();
+  for (const auto& verb : base.custom_verbs_) {
+    same_custom_verbs = same_custom_verbs && custom_verbs_.contains(verb.first);
+  }
+  if (cache_ != nullptr && base.cache_ != nullptr && same_custom_verbs) {
+    previous_cache_ = base.cache_;
+    changed_routes_ = std::move(changed_routes);
+  }
+}
+
+template <class Method>
+PathMatcher<Method>::PathMatcher()
+    : path_unescape_spec_(UrlUnescapeSpec::kAllCharactersExceptReserved),
+      query_param_unescape_plus_(false),
+      match_unregistered_custom_verb_(false),
+      fail_registration_on_duplicate_(false),
+      lookup_cache_capacity_(0),
+      lookup_cache_shards_(0),
+      version_(1) {}
+
+template <class Method>
+std::shared_ptr<typename PathMatcher<Method>::MethodData>
+PathMatcher<Method>::NewMethodData(
+    HttpTemplate* ht, const std::string& body_field_path,
+    const std::unordered_set<std::string>& system_query_parameter_names,
+    Method method) {
+  std::shared_ptr<MethodData> method_data(new MethodData());
+  method_data->method = method;
+  method_data->variables = std::move(ht->Variables());
+  method_data->body_field_path = body_field_path;
+  method_data->system_query_parameter_names.insert(
+      system_query_parameter_names.begin(), system_query_parameter_names.end());
+  return method_data;
+}
+
+// LookupMethodData is a wrapper method for the trie Lookup. First, the wrapper
+// splits the request path into slash-separated path parts. Next, this method
+// invokes the trie's Lookup on the extracted |parts| and the |http_method|
+// along with the custom verb of the path.
+template <class Method>
+const typename PathMatcher<Method>::MethodData*
+PathMatcher<Method>::LookupMethodData(
+    absl::string_view http_method, absl::string_view path,
+    PathMatcherNode::RequestPathParts* parts) const {
+  absl::string_view verb;
+  ExtractRequestParts(path, custom_verbs_, match_unregistered_custom_verb_,
+                      &verb, parts);
 
   // If service_name has not been registered to ESP and strict_service_matching_
   // is set to false, tries to lookup the method in all registered services.
-  if (root_ptr_ == nullptr) {
+  if (trie_ == nullptr) {
     return nullptr;
   }
 
-  PathMatcherLookupResult lookup_result =
-      LookupInPathMatcherNode(*root_ptr_, parts, http_method + verb);
+  PathMatcherLookupResult lookup_result;
+  trie_->LookupPath(*parts, RequestMethod(http_method, verb), &lookup_result);
   // Return nullptr if nothing is found or the result is marked for duplication.
   if (lookup_result.data == nullptr || lookup_result.is_multiple) {
     return nullptr;
   }
-  MethodData* method_data = reinterpret_cast<MethodData*>(lookup_result.data);
+  return reinterpret_cast<const MethodData*>(lookup_result.data);
+}
+
+// The cache is keyed on the path without the query string, which determines
+// both the matched method and the bindings of the path variables.
+template <class Method>
+std::shared_ptr<const PathMatcherLookupCache::Entry>
+PathMatcher<Method>::LookupCached(absl::string_view http_method,
+                                  absl::string_view path) const {
+  path = path.substr(0, path.find_first_of('?'));
+  std::shared_ptr<const PathMatcherLookupCache::Entry> entry =
+      cache_->Get(http_method, path);
+  if (entry != nullptr) {
+    return entry;
+  }
+  if (previous_cache_ != nullptr) {
+    // The method data of an entry for a path that doesn't match any changed
+    // template is still registered in this version, with the same bindings.
+    entry = previous_cache_->Peek(http_method, path);
+    if (entry != nullptr && !MatchesChangedRoute(http_method, path)) {
+      cache_->Put(http_method, path, entry);
+      return entry;
+    }
+  }
+  PathMatcherNode::RequestPathParts parts;
+  const MethodData* method_data = LookupMethodData(http_method, path, &parts);
+  if (method_data == nullptr) {
+    return nullptr;
+  }
+  std::shared_ptr<PathMatcherLookupCache::Entry> new_entry(
+      new PathMatcherLookupCache::Entry());
+  new_entry->method_data = method_data;
+  ExtractBindingsFromPath(method_data->variables, parts, path_unescape_spec_,
+                          &new_entry->path_bindings);
+  cache_->Put(http_method, path, new_entry);
+  return new_entry;
+}
+
+// A path can only be matched by another template, or none, if it matches one
+// of the templates registered or unregistered since the previous version.
+template <class Method>
+bool PathMatcher<Method>::MatchesChangedRoute(absl::string_view http_method,
+                                              absl::string_view path) const {
+  PathMatcherNode::RequestPathParts parts;
+  absl::string_view verb;
+  ExtractRequestParts(path, custom_verbs_, match_unregistered_custom_verb_,
+                      &verb, &parts);
+  PathMatcherLookupResult result;
+  changed_routes_->LookupPath(parts.begin(), parts.end(),
+                              RequestMethod(http_method, verb), &result);
+  return result.data != nullptr;
+}
+
+// Lookup finds the method registered for the |http_method| and the |path| and
+// fills the mapping from variables to their values parsed from the path and the
+// query parameters. If the cache is enabled, the method and the bindings of the
+// path variables come from the cache.
+template <class Method>
+Method PathMatcher<Method>::Lookup(
+    absl::string_view http_method, absl::string_view path,
+    absl::string_view query_params,
+    std::vector<VariableBinding>* variable_bindings,
+    std::string* body_field_path) const {
+  PathMatcherNode::RequestPathParts parts;
+  std::shared_ptr<const PathMatcherLookupCache::Entry> entry;
+  const MethodData* method_data = nullptr;
+  if (cache_ != nullptr) {
+    entry = LookupCached(http_method, path);
+    if (entry != nullptr) {
+      method_data = static_cast<const MethodData*>(entry->method_data);
+    }
+  } else {
+    method_data = LookupMethodData(http_method, path, &parts);
+  }
+  if (method_data == nullptr) {
+    return nullptr;
+  }
   if (variable_bindings != nullptr) {
-    variable_bindings->clear();
-    ExtractBindingsFromPath(method_data->variables, parts, path_unescape_spec_,
-                            variable_bindings);
+    if (entry != nullptr) {
+      *variable_bindings = entry->path_bindings;
+    } else {
+      variable_bindings->clear();
+      ExtractBindingsFromPath(method_data->variables, parts,
+                              path_unescape_spec_, variable_bindings);
+    }
     ExtractBindingsFromQueryParameters(
         query_params, method_data->system_query_parameter_names,
         query_param_unescape_plus_, variable_bindings);
@@ -357,30 +730,263 @@ Method PathMatcher<Method>::Lookup(
   return method_data->method;
 }
 
-// TODO: refactor common code with method above
 template <class Method>
-Method PathMatcher<Method>::Lookup(const std::string& http_method,
-                                   const std::string& path) const {
-  std::string verb;
-  const std::vector<std::string> parts = ExtractRequestParts(
-      path, custom_verbs_, verb, match_unregistered_custom_verb_);
-
-  // If service_name has not been registered to ESP and strict_service_matching_
-  // is set to false, tries to lookup the method in all registered services.
-  if (root_ptr_ == nullptr) {
-    return nullptr;
+Method PathMatcher<Method>::Lookup(absl::string_view http_method,
+                                   absl::string_view path) const {
+  if (cache_ != nullptr) {
+    std::shared_ptr<const PathMatcherLookupCache::Entry> entry =
+        LookupCached(http_method, path);
+    if (entry == nullptr) {
+      return nullptr;
+    }
+    return static_cast<const MethodData*>(entry->method_data)->method;
   }
-
-  PathMatcherLookupResult lookup_result =
-      LookupInPathMatcherNode(*root_ptr_, parts, http_method + verb);
-  // Return nullptr if nothing is found or the result is marked for duplication.
-  if (lookup_result.data == nullptr || lookup_result.is_multiple) {
+  PathMatcherNode::RequestPathParts parts;
+  const MethodData* method_data = LookupMethodData(http_method, path, &parts);
+  if (method_data == nullptr) {
     return nullptr;
   }
-  MethodData* method_data = reinterpret_cast<MethodData*>(lookup_result.data);
   return method_data->method;
 }
 
+template <class Method>
+PathMatcherLookupCache::Stats PathMatcher<Method>::GetLookupCacheStats() const {
+  if (cache_ == nullptr) {
+    return PathMatcherLookupCache::Stats{0, 0, 0, 0};
+  }
+  return cache_->GetStats();
+}
+
+// Update applies the changes to copies of the trie, which share all the nodes
+// not on the changed paths. The method data of the unregistered and replaced
+// templates is dropped from the new version.
+template <class Method>
+PathMatcherPtr<Method> PathMatcher<Method>::Update(
+    const PathMatcherUpdate<Method>& update) const {
+  std::shared_ptr<const PathMatcherNode> root =
+      root_ != nullptr ? root_ : trie_->Decompile();
+  absl::flat_hash_map<std::string, int> custom_verbs = custom_verbs_;
+  std::vector<std::shared_ptr<MethodData>> methods = methods_;
+  absl::flat_hash_set<const void*> dropped;
+  std::unique_ptr<PathMatcherNode> changed_routes(new PathMatcherNode());
+
+  for (const auto& change : update.changes_) {
+    const HttpMethod key = change.http_method + change.verb;
+    // Any non-null data marks the template as changed.
+    changed_routes->InsertPath(change.path_info, key, changed_routes.get(),
+                               false);
+    void* old_data = nullptr;
+    if (change.method_data == nullptr) {
+      root = PathMatcherNode::RemovePathCopy(root, change.path_info, key,
+                                             &old_data);
+      if (old_data != nullptr && !change.verb.empty() &&
+          --custom_verbs[change.verb] == 0) {
+        custom_verbs.erase(change.verb);
+      }
+    } else {
+      root = PathMatcherNode::InsertPathCopy(root, change.path_info, key,
+                                             change.method_data.get(), true,
+                                             &old_data);
+      if (old_data != nullptr && fail_registration_on_duplicate_) {
+        return nullptr;
+      }
+      if (old_data == nullptr && !change.verb.empty()) {
+        ++custom_verbs[change.verb];
+      }
+      methods.push_back(change.method_data);
+    }
+    if (old_data != nullptr) {
+      dropped.insert(old_data);
+    }
+  }
+
+  if (!dropped.empty()) {
+    methods.erase(std::remove_if(methods.begin(), methods.end(),
+                                 [&dropped](const std::shared_ptr<MethodData>&
+                                                method_data) {
+                                   return dropped.contains(method_data.get());
+                                 }),
+                  methods.end());
+  }
+  return PathMatcherPtr<Method>(
+      new PathMatcher<Method>(*this, std::move(root), std::move(custom_verbs),
+                              std::move(methods), std::move(changed_routes)));
+}
+
+// The section holds the settings, the custom verbs, the method data in the
+// order of the trie's data() and the trie, compiled into a single block.
+template <class Method>
+void PathMatcher<Method>::WriteSnapshot(
+    const std::function<std::string(const Method&)>& method_name,
+    SnapshotWriter* writer) const {
+  writer->BeginSection(kPathMatcherSection);
+  writer->WriteUint32(static_cast<uint32_t>(path_unescape_spec_));
+  writer->WriteUint32(query_param_unescape_plus_);
+  writer->WriteUint32(match_unregistered_custom_verb_);
+  writer->WriteUint32(fail_registration_on_duplicate_);
+  writer->WriteUint64(lookup_cache_capacity_);
+  writer->WriteUint64(lookup_cache_shards_);
+  writer->WriteUint64(version_);
+
+  writer->WriteUint64(custom_verbs_.size());
+  for (const auto& verb : custom_verbs_) {
+    writer->WriteString(verb.first);
+    writer->WriteUint32(verb.second);
+  }
+
+  std::unique_ptr<PathMatcherTrie> single_block;
+  const PathMatcherTrie* trie = trie_.get();
+  if (root_ != nullptr) {
+    single_block.reset(new PathMatcherTrie(*root_));
+    trie = single_block.get();
+  }
+
+  writer->WriteUint64(trie->data().size());
+  for (const void* data : trie->data()) {
+    const MethodData& method_data = *static_cast<const MethodData*>(data);
+    writer->WriteString(method_name(method_data.method));
+    writer->WriteUint64(method_data.variables.size());
+    for (const auto& variable : method_data.variables) {
+      writer->WriteUint32(static_cast<uint32_t>(variable.start_segment));
+      writer->WriteUint32(static_cast<uint32_t>(variable.end_segment));
+      writer->WriteUint32(variable.has_wildcard_path);
+      writer->WriteUint64(variable.field_path.size());
+      for (const auto& field : variable.field_path) {
+        writer->WriteString(field);
+      }
+    }
+    writer->WriteString(method_data.body_field_path);
+    writer->WriteUint64(method_data.system_query_parameter_names.size());
+    for (const auto& name : method_data.system_query_parameter_names) {
+      writer->WriteString(name);
+    }
+  }
+
+  trie->WriteSnapshot(writer);
+}
+
+template <class Method>
+absl::StatusOr<PathMatcherPtr<Method>> PathMatcher<Method>::LoadSnapshot(
+    const Snapshot& snapshot,
+    const std::function<absl::StatusOr<Method>(absl::string_view)>&
+        find_method) {
+  absl::StatusOr<SnapshotReader> section =
+      snapshot.Section(kPathMatcherSection);
+  if (!section.ok()) {
+    return section.status();
+  }
+  SnapshotReader& reader = *section;
+  const absl::Status malformed =
+      absl::InvalidArgumentError("Malformed path matcher snapshot.");
+
+  PathMatcherPtr<Method> matcher(new PathMatcher<Method>());
+  uint32_t path_unescape_spec, query_param_unescape_plus,
+      match_unregistered_custom_verb, fail_registration_on_duplicate;
+  uint64_t lookup_cache_capacity, lookup_cache_shards, count;
+  if (!reader.ReadUint32(&path_unescape_spec) ||
+      path_unescape_spec >
+          static_cast<uint32_t>(UrlUnescapeSpec::kAllCharacters) ||
+      !reader.ReadUint32(&query_param_unescape_plus) ||
+      !reader.ReadUint32(&match_unregistered_custom_verb) ||
+      !reader.ReadUint32(&fail_registration_on_duplicate) ||
+      !reader.ReadUint64(&lookup_cache_capacity) ||
+      !reader.ReadUint64(&lookup_cache_shards) ||
+      !reader.ReadUint64(&matcher->version_) || !reader.ReadUint64(&count)) {
+    return malformed;
+  }
+  matcher->path_unescape_spec_ =
+      static_cast<UrlUnescapeSpec>(path_unescape_spec);
+  matcher->query_param_unescape_plus_ = query_param_unescape_plus != 0;
+  matcher->match_unregistered_custom_verb_ =
+      match_unregistered_custom_verb != 0;
+  matcher->fail_registration_on_duplicate_ =
+      fail_registration_on_duplicate != 0;
+  matcher->lookup_cache_capacity_ = lookup_cache_capacity;
+  matcher->lookup_cache_shards_ = lookup_cache_shards;
+
+  for (uint64_t i = 0; i < count; ++i) {
+    absl::string_view verb;
+    uint32_t templates;
+    if (!reader.ReadString(&verb) || !reader.ReadUint32(&templates)) {
+      return malformed;
+    }
+    matcher->custom_verbs_[verb] = templates;
+  }
+
+  if (!reader.ReadUint64(&count)) {
+    return malformed;
+  }
+  std::vector<void*> data;
+  for (uint64_t i = 0; i < count; ++i) {
+    std::shared_ptr<MethodData> method_data(new MethodData());
+    absl::string_view name;
+    uint64_t variables;
+    if (!reader.ReadString(&name) || !reader.ReadUint64(&variables)) {
+      return malformed;
+    }
+    absl::StatusOr<Method> method = find_method(name);
+    if (!method.ok()) {
+      return method.status();
+    }
+    method_data->method = *method;
+    for (uint64_t v = 0; v < variables; ++v) {
+      HttpTemplate::Variable variable;
+      uint32_t start_segment, end_segment, has_wildcard_path;
+      uint64_t fields;
+      if (!reader.ReadUint32(&start_segment) ||
+          !reader.ReadUint32(&end_segment) ||
+          !reader.ReadUint32(&has_wildcard_path) ||
+          !reader.ReadUint64(&fields)) {
+        return malformed;
+      }
+      variable.start_segment = static_cast<int32_t>(start_segment);
+      variable.end_segment = static_cast<int32_t>(end_segment);
+      // A negative end_segment is relative to the end of the path.
+      if (variable.start_segment < 0 ||
+          (variable.end_segment >= 0 &&
+           variable.end_segment < variable.start_segment)) {
+        return malformed;
+      }
+      variable.has_wildcard_path = has_wildcard_path != 0;
+      for (uint64_t f = 0; f < fields; ++f) {
+        absl::string_view field;
+        if (!reader.ReadString(&field)) {
+          return malformed;
+        }
+        variable.field_path.emplace_back(field);
+      }
+      method_data->variables.push_back(std::move(variable));
+    }
+    absl::string_view body_field_path;
+    uint64_t system_params;
+    if (!reader.ReadString(&body_field_path) ||
+        !reader.ReadUint64(&system_params)) {
+      return malformed;
+    }
+    method_data->body_field_path = std::string(body_field_path);
+    for (uint64_t p = 0; p < system_params; ++p) {
+      absl::string_view param;
+      if (!reader.ReadString(&param)) {
+        return malformed;
+      }
+      method_data->system_query_parameter_names.emplace(param);
+    }
+    data.push_back(method_data.get());
+    matcher->methods_.push_back(std::move(method_data));
+  }
+
+  matcher->trie_ = PathMatcherTrie::ReadSnapshot(&reader, std::move(data),
+                                                 snapshot.storage());
+  if (matcher->trie_ == nullptr) {
+    return malformed;
+  }
+  if (matcher->lookup_cache_capacity_ > 0) {
+    matcher->cache_.reset(new PathMatcherLookupCache(
+        matcher->lookup_cache_capacity_, matcher->lookup_cache_shards_));
+  }
+  return matcher;
+}
+
 // Initializes the builder with a root Path Segment
 template <class Method>
 PathMatcherBuilder<Method>::PathMatcherBuilder()
@@ -394,8 +1000,9 @@ PathMatcherPtr<Method> PathMatcherBuilder<Method>::Build() {
 template <class Method>
 bool PathMatcherBuilder<Method>::InsertPathToNode(
     const PathMatcherNode::PathInfo& path, void* method_data,
-    std::string http_method, PathMatcherNode* root_ptr) {
-  if (!root_ptr->InsertPath(path, http_method, method_data, true)) {
+    std::string http_method, PathMatcherNode* root_ptr, bool* inserted) {
+  *inserted = root_ptr->InsertPath(path, http_method, method_data, true);
+  if (!*inserted) {
     if (fail_registration_on_duplicate_) {
       return false;
     }
@@ -419,20 +1026,18 @@ bool PathMatcherBuilder<Method>::Register(
 
   // Create & initialize a MethodData struct. Then insert its pointer
   // into the path matcher trie.
-  auto method_data = std::unique_ptr<MethodData>(new MethodData());
-  method_data->method = method;
-  method_data->variables = std::move(ht->Variables());
-  method_data->body_field_path = body_field_path;
-  method_data->system_query_parameter_names = system_query_parameter_names;
+  std::shared_ptr<MethodData> method_data = PathMatcher<Method>::NewMethodData(
+      ht.get(), body_field_path, system_query_parameter_names, method);
 
+  bool inserted = false;
   if (!InsertPathToNode(path_info, method_data.get(), http_method + ht->verb(),
-                        root_ptr_.get())) {
+                        root_ptr_.get(), &inserted)) {
     return false;
   }
   // Add the method_data to the methods_ vector for cleanup
   methods_.emplace_back(std::move(method_data));
-  if (!ht->verb().empty()) {
-    custom_verbs_.insert(ht->verb());
+  if (inserted && !ht->verb().empty()) {
+    ++custom_verbs_[ht->verb()];
   }
   return true;
 }
@@ -446,6 +1051,44 @@ bool PathMatcherBuilder<Method>::Register(const std::string& http_method,
                   std::unordered_set<std::string>(), method);
 }
 
+template <class Method>
+bool PathMatcherUpdate<Method>::Register(
+    const std::string& http_method, const std::string& http_template,
+    const std::string& body_field_path,
+    const std::unordered_set<std::string>& system_query_parameter_names,
+    Method method) {
+  std::unique_ptr<HttpTemplate> ht(HttpTemplate::Parse(http_template));
+  if (nullptr == ht) {
+    return false;
+  }
+  changes_.push_back(Change{
+      http_method, ht->verb(), TransformHttpTemplate(*ht),
+      PathMatcher<Method>::NewMethodData(
+          ht.get(), body_field_path, system_query_parameter_names, method)});
+  return true;
+}
+
+template <class Method>
+bool PathMatcherUpdate<Method>::Register(const std::string& http_method,
+                                         const std::string& http_template,
+                                         const std::string& body_field_path,
+                                         Method method) {
+  return Register(http_method, http_template, body_field_path,
+                  std::unordered_set<std::string>(), method);
+}
+
+template <class Method>
+bool PathMatcherUpdate<Method>::Unregister(const std::string& http_method,
+                                           const std::string& http_template) {
+  std::unique_ptr<HttpTemplate> ht(HttpTemplate::Parse(http_template));
+  if (nullptr == ht) {
+    return false;
+  }
+  changes_.push_back(
+      Change{http_method, ht->verb(), TransformHttpTemplate(*ht), nullptr});
+  return true;
+}
+
 }  // namespace transcoding
 }  // namespace grpc
 }  // namespace google
@@ -0,0 +1,106 @@
+/* Copyright 2016 Google Inc. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef GRPC_TRANSCODING_PATH_MATCHER_CACHE_H_
+#define GRPC_TRANSCODING_PATH_MATCHER_CACHE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "absl/strings/string_view.h"
+#include "http_template.h"
+
+namespace google {
+namespace grpc {
+namespace transcoding {
+
+// PathMatcherLookupCache is a bounded cache of PathMatcher lookup results keyed
+// on the HTTP method and the request path (without the query string). An entry
+// holds the matched method data and the variable bindings extracted from the
+// path, so a hit skips both the trie lookup and the unescaping of the path.
+//
+// The cache is split into shards, each with its own mutex, so that concurrent
+// lookups of different paths rarely contend for the same lock. A hit only
+// takes the shard's lock shared and sets the entry's reference bit, so that
+// concurrent hits of the same hot path don't serialize. The eviction order is
+// maintained on insertion only: the shard evicts with the CLOCK algorithm, an
+// approximation of least-recently-used that gives the entries hit since the
+// last sweep a second chance.
+//
+// Thread safe.
+class PathMatcherLookupCache {
+ public:
+  // A cached lookup result. Entries are immutable and shared, so a hit only
+  // copies a pointer while holding the shard's lock shared.
+  struct Entry {
+    // The PathMatcher's data of the matched method.
+    const void* method_data;
+    // The bindings of the path variables.
+    std::vector<VariableBinding> path_bindings;
+  };
+
+  struct Stats {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+    // The number of entries in the cache.
+    size_t size;
+  };
+
+  // Creates a cache holding at most about capacity entries split over
+  // num_shards shards. Both are rounded up to at least 1.
+  PathMatcherLookupCache(size_t capacity, size_t num_shards);
+  ~PathMatcherLookupCache();
+
+  // Returns the entry cached for the key and marks it as recently used.
+  // Returns nullptr on a miss.
+  std::shared_ptr<const Entry> Get(absl::string_view http_method,
+                                   absl::string_view path);
+
+  // Returns the entry cached for the key like Get(), but without counting the
+  // hit or the miss nor marking the entry as used.
+  std::shared_ptr<const Entry> Peek(absl::string_view http_method,
+                                    absl::string_view path) const;
+
+  // Caches the entry for the key, evicting an entry of the shard not used
+  // recently if it is full. Replaces an existing entry for the key.
+  void Put(absl::string_view http_method, absl::string_view path,
+           std::shared_ptr<const Entry> entry);
+
+  // Returns the counters summed over all the shards.
+  Stats GetStats() const;
+
+ private:
+  // The key is the HTTP method and the path.
+  typedef std::pair<absl::string_view, absl::string_view> KeyView;
+  struct Shard;
+
+  Shard& ShardFor(const KeyView& key) const;
+
+  size_t shard_capacity_;
+  size_t num_shards_;
+  std::unique_ptr<Shard[]> shards_;
+
+  PathMatcherLookupCache(const PathMatcherLookupCache&) = delete;
+  PathMatcherLookupCache& operator=(const PathMatcherLookupCache&) = delete;
+};
+
+}  // namespace transcoding
+}  // namespace grpc
+}  // namespace google
+
+#endif  // GRPC_TRANSCODING_PATH_MATCHER_CACHE_H_
@@ -15,18 +15,36 @@
 #ifndef GRPC_TRANSCODING_PATH_MATCHER_NODE_H_
 #define GRPC_TRANSCODING_PATH_MATCHER_NODE_H_
 
+#include <functional>
 #include <map>
 #include <memory>
 #include <string>
-#include <unordered_map>
 #include <vector>
 
+#include "absl/container/flat_hash_map.h"
+#include "absl/container/inlined_vector.h"
+#include "absl/strings/string_view.h"
+
 namespace google {
 namespace grpc {
 namespace transcoding {
 
 typedef std::string HttpMethod;
 
+// The HTTP method key that matches any HTTP method.
+extern const char HttpMethod_WILD_CARD[];
+
+// The HTTP method of a request along with its custom verb (if any). A request
+// matches a template registered with the `http_method + verb` key, which is
+// compared piecewise so that the lookup doesn't need to concatenate them.
+struct RequestMethod {
+  RequestMethod(absl::string_view http_method, absl::string_view verb)
+      : http_method(http_method), verb(verb) {}
+
+  absl::string_view http_method;
+  absl::string_view verb;
+};
+
 struct PathMatcherLookupResult {
   PathMatcherLookupResult() : data(nullptr), is_multiple(false) {}
 
@@ -43,6 +61,10 @@ struct PathMatcherLookupResult {
 // represent adjacent path parts. A node can have many literal children, one
 // single-parameter child, and one repeated-parameter child.
 //
+// The children are shared, so that the versions of a trie created by
+// InsertPathCopy() and RemovePathCopy() can share all the nodes not on the
+// changed path. The nodes reachable from such a version must not be modified.
+//
 // Thread Compatible.
 class PathMatcherNode {
  public:
@@ -109,7 +131,9 @@ class PathMatcherNode {
     std::vector<std::string> path_;
   };  // class PathInfo
 
-  typedef std::vector<std::string> RequestPathParts;
+  // The request path parts point into the request path. Most request paths
+  // have few enough parts to not need a heap allocation.
+  typedef absl::InlinedVector<absl::string_view, 16> RequestPathParts;
 
   // Creates a Root node with an empty WrapperGraph map.
   PathMatcherNode() : result_map_(), children_(), wildcard_(false) {}
@@ -126,7 +150,7 @@ class PathMatcherNode {
   // VariableBindingInfoMap to the result pointers.
   void LookupPath(const RequestPathParts::const_iterator current,
                   const RequestPathParts::const_iterator end,
-                  HttpMethod http_method,
+                  const RequestMethod& http_method,
                   PathMatcherLookupResult* result) const;
 
   // This method inserts a path of nodes into this subtrie. The WrapperGraph,
@@ -138,9 +162,31 @@ class PathMatcherNode {
   bool InsertPath(const PathInfo& node_path_info, std::string http_method,
                   void* method_data, bool mark_duplicates);
 
+  // Returns a new version of the trie rooted at root with the path inserted as
+  // InsertPath() would. Only the nodes on the path are copied, all the other
+  // nodes are shared with root. Sets *replaced_data to the data previously
+  // registered for the path and http_method or nullptr if there was none.
+  static std::shared_ptr<const PathMatcherNode> InsertPathCopy(
+      const std::shared_ptr<const PathMatcherNode>& root,
+      const PathInfo& node_path_info, const HttpMethod& http_method,
+      void* method_data, bool mark_duplicates, void** replaced_data);
+
+  // Returns a new version of the trie rooted at root without the data
+  // registered for the path and http_method. Only the nodes on the path are
+  // copied and the ones left without results and children are dropped. Sets
+  // *removed_data to the removed data, or to nullptr and returns root if there
+  // was none.
+  static std::shared_ptr<const PathMatcherNode> RemovePathCopy(
+      const std::shared_ptr<const PathMatcherNode>& root,
+      const PathInfo& node_path_info, const HttpMethod& http_method,
+      void** removed_data);
+
   void set_wildcard(bool wildcard) { wildcard_ = wildcard; }
 
  private:
+  // Compiles the trie from the nodes.
+  friend class PathMatcherTrie;
+
   // This method inserts a path of nodes into this subtrie (described by the
   // vector<Info>, starting from the |current| position in the iterator of path
   // parts, and if necessary, creating intermediate nodes along the way. The
@@ -155,13 +201,26 @@ class PathMatcherNode {
                       HttpMethod http_method, void* method_data,
                       bool mark_duplicates);
 
+  // The recursive parts of InsertPathCopy() and RemovePathCopy(), which return
+  // the copy of this node. RemoveTemplateCopy() returns nullptr if nothing is
+  // removed or if the copy would be empty.
+  std::shared_ptr<PathMatcherNode> InsertTemplateCopy(
+      const std::vector<std::string>::const_iterator current,
+      const std::vector<std::string>::const_iterator end,
+      const HttpMethod& http_method, void* method_data, bool mark_duplicates,
+      void** replaced_data) const;
+  std::shared_ptr<PathMatcherNode> RemoveTemplateCopy(
+      const std::vector<std::string>::const_iterator current,
+      const std::vector<std::string>::const_iterator end,
+      const HttpMethod& http_method, void** removed_data) const;
+
   // Helper method for LookupPath. If the given child key exists, search
   // continues on the child node pointed by the child key with the next part
   // in the path. Returns true if found a match for the path eventually.
-  bool LookupPathFromChild(const std::string child_key,
+  bool LookupPathFromChild(absl::string_view child_key,
                            const RequestPathParts::const_iterator current,
                            const RequestPathParts::const_iterator end,
-                           HttpMethod http_method,
+                           const RequestMethod& http_method,
                            PathMatcherLookupResult* result) const;
 
   // If a WrapperGraph is found for the provided key, then this method returns
@@ -170,10 +229,11 @@ class PathMatcherNode {
   //
   // NB: If result == nullptr, method will return bool value without modifying
   // result.
-  bool GetResultForHttpMethod(HttpMethod key,
+  bool GetResultForHttpMethod(const RequestMethod& key,
                               PathMatcherLookupResult* result) const;
 
-  std::map<HttpMethod, PathMatcherLookupResult> result_map_;
+  // Ordered with std::less<> so that it can be searched by absl::string_view.
+  std::map<HttpMethod, PathMatcherLookupResult, std::less<>> result_map_;
 
   // Lookup must be FAST
   //
@@ -181,8 +241,9 @@ class PathMatcherNode {
   // size of |children_| to range from ~5 to ~100 entries.
   //
   // To ensure fast lookups when n grows large, it is prudent to consider an
-  // alternative to binary search on a sorted vector.
-  std::unordered_map<std::string, std::unique_ptr<PathMatcherNode>> children_;
+  // alternative to binary search on a sorted vector. absl::flat_hash_map also
+  // allows looking the children up by the absl::string_view request parts.
+  absl::flat_hash_map<std::string, std::shared_ptr<PathMatcherNode>> children_;
 
   // True if this node represents a wildcard path '**'.
   bool wildcard_;
@@ -0,0 +1,252 @@
+/* Copyright 2016 Google Inc. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef GRPC_TRANSCODING_PATH_MATCHER_TRIE_H_
+#define GRPC_TRANSCODING_PATH_MATCHER_TRIE_H_
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/container/inlined_vector.h"
+#include "absl/strings/string_view.h"
+#include "absl/types/span.h"
+#include "path_matcher_node.h"
+#include "snapshot.h"
+
+namespace google {
+namespace grpc {
+namespace transcoding {
+
+// PathMatcherTrie is the compiled, immutable form of a PathMatcherNode trie
+// used for the lookups. Instead of a heap node per path part with its own maps,
+// all the nodes, their children and their results are laid out in a few
+// contiguous arrays of plain structs that refer to each other by index:
+//
+//  - The path segments of the templates are interned into a string pool and
+//    identified by their index. A request part is mapped to its segment id
+//    through an open-addressing hash table when it's first needed and the
+//    children are then matched by comparing the ids.
+//  - The literal children of a node are sorted by segment id and stored next to
+//    each other. The "/.", "*" and "**" children are also directly indexed.
+//  - The registered `http_method + verb` keys are interned into small integers,
+//    so a node's results are found by comparing integers.
+//
+// A trie compiled by Compile() is split into blocks so that the next versions
+// of the routes can be compiled incrementally. A subtrie of at most
+// max_block_nodes nodes is compiled into one PathMatcherTrie, and a larger one
+// into a PathMatcherTrie of its root node only that links to a
+// PathMatcherTrie per child. The blocks are immutable and shared: as the
+// versions of a PathMatcherNode trie share the nodes not on the changed paths,
+// the next version only compiles the blocks of the changed nodes and links to
+// the blocks of the previous version for all the others.
+//
+// The arrays are position independent, so a trie compiled by the constructor,
+// which has no links, can be written to a snapshot and used in place when it's
+// loaded. The results refer to their data by index into data(), which isn't
+// part of the snapshot.
+//
+// LookupPath() has the same semantics as PathMatcherNode::LookupPath().
+//
+// Thread safe.
+class PathMatcherTrie {
+ public:
+  // The default size of the blocks of Compile(). Larger blocks make for fewer
+  // links to follow in the lookups, but for more nodes to compile for every
+  // change.
+  static constexpr size_t kDefaultMaxBlockNodes = 512;
+
+  // Compiles the trie rooted at root into a single block, with no links.
+  explicit PathMatcherTrie(const PathMatcherNode& root);
+
+  // Compiles the trie rooted at root into blocks of at most max_block_nodes
+  // nodes, reusing the blocks of previous, which may be nullptr, that were
+  // compiled from the same nodes. previous should be the trie compiled from
+  // the version of the nodes that root was created from by
+  // PathMatcherNode::InsertPathCopy() and RemovePathCopy(), then only the
+  // blocks with nodes on the changed paths are compiled again.
+  static std::shared_ptr<const PathMatcherTrie> Compile(
+      std::shared_ptr<const PathMatcherNode> root,
+      const std::shared_ptr<const PathMatcherTrie>& previous,
+      size_t max_block_nodes = kDefaultMaxBlockNodes);
+
+  // Looks up the request path parts in the trie. See
+  // PathMatcherNode::LookupPath() for the matching rules.
+  void LookupPath(const PathMatcherNode::RequestPathParts& parts,
+                  const RequestMethod& http_method,
+                  PathMatcherLookupResult* result) const;
+
+  // The distinct data of the results, not including the ones of the linked
+  // blocks.
+  const std::vector<void*>& data() const { return data_; }
+
+  // Writes the arrays of the trie to the current section of the writer. The
+  // trie must have been compiled by the constructor.
+  void WriteSnapshot(SnapshotWriter* writer) const;
+
+  // Reads a trie written by WriteSnapshot(). The arrays are used in place and
+  // storage must keep them alive. data replaces the data() of the written
+  // trie. Returns nullptr if the trie is malformed.
+  static std::unique_ptr<PathMatcherTrie> ReadSnapshot(
+      SnapshotReader* reader, std::vector<void*> data,
+      std::shared_ptr<const void> storage);
+
+  // Returns a PathMatcherNode trie with the same paths and results.
+  std::shared_ptr<PathMatcherNode> Decompile() const;
+
+ private:
+  // Index of a node, a segment or a method key. kNone if not present.
+  typedef uint32_t Index;
+  static constexpr Index kNone = UINT32_MAX;
+  // Marks a segment id or a method id that isn't looked up yet.
+  static constexpr Index kUnknown = UINT32_MAX - 1;
+  // Marks a child that is the root of the linked block links_[child & ~kLink].
+  static constexpr Index kLink = 0x80000000u;
+
+  struct Node {
+    // The literal children are child_segments_[children_begin, children_end)
+    // and child_nodes_[children_begin, children_end), sorted by the segment.
+    Index children_begin;
+    Index children_end;
+    // The "/.", "*" and "**" children.
+    Index single_parameter_child;
+    Index wild_card_path_part_child;
+    Index wild_card_path_child;
+    // The results are result_methods_[results_begin, results_end) and
+    // results_[results_begin, results_end).
+    Index results_begin;
+    Index results_end;
+    // 1 if this node represents a wildcard path '**'. Not a bool to leave no
+    // padding in the snapshot.
+    uint32_t wildcard;
+  };
+
+  struct Result {
+    // The index of the data in data_.
+    Index data;
+    uint32_t is_multiple;
+  };
+
+  // A string in pool_.
+  struct PoolString {
+    uint32_t offset;
+    uint32_t size;
+  };
+
+  typedef absl::InlinedVector<Index, 16> SegmentIds;
+  typedef absl::InlinedVector<uint64_t, 16> SegmentHashes;
+
+  // The arrays of a compiled trie.
+  struct Arrays;
+
+  // The state of a lookup in one block.
+  struct LookupState;
+
+  // Returns the block to link to for a child of the root.
+  typedef std::function<std::shared_ptr<const PathMatcherTrie>(
+      absl::string_view segment,
+      const std::shared_ptr<const PathMatcherNode>& child)>
+      LinkChild;
+
+  PathMatcherTrie() : wild_card_method_(kNone), num_source_nodes_(0) {}
+
+  // Compiles the trie rooted at root. If link_child isn't nullptr, only the
+  // root is compiled and its children are linked.
+  void Build(const PathMatcherNode& root, const LinkChild* link_child);
+
+  // Returns the number of nodes of the trie rooted at node, or a number larger
+  // than limit once there are more. The subtries that the blocks of previous
+  // were compiled from aren't walked.
+  static size_t CountNodes(const PathMatcherNode& node,
+                           const PathMatcherTrie* previous, size_t limit);
+
+  // Returns the block linked for the child of the root for the segment or
+  // nullptr.
+  std::shared_ptr<const PathMatcherTrie> LinkedChild(
+      absl::string_view segment) const;
+
+  absl::string_view FromPool(PoolString s) const {
+    return pool_.substr(s.offset, s.size);
+  }
+
+  // Checks that the indices in the arrays are in range.
+  bool IsValid() const;
+
+  // Returns the id of the segment, given its HashSegment(), or of the method
+  // key, or kNone.
+  Index FindSegment(absl::string_view segment, uint64_t hash) const;
+  Index FindMethod(const RequestMethod& http_method) const;
+
+  // Returns the literal child of the node for the segment or kNone.
+  Index FindChild(const Node& node, Index segment) const;
+
+  // Looks up parts[current, end) from the root of this block.
+  void LookupPath(const PathMatcherNode::RequestPathParts& parts,
+                  const SegmentHashes& hashes, size_t current,
+                  const RequestMethod& http_method,
+                  PathMatcherLookupResult* result) const;
+
+  // The recursive lookup. Mirrors PathMatcherNode::LookupPath().
+  void LookupPath(Index node, size_t current, LookupState* state,
+                  PathMatcherLookupResult* result) const;
+  bool LookupPathFromChild(Index child, size_t current, LookupState* state,
+                           PathMatcherLookupResult* result) const;
+  bool GetResultForHttpMethod(const Node& node, Index method,
+                              PathMatcherLookupResult* result) const;
+  // GetResultForHttpMethod() of a child, which may be linked.
+  bool GetChildResultForHttpMethod(Index child, LookupState* state,
+                                   PathMatcherLookupResult* result) const;
+
+  // All the nodes, the root is the first one.
+  absl::Span<const Node> nodes_;
+  absl::Span<const Index> child_segments_;
+  absl::Span<const Index> child_nodes_;
+  absl::Span<const Index> result_methods_;
+  absl::Span<const Result> results_;
+
+  // The interned segments and their open-addressing hash table with
+  // segment id + 1 as the value (0 marks an empty slot).
+  absl::Span<const PoolString> segments_;
+  absl::Span<const Index> segment_table_;
+  // The interned `http_method + verb` keys and the id of the "*" key.
+  absl::Span<const PoolString> methods_;
+  Index wild_card_method_;
+
+  // The storage of the segments and the method keys.
+  absl::string_view pool_;
+
+  // The data the results refer to.
+  std::vector<void*> data_;
+
+  // Keeps the arrays alive: the Arrays of a compiled trie or the snapshot.
+  std::shared_ptr<const void> storage_;
+
+  // The blocks linked by the children marked with kLink.
+  std::vector<std::shared_ptr<const PathMatcherTrie>> links_;
+  // The root of the nodes a block of Compile() was compiled from and their
+  // number, including the ones of the linked blocks. nullptr otherwise.
+  std::shared_ptr<const PathMatcherNode> source_;
+  size_t num_source_nodes_;
+
+  PathMatcherTrie(const PathMatcherTrie&) = delete;
+  PathMatcherTrie& operator=(const PathMatcherTrie&) = delete;
+};
+
+}  // namespace transcoding
+}  // namespace grpc
+}  // namespace google
+
+#endif  // GRPC_TRANSCODING_PATH_MATCHER_TRIE_H_
@@ -126,52 +126,109 @@ inline int GetEscapedChar(absl::string_view src, size_t i,
   return 0;
 }
 
+// Same as FindUrlEscapeCandidate() below, but compares the characters 16 or 32
+// at a time with SSE2 or AVX2 when the CPU supports them.
+const char* FindUrlEscapeCandidateVectorized(const char* begin,
+                                             const char* end, bool find_plus);
+
+// Returns the first '%' in [begin, end), or the first '+' as well if find_plus
+// is true, or end if there is none.
+inline const char* FindUrlEscapeCandidate(const char* begin, const char* end,
+                                          bool find_plus) {
+  // The first characters are checked inline, which is faster for the short
+  // strings and the dense escapes. Compare with '%' twice instead of branching
+  // on find_plus.
+  const char plus = find_plus ? '+' : '%';
+  const char* inline_end = end - begin > 16 ? begin + 16 : end;
+  for (const char* p = begin; p < inline_end; ++p) {
+    if (*p == '%' || *p == plus) {
+      return p;
+    }
+  }
+  return inline_end == end
+             ? end
+             : FindUrlEscapeCandidateVectorized(inline_end, end, find_plus);
+}
+
+// Returns the position of the first escape in part at or after pos that is
+// unescaped according to unescape_spec and unescape_plus, or npos if there is
+// none. If there is one, *out is set to the unescaped character and *length to
+// the number of escaped characters, as by GetEscapedChar().
+inline size_t FindUrlEscape(absl::string_view part, size_t pos,
+                            UrlUnescapeSpec unescape_spec, bool unescape_plus,
+                            char* out, int* length) {
+  const char* end = part.data() + part.size();
+  for (const char* p = part.data() + pos;
+       (p = FindUrlEscapeCandidate(p, end, unescape_plus)) != end; ++p) {
+    size_t i = p - part.data();
+    *length = GetEscapedChar(part, i, unescape_spec, unescape_plus, out);
+    if (*length > 0) {
+      return i;
+    }
+  }
+  return absl::string_view::npos;
+}
+
 inline bool IsUrlEscapedString(absl::string_view part,
                                UrlUnescapeSpec unescape_spec,
                                bool unescape_plus) {
   char ch = '\0';
-  for (size_t i = 0; i < part.size(); ++i) {
-    if (GetEscapedChar(part, i, unescape_spec, unescape_plus, &ch) > 0) {
-      return true;
-    }
-  }
-  return false;
+  int length = 0;
+  return FindUrlEscape(part, 0, unescape_spec, unescape_plus, &ch, &length) !=
+         absl::string_view::npos;
 }
 
 inline bool IsUrlEscapedString(absl::string_view part) {
   return IsUrlEscapedString(part, UrlUnescapeSpec::kAllCharacters, false);
 }
 
+// Appends part[pos, part.size()) to *out unescaped, where escape is the result
+// of FindUrlEscape(part, pos, ...) and ch and length its outputs.
+void AppendUrlUnescapedFrom(absl::string_view part, size_t pos, size_t escape,
+                            char ch, int length, UrlUnescapeSpec unescape_spec,
+                            bool unescape_plus, std::string* out);
+
+// Unescapes string 'part' and appends it to *out, in a single pass over part.
+inline void UrlUnescapeAppend(absl::string_view part,
+                              UrlUnescapeSpec unescape_spec, bool unescape_plus,
+                              std::string* out) {
+  char ch = '\0';
+  int length = 0;
+  size_t escape =
+      FindUrlEscape(part, 0, unescape_spec, unescape_plus, &ch, &length);
+  AppendUrlUnescapedFrom(part, 0, escape, ch, length, unescape_spec,
+                         unescape_plus, out);
+}
+
+// Unescapes string 'part'. Returns part itself if there is nothing to
+// unescape; otherwise unescapes it into *buffer and returns *buffer.
+inline absl::string_view UrlUnescapeString(absl::string_view part,
+                                           UrlUnescapeSpec unescape_spec,
+                                           bool unescape_plus,
+                                           std::string* buffer) {
+  char ch = '\0';
+  int length = 0;
+  size_t escape =
+      FindUrlEscape(part, 0, unescape_spec, unescape_plus, &ch, &length);
+  if (escape == absl::string_view::npos) {
+    return part;
+  }
+  buffer->clear();
+  buffer->reserve(part.size());
+  AppendUrlUnescapedFrom(part, 0, escape, ch, length, unescape_spec,
+                         unescape_plus, buffer);
+  return *buffer;
+}
+
 // Unescapes string 'part' and returns the unescaped string. Reserved characters
 // (as specified in RFC 6570) are not escaped if unescape_reserved_chars is
 // false.
 inline std::string UrlUnescapeString(absl::string_view part,
                                      UrlUnescapeSpec unescape_spec,
                                      bool unescape_plus) {
-  // Check whether we need to escape at all.
-  if (!IsUrlEscapedString(part, unescape_spec, unescape_plus)) {
-    return std::string(part);
-  }
-
   std::string unescaped;
-  char ch = '\0';
-  unescaped.resize(part.size());
-
-  char* begin = &(unescaped)[0];
-  char* p = begin;
-
-  for (size_t i = 0; i < part.size();) {
-    int skip = GetEscapedChar(part, i, unescape_spec, unescape_plus, &ch);
-    if (skip > 0) {
-      *p++ = ch;
-      i += skip;
-    } else {
-      *p++ = part[i];
-      i += 1;
-    }
-  }
-
-  unescaped.resize(p - begin);
+  unescaped.reserve(part.size());
+  UrlUnescapeAppend(part, unescape_spec, unescape_plus, &unescaped);
   return unescaped;
 }
 
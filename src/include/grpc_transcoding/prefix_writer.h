@@ -20,6 +20,7 @@
 #include <vector>
 
 #include "absl/strings/string_view.h"
+#include "absl/types/span.h"
 #include "google/protobuf/util/converter/object_writer.h"
 
 namespace google {
@@ -63,6 +64,17 @@ class PrefixWriter : public google::protobuf::util::converter::ObjectWriter {
   PrefixWriter(const std::string& prefix,
                google::protobuf::util::converter::ObjectWriter* ow);
 
+  // Same as above, but the prefix is already split into the field names. The
+  // names aren't copied and must outlive the PrefixWriter.
+  PrefixWriter(absl::Span<const std::string> prefix,
+               google::protobuf::util::converter::ObjectWriter* ow);
+
+  // Forwards the writer events to ow from now on. Must only be called between
+  // objects.
+  void set_writer(google::protobuf::util::converter::ObjectWriter* ow) {
+    writer_ = ow;
+  }
+
   // ObjectWriter methods.
   PrefixWriter* StartObject(absl::string_view name);
   PrefixWriter* EndObject();
@@ -87,7 +99,9 @@ class PrefixWriter : public google::protobuf::util::converter::ObjectWriter {
   void EndPrefix();
 
   // The path prefix if the HTTP body maps to a nested message in the proto.
-  std::vector<std::string> prefix_;
+  // It points either into owned_prefix_ or into the caller's names.
+  std::vector<std::string> owned_prefix_;
+  absl::Span<const std::string> prefix_;
 
   // Tracks the depth within the output, so we know when to write the prefix
   // and when to close it off.
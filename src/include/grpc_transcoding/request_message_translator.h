@@ -19,14 +19,19 @@
 #include <string>
 
 #include "absl/strings/string_view.h"
+#include "absl/types/optional.h"
 #include "google/protobuf/stubs/bytestream.h"
 #include "google/protobuf/type.pb.h"
 #include "google/protobuf/util/converter/error_listener.h"
 #include "google/protobuf/util/converter/protostream_objectwriter.h"
+#include "google/protobuf/util/converter/type_info.h"
 #include "google/protobuf/util/type_resolver.h"
+#include "message_compression.h"
 #include "message_stream.h"
 #include "prefix_writer.h"
 #include "request_weaver.h"
+#include "transcoding_plan.h"
+#include "wire_encoder.h"
 
 namespace google {
 namespace grpc {
@@ -76,7 +81,8 @@ struct RequestInfo {
 //  - RequestWeaver injects the variable bindings and forwards the writer events
 //    to the ProtoStreamObjectWriter. This link will be absent if there are no
 //    variable bindings to weave.
-//  - ProtoStreamObjectWriter does the actual proto writing.
+//  - ProtoStreamObjectWriter does the actual proto writing. If the
+//    TranscodingPlan has a WireEncoderPlan, a WireEncoder does it instead.
 //
 // Example:
 //   RequestMessageTranslator t(type_resolver, true, std::move(request_info));
@@ -101,13 +107,32 @@ struct RequestInfo {
 //
 class RequestMessageTranslator : public MessageStream {
  public:
-  // type_resolver is forwarded to the ProtoStreamObjectWriter that does the
-  // actual proto writing.
+  // The types are resolved with type_resolver, through a TypeInfo that the
+  // translator creates once and keeps for all the messages of a stream.
   // output_delimiter specifies whether to output the GRPC 5 byte message
   // delimiter before the message or not.
   RequestMessageTranslator(google::protobuf::util::TypeResolver& type_resolver,
                            bool output_delimiter, RequestInfo request_info);
 
+  // Same as above, but the ProtoStreamObjectWriter uses the given type_info
+  // instead of building its own TypeInfo cache on top of a TypeResolver. This
+  // avoids re-resolving (and copying) the types for every request when
+  // type_info is long-lived and already populated, e.g. TypeHelper::Info().
+  // type_info must be thread-safe if it's shared between translators used on
+  // different threads. RequestMessageTranslator doesn't maintain the ownership
+  // of type_info.
+  RequestMessageTranslator(
+      const google::protobuf::util::converter::TypeInfo& type_info,
+      bool output_delimiter, RequestInfo request_info);
+
+  // Translates into the request message of the plan, using the types, the body
+  // prefix and the options resolved by the plan. variable_bindings come from
+  // TranscodingPlan::ResolveBindings(). RequestMessageTranslator doesn't
+  // maintain the ownership of plan, which must outlive it.
+  RequestMessageTranslator(
+      const TranscodingPlan& plan, bool output_delimiter,
+      std::vector<RequestWeaver::BindingInfo> variable_bindings);
+
   ~RequestMessageTranslator();
 
   // An ObjectWriter that takes the input object to translate
@@ -120,14 +145,59 @@ class RequestMessageTranslator : public MessageStream {
   bool Finished() const;
   absl::Status Status() const { return error_listener_.status(); }
 
+  // Compresses the output messages with compressor, which the GRPC delimiter
+  // then flags as compressed. A message that doesn't get smaller is left
+  // uncompressed. Only applies if output_delimiter is true.
+  // RequestMessageTranslator doesn't maintain the ownership of compressor.
+  void set_compressor(const MessageCompressor* compressor) {
+    compressor_ = compressor;
+  }
+
+  // Prepares the translator to translate another message of the same type,
+  // reusing the writer pipeline instead of constructing a new translator. The
+  // variable bindings are only woven into the first message. Used by
+  // RequestStreamTranslator for the elements of a stream.
+  void Reset();
+
  private:
+  // A ProtoStreamObjectWriter that exposes the constructor that takes a
+  // TypeInfo instead of a TypeResolver.
+  class ProtoWriter
+      : public google::protobuf::util::converter::ProtoStreamObjectWriter {
+   public:
+    ProtoWriter(const google::protobuf::util::converter::TypeInfo* type_info,
+                const google::protobuf::Type& type,
+                google::protobuf::strings::ByteSink* output,
+                google::protobuf::util::converter::ErrorListener* listener,
+                const Options& options)
+        : ProtoStreamObjectWriter(type_info, type, output, listener, options) {
+    }
+  };
+
+  // (Re)creates proto_writer_ or wire_encoder_ in place.
+  void CreateWriter();
+
+  // The writer at the end of the pipeline, either proto_writer_ or
+  // wire_encoder_.
+  google::protobuf::util::converter::ObjectWriter* Writer();
+  bool WriterDone();
+
+  // Builds the writer pipeline on top of proto_writer_. Shared by the
+  // constructors.
+  void BuildPipeline(RequestInfo request_info);
+
+  // Adds the RequestWeaver, if needed, to the pipeline and reserves the space
+  // for the delimiter. The PrefixWriter is left to the callers.
+  void BuildPipeline(std::vector<RequestWeaver::BindingInfo> variable_bindings,
+                     bool reject_binding_body_field_collisions);
+
   // Reserves space (5 bytes) for the GRPC delimiter to be written later. As it
   // requires the length of the message, we can't write it before the message
   // itself.
   void ReserveDelimiterSpace();
 
   // Writes the wire delimiter into the reserved delimiter space at the begining
-  // of this->message_.
+  // of this->message_, compressing the message first if there is a compressor.
   void WriteDelimiter();
 
   // The message being written
@@ -141,8 +211,27 @@ class RequestMessageTranslator : public MessageStream {
   // a status.
   StatusErrorListener error_listener_;
 
-  // The proto writer for writing the actual proto bytes
-  google::protobuf::util::converter::ProtoStreamObjectWriter proto_writer_;
+  // The TypeInfo created on top of the TypeResolver the translator is
+  // constructed with, if any. Unlike one created by each
+  // ProtoStreamObjectWriter, it keeps the resolved types across Reset().
+  std::unique_ptr<google::protobuf::util::converter::TypeInfo>
+      owned_type_info_;
+
+  // What the proto writer is created from, kept for Reset(). Either
+  // owned_type_info_ or the TypeInfo the translator is constructed with.
+  const google::protobuf::util::converter::TypeInfo* type_info_;
+  const google::protobuf::Type* message_type_;
+  google::protobuf::util::converter::ProtoStreamObjectWriter::Options
+      proto_writer_options_;
+
+  // The proto writer for writing the actual proto bytes. It's recreated in
+  // place by Reset().
+  absl::optional<ProtoWriter> proto_writer_;
+
+  // Used instead of proto_writer_ if the translator is constructed from a
+  // TranscodingPlan with a WireEncoderPlan.
+  const WireEncoderPlan* wire_encoder_plan_;
+  absl::optional<WireEncoder> wire_encoder_;
 
   // A RequestWeaver for writing the variable bindings
   std::unique_ptr<RequestWeaver> request_weaver_;
@@ -151,8 +240,7 @@ class RequestMessageTranslator : public MessageStream {
   std::unique_ptr<PrefixWriter> prefix_writer_;
 
   // The ObjectWriter that will receive the events
-  // This is either &proto_writer_, request_weaver_.get() or
-  // prefix_writer_.get()
+  // This is either Writer(), request_weaver_.get() or prefix_writer_.get()
   google::protobuf::util::converter::ObjectWriter* writer_pipeline_;
 
   // Whether to ouput a delimiter before the message or not
@@ -162,6 +250,15 @@ class RequestMessageTranslator : public MessageStream {
   // This helps with the MessageStream implementation.
   bool finished_;
 
+  // The size of the last message, reserved for the next one after Reset().
+  size_t last_message_size_;
+
+  // Compresses the messages if not null.
+  const MessageCompressor* compressor_;
+
+  // The compressed message, kept to reuse its buffer after Reset().
+  std::string compressed_message_;
+
   // GRPC delimiter size = 1 + 4 - 1-byte compression flag and 4-byte message
   // length.
   static const int kDelimiterSize = 5;
@@ -17,12 +17,13 @@
 
 #include <cstdint>
 #include <deque>
-#include <functional>
 #include <memory>
 
 #include "absl/strings/string_view.h"
 #include "google/protobuf/util/converter/object_writer.h"
+#include "google/protobuf/util/converter/type_info.h"
 #include "google/protobuf/util/type_resolver.h"
+#include "message_compression.h"
 #include "message_stream.h"
 #include "request_message_translator.h"
 
@@ -67,6 +68,20 @@ class RequestStreamTranslator
  public:
   RequestStreamTranslator(google::protobuf::util::TypeResolver& type_resolver,
                           bool output_delimiters, RequestInfo request_info);
+
+  // Same as above, but the per-message RequestMessageTranslators use the given
+  // (shared) type_info instead of the TypeResolver. See the corresponding
+  // RequestMessageTranslator constructor.
+  RequestStreamTranslator(
+      const google::protobuf::util::converter::TypeInfo& type_info,
+      bool output_delimiters, RequestInfo request_info);
+
+  // Same as above, but the per-message RequestMessageTranslators are
+  // constructed from the plan, which must outlive the RequestStreamTranslator.
+  // The variable_bindings are woven into the first message only.
+  RequestStreamTranslator(
+      const TranscodingPlan& plan, bool output_delimiters,
+      std::vector<RequestWeaver::BindingInfo> variable_bindings);
   ~RequestStreamTranslator();
 
   // MessageStream methods
@@ -74,6 +89,12 @@ class RequestStreamTranslator
   bool Finished() const;
   absl::Status Status() const { return status_; }
 
+  // Compresses the messages, see RequestMessageTranslator::set_compressor().
+  // Must be called before the first message is written.
+  void set_compressor(const MessageCompressor* compressor) {
+    compressor_ = compressor;
+  }
+
  private:
   // ObjectWriter methods.
   RequestStreamTranslator* StartObject(absl::string_view name);
@@ -99,11 +120,19 @@ class RequestStreamTranslator
   // Closes down the ProtoMessageHelper and stores its message.
   void EndMessageTranslator();
 
-  // Helper method to render a single piece of data, to reuse code.
-  void RenderData(absl::string_view name, std::function<void()> renderer);
+  // Helper method to render a single piece of data, to reuse code. renderer
+  // is called with no arguments to render the data into translator_.
+  template <typename Renderer>
+  void RenderData(absl::string_view name, Renderer renderer);
 
-  // TypeResolver to be passed to the RequestMessageTranslator
-  google::protobuf::util::TypeResolver& type_resolver_;
+  // Either the TypeResolver or the TypeInfo to be passed to the
+  // RequestMessageTranslator. Exactly one of them is not null.
+  google::protobuf::util::TypeResolver* type_resolver_;
+  const google::protobuf::util::converter::TypeInfo* type_info_;
+
+  // The plan to construct the RequestMessageTranslators from, or null if they
+  // are constructed from request_info_.
+  const TranscodingPlan* plan_;
 
   // The status of the translation
   absl::Status status_;
@@ -114,8 +143,11 @@ class RequestStreamTranslator
   // Whether to prefix each message with a delimiter or not
   bool output_delimiters_;
 
-  // The ProtoMessageWriter that is currently writing a message, or null if we
-  // are at the root or have invalid input.
+  // Passed to the RequestMessageTranslator.
+  const MessageCompressor* compressor_;
+
+  // The RequestMessageTranslator that writes the messages, or null before the
+  // first one. It's reset and reused for each message of the stream.
   std::unique_ptr<RequestMessageTranslator> translator_;
 
   // Holds the messages we've translated so far.
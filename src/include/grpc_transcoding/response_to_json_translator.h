@@ -15,11 +15,18 @@
 #ifndef GRPC_TRANSCODING_RESPONSE_TO_JSON_TRANSLATOR_H_
 #define GRPC_TRANSCODING_RESPONSE_TO_JSON_TRANSLATOR_H_
 
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
 #include <string>
 
 #include "google/protobuf/io/zero_copy_stream.h"
 #include "google/protobuf/util/json_util.h"
 #include "google/protobuf/util/type_resolver.h"
+#include "incremental_json_printer.h"
+#include "json_printer_cache.h"
+#include "message_compression.h"
 #include "message_reader.h"
 #include "message_stream.h"
 
@@ -30,7 +37,8 @@ namespace transcoding {
 
 // ResponseToJsonTranslator translates gRPC response message(s) into JSON. It
 // accepts the input from a ZeroCopyInputStream and exposes the output through a
-// MessageStream implementation. Supports streaming calls.
+// MessageStream implementation, or writes it to a ZeroCopyOutputStream.
+// Supports streaming calls.
 //
 // The implementation uses a MessageReader to extract complete messages from the
 // input stream and ::google::protobuf::util::BinaryToJsonStream() to do the
@@ -58,6 +66,18 @@ namespace transcoding {
 //       detect it and act appropriately.
 //
 
+// TranslationExecutor runs the translation of the messages of streaming calls
+// on other threads, e.g. on a worker pool of the proxy.
+class TranslationExecutor {
+ public:
+  virtual ~TranslationExecutor() {}
+
+  // Runs task, concurrently with the caller and the other tasks. The task may
+  // run after the translator that scheduled it has been destroyed, in which
+  // case it does nothing.
+  virtual void Execute(std::function<void()> task) = 0;
+};
+
 // Control various aspects of the generated JSON during response translation
 struct JsonResponseTranslateOptions {
   // JsonPrintOptions
@@ -75,6 +95,42 @@ struct JsonResponseTranslateOptions {
   // and, `stream_newline_delimited` is ignored.
   // If false, message framing is determined by `stream_newline_delimited`.
   bool stream_sse_style_delimited = false;
+
+  // Decompresses the messages of the gRPC frames with the compressed flag set,
+  // e.g. CreateMessageDecompressor("gzip") for "grpc-encoding: gzip". If
+  // nullptr, compressed frames are rejected. Not owned, must outlive the
+  // translator.
+  const MessageDecompressor* decompressor = nullptr;
+
+  // If true, the messages are translated as their bytes arrive instead of once
+  // they are complete, so that the JSON of a large message is emitted while
+  // the rest of it is still being received and the message isn't buffered.
+  // See IncrementalJsonPrinter for the differences in the JSON. The messages
+  // are translated as a whole if their type or json_print_options aren't
+  // supported by IncrementalJsonPrinter, and so are the compressed messages.
+  bool incremental_translation = false;
+
+  // If set, the messages are printed by an IncrementalJsonPrinter with the
+  // JsonPrinterPlan cached for the type and json_print_options, instead of
+  // BinaryToJsonStream(), which resolves the type for every message. The JSON
+  // is the same, as the messages that IncrementalJsonPrinter would print
+  // differently are printed with BinaryToJsonStream(), and so are the types
+  // that can't be compiled. With incremental_translation, see
+  // IncrementalJsonPrinter for the differences in the JSON. Not owned, must
+  // outlive the translator.
+  JsonPrinterCache* json_printer_cache = nullptr;
+
+  // If set, the messages of streaming calls are translated in parallel on the
+  // executor, and their JSON is still returned in order and with the same
+  // delimiters. The complete messages are copied from the input and scheduled
+  // while the messages scheduled and not returned yet take less than
+  // max_in_flight_bytes, so that the input isn't read further ahead than that.
+  // NextMessage() translates the next message itself if no task has started
+  // translating it yet, and waits for it otherwise. Takes precedence over
+  // incremental_translation. The type resolver needs to be thread-safe. Not
+  // owned, must outlive the translator.
+  TranslationExecutor* executor = nullptr;
+  size_t max_in_flight_bytes = 1 << 20;
 };
 
 class ResponseToJsonTranslator : public MessageStream {
@@ -91,15 +147,49 @@ class ResponseToJsonTranslator : public MessageStream {
       const JsonResponseTranslateOptions& options = {
           ::google::protobuf::util::JsonPrintOptions(), false, false});
 
+  // Waits for the translations running on options.executor, if any.
+  ~ResponseToJsonTranslator();
+
   // MessageStream implementation
   bool NextMessage(std::string* message);
   bool Finished() const { return finished_ || !status_.ok(); }
   absl::Status Status() const { return status_; }
 
+  // Writes the next message, including the '[', ',' and ']' or the delimiters
+  // of a streaming call, to out, like NextMessage(std::string*) returns it.
+  // out can be over the buffers of the response body, so that the JSON
+  // doesn't need to be copied from a string. Returns false if there is no
+  // message at this time or in case of an error, in which case a part of the
+  // message may have been written.
+  bool NextMessage(::google::protobuf::io::ZeroCopyOutputStream* out);
+
  private:
   // Translates a single message
   bool TranslateMessage(::google::protobuf::io::ZeroCopyInputStream* proto_in,
-                        std::string* json_out);
+                        ::google::protobuf::io::ZeroCopyOutputStream* json_out);
+
+  // Translates a part of a message with printer_. last is whether the part
+  // ends the message.
+  bool TranslateMessagePart(
+      ::google::protobuf::io::ZeroCopyInputStream* proto_in, bool last,
+      ::google::protobuf::io::ZeroCopyOutputStream* json_out);
+
+  // Write what comes before and after the JSON of each message of a streaming
+  // call, and the end of the stream once the input is finished.
+  bool WriteMessagePrefix(::google::protobuf::io::ZeroCopyOutputStream* out);
+  bool WriteMessageSuffix(::google::protobuf::io::ZeroCopyOutputStream* out);
+  bool WriteStreamEnd(::google::protobuf::io::ZeroCopyOutputStream* out);
+
+  // The messages translated on options_.executor. The state they share with
+  // the tasks and a scheduled message are defined in the .cc file.
+  struct ParallelState;
+  struct ParallelJob;
+
+  // NextMessage() with options_.executor: schedules the complete messages and
+  // writes the first one once it's translated.
+  bool NextParallelMessage(::google::protobuf::io::ZeroCopyOutputStream* out);
+  // Translates the proto of job, on the calling thread.
+  static void TranslateJob(const ParallelState& state, ParallelJob* job);
 
   ::google::protobuf::util::TypeResolver* type_resolver_;
   std::string type_url_;
@@ -115,6 +205,22 @@ class ResponseToJsonTranslator : public MessageStream {
 
   bool finished_;
   absl::Status status_;
+
+  // Prints the messages if options_.incremental_translation or
+  // options_.json_printer_cache is set and the type is supported, or null.
+  std::unique_ptr<IncrementalJsonPrinter> printer_;
+  // Whether a message is being translated incrementally by printer_.
+  bool in_message_;
+  // The JSON printed by printer_, reused for all the messages.
+  std::string printer_json_;
+  // The message printed as a whole by printer_, reused for all the messages.
+  std::string printer_proto_;
+
+  // Set for the streaming calls translated on options_.executor.
+  std::shared_ptr<ParallelState> parallel_;
+  // The scheduled messages in order, and the size of their protos.
+  std::deque<std::shared_ptr<ParallelJob>> jobs_;
+  size_t in_flight_bytes_;
 };
 
 }  // namespace transcoding
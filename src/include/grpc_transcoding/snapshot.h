@@ -0,0 +1,169 @@
+/* Copyright 2016 Google Inc. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef GRPC_TRANSCODING_SNAPSHOT_H_
+#define GRPC_TRANSCODING_SNAPSHOT_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <type_traits>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "absl/types/span.h"
+
+namespace google {
+namespace grpc {
+namespace transcoding {
+
+// A snapshot is a binary blob holding built PathMatchers and TypeHelpers, so
+// that a process can load them at startup instead of building them from the
+// service config. The blob is position independent: the arrays in it are
+// referred to by offsets and are used in place, so a snapshot can be mmapped
+// (see Snapshot::MapFile()) and its pages shared by the processes using it.
+//
+// The layout is a header followed by tagged sections:
+//
+//   header:  magic "GTSNAPSH", format version, byte order mark, number of
+//            sections, size of the sections, checksum of the sections
+//   section: tag, size, payload padded to a multiple of 8 bytes
+//
+// The numbers are stored in the byte order of the host that wrote the
+// snapshot; a snapshot is only loaded on a host with the same byte order. The
+// checksum detects corrupted or truncated blobs, not tampered ones.
+
+// The tags of the snapshot sections.
+enum SnapshotSection : uint32_t {
+  kPathMatcherSection = 1,
+  kTypeHelperSection = 2,
+};
+
+// Builds a snapshot.
+//
+// NOT THREAD SAFE.
+class SnapshotWriter {
+ public:
+  SnapshotWriter();
+
+  // Starts a new section. The following writes go into it.
+  void BeginSection(SnapshotSection tag);
+
+  void WriteUint32(uint32_t value) { WriteRaw(&value, sizeof(value)); }
+  void WriteUint64(uint64_t value) { WriteRaw(&value, sizeof(value)); }
+  void WriteString(absl::string_view value);
+
+  // Writes the array aligned to 8 bytes, so that it can be used in place.
+  template <class T>
+  void WriteArray(absl::Span<const T> values) {
+    static_assert(std::is_trivially_copyable<T>::value && alignof(T) <= 8,
+                  "the array must be usable in place");
+    Align();
+    WriteUint64(values.size());
+    WriteRaw(values.data(), values.size() * sizeof(T));
+  }
+
+  // Returns the snapshot. The writer must not be used afterwards.
+  std::string Finish();
+
+ private:
+  void WriteRaw(const void* data, size_t size);
+  // Pads the section to a multiple of 8 bytes.
+  void Align();
+  // Finishes the current section, if any.
+  void EndSection();
+
+  std::string sections_;
+  uint32_t section_count_;
+  // The offset of the current section in sections_, or npos if none.
+  size_t section_begin_;
+};
+
+// Reads a section of a snapshot. The strings and arrays it returns point into
+// the snapshot.
+//
+// NOT THREAD SAFE.
+class SnapshotReader {
+ public:
+  explicit SnapshotReader(absl::string_view data) : data_(data) {}
+
+  // The reads return false if the section ends too early.
+  bool ReadUint32(uint32_t* value) { return ReadRaw(value, sizeof(*value)); }
+  bool ReadUint64(uint64_t* value) { return ReadRaw(value, sizeof(*value)); }
+  bool ReadString(absl::string_view* value);
+
+  template <class T>
+  bool ReadArray(absl::Span<const T>* values) {
+    static_assert(std::is_trivially_copyable<T>::value && alignof(T) <= 8,
+                  "the array must be usable in place");
+    uint64_t size;
+    if (!Align() || !ReadUint64(&size) || size > data_.size() / sizeof(T)) {
+      return false;
+    }
+    *values = absl::Span<const T>(reinterpret_cast<const T*>(data_.data()),
+                                  size);
+    data_.remove_prefix(size * sizeof(T));
+    return true;
+  }
+
+  // Returns true if the whole section has been read, ignoring the padding.
+  bool AtEnd() const { return data_.size() < 8; }
+
+ private:
+  bool ReadRaw(void* value, size_t size);
+  // Skips the padding to the next multiple of 8 bytes.
+  bool Align();
+
+  absl::string_view data_;
+};
+
+// A validated snapshot.
+//
+// Thread safe.
+class Snapshot {
+ public:
+  // Validates the header and the checksum of the snapshot in data, which must
+  // be 8-byte aligned. storage keeps data alive; if nullptr, data must outlive
+  // the Snapshot and everything loaded from it.
+  static absl::StatusOr<Snapshot> Open(absl::string_view data,
+                                       std::shared_ptr<const void> storage);
+
+  // Opens a copy of the data.
+  static absl::StatusOr<Snapshot> Copy(absl::string_view data);
+
+  // Opens the snapshot file mapped into memory read only. The pages are
+  // shared by the processes mapping the same file.
+  static absl::StatusOr<Snapshot> MapFile(const std::string& path);
+
+  // Returns a reader of the section or NotFound if there's none.
+  absl::StatusOr<SnapshotReader> Section(SnapshotSection tag) const;
+
+  // Keeps the snapshot data alive, see Open().
+  const std::shared_ptr<const void>& storage() const { return storage_; }
+
+ private:
+  Snapshot(absl::string_view data, std::shared_ptr<const void> storage)
+      : data_(data), storage_(std::move(storage)) {}
+
+  absl::string_view data_;
+  std::shared_ptr<const void> storage_;
+};
+
+}  // namespace transcoding
+}  // namespace grpc
+}  // namespace google
+
+#endif  // GRPC_TRANSCODING_SNAPSHOT_H_
@@ -0,0 +1,168 @@
+/* Copyright 2016 Google Inc. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef GRPC_TRANSCODING_TRANSCODING_PLAN_H_
+#define GRPC_TRANSCODING_TRANSCODING_PLAN_H_
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "google/protobuf/type.pb.h"
+#include "google/protobuf/util/converter/type_info.h"
+#include "grpc_transcoding/http_template.h"
+#include "grpc_transcoding/request_weaver.h"
+#include "grpc_transcoding/type_helper.h"
+#include "grpc_transcoding/wire_encoder.h"
+
+namespace google {
+namespace grpc {
+
+namespace transcoding {
+
+// TranscodingPlan holds everything about the transcoding of a method that
+// doesn't depend on the request: the resolved request type, the body field
+// chain, the body prefix split into segments and the fields the HTTP template
+// variables bind to. A plan is built once when the route is registered, e.g.
+// stored in the Method registered with the PathMatcher, and the translators
+// constructed from it don't resolve anything per request.
+//
+// Example:
+//   TranscodingPlan::Spec spec;
+//   spec.request_type_url = "type.googleapis.com/CreateShelfRequest";
+//   spec.response_type_url = "type.googleapis.com/Shelf";
+//   spec.http_template = "/shelves/{shelf.name}";
+//   spec.body_field_path = "shelf";
+//   auto plan = TranscodingPlan::Create(type_helper, spec);
+//
+//   // For each request
+//   std::vector<RequestWeaver::BindingInfo> bindings;
+//   status = (*plan)->ResolveBindings(std::move(path_bindings), &bindings);
+//   JsonRequestTranslator t(**plan, json_input, std::move(bindings),
+//                           /*streaming=*/false, /*output_delimiters=*/true);
+//
+// The plan is immutable and thread-safe. It refers to the types of the
+// TypeHelper it was created with, so the TypeHelper must outlive it.
+class TranscodingPlan {
+ public:
+  // The method to plan the transcoding of.
+  struct Spec {
+    // The type URLs of the request and the response messages.
+    std::string request_type_url;
+    std::string response_type_url;
+
+    // The HTTP template of the route, if any. The fields its variables bind
+    // to are resolved upfront.
+    std::string http_template;
+
+    // The dot-delimited field path where the HTTP body goes, see RequestInfo.
+    std::string body_field_path;
+
+    // See RequestInfo.
+    bool reject_binding_body_field_collisions = false;
+    bool case_insensitive_enum_parsing = false;
+
+    // Whether to compile the request type for the WireEncoder, which the
+    // translators then use instead of ProtoStreamObjectWriter. Request types
+    // that can't be compiled keep using ProtoStreamObjectWriter.
+    bool use_wire_encoder = false;
+  };
+
+  // Resolves the plan of the method. Fails if a type, the body field path or a
+  // variable of the HTTP template can't be resolved.
+  static absl::StatusOr<std::shared_ptr<const TranscodingPlan>> Create(
+      const TypeHelper& type_helper, const Spec& spec);
+
+  // Resolves the fields of the bindings extracted from the request, e.g. by
+  // PathMatcher::Lookup(). The variables of the HTTP template use the fields
+  // resolved upfront; the others (e.g. query parameters) are resolved through
+  // the TypeHelper.
+  absl::Status ResolveBindings(
+      std::vector<VariableBinding> bindings,
+      std::vector<RequestWeaver::BindingInfo>* resolved) const;
+
+  const ::google::protobuf::util::converter::TypeInfo& type_info() const {
+    return *type_helper_->Info();
+  }
+  const ::google::protobuf::Type& request_type() const {
+    return *request_type_;
+  }
+  const std::string& response_type_url() const { return response_type_url_; }
+  // Null if the response type can't be resolved by the TypeHelper.
+  const ::google::protobuf::Type* response_type() const {
+    return response_type_;
+  }
+
+  const std::string& body_field_path() const { return body_field_path_; }
+  // The fields of the body field path, empty if the body is the whole message.
+  const std::vector<const ::google::protobuf::Field*>& body_fields() const {
+    return body_fields_;
+  }
+  // The body field path split for the PrefixWriter.
+  const std::vector<std::string>& body_prefix() const { return body_prefix_; }
+
+  bool reject_binding_body_field_collisions() const {
+    return reject_binding_body_field_collisions_;
+  }
+  bool case_insensitive_enum_parsing() const {
+    return case_insensitive_enum_parsing_;
+  }
+
+  // The compiled request type, null unless Spec::use_wire_encoder is set and
+  // the request type is supported by the WireEncoder.
+  const WireEncoderPlan* wire_encoder_plan() const {
+    return wire_encoder_plan_.get();
+  }
+
+  // Whether the HTTP body goes into a google.api.HttpBody (the body field, or
+  // the request message if the body is the whole message) and whether the
+  // response is a google.api.HttpBody. The bodies of such methods are passed
+  // through as they are, see HttpBodyRequestTranslator and
+  // HttpBodyResponseTranslator.
+  bool http_body_request() const { return http_body_request_; }
+  bool http_body_response() const { return http_body_response_; }
+
+ private:
+  TranscodingPlan(const TypeHelper& type_helper, const Spec& spec);
+
+  const TypeHelper* type_helper_;
+  const ::google::protobuf::Type* request_type_;
+  std::string response_type_url_;
+  const ::google::protobuf::Type* response_type_;
+  std::string body_field_path_;
+  std::vector<const ::google::protobuf::Field*> body_fields_;
+  std::vector<std::string> body_prefix_;
+  // The fields of the HTTP template variables by their field paths.
+  absl::flat_hash_map<std::vector<std::string>,
+                      std::vector<const ::google::protobuf::Field*>>
+      variable_fields_;
+  bool reject_binding_body_field_collisions_;
+  bool case_insensitive_enum_parsing_;
+  std::shared_ptr<const WireEncoderPlan> wire_encoder_plan_;
+  bool http_body_request_;
+  bool http_body_response_;
+
+  TranscodingPlan(const TranscodingPlan&) = delete;
+  TranscodingPlan& operator=(const TranscodingPlan&) = delete;
+};
+
+}  // namespace transcoding
+
+}  // namespace grpc
+}  // namespace google
+
+#endif  // GRPC_TRANSCODING_TRANSCODING_PLAN_H_
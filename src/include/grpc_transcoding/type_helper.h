@@ -18,9 +18,14 @@
 #include <memory>
 #include <vector>
 
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "absl/types/span.h"
 #include "google/protobuf/type.pb.h"
 #include "google/protobuf/util/converter/type_info.h"
 #include "google/protobuf/util/type_resolver.h"
+#include "grpc_transcoding/snapshot.h"
 
 namespace google {
 namespace grpc {
@@ -30,16 +35,29 @@ namespace transcoding {
 // Provides ::google::protobuf::util::TypeResolver and
 // ::google::protobuf::util::converter::TypeInfo implementations based on a
 // collection of types and a collection of enums.
-// This object is thread-safe
+// This object is thread-safe and the lookups through Info() never block.
 class TypeHelper {
  public:
+  // Indexes all the types & enums upfront. The types & enums are not copied
+  // and must outlive the TypeHelper.
   template <typename Types, typename Enums>
   TypeHelper(const Types& types, const Enums& enums);
 
+  // Resolves the types & enums through type_resolver on their first lookup and
+  // caches the result. Takes the ownership of type_resolver.
   TypeHelper(::google::protobuf::util::TypeResolver* type_resolver);
 
   ~TypeHelper();
 
+  // Writes the types & enums to a kTypeHelperSection of the snapshot. Only
+  // works for a TypeHelper that indexes the types & enums upfront.
+  absl::Status WriteSnapshot(SnapshotWriter* writer) const;
+
+  // Loads a TypeHelper written by WriteSnapshot(). The types & enums are
+  // parsed from their wire format and owned by the TypeHelper.
+  static absl::StatusOr<std::unique_ptr<TypeHelper>> LoadSnapshot(
+      const Snapshot& snapshot);
+
   ::google::protobuf::util::TypeResolver* Resolver() const;
   ::google::protobuf::util::converter::TypeInfo* Info() const;
 
@@ -78,9 +96,29 @@ class TypeHelper {
   const google::protobuf::Field* FindField(const google::protobuf::Type* type,
                                            absl::string_view name) const;
 
+  // ResolveFieldPath() of the field names, through the cache of the resolved
+  // field paths.
+  absl::Status ResolveFieldPath(
+      const ::google::protobuf::Type& type,
+      absl::Span<const absl::string_view> field_path_unresolved,
+      std::vector<const ::google::protobuf::Field*>* field_path_resolved) const;
+
+  // ResolveFieldPath() without the cache of the resolved field paths.
+  absl::Status ResolveFieldPathUncached(
+      const ::google::protobuf::Type& type,
+      absl::Span<const absl::string_view> field_path_unresolved,
+      std::vector<const ::google::protobuf::Field*>* field_path_resolved) const;
+
   ::google::protobuf::util::TypeResolver* type_resolver_;
   std::unique_ptr<::google::protobuf::util::converter::TypeInfo> type_info_;
 
+  // The types & enums indexed upfront, in the order they were added.
+  std::vector<const ::google::protobuf::Type*> types_;
+  std::vector<const ::google::protobuf::Enum*> enums_;
+  // The types & enums loaded from a snapshot.
+  std::vector<std::unique_ptr<::google::protobuf::Type>> owned_types_;
+  std::vector<std::unique_ptr<::google::protobuf::Enum>> owned_enums_;
+
   TypeHelper() = delete;
   TypeHelper(const TypeHelper&) = delete;
   TypeHelper& operator=(const TypeHelper&) = delete;
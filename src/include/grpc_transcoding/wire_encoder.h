@@ -0,0 +1,250 @@
+/* Copyright 2016 Google Inc. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef GRPC_TRANSCODING_WIRE_ENCODER_H_
+#define GRPC_TRANSCODING_WIRE_ENCODER_H_
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/container/flat_hash_set.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "google/protobuf/type.pb.h"
+#include "google/protobuf/util/converter/error_listener.h"
+#include "google/protobuf/util/converter/object_writer.h"
+#include "google/protobuf/util/converter/type_info.h"
+
+namespace google {
+namespace grpc {
+
+namespace transcoding {
+
+// WireEncoderPlan is a message type compiled for the WireEncoder: for each
+// message type reachable from the root type, a table from the field names
+// (both the proto and the JSON names) to the field tag, the compiled type of
+// message fields and the values of enum fields. It's compiled once per type,
+// e.g. by TranscodingPlan, and is immutable and thread-safe afterwards.
+//
+// Only the types that the WireEncoder encodes the same way as
+// ProtoStreamObjectWriter can be compiled. The well-known types (Any, Struct,
+// Timestamp, the wrappers, ...), maps, groups and proto2 required fields are
+// not supported; Compile() returns kUnimplemented if the root type reaches any
+// of them, and the caller is expected to fall back to ProtoStreamObjectWriter.
+class WireEncoderPlan {
+ public:
+  struct Message;
+
+  // The values of an enum type by their names, and their numbers.
+  struct Enum {
+    const ::google::protobuf::Enum* type;
+    absl::flat_hash_map<std::string, int32_t> values;
+    // The numbers of the declared values.
+    absl::flat_hash_set<int32_t> numbers;
+    // Whether it's google.protobuf.NullValue, for which a null is NULL_VALUE.
+    bool null_value;
+  };
+
+  struct Field {
+    const ::google::protobuf::Field* field;
+    // The wire format tag of the field.
+    uint32_t tag;
+    // The compiled type of a TYPE_MESSAGE field, null otherwise.
+    const Message* message;
+    // The compiled type of a TYPE_ENUM field, null otherwise.
+    const Enum* enum_type;
+  };
+
+  struct Message {
+    const ::google::protobuf::Type* type;
+    absl::flat_hash_map<std::string, Field> fields;
+  };
+
+  // Compiles type and the types of its fields, recursively. The types are
+  // resolved through type_info, which needs to outlive the plan.
+  static absl::StatusOr<std::shared_ptr<const WireEncoderPlan>> Compile(
+      const ::google::protobuf::util::converter::TypeInfo& type_info,
+      const ::google::protobuf::Type& type);
+
+  const Message& root() const { return *root_; }
+
+ private:
+  WireEncoderPlan() : root_(nullptr) {}
+
+  absl::StatusOr<const Message*> CompileMessage(
+      const ::google::protobuf::util::converter::TypeInfo& type_info,
+      const ::google::protobuf::Type& type);
+  const Enum* CompileEnum(const ::google::protobuf::Enum& type);
+
+  absl::flat_hash_map<const ::google::protobuf::Type*, std::unique_ptr<Message>>
+      messages_;
+  absl::flat_hash_map<const ::google::protobuf::Enum*, std::unique_ptr<Enum>>
+      enums_;
+  const Message* root_;
+
+  WireEncoderPlan(const WireEncoderPlan&) = delete;
+  WireEncoderPlan& operator=(const WireEncoderPlan&) = delete;
+};
+
+// WireEncoder is an ObjectWriter that encodes the events straight into the
+// protobuf wire format using a WireEncoderPlan. It's an alternative to
+// ProtoStreamObjectWriter for the types the plan could be compiled for: the
+// field names are looked up in the precompiled tables and the values are
+// converted and encoded in place, without going through DataPiece and the
+// TypeInfo for every token.
+//
+// The output is the same as that of ProtoStreamObjectWriter: the fields are
+// written in the order of the events, the repeated fields are not packed and
+// the nulls are skipped, except that of a google.protobuf.NullValue field,
+// which is NULL_VALUE. The values are converted following the same rules,
+// e.g. int64 values may come as strings, bytes as base64 and enums either as
+// names or as numbers. Errors are reported to the ErrorListener; the events
+// after the first error are ignored.
+//
+// Example:
+//   auto plan = WireEncoderPlan::Compile(type_info, type);
+//   if (plan.ok()) {
+//     std::string message;
+//     WireEncoder encoder(**plan, WireEncoder::Options(), &message,
+//                         &error_listener);
+//     JsonStreamParser parser(&encoder);
+//     ...
+//   }
+//
+class WireEncoder : public ::google::protobuf::util::converter::ObjectWriter {
+ public:
+  // The subset of the ProtoStreamObjectWriter options that applies.
+  struct Options {
+    // Skip the fields that aren't in the message type instead of failing.
+    bool ignore_unknown_fields = false;
+    // Accept enum names in any case, with '-' in place of '_'.
+    bool case_insensitive_enum_parsing = false;
+  };
+
+  // The encoded message is appended to output. plan, output and listener must
+  // outlive the WireEncoder.
+  WireEncoder(
+      const WireEncoderPlan& plan, const Options& options, std::string* output,
+      ::google::protobuf::util::converter::ErrorListener* listener);
+  ~WireEncoder();
+
+  // Whether the whole message has been written, i.e. the root object has been
+  // closed.
+  bool done() const { return done_; }
+
+  // ObjectWriter methods.
+  WireEncoder* StartObject(absl::string_view name);
+  WireEncoder* EndObject();
+  WireEncoder* StartList(absl::string_view name);
+  WireEncoder* EndList();
+  WireEncoder* RenderBool(absl::string_view name, bool value);
+  WireEncoder* RenderInt32(absl::string_view name, int32_t value);
+  WireEncoder* RenderUint32(absl::string_view name, uint32_t value);
+  WireEncoder* RenderInt64(absl::string_view name, int64_t value);
+  WireEncoder* RenderUint64(absl::string_view name, uint64_t value);
+  WireEncoder* RenderDouble(absl::string_view name, double value);
+  WireEncoder* RenderFloat(absl::string_view name, float value);
+  WireEncoder* RenderString(absl::string_view name, absl::string_view value);
+  WireEncoder* RenderBytes(absl::string_view name, absl::string_view value);
+  WireEncoder* RenderNull(absl::string_view name);
+
+ private:
+  class Location;
+  struct Value;
+
+  // A message or a list being written.
+  struct Frame {
+    // The message type, null for a list.
+    const WireEncoderPlan::Message* message;
+    // The field the frame was started for, null for the root.
+    const WireEncoderPlan::Field* field;
+    // The offset of the length of a nested message in the output.
+    size_t size_offset;
+    // The number of bytes of the gaps in the frame, which aren't part of the
+    // encoded message.
+    size_t gaps_size;
+    // The number of elements written to a list, for the error locations.
+    int list_size;
+    // Whether each oneof of the message is set, by oneof_index() - 1.
+    std::vector<bool> oneofs;
+  };
+
+  void PushFrame(const WireEncoderPlan::Message* message,
+                 const WireEncoderPlan::Field* field, size_t size_offset);
+
+  // Finds the field of an event in the current frame. Returns null, after
+  // reporting an error unless the field is ignored, if there is none.
+  const WireEncoderPlan::Field* FindField(absl::string_view name);
+
+  // Marks the oneof of field as set in the current message. Fails if it's
+  // already set.
+  bool TakeOneof(const WireEncoderPlan::Field& field);
+
+  void Render(absl::string_view name, const Value& value);
+
+  // Converts value to the type of field and writes it. Returns false if the
+  // value can't be converted.
+  bool WriteValue(const WireEncoderPlan::Field& field, const Value& value);
+
+  // Writes the length of the nested message of frame at its size_offset, and
+  // adds the rest of the placeholder for the length to the gaps.
+  void WriteSize(Frame& frame);
+  // Removes the gaps from the output, once the whole message is written.
+  void RemoveGaps();
+
+  void InvalidName(absl::string_view name, absl::string_view message);
+  void InvalidValue(absl::string_view type_name, absl::string_view value);
+
+  // The location of the current frame for the error messages, e.g.
+  // "book.authors[1]".
+  std::string CurrentLocation() const;
+
+  const WireEncoderPlan& plan_;
+  const Options options_;
+  std::string* output_;
+  ::google::protobuf::util::converter::ErrorListener* listener_;
+
+  // frames_[0, depth_) are the open frames. The frames above are kept to reuse
+  // their memory.
+  std::vector<Frame> frames_;
+  size_t depth_;
+
+  // The unused bytes of the placeholders for the lengths of the nested
+  // messages, as their offsets in the output and sizes. They are removed all
+  // at once when the root message ends, instead of moving the rest of the
+  // output after each nested message whose length takes more than one byte.
+  std::vector<std::pair<size_t, size_t>> gaps_;
+
+  // The depth within the objects and lists that are skipped, either because
+  // they are unknown or after an error.
+  int skip_depth_;
+
+  bool failed_;
+  bool done_;
+
+  WireEncoder(const WireEncoder&) = delete;
+  WireEncoder& operator=(const WireEncoder&) = delete;
+};
+
+}  // namespace transcoding
+
+}  // namespace grpc
+}  // namespace google
+
+#endif  // GRPC_TRANSCODING_WIRE_ENCODER_H_
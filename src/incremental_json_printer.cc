@@ -0,0 +1,960 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+#include "grpc_transcoding/incremental_json_printer.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <limits>
+
+#include "absl/base/casts.h"
+#include "absl/strings/ascii.h"
+#include "absl/strings/escaping.h"
+#include "absl/strings/str_cat.h"
+#include "google/protobuf/io/zero_copy_stream_impl_lite.h"
+#include "google/protobuf/wire_format_lite.h"
+
+namespace pb = ::google::protobuf;
+namespace pbio = ::google::protobuf::io;
+namespace pbutil = ::google::protobuf::util;
+
+namespace google {
+namespace grpc {
+
+namespace transcoding {
+
+namespace {
+
+using ::google::protobuf::internal::WireFormatLite;
+
+// The nesting limit of the messages, the default recursion limit of the
+// protobuf parser.
+constexpr size_t kMaxDepth = 100;
+
+// The well-known types with special JSON representations.
+const char* const kWellKnownTypes[] = {
+    "google.protobuf.Any",         "google.protobuf.Duration",
+    "google.protobuf.Timestamp",   "google.protobuf.FieldMask",
+    "google.protobuf.Struct",      "google.protobuf.Value",
+    "google.protobuf.ListValue",   "google.protobuf.DoubleValue",
+    "google.protobuf.FloatValue",  "google.protobuf.Int64Value",
+    "google.protobuf.UInt64Value", "google.protobuf.Int32Value",
+    "google.protobuf.UInt32Value", "google.protobuf.BoolValue",
+    "google.protobuf.StringValue", "google.protobuf.BytesValue",
+};
+
+bool IsWellKnownType(absl::string_view type_url) {
+  absl::string_view name = type_url.substr(type_url.rfind('/') + 1);
+  for (const char* well_known_type : kWellKnownTypes) {
+    if (name == well_known_type) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool IsMapEntry(const pb::Type& type) {
+  for (const auto& option : type.options()) {
+    if (option.name() == "map_entry" ||
+        option.name() == "google.protobuf.MessageOptions.map_entry") {
+      return true;
+    }
+  }
+  return false;
+}
+
+// "foo_bar" -> "fooBar", the JSON name of a field without a json_name.
+std::string ToCamelCase(absl::string_view name) {
+  std::string result;
+  result.reserve(name.size());
+  bool capitalize_next = false;
+  for (char c : name) {
+    if (c == '_') {
+      capitalize_next = true;
+    } else if (capitalize_next) {
+      result.push_back(absl::ascii_toupper(c));
+      capitalize_next = false;
+    } else {
+      result.push_back(c);
+    }
+  }
+  return result;
+}
+
+bool IsRepeated(const pb::Field& field) {
+  return field.cardinality() == pb::Field::CARDINALITY_REPEATED;
+}
+
+// Whether the values of a repeated field of the kind can be packed.
+bool IsPackable(pb::Field::Kind kind) {
+  return kind != pb::Field::TYPE_STRING && kind != pb::Field::TYPE_BYTES &&
+         kind != pb::Field::TYPE_MESSAGE && kind != pb::Field::TYPE_GROUP;
+}
+
+int WireTypeOf(const pb::Field& field) {
+  return WireFormatLite::WireTypeForFieldType(
+      static_cast<WireFormatLite::FieldType>(field.kind()));
+}
+
+absl::Status InvalidMessage(absl::string_view reason) {
+  return absl::Status(absl::StatusCode::kInvalidArgument,
+                      absl::StrCat("Invalid protobuf message: ", reason));
+}
+
+// Reads a varint from [data, end). Returns its size, 0 if it doesn't end in
+// [data, end) or -1 if it's longer than 10 bytes.
+int ReadVarint(const char* data, const char* end, uint64_t* value) {
+  uint64_t result = 0;
+  for (int i = 0; i < 10; ++i) {
+    if (data + i == end) {
+      return 0;
+    }
+    uint8_t byte = static_cast<uint8_t>(data[i]);
+    result |= static_cast<uint64_t>(byte & 0x7f) << (7 * i);
+    if (byte < 0x80) {
+      *value = result;
+      return i + 1;
+    }
+  }
+  return -1;
+}
+
+// Reads a varint, fixed32 or fixed64 value from [data, end), returning its
+// size like ReadVarint().
+int ReadScalar(int wire_type, const char* data, const char* end,
+               uint64_t* value) {
+  int size = 0;
+  switch (wire_type) {
+    case WireFormatLite::WIRETYPE_VARINT:
+      return ReadVarint(data, end, value);
+    case WireFormatLite::WIRETYPE_FIXED32:
+      size = 4;
+      break;
+    case WireFormatLite::WIRETYPE_FIXED64:
+      size = 8;
+      break;
+    default:
+      return -1;
+  }
+  if (end - data < size) {
+    return 0;
+  }
+  uint64_t result = 0;
+  for (int i = size - 1; i >= 0; --i) {
+    result = (result << 8) | static_cast<uint8_t>(data[i]);
+  }
+  *value = result;
+  return size;
+}
+
+// Returns the number of bytes of the character at value[i] that protobuf's
+// JSON writer escapes as \uXXXX, setting *code_point, or 0 if it doesn't: the
+// other control characters, '<' and '>' (so that the JSON can be embedded in
+// HTML), DEL, the C1 control characters and U+2028 and U+2029 (which end a
+// line in JavaScript).
+int EscapedAsCodePoint(absl::string_view value, size_t i, int* code_point) {
+  unsigned char c = static_cast<unsigned char>(value[i]);
+  if (c < 0x20 || c == '<' || c == '>' || c == 0x7f) {
+    *code_point = c;
+    return 1;
+  }
+  if (c == 0xc2 && i + 1 < value.size()) {
+    unsigned char next = static_cast<unsigned char>(value[i + 1]);
+    if (next >= 0x80 && next < 0xa0) {
+      *code_point = next;
+      return 2;
+    }
+  } else if (c == 0xe2 && i + 2 < value.size() &&
+             static_cast<unsigned char>(value[i + 1]) == 0x80) {
+    unsigned char last = static_cast<unsigned char>(value[i + 2]);
+    if (last == 0xa8 || last == 0xa9) {
+      *code_point = 0x2000 | (last - 0x80);
+      return 3;
+    }
+  }
+  return 0;
+}
+
+// Appends value as a JSON string, escaped the same way as by protobuf's JSON
+// writer.
+void AppendJsonString(absl::string_view value, std::string* json) {
+  json->push_back('"');
+  size_t start = 0;
+  for (size_t i = 0; i < value.size(); ++i) {
+    unsigned char c = static_cast<unsigned char>(value[i]);
+    // The bytes that can't start an escaped character.
+    if (c >= 0x20 && c != '"' && c != '\\' && c != '<' && c != '>' &&
+        c != 0x7f && c != 0xc2 && c != 0xe2) {
+      continue;
+    }
+    const char* escape = nullptr;
+    int size = 1;
+    int code_point = 0;
+    switch (c) {
+      case '"':
+        escape = "\\\"";
+        break;
+      case '\\':
+        escape = "\\\\";
+        break;
+      case '\b':
+        escape = "\\b";
+        break;
+      case '\f':
+        escape = "\\f";
+        break;
+      case '\n':
+        escape = "\\n";
+        break;
+      case '\r':
+        escape = "\\r";
+        break;
+      case '\t':
+        escape = "\\t";
+        break;
+      default:
+        size = EscapedAsCodePoint(value, i, &code_point);
+        if (size == 0) {
+          // A UTF-8 character that isn't escaped.
+          continue;
+        }
+    }
+    json->append(value.data() + start, i - start);
+    if (escape != nullptr) {
+      json->append(escape);
+    } else {
+      char escaped[7];
+      snprintf(escaped, sizeof(escaped), "\\u%04x", code_point);
+      json->append(escaped);
+    }
+    i += size - 1;
+    start = i + 1;
+  }
+  json->append(value.data() + start, value.size() - start);
+  json->push_back('"');
+}
+
+// Appends the shortest of the representations with digits and max_digits that
+// parses back to value, like protobuf's SimpleDtoa() and SimpleFtoa().
+template <typename T>
+void AppendFloatingPoint(T value, int digits, int max_digits,
+                         std::string* json) {
+  if (std::isnan(value)) {
+    json->append("\"NaN\"");
+    return;
+  }
+  if (std::isinf(value)) {
+    json->append(value > 0 ? "\"Infinity\"" : "\"-Infinity\"");
+    return;
+  }
+  char buffer[32];
+  snprintf(buffer, sizeof(buffer), "%.*g", digits, static_cast<double>(value));
+  if (static_cast<T>(strtod(buffer, nullptr)) != value) {
+    snprintf(buffer, sizeof(buffer), "%.*g", max_digits,
+             static_cast<double>(value));
+  }
+  json->append(buffer);
+}
+
+// Appends an integer or bool value as a JSON number or literal.
+void AppendInteger(const pb::Field& field, uint64_t value, std::string* json) {
+  switch (field.kind()) {
+    case pb::Field::TYPE_INT64:
+    case pb::Field::TYPE_SFIXED64:
+      absl::StrAppend(json, static_cast<int64_t>(value));
+      break;
+    case pb::Field::TYPE_SINT64:
+      absl::StrAppend(json, WireFormatLite::ZigZagDecode64(value));
+      break;
+    case pb::Field::TYPE_UINT64:
+    case pb::Field::TYPE_FIXED64:
+      absl::StrAppend(json, value);
+      break;
+    case pb::Field::TYPE_SINT32:
+      absl::StrAppend(json, WireFormatLite::ZigZagDecode32(
+                                static_cast<uint32_t>(value)));
+      break;
+    case pb::Field::TYPE_UINT32:
+    case pb::Field::TYPE_FIXED32:
+      absl::StrAppend(json, static_cast<uint32_t>(value));
+      break;
+    case pb::Field::TYPE_BOOL:
+      json->append(value != 0 ? "true" : "false");
+      break;
+    default:
+      // TYPE_INT32, TYPE_SFIXED32 and TYPE_ENUM.
+      absl::StrAppend(json, static_cast<int32_t>(value));
+  }
+}
+
+}  // namespace
+
+JsonPrinterPlan::JsonPrinterPlan(pbutil::TypeResolver* type_resolver,
+                                 const pbutil::JsonPrintOptions& options)
+    : type_resolver_(type_resolver), options_(options), root_(nullptr) {}
+
+absl::StatusOr<std::shared_ptr<const JsonPrinterPlan>> JsonPrinterPlan::Compile(
+    pbutil::TypeResolver* type_resolver, const std::string& type_url,
+    const pbutil::JsonPrintOptions& options) {
+  if (options.add_whitespace || options.always_print_primitive_fields) {
+    return absl::Status(absl::StatusCode::kUnimplemented,
+                        "The JSON print options are not supported.");
+  }
+  if (IsWellKnownType(type_url)) {
+    return absl::Status(absl::StatusCode::kUnimplemented,
+                        absl::StrCat("Well-known type '", type_url,
+                                     "' is not supported."));
+  }
+  std::shared_ptr<JsonPrinterPlan> plan(
+      new JsonPrinterPlan(type_resolver, options));
+  absl::StatusOr<const Message*> root = plan->CompileMessage(type_url);
+  if (!root.ok()) {
+    return root.status();
+  }
+  plan->root_ = *root;
+  return std::shared_ptr<const JsonPrinterPlan>(std::move(plan));
+}
+
+absl::StatusOr<const JsonPrinterPlan::Message*> JsonPrinterPlan::CompileMessage(
+    const std::string& type_url) {
+  auto it = messages_.find(type_url);
+  if (it != messages_.end()) {
+    return it->second.get();
+  }
+
+  std::unique_ptr<Message> owned(new Message());
+  owned->type.reset(new pb::Type());
+  absl::Status status =
+      type_resolver_->ResolveMessageType(type_url, owned->type.get());
+  if (!status.ok()) {
+    return status;
+  }
+  owned->map_entry = IsMapEntry(*owned->type);
+  // Registered before its fields are compiled, for the recursive types.
+  Message* message = owned.get();
+  messages_.emplace(type_url, std::move(owned));
+
+  for (const auto& field : message->type->fields()) {
+    Field compiled;
+    compiled.field = &field;
+    std::string name;
+    if (options_.preserve_proto_field_names) {
+      name = field.name();
+    } else if (!field.json_name().empty()) {
+      name = field.json_name();
+    } else {
+      name = ToCamelCase(field.name());
+    }
+    AppendJsonString(name, &compiled.key);
+    compiled.key.push_back(':');
+    compiled.well_known = field.kind() == pb::Field::TYPE_MESSAGE &&
+                          IsWellKnownType(field.type_url());
+    compiled.message = nullptr;
+    compiled.enum_type = nullptr;
+    if (field.kind() == pb::Field::TYPE_MESSAGE && !compiled.well_known) {
+      absl::StatusOr<const Message*> field_message =
+          CompileMessage(field.type_url());
+      if (!field_message.ok()) {
+        return field_message.status();
+      }
+      compiled.message = *field_message;
+    } else if (field.kind() == pb::Field::TYPE_ENUM) {
+      absl::StatusOr<const Enum*> enum_type = CompileEnum(field.type_url());
+      if (!enum_type.ok()) {
+        return enum_type.status();
+      }
+      compiled.enum_type = *enum_type;
+    }
+    message->fields.emplace(field.number(), std::move(compiled));
+  }
+  return message;
+}
+
+absl::StatusOr<const JsonPrinterPlan::Enum*> JsonPrinterPlan::CompileEnum(
+    const std::string& type_url) {
+  auto it = enums_.find(type_url);
+  if (it != enums_.end()) {
+    return it->second.get();
+  }
+  pb::Enum type;
+  absl::Status status = type_resolver_->ResolveEnumType(type_url, &type);
+  if (!status.ok()) {
+    return status;
+  }
+  std::unique_ptr<Enum> compiled(new Enum());
+  for (const auto& value : type.enumvalue()) {
+    // The first name of an aliased value is the one printed.
+    compiled->names.emplace(value.number(), value.name());
+  }
+  compiled->null_value = type.name() == "google.protobuf.NullValue";
+  const Enum* result = compiled.get();
+  enums_.emplace(type_url, std::move(compiled));
+  return result;
+}
+
+IncrementalJsonPrinter::IncrementalJsonPrinter(
+    std::shared_ptr<const JsonPrinterPlan> plan)
+    : plan_(std::move(plan)),
+      require_canonical_encoding_(false),
+      json_(nullptr),
+      in_message_(false),
+      position_(0),
+      need_(0),
+      skip_(0),
+      depth_(0) {}
+
+std::unique_ptr<IncrementalJsonPrinter> IncrementalJsonPrinter::Create(
+    pbutil::TypeResolver* type_resolver, const std::string& type_url,
+    const pbutil::JsonPrintOptions& options) {
+  absl::StatusOr<std::shared_ptr<const JsonPrinterPlan>> plan =
+      JsonPrinterPlan::Compile(type_resolver, type_url, options);
+  if (!plan.ok()) {
+    return nullptr;
+  }
+  return std::unique_ptr<IncrementalJsonPrinter>(
+      new IncrementalJsonPrinter(*std::move(plan)));
+}
+
+absl::Status IncrementalJsonPrinter::Print(pbio::ZeroCopyInputStream* input,
+                                           bool last, std::string* json) {
+  json_ = json;
+  if (!in_message_) {
+    in_message_ = true;
+    position_ = 0;
+    pending_.clear();
+    skip_ = 0;
+    depth_ = 0;
+    PushFrame(FrameKind::kMessage, &plan_->root(), nullptr,
+              std::numeric_limits<int64_t>::max());
+  }
+
+  const void* data = nullptr;
+  int size = 0;
+  absl::Status status;
+  while (status.ok() && input->Next(&data, &size)) {
+    const char* begin = static_cast<const char*>(data);
+    status = Consume(begin, begin + size);
+  }
+  if (status.ok() && last) {
+    status = Finish();
+  }
+  if (!status.ok() || last) {
+    in_message_ = false;
+  }
+  return status;
+}
+
+absl::Status IncrementalJsonPrinter::Consume(const char* data,
+                                             const char* end) {
+  while (data < end) {
+    if (skip_ > 0) {
+      int64_t size = std::min<int64_t>(skip_, end - data);
+      data += size;
+      skip_ -= size;
+      position_ += size;
+      continue;
+    }
+    absl::Status status = CloseEndedFrames();
+    if (!status.ok()) {
+      return status;
+    }
+
+    int64_t consumed = 0;
+    if (pending_.empty()) {
+      status = ParseItem(data, end, &consumed);
+      if (!status.ok()) {
+        return status;
+      }
+      if (consumed == 0) {
+        // The field continues in the next part.
+        pending_.assign(data, end - data);
+        return absl::OkStatus();
+      }
+      data += consumed;
+    } else {
+      // Add what's needed to complete the buffered field, at most.
+      int64_t buffered = pending_.size();
+      int64_t size = std::min<int64_t>(need_ - buffered, end - data);
+      pending_.append(data, size);
+      status = ParseItem(pending_.data(), pending_.data() + pending_.size(),
+                         &consumed);
+      if (!status.ok()) {
+        return status;
+      }
+      if (consumed == 0) {
+        data += size;
+        continue;
+      }
+      // The field ends in the bytes just added to pending_.
+      data += consumed - buffered;
+      pending_.clear();
+    }
+  }
+  return CloseEndedFrames();
+}
+
+absl::Status IncrementalJsonPrinter::ParseItem(const char* data,
+                                               const char* end,
+                                               int64_t* consumed) {
+  *consumed = 0;
+  const Frame& frame = Top();
+  // Nothing in the frame can extend past its end.
+  bool ends_frame = end - data >= frame.end - position_;
+  if (ends_frame) {
+    end = data + (frame.end - position_);
+  }
+  auto need = [this, ends_frame](int64_t size) {
+    if (ends_frame) {
+      return InvalidMessage("a field is longer than its message");
+    }
+    need_ = size;
+    return absl::OkStatus();
+  };
+
+  if (frame.kind == FrameKind::kPacked) {
+    const Field& field = *frame.packed_field;
+    uint64_t value = 0;
+    int size = ReadScalar(WireTypeOf(*field.field), data, end, &value);
+    if (size == 0) {
+      return need(end - data + 1);
+    }
+    if (size < 0) {
+      return InvalidMessage("invalid varint");
+    }
+    *consumed = size;
+    position_ += size;
+    BeginElement(&frames_[depth_ - 2]);
+    return PrintValue(field, value);
+  }
+
+  uint64_t tag = 0;
+  int tag_size = ReadVarint(data, end, &tag);
+  if (tag_size == 0) {
+    return need(end - data + 1);
+  }
+  if (tag_size < 0 || tag > std::numeric_limits<uint32_t>::max() ||
+      (tag >> 3) == 0) {
+    return InvalidMessage("invalid tag");
+  }
+  int32_t number = static_cast<int32_t>(tag >> 3);
+  int wire_type = static_cast<int>(tag & 7);
+  if (wire_type == WireFormatLite::WIRETYPE_START_GROUP ||
+      wire_type == WireFormatLite::WIRETYPE_END_GROUP) {
+    return absl::Status(absl::StatusCode::kUnimplemented,
+                        "Groups are not supported.");
+  }
+
+  const char* payload = data + tag_size;
+  uint64_t length = 0;
+  if (wire_type == WireFormatLite::WIRETYPE_LENGTH_DELIMITED) {
+    int length_size = ReadVarint(payload, end, &length);
+    if (length_size == 0) {
+      return need(end - data + 1);
+    }
+    if (length_size < 0) {
+      return InvalidMessage("invalid length");
+    }
+    payload += length_size;
+    if (length >
+        static_cast<uint64_t>(frame.end - position_ - (payload - data))) {
+      return InvalidMessage("a field is longer than its message");
+    }
+  }
+  int64_t header_size = payload - data;
+
+  auto it = frame.message->fields.find(number);
+  if (it == frame.message->fields.end()) {
+    // An unknown field, which isn't printed.
+    if (wire_type == WireFormatLite::WIRETYPE_LENGTH_DELIMITED) {
+      skip_ = length;
+      *consumed = header_size;
+      position_ += header_size;
+      return absl::OkStatus();
+    }
+    uint64_t value = 0;
+    int size = ReadScalar(wire_type, payload, end, &value);
+    if (size == 0) {
+      return need(end - data + 1);
+    }
+    if (size < 0) {
+      return InvalidMessage("invalid wire type");
+    }
+    *consumed = header_size + size;
+    position_ += *consumed;
+    return absl::OkStatus();
+  }
+
+  const Field& field = it->second;
+  pb::Field::Kind kind = field.field->kind();
+  // Map keys are printed as the JSON object keys.
+  bool map_key = frame.kind == FrameKind::kMapEntry && number == 1;
+
+  if (wire_type == WireFormatLite::WIRETYPE_LENGTH_DELIMITED) {
+    if (kind == pb::Field::TYPE_MESSAGE && !field.well_known) {
+      if (depth_ >= kMaxDepth) {
+        return InvalidMessage("the message is nested too deeply");
+      }
+      absl::Status status = BeginValue(field, false);
+      if (!status.ok()) {
+        return status;
+      }
+      *consumed = header_size;
+      position_ += header_size;
+      // The message is read and printed as it arrives.
+      PushFrame(IsRepeated(*field.field) && field.message->map_entry
+                    ? FrameKind::kMapEntry
+                    : FrameKind::kMessage,
+                field.message, nullptr, position_ + length);
+      return absl::OkStatus();
+    }
+
+    if (kind == pb::Field::TYPE_STRING || kind == pb::Field::TYPE_BYTES ||
+        kind == pb::Field::TYPE_MESSAGE) {
+      if (static_cast<uint64_t>(end - payload) < length) {
+        return need(header_size + length);
+      }
+      absl::Status status = BeginValue(field, false);
+      if (!status.ok()) {
+        return status;
+      }
+      *consumed = header_size + length;
+      position_ += *consumed;
+      absl::string_view bytes(payload, length);
+      if (map_key) {
+        AppendJsonString(bytes, json_);
+        json_->push_back(':');
+        return absl::OkStatus();
+      }
+      return PrintBytesValue(field, bytes);
+    }
+
+    if (IsRepeated(*field.field) && IsPackable(kind)) {
+      absl::Status status = BeginValue(field, true);
+      if (!status.ok()) {
+        return status;
+      }
+      *consumed = header_size;
+      position_ += header_size;
+      // The packed values are read and printed as they arrive.
+      PushFrame(FrameKind::kPacked, nullptr, &field, position_ + length);
+      return absl::OkStatus();
+    }
+  }
+
+  if (wire_type != WireTypeOf(*field.field)) {
+    return InvalidMessage(
+        absl::StrCat("invalid wire type of field '", field.field->name(), "'"));
+  }
+  uint64_t value = 0;
+  int size = ReadScalar(wire_type, payload, end, &value);
+  if (size == 0) {
+    return need(end - data + 1);
+  }
+  if (size < 0) {
+    return InvalidMessage("invalid varint");
+  }
+  absl::Status status = BeginValue(field, false);
+  if (!status.ok()) {
+    return status;
+  }
+  *consumed = header_size + size;
+  position_ += *consumed;
+  if (map_key) {
+    PrintMapKey(field, value);
+    return absl::OkStatus();
+  }
+  return PrintValue(field, value);
+}
+
+absl::Status IncrementalJsonPrinter::PrintValue(const Field& field,
+                                                uint64_t value) {
+  switch (field.field->kind()) {
+    case pb::Field::TYPE_DOUBLE:
+      AppendFloatingPoint(absl::bit_cast<double>(value), DBL_DIG, DBL_DIG + 2,
+                          json_);
+      break;
+    case pb::Field::TYPE_FLOAT:
+      AppendFloatingPoint(
+          absl::bit_cast<float>(static_cast<uint32_t>(value)), FLT_DIG,
+          FLT_DIG + 3, json_);
+      break;
+    case pb::Field::TYPE_INT64:
+    case pb::Field::TYPE_SFIXED64:
+    case pb::Field::TYPE_SINT64:
+    case pb::Field::TYPE_UINT64:
+    case pb::Field::TYPE_FIXED64:
+      // 64-bit integers are quoted, as they may not fit in a double.
+      json_->push_back('"');
+      AppendInteger(*field.field, value, json_);
+      json_->push_back('"');
+      break;
+    case pb::Field::TYPE_ENUM: {
+      int32_t number = static_cast<int32_t>(value);
+      if (field.enum_type->null_value) {
+        json_->append("null");
+        break;
+      }
+      auto name = field.enum_type->names.find(number);
+      if (plan_->options().always_print_enums_as_ints ||
+          name == field.enum_type->names.end()) {
+        absl::StrAppend(json_, number);
+      } else {
+        AppendJsonString(name->second, json_);
+      }
+      break;
+    }
+    default:
+      AppendInteger(*field.field, value, json_);
+  }
+  return absl::OkStatus();
+}
+
+absl::Status IncrementalJsonPrinter::PrintBytesValue(const Field& field,
+                                                     absl::string_view bytes) {
+  switch (field.field->kind()) {
+    case pb::Field::TYPE_STRING:
+      AppendJsonString(bytes, json_);
+      return absl::OkStatus();
+    case pb::Field::TYPE_BYTES:
+      json_->push_back('"');
+      json_->append(absl::Base64Escape(bytes));
+      json_->push_back('"');
+      return absl::OkStatus();
+    default: {
+      // A well-known type.
+      pbio::ArrayInputStream input(bytes.data(), bytes.size());
+      pbio::StringOutputStream output(json_);
+      return pbutil::BinaryToJsonStream(plan_->type_resolver(),
+                                        field.field->type_url(), &input,
+                                        &output, plan_->options());
+    }
+  }
+}
+
+void IncrementalJsonPrinter::PrintMapKey(const Field& field, uint64_t value) {
+  json_->push_back('"');
+  AppendInteger(*field.field, value, json_);
+  json_->append("\":");
+}
+
+absl::Status IncrementalJsonPrinter::PrintDefaultValue(const Field& field) {
+  switch (field.field->kind()) {
+    case pb::Field::TYPE_STRING:
+    case pb::Field::TYPE_BYTES:
+      json_->append("\"\"");
+      return absl::OkStatus();
+    case pb::Field::TYPE_MESSAGE:
+      if (field.well_known) {
+        return PrintBytesValue(field, "");
+      }
+      json_->append("{}");
+      return absl::OkStatus();
+    default:
+      return PrintValue(field, 0);
+  }
+}
+
+absl::Status IncrementalJsonPrinter::BeginValue(const Field& field,
+                                                bool packed) {
+  Frame* frame = &Top();
+  if (frame->kind == FrameKind::kMessage) {
+    absl::Status status = BeginField(frame, field);
+    if (!status.ok()) {
+      return status;
+    }
+    if (IsRepeated(*field.field) && !packed) {
+      BeginElement(frame);
+    }
+    return absl::OkStatus();
+  }
+
+  // A map entry, where the key must come before the value.
+  int32_t number = field.field->number();
+  if (std::find(frame->seen.begin(), frame->seen.end(), number) !=
+          frame->seen.end() ||
+      (number == 1 && !frame->seen.empty())) {
+    return NotEncodedOnce(field);
+  }
+  if (number == 2 && frame->seen.empty()) {
+    // The key has the default value.
+    PrintDefaultMapKey(*frame->message);
+  }
+  frame->seen.push_back(number);
+  return absl::OkStatus();
+}
+
+absl::Status IncrementalJsonPrinter::BeginField(Frame* frame,
+                                                const Field& field) {
+  if (frame->open_field == &field) {
+    // The next value of the repeated field.
+    return absl::OkStatus();
+  }
+  CloseOpenField(frame);
+  int32_t number = field.field->number();
+  if (std::find(frame->seen.begin(), frame->seen.end(), number) !=
+      frame->seen.end()) {
+    return NotEncodedOnce(field);
+  }
+  if (require_canonical_encoding_) {
+    if (!frame->seen.empty() && number < frame->seen.back()) {
+      return NotCanonical(field);
+    }
+    int32_t oneof = field.field->oneof_index();
+    if (oneof != 0) {
+      if (std::find(frame->oneofs.begin(), frame->oneofs.end(), oneof) !=
+          frame->oneofs.end()) {
+        return NotCanonical(field);
+      }
+      frame->oneofs.push_back(oneof);
+    }
+  }
+  frame->seen.push_back(number);
+
+  if (!frame->empty) {
+    json_->push_back(',');
+  }
+  frame->empty = false;
+  json_->append(field.key);
+  if (IsRepeated(*field.field)) {
+    json_->push_back(field.message != nullptr && field.message->map_entry
+                         ? '{'
+                         : '[');
+    frame->open_field = &field;
+    frame->open_field_empty = true;
+  }
+  return absl::OkStatus();
+}
+
+void IncrementalJsonPrinter::BeginElement(Frame* frame) {
+  if (!frame->open_field_empty) {
+    json_->push_back(',');
+  }
+  frame->open_field_empty = false;
+}
+
+void IncrementalJsonPrinter::CloseOpenField(Frame* frame) {
+  if (frame->open_field == nullptr) {
+    return;
+  }
+  const Field& field = *frame->open_field;
+  json_->push_back(field.message != nullptr && field.message->map_entry ? '}'
+                                                                        : ']');
+  frame->open_field = nullptr;
+}
+
+void IncrementalJsonPrinter::PrintDefaultMapKey(const Message& entry) {
+  auto key = entry.fields.find(1);
+  if (key == entry.fields.end() ||
+      key->second.field->kind() == pb::Field::TYPE_STRING) {
+    json_->append("\"\":");
+  } else {
+    PrintMapKey(key->second, 0);
+  }
+}
+
+absl::Status IncrementalJsonPrinter::NotEncodedOnce(const Field& field) {
+  return absl::Status(
+      absl::StatusCode::kUnimplemented,
+      absl::StrCat("Field '", field.field->name(),
+                   "' is encoded more than once or out of order, which "
+                   "incremental JSON translation doesn't support."));
+}
+
+absl::Status IncrementalJsonPrinter::NotCanonical(const Field& field) {
+  return absl::Status(
+      absl::StatusCode::kUnimplemented,
+      absl::StrCat("Field '", field.field->name(),
+                   "' is encoded out of the order of the field numbers or "
+                   "after another field of its oneof."));
+}
+
+void IncrementalJsonPrinter::PushFrame(FrameKind kind, const Message* message,
+                                       const Field* packed_field,
+                                       int64_t end) {
+  if (depth_ == frames_.size()) {
+    frames_.emplace_back();
+  }
+  Frame& frame = frames_[depth_++];
+  frame.kind = kind;
+  frame.message = message;
+  frame.packed_field = packed_field;
+  frame.end = end;
+  frame.empty = true;
+  frame.open_field = nullptr;
+  frame.open_field_empty = true;
+  frame.seen.clear();
+  frame.oneofs.clear();
+  if (kind == FrameKind::kMessage) {
+    json_->push_back('{');
+  }
+}
+
+absl::Status IncrementalJsonPrinter::CloseFrame() {
+  Frame& frame = Top();
+  absl::Status status;
+  switch (frame.kind) {
+    case FrameKind::kMessage:
+      CloseOpenField(&frame);
+      json_->push_back('}');
+      break;
+    case FrameKind::kMapEntry:
+      if (frame.seen.empty()) {
+        PrintDefaultMapKey(*frame.message);
+      }
+      if (std::find(frame.seen.begin(), frame.seen.end(), 2) ==
+          frame.seen.end()) {
+        auto value = frame.message->fields.find(2);
+        if (value == frame.message->fields.end()) {
+          return InvalidMessage("the map entry type has no value");
+        }
+        status = PrintDefaultValue(value->second);
+      }
+      break;
+    case FrameKind::kPacked:
+      break;
+  }
+  --depth_;
+  return status;
+}
+
+absl::Status IncrementalJsonPrinter::CloseEndedFrames() {
+  while (depth_ > 1 && Top().end == position_) {
+    absl::Status status = CloseFrame();
+    if (!status.ok()) {
+      return status;
+    }
+  }
+  return absl::OkStatus();
+}
+
+absl::Status IncrementalJsonPrinter::Finish() {
+  absl::Status status = CloseEndedFrames();
+  if (!status.ok()) {
+    return status;
+  }
+  if (!pending_.empty() || skip_ > 0 || depth_ != 1) {
+    return InvalidMessage("the message is truncated");
+  }
+  return CloseFrame();
+}
+
+}  // namespace transcoding
+
+}  // namespace grpc
+}  // namespace google
@@ -0,0 +1,71 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+#include "grpc_transcoding/json_printer_cache.h"
+
+namespace google {
+namespace grpc {
+namespace transcoding {
+
+namespace {
+
+int OptionBits(const ::google::protobuf::util::JsonPrintOptions& options) {
+  return (options.add_whitespace ? 1 : 0) |
+         (options.always_print_primitive_fields ? 2 : 0) |
+         (options.always_print_enums_as_ints ? 4 : 0) |
+         (options.preserve_proto_field_names ? 8 : 0);
+}
+
+}  // namespace
+
+JsonPrinterCache::JsonPrinterCache(
+    ::google::protobuf::util::TypeResolver* type_resolver)
+    : type_resolver_(type_resolver) {}
+
+std::shared_ptr<const JsonPrinterPlan> JsonPrinterCache::Get(
+    const std::string& type_url,
+    const ::google::protobuf::util::JsonPrintOptions& options) {
+  Key key(type_url, OptionBits(options));
+  {
+    // The hits only hold the lock shared, so that the translators don't wait
+    // for each other.
+    absl::ReaderMutexLock lock(&mu_);
+    auto it = plans_.find(key);
+    if (it != plans_.end()) {
+      return it->second;
+    }
+  }
+
+  // Compiled without holding the lock, so that the other types can be looked
+  // up in the meantime.
+  auto plan = JsonPrinterPlan::Compile(type_resolver_, type_url, options);
+  std::shared_ptr<const JsonPrinterPlan> compiled =
+      plan.ok() ? *std::move(plan) : nullptr;
+
+  absl::MutexLock lock(&mu_);
+  // Another thread may have compiled the same type in the meantime, in which
+  // case its plan is kept.
+  return plans_.emplace(std::move(key), std::move(compiled)).first->second;
+}
+
+size_t JsonPrinterCache::size() const {
+  absl::ReaderMutexLock lock(&mu_);
+  return plans_.size();
+}
+
+}  // namespace transcoding
+}  // namespace grpc
+}  // namespace google
@@ -20,8 +20,9 @@
 
 #include "absl/strings/string_view.h"
 #include "google/protobuf/io/zero_copy_stream.h"
-#include "google/protobuf/util/converter/json_stream_parser.h"
 #include "google/protobuf/util/converter/object_writer.h"
+#include "google/protobuf/util/converter/type_info.h"
+#include "grpc_transcoding/json_tokenizer.h"
 #include "grpc_transcoding/message_stream.h"
 #include "grpc_transcoding/request_message_translator.h"
 #include "grpc_transcoding/request_stream_translator.h"
@@ -43,7 +44,7 @@ namespace pbconv = ::google::protobuf::util::converter;
 //
 // LazyRequestTranslator is given
 //    - a ZeroCopyInputStream (json_input) to read the input JSON from,
-//    - a JsonStreamParser (parser) - the input end of the translation
+//    - a JsonTokenizer (parser) - the input end of the translation
 //      pipeline, i.e. that takes the input JSON,
 //    - a MessageStream (translated), the output end of the translation
 //      pipeline, i.e. where the output proto messages appear.
@@ -54,7 +55,7 @@ namespace pbconv = ::google::protobuf::util::converter;
 class LazyRequestTranslator : public MessageStream {
  public:
   LazyRequestTranslator(pbio::ZeroCopyInputStream* json_input,
-                        pbconv::JsonStreamParser* json_parser,
+                        JsonTokenizer* json_parser,
                         MessageStream* translated)
       : input_json_(json_input),
         json_parser_(json_parser),
@@ -125,7 +126,7 @@ class LazyRequestTranslator : public MessageStream {
   pbio::ZeroCopyInputStream* input_json_;
 
   // The JSON parser that is the starting point of the translation pipeline
-  pbconv::JsonStreamParser* json_parser_;
+  JsonTokenizer* json_parser_;
 
   // The stream where the translated messages appear
   MessageStream* translated_;
@@ -141,25 +142,72 @@ class LazyRequestTranslator : public MessageStream {
 
 JsonRequestTranslator::JsonRequestTranslator(
     pbutil::TypeResolver* type_resolver, pbio::ZeroCopyInputStream* json_input,
-    RequestInfo request_info, bool streaming, bool output_delimiters) {
-  // A writer that accepts input ObjectWriter events for translation
-  pbconv::ObjectWriter* writer = nullptr;
-  // The stream where translated messages appear
-  MessageStream* translated = nullptr;
+    RequestInfo request_info, bool streaming, bool output_delimiters,
+    JsonTokenizer::Kind tokenizer) {
   if (streaming) {
     // Streaming - we'll need a RequestStreamTranslator
     stream_translator_.reset(new RequestStreamTranslator(
         *type_resolver, output_delimiters, std::move(request_info)));
-    writer = stream_translator_.get();
-    translated = stream_translator_.get();
   } else {
     // No streaming - use a RequestMessageTranslator
     message_translator_.reset(new RequestMessageTranslator(
         *type_resolver, output_delimiters, std::move(request_info)));
+  }
+  Initialize(json_input, streaming, tokenizer);
+}
+
+JsonRequestTranslator::JsonRequestTranslator(
+    const pbconv::TypeInfo* type_info, pbio::ZeroCopyInputStream* json_input,
+    RequestInfo request_info, bool streaming, bool output_delimiters,
+    JsonTokenizer::Kind tokenizer) {
+  if (streaming) {
+    stream_translator_.reset(new RequestStreamTranslator(
+        *type_info, output_delimiters, std::move(request_info)));
+  } else {
+    message_translator_.reset(new RequestMessageTranslator(
+        *type_info, output_delimiters, std::move(request_info)));
+  }
+  Initialize(json_input, streaming, tokenizer);
+}
+
+JsonRequestTranslator::JsonRequestTranslator(
+    const TranscodingPlan& plan, pbio::ZeroCopyInputStream* json_input,
+    std::vector<RequestWeaver::BindingInfo> variable_bindings, bool streaming,
+    bool output_delimiters, JsonTokenizer::Kind tokenizer) {
+  if (streaming) {
+    stream_translator_.reset(new RequestStreamTranslator(
+        plan, output_delimiters, std::move(variable_bindings)));
+  } else {
+    message_translator_.reset(new RequestMessageTranslator(
+        plan, output_delimiters, std::move(variable_bindings)));
+  }
+  Initialize(json_input, streaming, tokenizer);
+}
+
+void JsonRequestTranslator::set_compressor(
+    const MessageCompressor* compressor) {
+  if (stream_translator_ != nullptr) {
+    stream_translator_->set_compressor(compressor);
+  } else {
+    message_translator_->set_compressor(compressor);
+  }
+}
+
+void JsonRequestTranslator::Initialize(pbio::ZeroCopyInputStream* json_input,
+                                       bool streaming,
+                                       JsonTokenizer::Kind tokenizer) {
+  // A writer that accepts input ObjectWriter events for translation
+  pbconv::ObjectWriter* writer = nullptr;
+  // The stream where translated messages appear
+  MessageStream* translated = nullptr;
+  if (streaming) {
+    writer = stream_translator_.get();
+    translated = stream_translator_.get();
+  } else {
     writer = &message_translator_->Input();
     translated = message_translator_.get();
   }
-  parser_.reset(new pbconv::JsonStreamParser(writer));
+  parser_ = JsonTokenizer::Create(tokenizer, writer);
   output_.reset(
       new LazyRequestTranslator(json_input, parser_.get(), translated));
 }
@@ -0,0 +1,199 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+#include "grpc_transcoding/json_scanner.h"
+
+#include <cstdint>
+
+#include "grpc_transcoding/cpu_features.h"
+
+namespace google {
+namespace grpc {
+
+namespace transcoding {
+
+namespace {
+
+inline bool IsWhitespace(char c) {
+  return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+}
+
+const char* FindStringSpecialScalar(const char* begin, const char* end,
+                                    char quote, bool* non_ascii) {
+  for (const char* p = begin; p < end; ++p) {
+    if (*p == quote || *p == '\\') {
+      return p;
+    }
+    if (static_cast<unsigned char>(*p) >= 0x80) {
+      *non_ascii = true;
+    }
+  }
+  return end;
+}
+
+const char* SkipWhitespaceScalar(const char* begin, const char* end) {
+  const char* p = begin;
+  while (p < end && IsWhitespace(*p)) {
+    ++p;
+  }
+  return p;
+}
+
+#ifdef GRPC_TRANSCODING_X86
+
+const char* FindStringSpecialSse2(const char* begin, const char* end,
+                                  char quote, bool* non_ascii) {
+  const __m128i quotes = _mm_set1_epi8(quote);
+  const __m128i backslashes = _mm_set1_epi8('\\');
+  const char* p = begin;
+  for (; end - p >= 16; p += 16) {
+    __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    uint32_t special = _mm_movemask_epi8(_mm_or_si128(
+        _mm_cmpeq_epi8(chunk, quotes), _mm_cmpeq_epi8(chunk, backslashes)));
+    // The high bits, i.e. the non-ASCII characters.
+    uint32_t high = _mm_movemask_epi8(chunk);
+    if (special != 0) {
+      int index = __builtin_ctz(special);
+      if ((high & ((1u << index) - 1)) != 0) {
+        *non_ascii = true;
+      }
+      return p + index;
+    }
+    if (high != 0) {
+      *non_ascii = true;
+    }
+  }
+  return FindStringSpecialScalar(p, end, quote, non_ascii);
+}
+
+const char* SkipWhitespaceSse2(const char* begin, const char* end) {
+  const __m128i spaces = _mm_set1_epi8(' ');
+  const __m128i newlines = _mm_set1_epi8('\n');
+  const __m128i returns = _mm_set1_epi8('\r');
+  const __m128i tabs = _mm_set1_epi8('\t');
+  const char* p = begin;
+  for (; end - p >= 16; p += 16) {
+    __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    __m128i whitespace = _mm_or_si128(
+        _mm_or_si128(_mm_cmpeq_epi8(chunk, spaces),
+                     _mm_cmpeq_epi8(chunk, newlines)),
+        _mm_or_si128(_mm_cmpeq_epi8(chunk, returns),
+                     _mm_cmpeq_epi8(chunk, tabs)));
+    uint32_t other = ~_mm_movemask_epi8(whitespace) & 0xFFFF;
+    if (other != 0) {
+      return p + __builtin_ctz(other);
+    }
+  }
+  return SkipWhitespaceScalar(p, end);
+}
+
+__attribute__((target("avx2"))) const char* FindStringSpecialAvx2(
+    const char* begin, const char* end, char quote, bool* non_ascii) {
+  const __m256i quotes = _mm256_set1_epi8(quote);
+  const __m256i backslashes = _mm256_set1_epi8('\\');
+  const char* p = begin;
+  for (; end - p >= 32; p += 32) {
+    __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+    uint32_t special = _mm256_movemask_epi8(
+        _mm256_or_si256(_mm256_cmpeq_epi8(chunk, quotes),
+                        _mm256_cmpeq_epi8(chunk, backslashes)));
+    uint32_t high = _mm256_movemask_epi8(chunk);
+    if (special != 0) {
+      int index = __builtin_ctz(special);
+      if (index > 0 && (high & (0xFFFFFFFFu >> (32 - index))) != 0) {
+        *non_ascii = true;
+      }
+      return p + index;
+    }
+    if (high != 0) {
+      *non_ascii = true;
+    }
+  }
+  return FindStringSpecialSse2(p, end, quote, non_ascii);
+}
+
+__attribute__((target("avx2"))) const char* SkipWhitespaceAvx2(
+    const char* begin, const char* end) {
+  const __m256i spaces = _mm256_set1_epi8(' ');
+  const __m256i newlines = _mm256_set1_epi8('\n');
+  const __m256i returns = _mm256_set1_epi8('\r');
+  const __m256i tabs = _mm256_set1_epi8('\t');
+  const char* p = begin;
+  for (; end - p >= 32; p += 32) {
+    __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+    __m256i whitespace = _mm256_or_si256(
+        _mm256_or_si256(_mm256_cmpeq_epi8(chunk, spaces),
+                        _mm256_cmpeq_epi8(chunk, newlines)),
+        _mm256_or_si256(_mm256_cmpeq_epi8(chunk, returns),
+                        _mm256_cmpeq_epi8(chunk, tabs)));
+    uint32_t other = ~static_cast<uint32_t>(_mm256_movemask_epi8(whitespace));
+    if (other != 0) {
+      return p + __builtin_ctz(other);
+    }
+  }
+  return SkipWhitespaceSse2(p, end);
+}
+
+#endif  // GRPC_TRANSCODING_X86
+
+}  // namespace
+
+const JsonScanner& JsonScanner::Get() {
+  static const JsonScanner& scanner =
+      ForIsa(IsSupported(kAvx2) ? kAvx2
+                                : IsSupported(kSse2) ? kSse2 : kScalar);
+  return scanner;
+}
+
+bool JsonScanner::IsSupported(Isa isa) {
+  switch (isa) {
+    case kScalar:
+      return true;
+    case kSse2:
+      return CpuSupportsSse2();
+    case kAvx2:
+      return CpuSupportsAvx2();
+    default:
+      return false;
+  }
+}
+
+const JsonScanner& JsonScanner::ForIsa(Isa isa) {
+  // The scanners are constant-initialized, so they are safe to use from
+  // static initializers as well.
+  static const JsonScanner scalar(kScalar, FindStringSpecialScalar,
+                                  SkipWhitespaceScalar);
+#ifdef GRPC_TRANSCODING_X86
+  static const JsonScanner sse2(kSse2, FindStringSpecialSse2,
+                                SkipWhitespaceSse2);
+  static const JsonScanner avx2(kAvx2, FindStringSpecialAvx2,
+                                SkipWhitespaceAvx2);
+  switch (isa) {
+    case kSse2:
+      return sse2;
+    case kAvx2:
+      return avx2;
+    default:
+      break;
+  }
+#endif
+  return scalar;
+}
+
+}  // namespace transcoding
+
+}  // namespace grpc
+}  // namespace google
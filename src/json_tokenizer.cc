@@ -0,0 +1,673 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+#include "grpc_transcoding/json_tokenizer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "google/protobuf/util/converter/json_stream_parser.h"
+#include "google/protobuf/util/converter/object_writer.h"
+#include "grpc_transcoding/json_scanner.h"
+
+namespace google {
+namespace grpc {
+
+namespace transcoding {
+namespace {
+
+namespace pbconv = ::google::protobuf::util::converter;
+
+// The maximum nesting of objects and lists, the same as JsonStreamParser's.
+const size_t kMaxDepth = 100;
+
+// The number of characters around the failure shown in the error messages.
+const int kContextLength = 20;
+
+inline bool IsWhitespace(char c) {
+  return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+}
+
+inline bool IsDigit(char c) { return c >= '0' && c <= '9'; }
+
+inline bool IsNumberChar(char c) {
+  return IsDigit(c) || c == '-' || c == '+' || c == '.' || c == 'e' ||
+         c == 'E';
+}
+
+inline bool IsKeyStart(char c) {
+  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_' ||
+         c == '$';
+}
+
+inline bool IsKeyChar(char c) { return IsKeyStart(c) || IsDigit(c); }
+
+inline int HexValue(char c) {
+  if (IsDigit(c)) return c - '0';
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  return -1;
+}
+
+// Whether s is valid UTF-8, without overlong encodings and surrogates.
+bool IsValidUtf8(absl::string_view s) {
+  const unsigned char* p = reinterpret_cast<const unsigned char*>(s.data());
+  const unsigned char* end = p + s.size();
+  while (p < end) {
+    unsigned char c = *p;
+    if (c < 0x80) {
+      ++p;
+      continue;
+    }
+    int length;
+    uint32_t code_point;
+    uint32_t min_code_point;
+    if ((c & 0xE0) == 0xC0) {
+      length = 2;
+      code_point = c & 0x1F;
+      min_code_point = 0x80;
+    } else if ((c & 0xF0) == 0xE0) {
+      length = 3;
+      code_point = c & 0x0F;
+      min_code_point = 0x800;
+    } else if ((c & 0xF8) == 0xF0) {
+      length = 4;
+      code_point = c & 0x07;
+      min_code_point = 0x10000;
+    } else {
+      return false;
+    }
+    if (end - p < length) {
+      return false;
+    }
+    for (int i = 1; i < length; ++i) {
+      if ((p[i] & 0xC0) != 0x80) {
+        return false;
+      }
+      code_point = (code_point << 6) | (p[i] & 0x3F);
+    }
+    if (code_point < min_code_point || code_point > 0x10FFFF ||
+        (code_point >= 0xD800 && code_point <= 0xDFFF)) {
+      return false;
+    }
+    p += length;
+  }
+  return true;
+}
+
+void AppendUtf8(uint32_t code_point, std::string* out) {
+  if (code_point < 0x80) {
+    out->push_back(static_cast<char>(code_point));
+  } else if (code_point < 0x800) {
+    out->push_back(static_cast<char>(0xC0 | (code_point >> 6)));
+    out->push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+  } else if (code_point < 0x10000) {
+    out->push_back(static_cast<char>(0xE0 | (code_point >> 12)));
+    out->push_back(static_cast<char>(0x80 | ((code_point >> 6) & 0x3F)));
+    out->push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+  } else {
+    out->push_back(static_cast<char>(0xF0 | (code_point >> 18)));
+    out->push_back(static_cast<char>(0x80 | ((code_point >> 12) & 0x3F)));
+    out->push_back(static_cast<char>(0x80 | ((code_point >> 6) & 0x3F)));
+    out->push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+  }
+}
+
+class ProtobufJsonTokenizer : public JsonTokenizer {
+ public:
+  explicit ProtobufJsonTokenizer(pbconv::ObjectWriter* writer)
+      : parser_(writer) {}
+
+  absl::Status Parse(absl::string_view json) override {
+    return parser_.Parse(json);
+  }
+  absl::Status FinishParse() override { return parser_.FinishParse(); }
+
+ private:
+  pbconv::JsonStreamParser parser_;
+};
+
+// A JSON parser that uses JsonScanner for the bulk of the input, i.e. the
+// string contents and the whitespace, and dispatches on the first character
+// of the other tokens.
+//
+// The tokens are parsed in place in the chunk passed to Parse(). Only when a
+// token is split between chunks, the rest of the chunk is kept in leftover_
+// and the next chunk is appended to it. For a long string split across many
+// chunks, the scan resumes where it stopped, so the input is scanned once.
+class VectorizedJsonTokenizer : public JsonTokenizer {
+ public:
+  explicit VectorizedJsonTokenizer(pbconv::ObjectWriter* writer)
+      : writer_(writer),
+        scanner_(JsonScanner::Get()),
+        expect_(kValue),
+        finishing_(false),
+        string_scanned_(0),
+        string_non_ascii_(false),
+        string_escaped_(false) {}
+
+  absl::Status Parse(absl::string_view json) override {
+    if (!status_.ok()) {
+      return status_;
+    }
+    if (leftover_.empty()) {
+      size_t parsed = ParseBuffer(json);
+      if (status_.ok()) {
+        leftover_.assign(json.data() + parsed, json.size() - parsed);
+      }
+    } else {
+      // The events may refer to leftover_, so it's only changed after parsing.
+      leftover_.append(json.data(), json.size());
+      size_t parsed = ParseBuffer(leftover_);
+      if (status_.ok()) {
+        leftover_.erase(0, parsed);
+      }
+    }
+    return status_;
+  }
+
+  absl::Status FinishParse() override {
+    if (!status_.ok()) {
+      return status_;
+    }
+    finishing_ = true;
+    size_t parsed = ParseBuffer(leftover_);
+    if (status_.ok() && expect_ != kDone) {
+      // The input ended within a token or a value.
+      Fail("Unexpected end of string.", leftover_.data() + parsed);
+    }
+    return status_;
+  }
+
+ private:
+  // What the parser expects to see next.
+  enum Expect {
+    // A value: the root, a value of an object or a list value after ','.
+    kValue,
+    // The first value of a list or ']'.
+    kListValueOrEnd,
+    // ',' or ']' after a list value.
+    kListCommaOrEnd,
+    // The first key of an object or '}'.
+    kKeyOrEnd,
+    // A key after ','.
+    kKey,
+    // ':' after a key.
+    kColon,
+    // ',' or '}' after an object value.
+    kObjectCommaOrEnd,
+    // Nothing, the root value is complete.
+    kDone,
+  };
+
+  enum Container {
+    kObject,
+    kList,
+  };
+
+  // Parses the complete tokens in buffer and returns the size of the parsed
+  // part, i.e. the offset of the incomplete token, if any.
+  size_t ParseBuffer(absl::string_view buffer) {
+    buffer_ = buffer;
+    const char* p = buffer.data();
+    const char* end = p + buffer.size();
+    while (true) {
+      if (p < end && IsWhitespace(*p)) {
+        p = scanner_.SkipWhitespace(p, end);
+      }
+      if (p == end) {
+        break;
+      }
+      const char* next = ParseToken(p, end);
+      if (next == nullptr) {
+        // Failed or the token is incomplete.
+        break;
+      }
+      p = next;
+    }
+    return p - buffer.data();
+  }
+
+  // Parses the token starting at p, which is not whitespace. Returns the end
+  // of the token, or null if it has failed or if the token doesn't end before
+  // end.
+  const char* ParseToken(const char* p, const char* end) {
+    switch (expect_) {
+      case kValue:
+        return ParseValue(p, end);
+      case kListValueOrEnd:
+        if (*p == ']') {
+          return EndList(p);
+        }
+        return ParseValue(p, end);
+      case kListCommaOrEnd:
+        if (*p == ',') {
+          expect_ = kValue;
+          return p + 1;
+        }
+        if (*p == ']') {
+          return EndList(p);
+        }
+        return Fail("Expected , or ] after array value.", p);
+      case kKeyOrEnd:
+        if (*p == '}') {
+          return EndObject(p);
+        }
+        return ParseKey(p, end);
+      case kKey:
+        return ParseKey(p, end);
+      case kColon:
+        if (*p == ':') {
+          expect_ = kValue;
+          return p + 1;
+        }
+        return Fail("Expected : between key:value pair.", p);
+      case kObjectCommaOrEnd:
+        if (*p == ',') {
+          expect_ = kKey;
+          return p + 1;
+        }
+        if (*p == '}') {
+          return EndObject(p);
+        }
+        return Fail("Expected , or } after key:value pair.", p);
+      case kDone:
+        return Fail("Parsing terminated before end of input.", p);
+    }
+    return nullptr;
+  }
+
+  const char* ParseValue(const char* p, const char* end) {
+    // The values in lists and the root value have no name.
+    absl::string_view name;
+    if (!containers_.empty() && containers_.back() == kObject) {
+      name = key_;
+    }
+    switch (*p) {
+      case '{':
+        if (!Push(kObject, p)) {
+          return nullptr;
+        }
+        writer_->StartObject(name);
+        expect_ = kKeyOrEnd;
+        return p + 1;
+      case '[':
+        if (!Push(kList, p)) {
+          return nullptr;
+        }
+        writer_->StartList(name);
+        expect_ = kListValueOrEnd;
+        return p + 1;
+      case '"':
+      case '\'': {
+        absl::string_view value;
+        const char* next = ParseString(p, end, &value);
+        if (next == nullptr) {
+          return nullptr;
+        }
+        writer_->RenderString(name, value);
+        return ValueDone(next);
+      }
+      case 't':
+      case 'f':
+      case 'n':
+        return ParseLiteral(p, end, name);
+      default:
+        if (*p == '-' || IsDigit(*p)) {
+          return ParseNumber(p, end, name);
+        }
+        return Fail("Expected a value.", p);
+    }
+  }
+
+  const char* ParseKey(const char* p, const char* end) {
+    const char* next;
+    if (*p == '"' || *p == '\'') {
+      absl::string_view key;
+      next = ParseString(p, end, &key);
+      if (next == nullptr) {
+        return nullptr;
+      }
+      key_.assign(key.data(), key.size());
+    } else if (IsKeyStart(*p)) {
+      // An unquoted key, as JsonStreamParser accepts them.
+      next = p + 1;
+      while (next < end && IsKeyChar(*next)) {
+        ++next;
+      }
+      if (next == end && !finishing_) {
+        return nullptr;
+      }
+      key_.assign(p, next - p);
+    } else {
+      return Fail("Expected an object key or }.", p);
+    }
+    expect_ = kColon;
+    return next;
+  }
+
+  // Parses the string starting with the quote at p into *value, which refers
+  // either to the input or, if the string has escapes, to scratch_.
+  const char* ParseString(const char* p, const char* end,
+                          absl::string_view* value) {
+    const char quote = *p;
+    const char* begin = p + 1;
+    // Resume the scan of a string that was split between chunks.
+    const char* q = begin + string_scanned_;
+    bool non_ascii = string_non_ascii_;
+    bool escaped = string_escaped_;
+    while (true) {
+      q = scanner_.FindStringSpecial(q, end, quote, &non_ascii);
+      if (q == end || (*q == '\\' && end - q < 2)) {
+        string_scanned_ = q - begin;
+        string_non_ascii_ = non_ascii;
+        string_escaped_ = escaped;
+        return nullptr;
+      }
+      if (*q == quote) {
+        break;
+      }
+      // Skip the escaped character, which might be a quote.
+      escaped = true;
+      q += 2;
+    }
+    string_scanned_ = 0;
+    string_non_ascii_ = false;
+    string_escaped_ = false;
+
+    absl::string_view raw(begin, q - begin);
+    if (non_ascii && !IsValidUtf8(raw)) {
+      return Fail("Encountered non UTF-8 code points.", p);
+    }
+    if (!escaped) {
+      *value = raw;
+    } else {
+      if (!Unescape(raw)) {
+        return nullptr;
+      }
+      *value = scratch_;
+    }
+    return q + 1;
+  }
+
+  // Unescapes raw into scratch_.
+  bool Unescape(absl::string_view raw) {
+    scratch_.clear();
+    const char* p = raw.data();
+    const char* end = p + raw.size();
+    while (p < end) {
+      const char* escape = std::find(p, end, '\\');
+      scratch_.append(p, escape - p);
+      if (escape == end) {
+        break;
+      }
+      // The scan guarantees that a backslash is followed by a character.
+      switch (escape[1]) {
+        case '"':
+        case '\'':
+        case '\\':
+        case '/':
+          scratch_.push_back(escape[1]);
+          break;
+        case 'b':
+          scratch_.push_back('\b');
+          break;
+        case 'f':
+          scratch_.push_back('\f');
+          break;
+        case 'n':
+          scratch_.push_back('\n');
+          break;
+        case 'r':
+          scratch_.push_back('\r');
+          break;
+        case 't':
+          scratch_.push_back('\t');
+          break;
+        case 'u': {
+          p = ParseUnicodeEscape(escape, end);
+          if (p == nullptr) {
+            return false;
+          }
+          continue;
+        }
+        default:
+          Fail("Invalid escape sequence.", escape);
+          return false;
+      }
+      p = escape + 2;
+    }
+    return true;
+  }
+
+  // Parses the \uXXXX escape at p, or the pair of them for a surrogate pair,
+  // and appends the character to scratch_.
+  const char* ParseUnicodeEscape(const char* p, const char* end) {
+    uint32_t code_point;
+    if (!ParseHex4(p, end, &code_point)) {
+      Fail("Illegal hex string.", p);
+      return nullptr;
+    }
+    const char* next = p + 6;
+    if (code_point >= 0xD800 && code_point <= 0xDBFF) {
+      uint32_t low;
+      if (end - next < 2 || next[0] != '\\' || next[1] != 'u') {
+        Fail("Missing low surrogate.", p);
+        return nullptr;
+      }
+      if (!ParseHex4(next, end, &low)) {
+        Fail("Illegal hex string.", next);
+        return nullptr;
+      }
+      if (low < 0xDC00 || low > 0xDFFF) {
+        Fail("Invalid low surrogate.", next);
+        return nullptr;
+      }
+      code_point = 0x10000 + ((code_point - 0xD800) << 10) + (low - 0xDC00);
+      next += 6;
+    } else if (code_point >= 0xDC00 && code_point <= 0xDFFF) {
+      Fail("Invalid unicode code point.", p);
+      return nullptr;
+    }
+    AppendUtf8(code_point, &scratch_);
+    return next;
+  }
+
+  // Parses the 4 hex digits of the \u escape at p.
+  static bool ParseHex4(const char* p, const char* end, uint32_t* value) {
+    if (end - p < 6) {
+      return false;
+    }
+    *value = 0;
+    for (int i = 2; i < 6; ++i) {
+      int digit = HexValue(p[i]);
+      if (digit < 0) {
+        return false;
+      }
+      *value = (*value << 4) | digit;
+    }
+    return true;
+  }
+
+  // Parses a number the way JsonStreamParser does: the integers are rendered
+  // as uint64 or int64 values if they fit, all other numbers as doubles.
+  const char* ParseNumber(const char* p, const char* end,
+                          absl::string_view name) {
+    const char* next = p;
+    while (next < end && IsNumberChar(*next)) {
+      ++next;
+    }
+    if (next == end && !finishing_) {
+      return nullptr;
+    }
+    absl::string_view text(p, next - p);
+    size_t first_digit = text[0] == '-' ? 1 : 0;
+    if (text.size() > first_digit + 1 && text[first_digit] == '0' &&
+        IsDigit(text[first_digit + 1])) {
+      return Fail("Octal/hex numbers are not valid JSON values.", p);
+    }
+    if (text.find_first_of(".eE") == absl::string_view::npos) {
+      if (text[0] == '-') {
+        int64_t value;
+        if (absl::SimpleAtoi(text, &value)) {
+          writer_->RenderInt64(name, value);
+          return ValueDone(next);
+        }
+      } else {
+        uint64_t value;
+        if (absl::SimpleAtoi(text, &value)) {
+          writer_->RenderUint64(name, value);
+          return ValueDone(next);
+        }
+      }
+    }
+    double value;
+    if (!absl::SimpleAtod(text, &value)) {
+      return Fail("Unable to parse number.", p);
+    }
+    if (std::isinf(value)) {
+      return Fail("Number exceeds the range of double.", p);
+    }
+    writer_->RenderDouble(name, value);
+    return ValueDone(next);
+  }
+
+  const char* ParseLiteral(const char* p, const char* end,
+                           absl::string_view name) {
+    absl::string_view literal =
+        *p == 't' ? "true" : *p == 'f' ? "false" : "null";
+    size_t available = end - p;
+    if (available < literal.size()) {
+      if (absl::string_view(p, available) == literal.substr(0, available)) {
+        // The literal is incomplete.
+        return nullptr;
+      }
+      return Fail("Expected a value.", p);
+    }
+    if (absl::string_view(p, literal.size()) != literal) {
+      return Fail("Expected a value.", p);
+    }
+    if (*p == 'n') {
+      writer_->RenderNull(name);
+    } else {
+      writer_->RenderBool(name, *p == 't');
+    }
+    return ValueDone(p + literal.size());
+  }
+
+  bool Push(Container container, const char* p) {
+    if (containers_.size() >= kMaxDepth) {
+      Fail(absl::StrCat(
+               "Message too deep. Max recursion depth reached for key '", key_,
+               "'"),
+           p);
+      return false;
+    }
+    containers_.push_back(container);
+    return true;
+  }
+
+  const char* EndObject(const char* p) {
+    containers_.pop_back();
+    writer_->EndObject();
+    return ValueDone(p + 1);
+  }
+
+  const char* EndList(const char* p) {
+    containers_.pop_back();
+    writer_->EndList();
+    return ValueDone(p + 1);
+  }
+
+  // Moves on after a complete value ending at next.
+  const char* ValueDone(const char* next) {
+    if (containers_.empty()) {
+      expect_ = kDone;
+    } else if (containers_.back() == kObject) {
+      expect_ = kObjectCommaOrEnd;
+    } else {
+      expect_ = kListCommaOrEnd;
+    }
+    return next;
+  }
+
+  // Fails with the message and the input around p, in the format of
+  // JsonStreamParser. Returns null for convenience.
+  const char* Fail(absl::string_view message, const char* p) {
+    const char* buffer_begin = buffer_.data();
+    const char* buffer_end = buffer_begin + buffer_.size();
+    const char* begin = std::max(p - kContextLength, buffer_begin);
+    const char* end = std::min(p + kContextLength, buffer_end);
+    status_ = absl::InvalidArgumentError(
+        absl::StrCat(message, "\n", absl::string_view(begin, end - begin),
+                     "\n", std::string(p - begin, ' '), "^"));
+    return nullptr;
+  }
+
+  pbconv::ObjectWriter* writer_;
+  const JsonScanner& scanner_;
+
+  Expect expect_;
+  // The objects and lists being parsed.
+  std::vector<Container> containers_;
+  // The key of the current object value.
+  std::string key_;
+
+  // The end of the input has been reached.
+  bool finishing_;
+
+  // The chunk being parsed, for the error messages.
+  absl::string_view buffer_;
+  // The incomplete token at the end of the previous chunks, if any.
+  std::string leftover_;
+
+  // The state of the scan of an incomplete string: the number of characters
+  // scanned after the opening quote and whether they contain non-ASCII
+  // characters or escapes.
+  size_t string_scanned_;
+  bool string_non_ascii_;
+  bool string_escaped_;
+
+  // The unescaped string.
+  std::string scratch_;
+
+  absl::Status status_;
+};
+
+}  // namespace
+
+std::unique_ptr<JsonTokenizer> JsonTokenizer::Create(
+    Kind kind, pbconv::ObjectWriter* writer) {
+  switch (kind) {
+    case kVectorized:
+      return std::unique_ptr<JsonTokenizer>(
+          new VectorizedJsonTokenizer(writer));
+    case kProtobuf:
+    default:
+      return std::unique_ptr<JsonTokenizer>(new ProtobufJsonTokenizer(writer));
+  }
+}
+
+}  // namespace transcoding
+
+}  // namespace grpc
+}  // namespace google
@@ -0,0 +1,263 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+#include "grpc_transcoding/message_compression.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <string>
+
+#include "zlib.h"
+
+namespace google {
+namespace grpc {
+
+namespace transcoding {
+
+namespace pbio = ::google::protobuf::io;
+
+namespace {
+
+// zlib's windowBits for the gRPC encodings: 15 is the largest window, and
+// adding 16 selects the gzip wrapper instead of the zlib one.
+constexpr int kDeflateWindowBits = 15;
+constexpr int kGzipWindowBits = 15 + 16;
+
+// The size of the buffer for the decompressed bytes, which is what bounds the
+// memory used by a decompressed stream.
+constexpr int kInflateBufferSize = 16 * 1024;
+
+// A ZeroCopyInputStream that inflates another ZeroCopyInputStream one buffer at
+// a time.
+class InflateInputStream : public pbio::ZeroCopyInputStream {
+ public:
+  InflateInputStream(std::unique_ptr<pbio::ZeroCopyInputStream> compressed,
+                     int window_bits, int64_t max_size, absl::Status* status)
+      : compressed_(std::move(compressed)),
+        max_size_(max_size),
+        status_(status),
+        buffer_(new unsigned char[kInflateBufferSize]),
+        buffer_size_(0),
+        backed_up_(0),
+        byte_count_(0),
+        done_(false) {
+    memset(&zstream_, 0, sizeof(zstream_));
+    if (inflateInit2(&zstream_, window_bits) != Z_OK) {
+      SetError();
+    }
+  }
+
+  ~InflateInputStream() override {
+    inflateEnd(&zstream_);
+    // Skip what's left of the compressed message, so that the next message is
+    // read from the right place.
+    compressed_->Skip(std::numeric_limits<int>::max());
+  }
+
+  bool Next(const void** data, int* size) override {
+    if (backed_up_ > 0) {
+      *data = buffer_.get() + buffer_size_ - backed_up_;
+      *size = backed_up_;
+      byte_count_ += backed_up_;
+      backed_up_ = 0;
+      return true;
+    }
+    buffer_size_ = 0;
+    while (buffer_size_ == 0 && !done_) {
+      if (zstream_.avail_in == 0) {
+        const void* in = nullptr;
+        int in_size = 0;
+        if (!compressed_->Next(&in, &in_size)) {
+          // The compressed message has ended before the compressed data.
+          SetError();
+          break;
+        }
+        zstream_.next_in = static_cast<Bytef*>(const_cast<void*>(in));
+        zstream_.avail_in = in_size;
+        continue;
+      }
+      // Inflate at most one byte past max_size_, enough to tell that the
+      // message is too large.
+      const int64_t avail_out = std::min<int64_t>(
+          kInflateBufferSize,
+          max_size_ - static_cast<int64_t>(zstream_.total_out) + 1);
+      zstream_.next_out = buffer_.get();
+      zstream_.avail_out = static_cast<uInt>(avail_out);
+      int result = inflate(&zstream_, Z_NO_FLUSH);
+      if (result == Z_STREAM_END) {
+        done_ = true;
+      } else if (result != Z_OK && result != Z_BUF_ERROR) {
+        SetError();
+        break;
+      }
+      if (static_cast<int64_t>(zstream_.total_out) > max_size_) {
+        SetError(absl::Status(
+            absl::StatusCode::kResourceExhausted,
+            "The decompressed gRPC message is larger than " +
+                std::to_string(max_size_) + " bytes"));
+        break;
+      }
+      buffer_size_ = avail_out - zstream_.avail_out;
+    }
+    if (buffer_size_ == 0) {
+      return false;
+    }
+    byte_count_ += buffer_size_;
+    *data = buffer_.get();
+    *size = buffer_size_;
+    return true;
+  }
+
+  void BackUp(int count) override {
+    backed_up_ = count;
+    byte_count_ -= count;
+  }
+
+  bool Skip(int count) override {
+    const void* data = nullptr;
+    int size = 0;
+    while (count > 0) {
+      if (!Next(&data, &size)) {
+        return false;
+      }
+      if (size > count) {
+        BackUp(size - count);
+        return true;
+      }
+      count -= size;
+    }
+    return true;
+  }
+
+  int64_t ByteCount() const override { return byte_count_; }
+
+ private:
+  void SetError() {
+    SetError(absl::Status(
+        absl::StatusCode::kInternal,
+        std::string("Invalid compressed gRPC message") +
+            (zstream_.msg != nullptr ? std::string(": ") + zstream_.msg : "")));
+  }
+
+  void SetError(absl::Status status) {
+    done_ = true;
+    buffer_size_ = 0;
+    *status_ = std::move(status);
+  }
+
+  std::unique_ptr<pbio::ZeroCopyInputStream> compressed_;
+  // The maximum size of the decompressed message.
+  int64_t max_size_;
+  absl::Status* status_;
+  z_stream zstream_;
+  // The decompressed bytes last returned by Next(), of which the last
+  // backed_up_ bytes were backed up.
+  std::unique_ptr<unsigned char[]> buffer_;
+  int buffer_size_;
+  int backed_up_;
+  int64_t byte_count_;
+  // Whether the compressed data has ended or is invalid.
+  bool done_;
+};
+
+class ZlibMessageDecompressor : public MessageDecompressor {
+ public:
+  ZlibMessageDecompressor(int window_bits, int64_t max_decompressed_size)
+      : window_bits_(window_bits),
+        max_decompressed_size_(max_decompressed_size) {}
+
+  std::unique_ptr<pbio::ZeroCopyInputStream> Decompress(
+      std::unique_ptr<pbio::ZeroCopyInputStream> compressed,
+      absl::Status* status) const override {
+    return std::unique_ptr<pbio::ZeroCopyInputStream>(
+        new InflateInputStream(std::move(compressed), window_bits_,
+                               max_decompressed_size_, status));
+  }
+
+ private:
+  int window_bits_;
+  int64_t max_decompressed_size_;
+};
+
+class ZlibMessageCompressor : public MessageCompressor {
+ public:
+  explicit ZlibMessageCompressor(int window_bits) : window_bits_(window_bits) {}
+
+  absl::Status Compress(absl::string_view message,
+                        std::string* compressed) const override {
+    z_stream zstream;
+    memset(&zstream, 0, sizeof(zstream));
+    // 8 is zlib's default memLevel.
+    if (deflateInit2(&zstream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, window_bits_,
+                     8, Z_DEFAULT_STRATEGY) != Z_OK) {
+      return absl::Status(absl::StatusCode::kInternal,
+                          "Failed to compress the gRPC message");
+    }
+    // With the bound for the output a single deflate() call is enough.
+    compressed->resize(deflateBound(&zstream, message.size()));
+    zstream.next_in =
+        reinterpret_cast<Bytef*>(const_cast<char*>(message.data()));
+    zstream.avail_in = message.size();
+    zstream.next_out = reinterpret_cast<Bytef*>(&(*compressed)[0]);
+    zstream.avail_out = compressed->size();
+    int result = deflate(&zstream, Z_FINISH);
+    compressed->resize(zstream.total_out);
+    deflateEnd(&zstream);
+    if (result != Z_STREAM_END) {
+      return absl::Status(absl::StatusCode::kInternal,
+                          "Failed to compress the gRPC message");
+    }
+    return absl::OkStatus();
+  }
+
+ private:
+  int window_bits_;
+};
+
+}  // namespace
+
+std::unique_ptr<MessageDecompressor> CreateMessageDecompressor(
+    absl::string_view encoding, int64_t max_decompressed_size) {
+  if (encoding == "gzip") {
+    return std::unique_ptr<MessageDecompressor>(
+        new ZlibMessageDecompressor(kGzipWindowBits, max_decompressed_size));
+  }
+  if (encoding == "deflate") {
+    return std::unique_ptr<MessageDecompressor>(new ZlibMessageDecompressor(
+        kDeflateWindowBits, max_decompressed_size));
+  }
+  return nullptr;
+}
+
+std::unique_ptr<MessageCompressor> CreateMessageCompressor(
+    absl::string_view encoding) {
+  if (encoding == "gzip") {
+    return std::unique_ptr<MessageCompressor>(
+        new ZlibMessageCompressor(kGzipWindowBits));
+  }
+  if (encoding == "deflate") {
+    return std::unique_ptr<MessageCompressor>(
+        new ZlibMessageCompressor(kDeflateWindowBits));
+  }
+  return nullptr;
+}
+
+}  // namespace transcoding
+
+}  // namespace grpc
+}  // namespace google
@@ -16,6 +16,7 @@
 //
 #include "grpc_transcoding/message_reader.h"
 
+#include <algorithm>
 #include <memory>
 
 #include "google/protobuf/io/zero_copy_stream_impl.h"
@@ -28,11 +29,14 @@ namespace transcoding {
 namespace pb = ::google::protobuf;
 namespace pbio = ::google::protobuf::io;
 
-MessageReader::MessageReader(TranscoderInputStream* in)
+MessageReader::MessageReader(TranscoderInputStream* in,
+                             const MessageDecompressor* decompressor)
     : in_(in),
+      decompressor_(decompressor),
       current_message_size_(0),
       have_current_message_size_(false),
-      finished_(false) {}
+      finished_(false),
+      delimiter_() {}
 
 namespace {
 
@@ -60,6 +64,24 @@ bool ReadStream(pbio::ZeroCopyInputStream* stream, unsigned char* buffer,
   return true;
 }
 
+// Reads the gRPC message delimiter. It's usually in the current chunk of the
+// stream, in which case it's copied from there without the ReadStream() loop.
+bool ReadDelimiter(pbio::ZeroCopyInputStream* stream,
+                   unsigned char* delimiter) {
+  const void* data = nullptr;
+  int size = 0;
+  if (!stream->Next(&data, &size)) {
+    return false;
+  }
+  if (size >= static_cast<int>(kGrpcDelimiterByteSize)) {
+    memcpy(delimiter, data, kGrpcDelimiterByteSize);
+    stream->BackUp(size - kGrpcDelimiterByteSize);
+    return true;
+  }
+  stream->BackUp(size);
+  return ReadStream(stream, delimiter, kGrpcDelimiterByteSize);
+}
+
 // A helper function to extract the size from a gRPC wire format message
 // delimiter - see http://www.grpc.io/docs/guides/wire.html.
 uint32_t DelimiterToSize(const unsigned char* delimiter) {
@@ -77,10 +99,10 @@ uint32_t DelimiterToSize(const unsigned char* delimiter) {
 
 }  // namespace
 
-std::unique_ptr<pbio::ZeroCopyInputStream> MessageReader::NextMessage() {
+bool MessageReader::ReadFrameHeader() {
   if (Finished()) {
     // The stream has ended
-    return nullptr;
+    return false;
   }
 
   // Check if we have the current message size. If not try to read it.
@@ -94,46 +116,128 @@ std::unique_ptr<pbio::ZeroCopyInputStream> MessageReader::NextMessage() {
         status_ = absl::Status(absl::StatusCode::kInternal,
                                "Incomplete gRPC frame header received");
       }
-      return nullptr;
+      return false;
     }
 
     // Try to read the delimiter.
-    memset(delimiter_, 0, kGrpcDelimiterByteSize);
-    if (!ReadStream(in_, delimiter_, kGrpcDelimiterByteSize)) {
+    if (!ReadDelimiter(in_, delimiter_)) {
       finished_ = true;
-      return nullptr;
+      return false;
     }
 
-    if (delimiter_[0] != 0) {
+    // The flag is 1 for the compressed messages, which need the
+    // decompressor.
+    if (delimiter_[0] != 0 &&
+        (delimiter_[0] != 1 || decompressor_ == nullptr)) {
       status_ = absl::Status(
           absl::StatusCode::kInternal,
           "Unsupported gRPC frame flag: " + std::to_string(delimiter_[0]));
-      return nullptr;
+      return false;
     }
 
     current_message_size_ = DelimiterToSize(delimiter_);
     have_current_message_size_ = true;
   }
+  return true;
+}
+
+bool MessageReader::NextFrame() {
+  if (!ReadFrameHeader()) {
+    return false;
+  }
 
   if (in_->BytesAvailable() < static_cast<pb::int64>(current_message_size_)) {
     if (in_->Finished()) {
-      status_ = absl::Status(
-          absl::StatusCode::kInternal,
-          "Incomplete gRPC frame expected size: " +
-              std::to_string(current_message_size_) +
-              " actual size: " + std::to_string(in_->BytesAvailable()));
+      SetIncompleteFrameStatus();
     }
     // We don't have a full message
-    return nullptr;
+    return false;
   }
 
   // Reset the have_current_message_size_ for the next message
   have_current_message_size_ = false;
+  return true;
+}
+
+void MessageReader::SetIncompleteFrameStatus() {
+  status_ = absl::Status(absl::StatusCode::kInternal,
+                         "Incomplete gRPC frame expected size: " +
+                             std::to_string(current_message_size_) +
+                             " actual size: " +
+                             std::to_string(in_->BytesAvailable()));
+}
+
+void MessageReader::ReleaseMessageView() {
+  // The LimitingInputStream backs up what it has read past the message when
+  // it's destroyed, so it must be destroyed before reading on.
+  message_view_.reset();
+  decompressed_view_.reset();
+}
+
+std::unique_ptr<pbio::ZeroCopyInputStream> MessageReader::NextMessage() {
+  ReleaseMessageView();
+  if (!NextFrame()) {
+    return nullptr;
+  }
 
   // We have a message! Use LimitingInputStream to wrap the input stream and
   // limit it to current_message_size_ bytes to cover only the current message.
-  return std::unique_ptr<pbio::ZeroCopyInputStream>(
+  std::unique_ptr<pbio::ZeroCopyInputStream> message(
       new pbio::LimitingInputStream(in_, current_message_size_));
+  if (delimiter_[0] == 1) {
+    // A decompression error is reported in status_ as the message is read.
+    return decompressor_->Decompress(std::move(message), &status_);
+  }
+  return message;
+}
+
+pbio::ZeroCopyInputStream* MessageReader::NextMessageView() {
+  ReleaseMessageView();
+  if (!NextFrame()) {
+    return nullptr;
+  }
+
+  if (delimiter_[0] == 1) {
+    // The decompressor takes the ownership of the compressed stream, so it
+    // can't be message_view_.
+    decompressed_view_ = decompressor_->Decompress(
+        std::unique_ptr<pbio::ZeroCopyInputStream>(
+            new pbio::LimitingInputStream(in_, current_message_size_)),
+        &status_);
+    return decompressed_view_.get();
+  }
+  message_view_.emplace(in_, current_message_size_);
+  return &*message_view_;
+}
+
+pbio::ZeroCopyInputStream* MessageReader::NextMessagePart(bool* last) {
+  ReleaseMessageView();
+  if (!ReadFrameHeader()) {
+    return nullptr;
+  }
+  if (delimiter_[0] == 1) {
+    // A compressed message can only be decompressed as a whole.
+    *last = true;
+    return NextMessageView();
+  }
+
+  uint32_t part_size = static_cast<uint32_t>(std::min<pb::int64>(
+      in_->BytesAvailable(), current_message_size_));
+  if (part_size == 0 && current_message_size_ > 0) {
+    if (in_->Finished()) {
+      SetIncompleteFrameStatus();
+    }
+    return nullptr;
+  }
+
+  // The rest of the message is in the next parts.
+  current_message_size_ -= part_size;
+  *last = current_message_size_ == 0;
+  if (*last) {
+    have_current_message_size_ = false;
+  }
+  message_view_.emplace(in_, part_size);
+  return &*message_view_;
 }
 
 MessageAndGrpcFrame MessageReader::NextMessageAndGrpcFrame() {
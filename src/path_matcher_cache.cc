@@ -0,0 +1,169 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+#include "grpc_transcoding/path_matcher_cache.h"
+
+#include <atomic>
+#include <string>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/container/flat_hash_map.h"
+#include "absl/hash/hash.h"
+#include "absl/synchronization/mutex.h"
+
+namespace google {
+namespace grpc {
+namespace transcoding {
+
+// Aligned to a cache line so that the locks of adjacent shards don't share one.
+struct alignas(64) PathMatcherLookupCache::Shard {
+  struct Slot {
+    std::string http_method;
+    std::string path;
+    std::shared_ptr<const Entry> entry;
+    // Set by the hits, cleared by the clock hand when it passes over the slot.
+    // Hits set it while holding the lock shared, hence atomic.
+    std::atomic<bool> referenced{false};
+  };
+
+  absl::Mutex mu;
+  // The slots, of which the first size are in use. Allocated once at the
+  // capacity of the shard, so that the slots never move.
+  std::unique_ptr<Slot[]> slots;
+  size_t size ABSL_GUARDED_BY(mu) = 0;
+  // The next slot the clock hand looks at for an eviction.
+  size_t hand ABSL_GUARDED_BY(mu) = 0;
+  // The index of the slots in use. The keys point into the strings of the
+  // slots.
+  absl::flat_hash_map<KeyView, size_t> index ABSL_GUARDED_BY(mu);
+  // Hits only hold the lock shared, hence atomic.
+  std::atomic<uint64_t> hits{0};
+  std::atomic<uint64_t> misses{0};
+  uint64_t evictions ABSL_GUARDED_BY(mu) = 0;
+};
+
+PathMatcherLookupCache::PathMatcherLookupCache(size_t capacity,
+                                               size_t num_shards)
+    : num_shards_(num_shards > 0 ? num_shards : 1),
+      shards_(new Shard[num_shards_]) {
+  shard_capacity_ = (capacity + num_shards_ - 1) / num_shards_;
+  if (shard_capacity_ == 0) {
+    shard_capacity_ = 1;
+  }
+  for (size_t i = 0; i < num_shards_; ++i) {
+    shards_[i].slots.reset(new Shard::Slot[shard_capacity_]);
+  }
+}
+
+PathMatcherLookupCache::~PathMatcherLookupCache() {}
+
+PathMatcherLookupCache::Shard& PathMatcherLookupCache::ShardFor(
+    const KeyView& key) const {
+  return shards_[absl::Hash<KeyView>()(key) % num_shards_];
+}
+
+std::shared_ptr<const PathMatcherLookupCache::Entry>
+PathMatcherLookupCache::Get(absl::string_view http_method,
+                            absl::string_view path) {
+  const KeyView key(http_method, path);
+  Shard& shard = ShardFor(key);
+  absl::ReaderMutexLock lock(&shard.mu);
+  auto it = shard.index.find(key);
+  if (it == shard.index.end()) {
+    shard.misses.fetch_add(1, std::memory_order_relaxed);
+    return nullptr;
+  }
+  shard.hits.fetch_add(1, std::memory_order_relaxed);
+  Shard::Slot& slot = shard.slots[it->second];
+  // Only write the bit when it changes, so that the hits of a hot entry don't
+  // keep invalidating the cache line holding it.
+  if (!slot.referenced.load(std::memory_order_relaxed)) {
+    slot.referenced.store(true, std::memory_order_relaxed);
+  }
+  return slot.entry;
+}
+
+std::shared_ptr<const PathMatcherLookupCache::Entry>
+PathMatcherLookupCache::Peek(absl::string_view http_method,
+                             absl::string_view path) const {
+  const KeyView key(http_method, path);
+  Shard& shard = ShardFor(key);
+  absl::ReaderMutexLock lock(&shard.mu);
+  auto it = shard.index.find(key);
+  if (it == shard.index.end()) {
+    return nullptr;
+  }
+  return shard.slots[it->second].entry;
+}
+
+void PathMatcherLookupCache::Put(absl::string_view http_method,
+                                 absl::string_view path,
+                                 std::shared_ptr<const Entry> entry) {
+  const KeyView key(http_method, path);
+  Shard& shard = ShardFor(key);
+  absl::MutexLock lock(&shard.mu);
+  auto it = shard.index.find(key);
+  if (it != shard.index.end()) {
+    // Another thread has cached the same lookup in the meantime.
+    Shard::Slot& slot = shard.slots[it->second];
+    slot.entry = std::move(entry);
+    slot.referenced.store(true, std::memory_order_relaxed);
+    return;
+  }
+
+  size_t i;
+  if (shard.size < shard_capacity_) {
+    i = shard.size++;
+  } else {
+    // Sweeps the clock hand past the referenced slots, clearing their bits,
+    // to the first slot not referenced since the hand last passed it. This
+    // ends within one turn, as the hand clears the bits it passes.
+    while (shard.slots[shard.hand].referenced.load(std::memory_order_relaxed)) {
+      shard.slots[shard.hand].referenced.store(false,
+                                               std::memory_order_relaxed);
+      shard.hand = (shard.hand + 1) % shard_capacity_;
+    }
+    i = shard.hand;
+    shard.hand = (shard.hand + 1) % shard_capacity_;
+    const Shard::Slot& victim = shard.slots[i];
+    shard.index.erase(KeyView(victim.http_method, victim.path));
+    ++shard.evictions;
+  }
+
+  Shard::Slot& slot = shard.slots[i];
+  slot.http_method.assign(http_method.data(), http_method.size());
+  slot.path.assign(path.data(), path.size());
+  slot.entry = std::move(entry);
+  slot.referenced.store(false, std::memory_order_relaxed);
+  shard.index.emplace(KeyView(slot.http_method, slot.path), i);
+}
+
+PathMatcherLookupCache::Stats PathMatcherLookupCache::GetStats() const {
+  Stats stats = {0, 0, 0, 0};
+  for (size_t i = 0; i < num_shards_; ++i) {
+    Shard& shard = shards_[i];
+    absl::MutexLock lock(&shard.mu);
+    stats.hits += shard.hits.load(std::memory_order_relaxed);
+    stats.misses += shard.misses.load(std::memory_order_relaxed);
+    stats.evictions += shard.evictions;
+    stats.size += shard.size;
+  }
+  return stats;
+}
+
+}  // namespace transcoding
+}  // namespace grpc
+}  // namespace google
@@ -16,6 +16,7 @@
 //
 #include "grpc_transcoding/path_matcher_node.h"
 
+#include "absl/strings/match.h"
 #include "grpc_transcoding/http_template.h"
 
 namespace google {
@@ -72,22 +73,6 @@ typename Collection::value_type::second_type& LookupOrInsertNew(
   return ret.first->second;
 }
 
-// A convinent function to lookup a STL colllection with two keys.
-// Lookup key1 first, if not found, lookup key2, or return nullptr.
-template <class Collection>
-const typename Collection::value_type::second_type* Find2KeysOrNull(
-    const Collection& collection,
-    const typename Collection::value_type::first_type& key1,
-    const typename Collection::value_type::first_type& key2) {
-  auto it = collection.find(key1);
-  if (it == collection.end()) {
-    it = collection.find(key2);
-    if (it == collection.end()) {
-      return nullptr;
-    }
-  }
-  return &it->second;
-}
 }  // namespace
 
 PathMatcherNode::PathInfo::Builder&
@@ -139,7 +124,7 @@ std::unique_ptr<PathMatcherNode> PathMatcherNode::Clone() const {
 // result and returns true.
 void PathMatcherNode::LookupPath(RequestPathParts::const_iterator current,
                                  const RequestPathParts::const_iterator end,
-                                 HttpMethod http_method,
+                                 const RequestMethod& http_method,
                                  PathMatcherLookupResult* result) const {
   // Loop is only used when matching a wildcard node.
   // For a wild card, keeps advancing until all remaining segments match one of
@@ -168,7 +153,7 @@ void PathMatcherNode::LookupPath(RequestPathParts::const_iterator current,
   // No matching child, and this node isn't a wildcard.  Maybe it has a
   // match-any child?
 
-  for (const std::string& child_key :
+  for (absl::string_view child_key :
        {HttpTemplate::kSingleParameterKey, HttpTemplate::kWildCardPathPartKey,
         HttpTemplate::kWildCardPathKey}) {
     if (LookupPathFromChild(child_key, current, end, http_method, result)) {
@@ -215,7 +200,7 @@ bool PathMatcherNode::InsertTemplate(
     }
     return true;
   }
-  std::unique_ptr<PathMatcherNode>& child =
+  std::shared_ptr<PathMatcherNode>& child =
       LookupOrInsertNew(&children_, *current);
   if (*current == HttpTemplate::kWildCardPathKey) {
     child->set_wildcard(true);
@@ -224,10 +209,112 @@ bool PathMatcherNode::InsertTemplate(
                                mark_duplicates);
 }
 
+std::shared_ptr<const PathMatcherNode> PathMatcherNode::InsertPathCopy(
+    const std::shared_ptr<const PathMatcherNode>& root,
+    const PathInfo& node_path_info, const HttpMethod& http_method,
+    void* method_data, bool mark_duplicates, void** replaced_data) {
+  *replaced_data = nullptr;
+  return root->InsertTemplateCopy(node_path_info.path_info().begin(),
+                                  node_path_info.path_info().end(),
+                                  http_method, method_data, mark_duplicates,
+                                  replaced_data);
+}
+
+std::shared_ptr<const PathMatcherNode> PathMatcherNode::RemovePathCopy(
+    const std::shared_ptr<const PathMatcherNode>& root,
+    const PathInfo& node_path_info, const HttpMethod& http_method,
+    void** removed_data) {
+  *removed_data = nullptr;
+  std::shared_ptr<PathMatcherNode> copy = root->RemoveTemplateCopy(
+      node_path_info.path_info().begin(), node_path_info.path_info().end(),
+      http_method, removed_data);
+  if (*removed_data == nullptr) {
+    return root;
+  }
+  if (copy == nullptr) {
+    // The root is never dropped.
+    return std::make_shared<PathMatcherNode>();
+  }
+  return copy;
+}
+
+// Copies this node and recurses on the matching child, sharing the other
+// children. A missing child is created and the rest of the path is inserted
+// into it in place, as no other trie refers to it.
+std::shared_ptr<PathMatcherNode> PathMatcherNode::InsertTemplateCopy(
+    const std::vector<std::string>::const_iterator current,
+    const std::vector<std::string>::const_iterator end,
+    const HttpMethod& http_method, void* method_data, bool mark_duplicates,
+    void** replaced_data) const {
+  std::shared_ptr<PathMatcherNode> copy =
+      std::make_shared<PathMatcherNode>(*this);
+  if (current == end) {
+    auto it = result_map_.find(http_method);
+    if (it != result_map_.end()) {
+      *replaced_data = it->second.data;
+    }
+    copy->InsertTemplate(current, end, http_method, method_data,
+                         mark_duplicates);
+    return copy;
+  }
+  std::shared_ptr<PathMatcherNode> child;
+  auto it = children_.find(*current);
+  if (it != children_.end()) {
+    child = it->second->InsertTemplateCopy(current + 1, end, http_method,
+                                           method_data, mark_duplicates,
+                                           replaced_data);
+  } else {
+    child = std::make_shared<PathMatcherNode>();
+    if (*current == HttpTemplate::kWildCardPathKey) {
+      child->set_wildcard(true);
+    }
+    child->InsertTemplate(current + 1, end, http_method, method_data,
+                          mark_duplicates);
+  }
+  copy->children_[*current] = std::move(child);
+  return copy;
+}
+
+std::shared_ptr<PathMatcherNode> PathMatcherNode::RemoveTemplateCopy(
+    const std::vector<std::string>::const_iterator current,
+    const std::vector<std::string>::const_iterator end,
+    const HttpMethod& http_method, void** removed_data) const {
+  std::shared_ptr<PathMatcherNode> copy;
+  if (current == end) {
+    auto it = result_map_.find(http_method);
+    if (it == result_map_.end()) {
+      return nullptr;
+    }
+    *removed_data = it->second.data;
+    copy = std::make_shared<PathMatcherNode>(*this);
+    copy->result_map_.erase(http_method);
+  } else {
+    auto it = children_.find(*current);
+    if (it == children_.end()) {
+      return nullptr;
+    }
+    std::shared_ptr<PathMatcherNode> child = it->second->RemoveTemplateCopy(
+        current + 1, end, http_method, removed_data);
+    if (*removed_data == nullptr) {
+      return nullptr;
+    }
+    copy = std::make_shared<PathMatcherNode>(*this);
+    if (child == nullptr) {
+      copy->children_.erase(*current);
+    } else {
+      copy->children_[*current] = std::move(child);
+    }
+  }
+  if (copy->result_map_.empty() && copy->children_.empty()) {
+    return nullptr;
+  }
+  return copy;
+}
+
 bool PathMatcherNode::LookupPathFromChild(
-    const std::string child_key, const RequestPathParts::const_iterator current,
-    const RequestPathParts::const_iterator end, HttpMethod http_method,
-    PathMatcherLookupResult* result) const {
+    absl::string_view child_key, const RequestPathParts::const_iterator current,
+    const RequestPathParts::const_iterator end,
+    const RequestMethod& http_method, PathMatcherLookupResult* result) const {
   auto pair = children_.find(child_key);
   if (pair != children_.end()) {
     pair->second->LookupPath(current + 1, end, http_method, result);
@@ -239,14 +326,31 @@ bool PathMatcherNode::LookupPathFromChild(
 }
 
 bool PathMatcherNode::GetResultForHttpMethod(
-    HttpMethod key, PathMatcherLookupResult* result) const {
-  const PathMatcherLookupResult* found_p =
-      Find2KeysOrNull(result_map_, key, HttpMethod_WILD_CARD);
-  if (found_p != nullptr) {
-    *result = *found_p;
-    return true;
+    const RequestMethod& key, PathMatcherLookupResult* result) const {
+  auto it = result_map_.end();
+  if (key.verb.empty()) {
+    it = result_map_.find(key.http_method);
+  } else {
+    // The keys with a custom verb are rare, so just scan for
+    // `http_method + verb` instead of building the key.
+    for (auto i = result_map_.begin(); i != result_map_.end(); ++i) {
+      absl::string_view k = i->first;
+      if (k.size() == key.http_method.size() + key.verb.size() &&
+          absl::StartsWith(k, key.http_method) &&
+          absl::EndsWith(k, key.verb)) {
+        it = i;
+        break;
+      }
+    }
   }
-  return false;
+  if (it == result_map_.end()) {
+    it = result_map_.find(HttpMethod_WILD_CARD);
+    if (it == result_map_.end()) {
+      return false;
+    }
+  }
+  *result = it->second;
+  return true;
 }
 
 }  // namespace transcoding
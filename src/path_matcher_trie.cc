@@ -0,0 +1,561 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+#include "grpc_transcoding/path_matcher_trie.h"
+
+#include <algorithm>
+#include <utility>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/strings/match.h"
+#include "grpc_transcoding/http_template.h"
+
+namespace google {
+namespace grpc {
+namespace transcoding {
+
+namespace {
+
+// Nodes with up to this many literal children are searched linearly, the
+// others with a binary search.
+constexpr size_t kMaxLinearSearchChildren = 8;
+
+// FNV-1a. Unlike absl::Hash it's not seeded per process, so the segment table
+// only depends on the registered templates.
+uint64_t HashSegment(absl::string_view segment) {
+  uint64_t hash = 14695981039346656037ull;
+  for (char c : segment) {
+    hash ^= static_cast<unsigned char>(c);
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+
+}  // namespace
+
+constexpr size_t PathMatcherTrie::kDefaultMaxBlockNodes;
+constexpr PathMatcherTrie::Index PathMatcherTrie::kNone;
+constexpr PathMatcherTrie::Index PathMatcherTrie::kUnknown;
+constexpr PathMatcherTrie::Index PathMatcherTrie::kLink;
+
+struct PathMatcherTrie::LookupState {
+  const PathMatcherNode::RequestPathParts& parts;
+  const SegmentHashes& hashes;
+  const RequestMethod& http_method;
+  // The ids of the parts and of the method in this block. They are looked up
+  // when first needed, as a lookup only visits a few of the parts of a block.
+  SegmentIds segments;
+  Index method;
+};
+
+struct PathMatcherTrie::Arrays {
+  // Appends the string to pool.
+  PoolString AddToPool(absl::string_view s) {
+    PoolString pool_string{static_cast<uint32_t>(pool.size()),
+                           static_cast<uint32_t>(s.size())};
+    pool.append(s.data(), s.size());
+    return pool_string;
+  }
+
+  std::vector<Node> nodes;
+  std::vector<Index> child_segments;
+  std::vector<Index> child_nodes;
+  std::vector<Index> result_methods;
+  std::vector<Result> results;
+  std::vector<PoolString> segments;
+  std::vector<Index> segment_table;
+  std::vector<PoolString> methods;
+  std::string pool;
+};
+
+PathMatcherTrie::PathMatcherTrie(const PathMatcherNode& root)
+    : wild_card_method_(kNone), num_source_nodes_(0) {
+  Build(root, nullptr);
+}
+
+// A block is reused if it was compiled from the same node: the nodes reachable
+// from a version of the trie are never modified, so the whole subtrie is the
+// same. A new block of the root only is linked to the blocks of the previous
+// version at the same path for the children, which are reused or, for the
+// children on the changed paths, compiled the same way.
+std::shared_ptr<const PathMatcherTrie> PathMatcherTrie::Compile(
+    std::shared_ptr<const PathMatcherNode> root,
+    const std::shared_ptr<const PathMatcherTrie>& previous,
+    size_t max_block_nodes) {
+  if (previous != nullptr && previous->source_ == root) {
+    return previous;
+  }
+  std::shared_ptr<PathMatcherTrie> trie(new PathMatcherTrie());
+  const size_t num_nodes = CountNodes(*root, previous.get(), max_block_nodes);
+  if (num_nodes <= max_block_nodes) {
+    trie->Build(*root, nullptr);
+    trie->num_source_nodes_ = num_nodes;
+  } else {
+    const LinkChild link_child =
+        [&previous, max_block_nodes](
+            absl::string_view segment,
+            const std::shared_ptr<const PathMatcherNode>& child) {
+          return Compile(child,
+                         previous != nullptr ? previous->LinkedChild(segment)
+                                             : nullptr,
+                         max_block_nodes);
+        };
+    trie->Build(*root, &link_child);
+    trie->num_source_nodes_ = 1;
+    for (const auto& link : trie->links_) {
+      trie->num_source_nodes_ += link->num_source_nodes_;
+    }
+  }
+  trie->source_ = std::move(root);
+  return trie;
+}
+
+size_t PathMatcherTrie::CountNodes(const PathMatcherNode& node,
+                                   const PathMatcherTrie* previous,
+                                   size_t limit) {
+  if (previous != nullptr && previous->source_.get() == &node) {
+    return previous->num_source_nodes_;
+  }
+  size_t count = 1;
+  for (const auto& child : node.children_) {
+    if (count > limit) {
+      break;
+    }
+    std::shared_ptr<const PathMatcherTrie> linked =
+        previous != nullptr ? previous->LinkedChild(child.first) : nullptr;
+    count += CountNodes(*child.second, linked.get(), limit - count);
+  }
+  return count;
+}
+
+std::shared_ptr<const PathMatcherTrie> PathMatcherTrie::LinkedChild(
+    absl::string_view segment) const {
+  if (links_.empty()) {
+    return nullptr;
+  }
+  Index child =
+      FindChild(nodes_[0], FindSegment(segment, HashSegment(segment)));
+  if (child == kNone || (child & kLink) == 0) {
+    return nullptr;
+  }
+  return links_[child & ~kLink];
+}
+
+void PathMatcherTrie::Build(const PathMatcherNode& root,
+                            const LinkChild* link_child) {
+  std::shared_ptr<Arrays> arrays = std::make_shared<Arrays>();
+  Arrays& a = *arrays;
+  absl::flat_hash_map<std::string, Index> segment_ids;
+  absl::flat_hash_map<std::string, Index> method_ids;
+  absl::flat_hash_map<void*, Index> data_ids;
+
+  // Lay out the nodes in breadth-first order so that the children of a node
+  // are next to each other. A node's index is assigned when it's queued.
+  std::vector<const PathMatcherNode*> queue = {&root};
+  for (size_t i = 0; i < queue.size(); ++i) {
+    const PathMatcherNode& source = *queue[i];
+    Node node;
+    node.single_parameter_child = kNone;
+    node.wild_card_path_part_child = kNone;
+    node.wild_card_path_child = kNone;
+    node.wildcard = source.wildcard_ ? 1 : 0;
+
+    std::vector<std::pair<Index, const std::shared_ptr<PathMatcherNode>*>>
+        children;
+    for (const auto& child : source.children_) {
+      auto inserted = segment_ids.emplace(child.first, a.segments.size());
+      if (inserted.second) {
+        a.segments.push_back(a.AddToPool(child.first));
+      }
+      children.emplace_back(inserted.first->second, &child.second);
+    }
+    std::sort(children.begin(), children.end());
+
+    node.children_begin = a.child_segments.size();
+    for (const auto& child : children) {
+      const PoolString& segment = a.segments[child.first];
+      absl::string_view key(a.pool.data() + segment.offset, segment.size);
+      Index child_index;
+      if (link_child != nullptr) {
+        child_index = kLink | static_cast<Index>(links_.size());
+        links_.push_back((*link_child)(key, *child.second));
+      } else {
+        child_index = queue.size();
+        queue.push_back(child.second->get());
+      }
+      a.child_segments.push_back(child.first);
+      a.child_nodes.push_back(child_index);
+
+      if (key == HttpTemplate::kSingleParameterKey) {
+        node.single_parameter_child = child_index;
+      } else if (key == HttpTemplate::kWildCardPathPartKey) {
+        node.wild_card_path_part_child = child_index;
+      } else if (key == HttpTemplate::kWildCardPathKey) {
+        node.wild_card_path_child = child_index;
+      }
+    }
+    node.children_end = a.child_segments.size();
+
+    std::vector<std::pair<Index, Result>> results;
+    for (const auto& result : source.result_map_) {
+      auto inserted = method_ids.emplace(result.first, a.methods.size());
+      if (inserted.second) {
+        a.methods.push_back(a.AddToPool(result.first));
+      }
+      auto data = data_ids.emplace(result.second.data, data_.size());
+      if (data.second) {
+        data_.push_back(result.second.data);
+      }
+      results.emplace_back(
+          inserted.first->second,
+          Result{data.first->second, result.second.is_multiple ? 1u : 0u});
+    }
+    std::sort(results.begin(), results.end(),
+              [](const std::pair<Index, Result>& a,
+                 const std::pair<Index, Result>& b) {
+                return a.first < b.first;
+              });
+
+    node.results_begin = a.result_methods.size();
+    for (const auto& result : results) {
+      a.result_methods.push_back(result.first);
+      a.results.push_back(result.second);
+    }
+    node.results_end = a.result_methods.size();
+
+    a.nodes.push_back(node);
+  }
+
+  auto wild_card = method_ids.find(HttpMethod_WILD_CARD);
+  if (wild_card != method_ids.end()) {
+    wild_card_method_ = wild_card->second;
+  }
+
+  // Keep the segment table at most half full.
+  size_t table_size = 1;
+  while (table_size < 2 * a.segments.size()) {
+    table_size *= 2;
+  }
+  a.segment_table.assign(table_size, 0);
+  for (Index id = 0; id < a.segments.size(); ++id) {
+    const PoolString& segment = a.segments[id];
+    absl::string_view key(a.pool.data() + segment.offset, segment.size);
+    size_t slot = HashSegment(key) & (table_size - 1);
+    while (a.segment_table[slot] != 0) {
+      slot = (slot + 1) & (table_size - 1);
+    }
+    a.segment_table[slot] = id + 1;
+  }
+
+  nodes_ = a.nodes;
+  child_segments_ = a.child_segments;
+  child_nodes_ = a.child_nodes;
+  result_methods_ = a.result_methods;
+  results_ = a.results;
+  segments_ = a.segments;
+  segment_table_ = a.segment_table;
+  methods_ = a.methods;
+  pool_ = a.pool;
+  storage_ = std::move(arrays);
+}
+
+void PathMatcherTrie::WriteSnapshot(SnapshotWriter* writer) const {
+  writer->WriteArray(nodes_);
+  writer->WriteArray(child_segments_);
+  writer->WriteArray(child_nodes_);
+  writer->WriteArray(result_methods_);
+  writer->WriteArray(results_);
+  writer->WriteArray(segments_);
+  writer->WriteArray(segment_table_);
+  writer->WriteArray(methods_);
+  writer->WriteUint32(wild_card_method_);
+  writer->WriteString(pool_);
+}
+
+std::unique_ptr<PathMatcherTrie> PathMatcherTrie::ReadSnapshot(
+    SnapshotReader* reader, std::vector<void*> data,
+    std::shared_ptr<const void> storage) {
+  std::unique_ptr<PathMatcherTrie> trie(new PathMatcherTrie());
+  if (!reader->ReadArray(&trie->nodes_) ||
+      !reader->ReadArray(&trie->child_segments_) ||
+      !reader->ReadArray(&trie->child_nodes_) ||
+      !reader->ReadArray(&trie->result_methods_) ||
+      !reader->ReadArray(&trie->results_) ||
+      !reader->ReadArray(&trie->segments_) ||
+      !reader->ReadArray(&trie->segment_table_) ||
+      !reader->ReadArray(&trie->methods_) ||
+      !reader->ReadUint32(&trie->wild_card_method_) ||
+      !reader->ReadString(&trie->pool_)) {
+    return nullptr;
+  }
+  trie->data_ = std::move(data);
+  trie->storage_ = std::move(storage);
+  if (!trie->IsValid()) {
+    return nullptr;
+  }
+  return trie;
+}
+
+// The checks make sure that a malformed snapshot, e.g. written by another
+// version of the code, can't make the lookups read out of bounds.
+bool PathMatcherTrie::IsValid() const {
+  const size_t num_nodes = nodes_.size();
+  auto valid_child = [num_nodes](Index child) {
+    return child == kNone || child < num_nodes;
+  };
+  if (num_nodes == 0 || child_segments_.size() != child_nodes_.size() ||
+      result_methods_.size() != results_.size()) {
+    return false;
+  }
+  for (const Node& node : nodes_) {
+    if (node.children_begin > node.children_end ||
+        node.children_end > child_segments_.size() ||
+        node.results_begin > node.results_end ||
+        node.results_end > results_.size() ||
+        !valid_child(node.single_parameter_child) ||
+        !valid_child(node.wild_card_path_part_child) ||
+        !valid_child(node.wild_card_path_child)) {
+      return false;
+    }
+  }
+  for (size_t i = 0; i < child_nodes_.size(); ++i) {
+    if (child_nodes_[i] >= num_nodes ||
+        child_segments_[i] >= segments_.size()) {
+      return false;
+    }
+  }
+  for (size_t i = 0; i < results_.size(); ++i) {
+    if (result_methods_[i] >= methods_.size() ||
+        results_[i].data >= data_.size()) {
+      return false;
+    }
+  }
+  for (const auto& strings : {segments_, methods_}) {
+    for (const PoolString& s : strings) {
+      if (s.offset > pool_.size() || s.size > pool_.size() - s.offset) {
+        return false;
+      }
+    }
+  }
+  // The segment table size must be a power of 2 with an empty slot, which ends
+  // the probing of FindSegment().
+  const size_t table_size = segment_table_.size();
+  if (table_size == 0 || (table_size & (table_size - 1)) != 0 ||
+      table_size <= segments_.size()) {
+    return false;
+  }
+  size_t used_slots = 0;
+  for (Index entry : segment_table_) {
+    if (entry > segments_.size()) {
+      return false;
+    }
+    used_slots += entry != 0 ? 1 : 0;
+  }
+  if (used_slots != segments_.size()) {
+    return false;
+  }
+  return wild_card_method_ == kNone || wild_card_method_ < methods_.size();
+}
+
+std::shared_ptr<PathMatcherNode> PathMatcherTrie::Decompile() const {
+  std::vector<std::shared_ptr<PathMatcherNode>> nodes(nodes_.size());
+  for (auto& node : nodes) {
+    node = std::make_shared<PathMatcherNode>();
+  }
+  for (size_t i = 0; i < nodes_.size(); ++i) {
+    const Node& node = nodes_[i];
+    PathMatcherNode* target = nodes[i].get();
+    target->set_wildcard(node.wildcard != 0);
+    for (Index c = node.children_begin; c < node.children_end; ++c) {
+      const Index child = child_nodes_[c];
+      target->children_.emplace(FromPool(segments_[child_segments_[c]]),
+                                (child & kLink) != 0
+                                    ? links_[child & ~kLink]->Decompile()
+                                    : nodes[child]);
+    }
+    for (Index r = node.results_begin; r < node.results_end; ++r) {
+      target->result_map_.emplace(
+          FromPool(methods_[result_methods_[r]]),
+          PathMatcherLookupResult(data_[results_[r].data],
+                                  results_[r].is_multiple != 0));
+    }
+  }
+  return nodes[0];
+}
+
+PathMatcherTrie::Index PathMatcherTrie::FindSegment(absl::string_view segment,
+                                                    uint64_t hash) const {
+  const size_t mask = segment_table_.size() - 1;
+  for (size_t slot = hash & mask;; slot = (slot + 1) & mask) {
+    Index entry = segment_table_[slot];
+    if (entry == 0) {
+      return kNone;
+    }
+    if (FromPool(segments_[entry - 1]) == segment) {
+      return entry - 1;
+    }
+  }
+}
+
+PathMatcherTrie::Index PathMatcherTrie::FindMethod(
+    const RequestMethod& http_method) const {
+  const size_t size = http_method.http_method.size() + http_method.verb.size();
+  for (Index id = 0; id < methods_.size(); ++id) {
+    absl::string_view key = FromPool(methods_[id]);
+    if (key.size() == size &&
+        absl::StartsWith(key, http_method.http_method) &&
+        absl::EndsWith(key, http_method.verb)) {
+      return id;
+    }
+  }
+  return kNone;
+}
+
+PathMatcherTrie::Index PathMatcherTrie::FindChild(const Node& node,
+                                                  Index segment) const {
+  if (segment == kNone) {
+    return kNone;
+  }
+  auto begin = child_segments_.begin() + node.children_begin;
+  auto end = child_segments_.begin() + node.children_end;
+  auto it = end;
+  if (node.children_end - node.children_begin <= kMaxLinearSearchChildren) {
+    it = std::find(begin, end, segment);
+  } else {
+    it = std::lower_bound(begin, end, segment);
+    if (it != end && *it != segment) {
+      it = end;
+    }
+  }
+  return it == end ? kNone : child_nodes_[it - child_segments_.begin()];
+}
+
+void PathMatcherTrie::LookupPath(const PathMatcherNode::RequestPathParts& parts,
+                                 const RequestMethod& http_method,
+                                 PathMatcherLookupResult* result) const {
+  // The parts are hashed once for all the blocks.
+  SegmentHashes hashes;
+  hashes.reserve(parts.size());
+  for (absl::string_view part : parts) {
+    hashes.push_back(HashSegment(part));
+  }
+  LookupPath(parts, hashes, 0, http_method, result);
+}
+
+void PathMatcherTrie::LookupPath(const PathMatcherNode::RequestPathParts& parts,
+                                 const SegmentHashes& hashes, size_t current,
+                                 const RequestMethod& http_method,
+                                 PathMatcherLookupResult* result) const {
+  LookupState state{parts, hashes, http_method,
+                    SegmentIds(parts.size(), kUnknown), kUnknown};
+  if (links_.empty()) {
+    state.method = FindMethod(http_method);
+    if (state.method == kNone && wild_card_method_ == kNone) {
+      // Nothing is registered for the method.
+      return;
+    }
+  }
+  LookupPath(0, current, &state, result);
+}
+
+// See PathMatcherNode::LookupPath() for the details of the matching.
+void PathMatcherTrie::LookupPath(Index node_index, size_t current,
+                                 LookupState* state,
+                                 PathMatcherLookupResult* result) const {
+  const Node& node = nodes_[node_index];
+  const size_t end = state->parts.size();
+  // Loop is only used when matching a wildcard node.
+  for (;; ++current) {
+    if (current == end) {
+      if (state->method == kUnknown) {
+        state->method = FindMethod(state->http_method);
+      }
+      if (!GetResultForHttpMethod(node, state->method, result) &&
+          node.wild_card_path_child != kNone) {
+        // Use the result of the wildcard (**) child if there is one.
+        GetChildResultForHttpMethod(node.wild_card_path_child, state, result);
+      }
+      return;
+    }
+    Index& segment = state->segments[current];
+    if (segment == kUnknown) {
+      segment = FindSegment(state->parts[current], state->hashes[current]);
+    }
+    if (LookupPathFromChild(FindChild(node, segment), current, state,
+                            result)) {
+      return;
+    }
+    if (!node.wildcard) {
+      break;
+    }
+  }
+  // No matching child, and this node isn't a wildcard.  Maybe it has a
+  // match-any child?
+  for (Index child : {node.single_parameter_child,
+                      node.wild_card_path_part_child,
+                      node.wild_card_path_child}) {
+    if (LookupPathFromChild(child, current, state, result)) {
+      return;
+    }
+  }
+}
+
+bool PathMatcherTrie::LookupPathFromChild(
+    Index child, size_t current, LookupState* state,
+    PathMatcherLookupResult* result) const {
+  if (child == kNone) {
+    return false;
+  }
+  if ((child & kLink) != 0) {
+    links_[child & ~kLink]->LookupPath(state->parts, state->hashes,
+                                       current + 1, state->http_method,
+                                       result);
+  } else {
+    LookupPath(child, current + 1, state, result);
+  }
+  return result != nullptr && result->data != nullptr;
+}
+
+bool PathMatcherTrie::GetChildResultForHttpMethod(
+    Index child, LookupState* state, PathMatcherLookupResult* result) const {
+  if ((child & kLink) != 0) {
+    const PathMatcherTrie& linked = *links_[child & ~kLink];
+    return linked.GetResultForHttpMethod(
+        linked.nodes_[0], linked.FindMethod(state->http_method), result);
+  }
+  return GetResultForHttpMethod(nodes_[child], state->method, result);
+}
+
+bool PathMatcherTrie::GetResultForHttpMethod(
+    const Node& node, Index method, PathMatcherLookupResult* result) const {
+  for (Index key : {method, wild_card_method_}) {
+    if (key == kNone) {
+      continue;
+    }
+    for (Index i = node.results_begin; i < node.results_end; ++i) {
+      if (result_methods_[i] == key) {
+        *result = PathMatcherLookupResult(data_[results_[i].data],
+                                          results_[i].is_multiple != 0);
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+}  // namespace transcoding
+}  // namespace grpc
+}  // namespace google
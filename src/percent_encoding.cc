@@ -0,0 +1,184 @@
+// Copyright 2022 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+#include "grpc_transcoding/percent_encoding.h"
+
+#include <cstdint>
+#include <cstring>
+
+#include "grpc_transcoding/cpu_features.h"
+
+namespace google {
+namespace grpc {
+namespace transcoding {
+namespace {
+
+typedef const char* (*FindUrlEscapeCandidateFn)(const char* begin,
+                                                const char* end,
+                                                bool find_plus);
+
+const char* FindUrlEscapeCandidateScalar(const char* begin, const char* end,
+                                         bool find_plus) {
+  // Without find_plus, compare with '%' twice instead of branching.
+  const char plus = find_plus ? '+' : '%';
+  for (const char* p = begin; p < end; ++p) {
+    if (*p == '%' || *p == plus) {
+      return p;
+    }
+  }
+  return end;
+}
+
+#ifdef GRPC_TRANSCODING_X86
+
+const char* FindUrlEscapeCandidateSse2(const char* begin, const char* end,
+                                       bool find_plus) {
+  const __m128i percents = _mm_set1_epi8('%');
+  const __m128i pluses = _mm_set1_epi8(find_plus ? '+' : '%');
+  const char* p = begin;
+  for (; end - p >= 16; p += 16) {
+    __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    uint32_t mask = _mm_movemask_epi8(_mm_or_si128(
+        _mm_cmpeq_epi8(chunk, percents), _mm_cmpeq_epi8(chunk, pluses)));
+    if (mask != 0) {
+      return p + __builtin_ctz(mask);
+    }
+  }
+  return FindUrlEscapeCandidateScalar(p, end, find_plus);
+}
+
+__attribute__((target("avx2"))) const char* FindUrlEscapeCandidateAvx2(
+    const char* begin, const char* end, bool find_plus) {
+  const __m256i percents = _mm256_set1_epi8('%');
+  const __m256i pluses = _mm256_set1_epi8(find_plus ? '+' : '%');
+  const char* p = begin;
+  for (; end - p >= 32; p += 32) {
+    __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+    uint32_t mask = _mm256_movemask_epi8(_mm256_or_si256(
+        _mm256_cmpeq_epi8(chunk, percents), _mm256_cmpeq_epi8(chunk, pluses)));
+    if (mask != 0) {
+      return p + __builtin_ctz(mask);
+    }
+  }
+  return FindUrlEscapeCandidateSse2(p, end, find_plus);
+}
+
+#endif  // GRPC_TRANSCODING_X86
+
+FindUrlEscapeCandidateFn ChooseFindUrlEscapeCandidate() {
+#ifdef GRPC_TRANSCODING_X86
+  if (CpuSupportsAvx2()) {
+    return FindUrlEscapeCandidateAvx2;
+  }
+  if (CpuSupportsSse2()) {
+    return FindUrlEscapeCandidateSse2;
+  }
+#endif
+  return FindUrlEscapeCandidateScalar;
+}
+
+// Same as GetEscapedChar() for the '%' or '+' at src, but always writes the
+// output character (the '%' or '+' itself if it's not unescaped) and returns
+// the number of characters consumed. Works on pointers so that the hot loop
+// in AppendUrlUnescapedFrom() doesn't pay for the string_view indexing.
+inline int DecodeEscape(const char* src, const char* end,
+                        UrlUnescapeSpec unescape_spec, bool unescape_plus,
+                        char* out) {
+  if (*src == '+') {
+    *out = unescape_plus ? ' ' : '+';
+    return 1;
+  }
+  *out = '%';
+  if (end - src < 3 || !ascii_isxdigit(src[1]) || !ascii_isxdigit(src[2])) {
+    return 1;
+  }
+  char c = (hex_digit_to_int(src[1]) << 4) | hex_digit_to_int(src[2]);
+  switch (unescape_spec) {
+    case UrlUnescapeSpec::kAllCharactersExceptReserved:
+      if (IsReservedChar(c)) {
+        return 1;
+      }
+      break;
+    case UrlUnescapeSpec::kAllCharactersExceptSlash:
+      if (c == '/') {
+        return 1;
+      }
+      break;
+    case UrlUnescapeSpec::kAllCharacters:
+      break;
+  }
+  *out = c;
+  return 3;
+}
+
+}  // namespace
+
+const char* FindUrlEscapeCandidateVectorized(const char* begin,
+                                             const char* end, bool find_plus) {
+  static const FindUrlEscapeCandidateFn find = ChooseFindUrlEscapeCandidate();
+  return find(begin, end, find_plus);
+}
+
+void AppendUrlUnescapedFrom(absl::string_view part, size_t pos, size_t escape,
+                            char ch, int length, UrlUnescapeSpec unescape_spec,
+                            bool unescape_plus, std::string* out) {
+  if (escape == absl::string_view::npos) {
+    out->append(part.data() + pos, part.size() - pos);
+    return;
+  }
+  // The unescaped string is never longer than the escaped one, so it's written
+  // in place and the size is adjusted at the end.
+  const size_t out_size = out->size();
+  out->resize(out_size + part.size() - pos);
+  char* begin = &(*out)[out_size];
+  std::memcpy(begin, part.data() + pos, escape - pos);
+  char* p = begin + (escape - pos);
+  *p++ = ch;
+
+  const char* src = part.data() + escape + length;
+  const char* end = part.data() + part.size();
+  const char plus = unescape_plus ? '+' : '%';
+  while (src < end) {
+    if (*src == '%' || *src == plus) {
+      // Consecutive escapes don't need the scan.
+      int skip = DecodeEscape(src, end, unescape_spec, unescape_plus, p);
+      src += skip;
+      ++p;
+      continue;
+    }
+    // The runs between the escapes are usually short, so the characters are
+    // copied one by one first and only a longer run is scanned and copied as
+    // a whole.
+    const char* run_end = end - src > 8 ? src + 8 : end;
+    char c = *src;
+    do {
+      *p++ = c;
+      ++src;
+    } while (src < run_end && (c = *src) != '%' && c != plus);
+    if (src == run_end && src < end) {
+      const char* next = FindUrlEscapeCandidateVectorized(src, end,
+                                                          unescape_plus);
+      std::memcpy(p, src, next - src);
+      p += next - src;
+      src = next;
+    }
+  }
+  out->resize(out_size + (p - begin));
+}
+
+}  // namespace transcoding
+}  // namespace grpc
+}  // namespace google
@@ -29,10 +29,15 @@ namespace transcoding {
 
 PrefixWriter::PrefixWriter(const std::string& prefix,
                            google::protobuf::util::converter::ObjectWriter* ow)
-    : prefix_(absl::StrSplit(prefix, ".", absl::SkipEmpty())),
+    : owned_prefix_(absl::StrSplit(prefix, ".", absl::SkipEmpty())),
+      prefix_(owned_prefix_),
       non_actionable_depth_(0),
       writer_(ow) {}
 
+PrefixWriter::PrefixWriter(absl::Span<const std::string> prefix,
+                           google::protobuf::util::converter::ObjectWriter* ow)
+    : owned_prefix_(), prefix_(prefix), non_actionable_depth_(0), writer_(ow) {}
+
 PrefixWriter* PrefixWriter::StartObject(absl::string_view name) {
   if (++non_actionable_depth_ == 1) {
     name = StartPrefix(name);
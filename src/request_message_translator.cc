@@ -21,8 +21,10 @@
 #include "google/protobuf/stubs/bytestream.h"
 #include "google/protobuf/util/converter/error_listener.h"
 #include "google/protobuf/util/converter/protostream_objectwriter.h"
+#include "google/protobuf/util/converter/type_info.h"
 #include "grpc_transcoding/prefix_writer.h"
 #include "grpc_transcoding/request_weaver.h"
+#include "grpc_transcoding/transcoding_plan.h"
 
 namespace pbconv = ::google::protobuf::util::converter;
 
@@ -51,24 +53,119 @@ RequestMessageTranslator::RequestMessageTranslator(
     : message_(),
       sink_(&message_),
       error_listener_(),
-      proto_writer_(
-          &type_resolver, *request_info.message_type, &sink_, &error_listener_,
+      owned_type_info_(pbconv::TypeInfo::NewTypeInfo(&type_resolver)),
+      type_info_(owned_type_info_.get()),
+      message_type_(request_info.message_type),
+      proto_writer_options_(
           GetProtoWriterOptions(request_info.case_insensitive_enum_parsing)),
+      proto_writer_(),
+      wire_encoder_plan_(nullptr),
+      wire_encoder_(),
       request_weaver_(),
       prefix_writer_(),
-      writer_pipeline_(&proto_writer_),
+      writer_pipeline_(nullptr),
       output_delimiter_(output_delimiter),
-      finished_(false) {
+      finished_(false),
+      last_message_size_(0),
+      compressor_(nullptr) {
+  CreateWriter();
+  writer_pipeline_ = Writer();
+  BuildPipeline(std::move(request_info));
+}
+
+RequestMessageTranslator::RequestMessageTranslator(
+    const pbconv::TypeInfo& type_info, bool output_delimiter,
+    RequestInfo request_info)
+    : message_(),
+      sink_(&message_),
+      error_listener_(),
+      owned_type_info_(),
+      type_info_(&type_info),
+      message_type_(request_info.message_type),
+      proto_writer_options_(
+          GetProtoWriterOptions(request_info.case_insensitive_enum_parsing)),
+      proto_writer_(),
+      wire_encoder_plan_(nullptr),
+      wire_encoder_(),
+      request_weaver_(),
+      prefix_writer_(),
+      writer_pipeline_(nullptr),
+      output_delimiter_(output_delimiter),
+      finished_(false),
+      last_message_size_(0),
+      compressor_(nullptr) {
+  CreateWriter();
+  writer_pipeline_ = Writer();
+  BuildPipeline(std::move(request_info));
+}
+
+RequestMessageTranslator::RequestMessageTranslator(
+    const TranscodingPlan& plan, bool output_delimiter,
+    std::vector<RequestWeaver::BindingInfo> variable_bindings)
+    : message_(),
+      sink_(&message_),
+      error_listener_(),
+      owned_type_info_(),
+      type_info_(&plan.type_info()),
+      message_type_(&plan.request_type()),
+      proto_writer_options_(
+          GetProtoWriterOptions(plan.case_insensitive_enum_parsing())),
+      proto_writer_(),
+      wire_encoder_plan_(plan.wire_encoder_plan()),
+      wire_encoder_(),
+      request_weaver_(),
+      prefix_writer_(),
+      writer_pipeline_(nullptr),
+      output_delimiter_(output_delimiter),
+      finished_(false),
+      last_message_size_(0),
+      compressor_(nullptr) {
+  CreateWriter();
+  writer_pipeline_ = Writer();
+  BuildPipeline(std::move(variable_bindings),
+                plan.reject_binding_body_field_collisions());
+
+  // The plan has already split the prefix
+  if (!plan.body_prefix().empty()) {
+    prefix_writer_.reset(new PrefixWriter(
+        absl::MakeConstSpan(plan.body_prefix()), writer_pipeline_));
+    writer_pipeline_ = prefix_writer_.get();
+  }
+}
+
+void RequestMessageTranslator::CreateWriter() {
+  if (wire_encoder_plan_ != nullptr) {
+    WireEncoder::Options options;
+    options.ignore_unknown_fields = proto_writer_options_.ignore_unknown_fields;
+    options.case_insensitive_enum_parsing =
+        proto_writer_options_.case_insensitive_enum_parsing;
+    wire_encoder_.emplace(*wire_encoder_plan_, options, &message_,
+                          &error_listener_);
+  } else {
+    proto_writer_.emplace(type_info_, *message_type_, &sink_, &error_listener_,
+                          proto_writer_options_);
+  }
   // Relax Base64 decoding to support RFC 2045 Base64
-  proto_writer_.set_use_strict_base64_decoding(false);
+  Writer()->set_use_strict_base64_decoding(false);
+}
 
-  // Create a RequestWeaver if we have variable bindings to weave
-  if (!request_info.variable_bindings.empty()) {
-    request_weaver_.reset(new RequestWeaver(
-        std::move(request_info.variable_bindings), writer_pipeline_,
-        &error_listener_, request_info.reject_binding_body_field_collisions));
-    writer_pipeline_ = request_weaver_.get();
+pbconv::ObjectWriter* RequestMessageTranslator::Writer() {
+  if (wire_encoder_.has_value()) {
+    return &*wire_encoder_;
+  }
+  return &*proto_writer_;
+}
+
+bool RequestMessageTranslator::WriterDone() {
+  if (wire_encoder_.has_value()) {
+    return wire_encoder_->done();
   }
+  return proto_writer_->done();
+}
+
+void RequestMessageTranslator::BuildPipeline(RequestInfo request_info) {
+  BuildPipeline(std::move(request_info.variable_bindings),
+                request_info.reject_binding_body_field_collisions);
 
   // Create a PrefixWriter if there is a prefix to write
   if (!request_info.body_field_path.empty() &&
@@ -77,6 +174,19 @@ RequestMessageTranslator::RequestMessageTranslator(
         new PrefixWriter(request_info.body_field_path, writer_pipeline_));
     writer_pipeline_ = prefix_writer_.get();
   }
+}
+
+void RequestMessageTranslator::BuildPipeline(
+    std::vector<RequestWeaver::BindingInfo> variable_bindings,
+    bool reject_binding_body_field_collisions) {
+  // Create a RequestWeaver if we have variable bindings to weave
+  if (!variable_bindings.empty()) {
+    request_weaver_.reset(
+        new RequestWeaver(std::move(variable_bindings), writer_pipeline_,
+                          &error_listener_,
+                          reject_binding_body_field_collisions));
+    writer_pipeline_ = request_weaver_.get();
+  }
 
   if (output_delimiter_) {
     // Reserve space for the delimiter at the begining of the message_
@@ -93,18 +203,42 @@ bool RequestMessageTranslator::NextMessage(std::string* message) {
     // Finished reading
     return false;
   }
-  if (!proto_writer_.done()) {
+  if (!WriterDone()) {
     // No full message yet
     return false;
   }
   if (output_delimiter_) {
     WriteDelimiter();
   }
+  last_message_size_ = message_.size();
   *message = std::move(message_);
   finished_ = true;
   return true;
 }
 
+void RequestMessageTranslator::Reset() {
+  message_.clear();
+  message_.reserve(last_message_size_);
+  error_listener_.set_status(absl::OkStatus());
+  finished_ = false;
+  CreateWriter();
+
+  if (request_weaver_ != nullptr) {
+    // The variable bindings are woven into the first message only, so the
+    // RequestWeaver is bypassed from now on.
+    request_weaver_.reset();
+    if (prefix_writer_ != nullptr) {
+      prefix_writer_->set_writer(Writer());
+    } else {
+      writer_pipeline_ = Writer();
+    }
+  }
+
+  if (output_delimiter_) {
+    ReserveDelimiterSpace();
+  }
+}
+
 void RequestMessageTranslator::ReserveDelimiterSpace() {
   static char reserved[kDelimiterSize] = {0};
   sink_.Append(reserved, sizeof(reserved));
@@ -112,8 +246,9 @@ void RequestMessageTranslator::ReserveDelimiterSpace() {
 
 namespace {
 
-void SizeToDelimiter(unsigned size, unsigned char* delimiter) {
-  delimiter[0] = 0;  // compression bit
+void SizeToDelimiter(unsigned size, bool compressed,
+                     unsigned char* delimiter) {
+  delimiter[0] = compressed ? 1 : 0;  // compression bit
 
   // big-endian 32-bit length
   delimiter[4] = 0xFF & size;
@@ -128,9 +263,21 @@ void SizeToDelimiter(unsigned size, unsigned char* delimiter) {
 }  // namespace
 
 void RequestMessageTranslator::WriteDelimiter() {
+  bool compressed = false;
+  if (compressor_ != nullptr) {
+    absl::string_view message(message_);
+    message.remove_prefix(kDelimiterSize);
+    // The message is sent uncompressed if compressing fails or doesn't help,
+    // which gRPC allows for any message of a stream.
+    if (compressor_->Compress(message, &compressed_message_).ok() &&
+        compressed_message_.size() < message.size()) {
+      message_.replace(kDelimiterSize, std::string::npos, compressed_message_);
+      compressed = true;
+    }
+  }
   // Asumming that the message_.size() - kDelimiterSize is less than UINT_MAX
   SizeToDelimiter(static_cast<unsigned>(message_.size() - kDelimiterSize),
-                  reinterpret_cast<unsigned char*>(&message_[0]));
+                  compressed, reinterpret_cast<unsigned char*>(&message_[0]));
 }
 
 }  // namespace transcoding
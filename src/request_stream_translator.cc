@@ -33,15 +33,50 @@ namespace pbconv = google::protobuf::util::converter;
 RequestStreamTranslator::RequestStreamTranslator(
     google::protobuf::util::TypeResolver& type_resolver, bool output_delimiters,
     RequestInfo request_info)
-    : type_resolver_(type_resolver),
+    : type_resolver_(&type_resolver),
+      type_info_(nullptr),
+      plan_(nullptr),
       status_(),
       request_info_(std::move(request_info)),
       output_delimiters_(output_delimiters),
+      compressor_(nullptr),
       translator_(),
       messages_(),
       depth_(0),
       done_(false) {}
 
+RequestStreamTranslator::RequestStreamTranslator(
+    const pbconv::TypeInfo& type_info, bool output_delimiters,
+    RequestInfo request_info)
+    : type_resolver_(nullptr),
+      type_info_(&type_info),
+      plan_(nullptr),
+      status_(),
+      request_info_(std::move(request_info)),
+      output_delimiters_(output_delimiters),
+      compressor_(nullptr),
+      translator_(),
+      messages_(),
+      depth_(0),
+      done_(false) {}
+
+RequestStreamTranslator::RequestStreamTranslator(
+    const TranscodingPlan& plan, bool output_delimiters,
+    std::vector<RequestWeaver::BindingInfo> variable_bindings)
+    : type_resolver_(nullptr),
+      type_info_(&plan.type_info()),
+      plan_(&plan),
+      status_(),
+      request_info_(),
+      output_delimiters_(output_delimiters),
+      compressor_(nullptr),
+      translator_(),
+      messages_(),
+      depth_(0),
+      done_(false) {
+  request_info_.variable_bindings = std::move(variable_bindings);
+}
+
 RequestStreamTranslator::~RequestStreamTranslator() {}
 
 bool RequestStreamTranslator::NextMessage(std::string* message) {
@@ -147,6 +182,31 @@ RequestStreamTranslator* RequestStreamTranslator::EndList() {
   return this;
 }
 
+template <typename Renderer>
+void RequestStreamTranslator::RenderData(absl::string_view name,
+                                         Renderer renderer) {
+  if (!status_.ok()) {
+    // In error state - ignore
+    return;
+  }
+  if (depth_ == 0) {
+    // In depth_ == 0 case we expect only a StartList()
+    status_ = absl::Status(absl::StatusCode::kInvalidArgument,
+                           "Expected an array instead of a scalar value.");
+  } else if (depth_ == 1) {
+    // This means we have an array of scalar values. This can happen if the HTTP
+    // body is mapped to a scalar field.
+    // We need to start the ProtoMessageTranslator, render the scalar value to
+    // translate it and end the ProtoMessageTranslator to save the translated
+    // message.
+    StartMessageTranslator();
+    renderer();
+    EndMessageTranslator();
+  } else {  // depth_ > 1
+    renderer();
+  }
+}
+
 RequestStreamTranslator* RequestStreamTranslator::RenderBool(
     absl::string_view name, bool value) {
   RenderData(name, [this, name, value]() {
@@ -226,6 +286,21 @@ RequestStreamTranslator* RequestStreamTranslator::RenderNull(
 }
 
 void RequestStreamTranslator::StartMessageTranslator() {
+  if (translator_ != nullptr) {
+    // Reuse the translator of the previous message. It has already consumed
+    // the variable bindings.
+    translator_->Reset();
+    return;
+  }
+  if (plan_ != nullptr) {
+    std::vector<RequestWeaver::BindingInfo> variable_bindings;
+    // Only the first message gets the variable bindings, see below.
+    variable_bindings.swap(request_info_.variable_bindings);
+    translator_.reset(new RequestMessageTranslator(
+        *plan_, output_delimiters_, std::move(variable_bindings)));
+    translator_->set_compressor(compressor_);
+    return;
+  }
   RequestInfo request_info;
   request_info.message_type = request_info_.message_type;
   request_info.body_field_path = request_info_.body_field_path;
@@ -234,8 +309,14 @@ void RequestStreamTranslator::StartMessageTranslator() {
   // request_info_, s.t. the subsequent messages don't use them.
   request_info.variable_bindings.swap(request_info_.variable_bindings);
   // Create a RequestMessageTranslator to handle the events in a single message
-  translator_.reset(new RequestMessageTranslator(
-      type_resolver_, output_delimiters_, std::move(request_info)));
+  if (type_info_ != nullptr) {
+    translator_.reset(new RequestMessageTranslator(
+        *type_info_, output_delimiters_, std::move(request_info)));
+  } else {
+    translator_.reset(new RequestMessageTranslator(
+        *type_resolver_, output_delimiters_, std::move(request_info)));
+  }
+  translator_->set_compressor(compressor_);
 }
 
 void RequestStreamTranslator::EndMessageTranslator() {
@@ -254,31 +335,7 @@ void RequestStreamTranslator::EndMessageTranslator() {
     status_ =
         absl::Status(absl::StatusCode::kInvalidArgument, "Invalid object");
   }
-  translator_.reset();
-}
-
-void RequestStreamTranslator::RenderData(absl::string_view name,
-                                         std::function<void()> renderer) {
-  if (!status_.ok()) {
-    // In error state - ignore
-    return;
-  }
-  if (depth_ == 0) {
-    // In depth_ == 0 case we expect only a StartList()
-    status_ = absl::Status(absl::StatusCode::kInvalidArgument,
-                           "Expected an array instead of a scalar value.");
-  } else if (depth_ == 1) {
-    // This means we have an array of scalar values. This can happen if the HTTP
-    // body is mapped to a scalar field.
-    // We need to start the ProtoMessageTranslator, render the scalar value to
-    // translate it and end the ProtoMessageTranslator to save the translated
-    // message.
-    StartMessageTranslator();
-    renderer();
-    EndMessageTranslator();
-  } else {  // depth_ > 1
-    renderer();
-  }
+  // translator_ is kept to be reset for the next message.
 }
 
 }  // namespace transcoding
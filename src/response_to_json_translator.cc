@@ -17,9 +17,11 @@
 #include "grpc_transcoding/response_to_json_translator.h"
 
 #include <algorithm>
+#include <cstdint>
 #include <cstring>
 #include <string>
 
+#include "absl/synchronization/mutex.h"
 #include "google/protobuf/io/zero_copy_stream_impl_lite.h"
 #include "google/protobuf/util/type_resolver.h"
 
@@ -27,6 +29,34 @@ namespace google {
 namespace grpc {
 
 namespace transcoding {
+
+// What the translation tasks share with the translator. The tasks hold a
+// reference to it, as they may run after the translator is destroyed.
+struct ResponseToJsonTranslator::ParallelState {
+  ::google::protobuf::util::TypeResolver* type_resolver;
+  std::string type_url;
+  ::google::protobuf::util::JsonPrintOptions json_print_options;
+  // The plan to print the messages with, or null to use BinaryToJsonStream().
+  std::shared_ptr<const JsonPrinterPlan> plan;
+
+  absl::Mutex mu;
+  // The number of the messages being translated.
+  int running ABSL_GUARDED_BY(mu) = 0;
+  // Set when the translator is destroyed, so that the tasks do nothing.
+  bool cancelled ABSL_GUARDED_BY(mu) = false;
+};
+
+struct ResponseToJsonTranslator::ParallelJob {
+  enum State { kScheduled, kRunning, kDone };
+
+  std::string proto;
+  // The result of the translation, set by the thread that translates it.
+  std::string json;
+  absl::Status status;
+  // Guarded by ParallelState::mu.
+  State state = kScheduled;
+};
+
 ResponseToJsonTranslator::ResponseToJsonTranslator(
     ::google::protobuf::util::TypeResolver* type_resolver, std::string type_url,
     bool streaming, TranscoderInputStream* in,
@@ -35,51 +65,48 @@ ResponseToJsonTranslator::ResponseToJsonTranslator(
       type_url_(std::move(type_url)),
       options_(options),
       streaming_(streaming),
-      reader_(in),
+      reader_(in, options.decompressor),
       first_(true),
-      finished_(false) {}
-
-bool ResponseToJsonTranslator::NextMessage(std::string* message) {
-  if (Finished()) {
-    // All done
-    return false;
+      finished_(false),
+      in_message_(false),
+      in_flight_bytes_(0) {
+  std::shared_ptr<const JsonPrinterPlan> plan;
+  if (options_.json_printer_cache != nullptr) {
+    plan = options_.json_printer_cache->Get(type_url_,
+                                            options_.json_print_options);
+  } else if (options_.incremental_translation) {
+    auto compiled = JsonPrinterPlan::Compile(type_resolver_, type_url_,
+                                             options_.json_print_options);
+    if (compiled.ok()) {
+      plan = *std::move(compiled);
+    }
   }
 
-  // Try to read a message
-  auto proto_in = reader_.NextMessage();
-  status_ = reader_.Status();
-  if (!status_.ok()) {
-    return false;
+  if (streaming_ && options_.executor != nullptr) {
+    parallel_ = std::make_shared<ParallelState>();
+    parallel_->type_resolver = type_resolver_;
+    parallel_->type_url = type_url_;
+    parallel_->json_print_options = options_.json_print_options;
+    parallel_->plan = std::move(plan);
+  } else if (plan != nullptr) {
+    printer_.reset(new IncrementalJsonPrinter(std::move(plan)));
+    // The complete messages are printed the same way as BinaryToJsonStream()
+    // does, and only the parts of the messages in the order they arrive.
+    printer_->set_require_canonical_encoding(
+        !options_.incremental_translation);
   }
+}
 
-  if (proto_in) {
-    std::string json_out;
-    if (TranslateMessage(proto_in.get(), &json_out)) {
-      *message = std::move(json_out);
-      if (!streaming_) {
-        // This is a non-streaming call, so we don't expect more messages.
-        finished_ = true;
-      }
-      return true;
-    } else {
-      // TranslateMessage() failed - return false. The error details are stored
-      // in status_.
-      return false;
-    }
-  } else if (streaming_ && reader_.Finished()) {
-    if (!options_.stream_newline_delimited &&
-        !options_.stream_sse_style_delimited) {
-      // This is a non-newline-delimited and non-SSE-style-delimited streaming
-      // call and the input is finished. Return the final ']' or "[]" in case
-      // this was an empty stream.
-      *message = first_ ? "[]" : "]";
-    }
-    finished_ = true;
-    return true;
-  } else {
-    // Don't have an input message
-    return false;
+ResponseToJsonTranslator::~ResponseToJsonTranslator() {
+  if (parallel_ == nullptr) {
+    return;
   }
+  // The tasks that haven't started yet won't translate anything, and the
+  // running ones may still use the type resolver.
+  absl::MutexLock lock(&parallel_->mu);
+  parallel_->cancelled = true;
+  parallel_->mu.Await(absl::Condition(
+      +[](int* running) { return *running == 0; }, &parallel_->running));
 }
 
 namespace {
@@ -122,63 +149,348 @@ bool WriteString(::google::protobuf::io::ZeroCopyOutputStream* stream,
 
 }  // namespace
 
-bool ResponseToJsonTranslator::TranslateMessage(
-    ::google::protobuf::io::ZeroCopyInputStream* proto_in,
-    std::string* json_out) {
-  ::google::protobuf::io::StringOutputStream json_stream(json_out);
+bool ResponseToJsonTranslator::NextMessage(std::string* message) {
+  std::string json_out;
+  {
+    ::google::protobuf::io::StringOutputStream json_stream(&json_out);
+    if (!NextMessage(&json_stream)) {
+      return false;
+    }
+  }
+  *message = std::move(json_out);
+  return true;
+}
 
-  if (streaming_ && options_.stream_sse_style_delimited) {
-    if (!WriteString(&json_stream, "data: ")) {
-      status_ = absl::Status(absl::StatusCode::kInternal,
-                             "Failed to build the response message.");
+bool ResponseToJsonTranslator::NextMessage(
+    ::google::protobuf::io::ZeroCopyOutputStream* out) {
+  if (Finished()) {
+    // All done
+    return false;
+  }
+
+  if (parallel_ != nullptr) {
+    return NextParallelMessage(out);
+  }
+
+  bool incremental = printer_ && options_.incremental_translation;
+  if (incremental) {
+    // Translate the part of the message that has arrived.
+    bool last = false;
+    ::google::protobuf::io::ZeroCopyInputStream* part =
+        reader_.NextMessagePart(&last);
+    status_ = reader_.Status();
+    if (!status_.ok()) {
       return false;
     }
-  } else if (streaming_ && !options_.stream_newline_delimited) {
-    if (first_) {
-      // This is a non-newline-delimited streaming call and this is the first
-      // message, so prepend the
-      // output JSON with a '['.
-      if (!WriteChar(&json_stream, '[')) {
-        status_ = absl::Status(absl::StatusCode::kInternal,
-                               "Failed to build the response message.");
+    if (part) {
+      int64_t byte_count = out->ByteCount();
+      const bool translated = TranslateMessagePart(part, last, out);
+      reader_.ReleaseMessageView();
+      if (!translated) {
         return false;
       }
-      first_ = false;
-    } else {
-      // For non-newline-delimited streaming calls add a ',' before each message
-      // except the first.
-      if (!WriteChar(&json_stream, ',')) {
-        status_ = absl::Status(absl::StatusCode::kInternal,
-                               "Failed to build the response message.");
-        return false;
+      if (last && !streaming_) {
+        finished_ = true;
       }
+      // Nothing is written if the part ended inside a field.
+      return out->ByteCount() > byte_count;
     }
   }
 
-  // Do the actual translation.
-  status_ = ::google::protobuf::util::BinaryToJsonStream(
-      type_resolver_, type_url_, proto_in, &json_stream,
-      options_.json_print_options);
+  // Try to read a message. The stream is reused for all the messages, which
+  // are translated one at a time.
+  ::google::protobuf::io::ZeroCopyInputStream* proto_in =
+      incremental ? nullptr : reader_.NextMessageView();
+  status_ = reader_.Status();
+  if (!status_.ok()) {
+    return false;
+  }
 
+  if (proto_in) {
+    const bool translated = TranslateMessage(proto_in, out);
+    // Backs the input up to the end of the message now rather than at the
+    // next read.
+    reader_.ReleaseMessageView();
+    if (!translated) {
+      // TranslateMessage() failed - return false. The error details are stored
+      // in status_.
+      return false;
+    }
+    if (!streaming_) {
+      // This is a non-streaming call, so we don't expect more messages.
+      finished_ = true;
+    }
+    return true;
+  } else if (streaming_ && reader_.Finished()) {
+    return WriteStreamEnd(out);
+  } else {
+    // Don't have an input message
+    return false;
+  }
+}
+
+namespace {
+
+// Reads the whole stream into *data.
+void ReadAll(::google::protobuf::io::ZeroCopyInputStream* in,
+             std::string* data) {
+  const void* buffer = nullptr;
+  int size = 0;
+  while (in->Next(&buffer, &size)) {
+    data->append(static_cast<const char*>(buffer), size);
+  }
+}
+
+// Appends the JSON of the message proto to *json. It's printed by printer,
+// unless the printer can't print it the same way as BinaryToJsonStream().
+absl::Status PrintMessage(
+    IncrementalJsonPrinter* printer,
+    ::google::protobuf::util::TypeResolver* type_resolver,
+    const std::string& type_url,
+    const ::google::protobuf::util::JsonPrintOptions& options,
+    const std::string& proto, std::string* json) {
+  size_t json_size = json->size();
+  {
+    ::google::protobuf::io::ArrayInputStream proto_in(proto.data(),
+                                                      proto.size());
+    absl::Status status = printer->Print(&proto_in, true, json);
+    if (status.code() != absl::StatusCode::kUnimplemented) {
+      return status;
+    }
+  }
+  // The fields are encoded out of order or more than once, as protobuf
+  // serializers don't, so this is rare.
+  json->resize(json_size);
+  ::google::protobuf::io::ArrayInputStream proto_in(proto.data(), proto.size());
+  ::google::protobuf::io::StringOutputStream json_out(json);
+  return ::google::protobuf::util::BinaryToJsonStream(
+      type_resolver, type_url, &proto_in, &json_out, options);
+}
+
+}  // namespace
+
+bool ResponseToJsonTranslator::NextParallelMessage(
+    ::google::protobuf::io::ZeroCopyOutputStream* out) {
+  // Schedule the complete messages, at least one of them.
+  while (jobs_.empty() || in_flight_bytes_ < options_.max_in_flight_bytes) {
+    ::google::protobuf::io::ZeroCopyInputStream* proto_in =
+        reader_.NextMessageView();
+    if (proto_in == nullptr) {
+      break;
+    }
+    std::shared_ptr<ParallelJob> job = std::make_shared<ParallelJob>();
+    ReadAll(proto_in, &job->proto);
+    reader_.ReleaseMessageView();
+    // A compressed message may turn out to be invalid only while it's read.
+    if (!reader_.Status().ok()) {
+      break;
+    }
+    in_flight_bytes_ += job->proto.size();
+    jobs_.push_back(job);
+    std::shared_ptr<ParallelState> state = parallel_;
+    options_.executor->Execute([state, job]() {
+      {
+        absl::MutexLock lock(&state->mu);
+        if (state->cancelled || job->state != ParallelJob::kScheduled) {
+          return;
+        }
+        job->state = ParallelJob::kRunning;
+        ++state->running;
+      }
+      TranslateJob(*state, job.get());
+      absl::MutexLock lock(&state->mu);
+      job->state = ParallelJob::kDone;
+      --state->running;
+    });
+  }
+
+  if (jobs_.empty()) {
+    // The messages before an error are returned first.
+    status_ = reader_.Status();
+    if (!status_.ok()) {
+      return false;
+    }
+    return reader_.Finished() && WriteStreamEnd(out);
+  }
+
+  // Translate the first message here if no task has started it, or wait for
+  // it.
+  std::shared_ptr<ParallelJob> job = jobs_.front();
+  bool translate = false;
+  {
+    absl::MutexLock lock(&parallel_->mu);
+    if (job->state == ParallelJob::kScheduled) {
+      job->state = ParallelJob::kRunning;
+      translate = true;
+    } else {
+      parallel_->mu.Await(absl::Condition(
+          +[](ParallelJob* scheduled) {
+            return scheduled->state == ParallelJob::kDone;
+          },
+          job.get()));
+    }
+  }
+  if (translate) {
+    TranslateJob(*parallel_, job.get());
+    absl::MutexLock lock(&parallel_->mu);
+    job->state = ParallelJob::kDone;
+  }
+  jobs_.pop_front();
+  in_flight_bytes_ -= job->proto.size();
+
+  status_ = job->status;
   if (!status_.ok()) {
     return false;
   }
+  if (!WriteMessagePrefix(out)) {
+    return false;
+  }
+  if (!WriteString(out, job->json)) {
+    status_ = absl::Status(absl::StatusCode::kInternal,
+                           "Failed to build the response message.");
+    return false;
+  }
+  return WriteMessageSuffix(out);
+}
+
+void ResponseToJsonTranslator::TranslateJob(const ParallelState& state,
+                                            ParallelJob* job) {
+  ::google::protobuf::io::ArrayInputStream proto_in(job->proto.data(),
+                                                    job->proto.size());
+  if (state.plan != nullptr) {
+    IncrementalJsonPrinter printer(state.plan);
+    printer.set_require_canonical_encoding(true);
+    job->status =
+        PrintMessage(&printer, state.type_resolver, state.type_url,
+                     state.json_print_options, job->proto, &job->json);
+    return;
+  }
+  ::google::protobuf::io::StringOutputStream json_out(&job->json);
+  job->status = ::google::protobuf::util::BinaryToJsonStream(
+      state.type_resolver, state.type_url, &proto_in, &json_out,
+      state.json_print_options);
+}
 
-  // Append a newline delimiter after the message if needed.
+bool ResponseToJsonTranslator::WriteMessagePrefix(
+    ::google::protobuf::io::ZeroCopyOutputStream* out) {
+  bool ok = true;
   if (streaming_ && options_.stream_sse_style_delimited) {
-    if (!WriteString(&json_stream, "\n\n")) {
+    ok = WriteString(out, "data: ");
+  } else if (streaming_ && !options_.stream_newline_delimited) {
+    // This is a non-newline-delimited streaming call, so prepend the output
+    // JSON with a '[' for the first message and with a ',' for the others.
+    ok = WriteChar(out, first_ ? '[' : ',');
+    first_ = false;
+  }
+  if (!ok) {
+    status_ = absl::Status(absl::StatusCode::kInternal,
+                           "Failed to build the response message.");
+  }
+  return ok;
+}
+
+bool ResponseToJsonTranslator::WriteStreamEnd(
+    ::google::protobuf::io::ZeroCopyOutputStream* out) {
+  if (!options_.stream_newline_delimited &&
+      !options_.stream_sse_style_delimited) {
+    // This is a non-newline-delimited and non-SSE-style-delimited streaming
+    // call and the input is finished. Write the final ']' or "[]" in case
+    // this was an empty stream.
+    if (!WriteString(out, first_ ? "[]" : "]")) {
       status_ = absl::Status(absl::StatusCode::kInternal,
                              "Failed to build the response message.");
       return false;
     }
+  }
+  finished_ = true;
+  return true;
+}
+
+bool ResponseToJsonTranslator::WriteMessageSuffix(
+    ::google::protobuf::io::ZeroCopyOutputStream* out) {
+  // Append a newline delimiter after the message if needed.
+  bool ok = true;
+  if (streaming_ && options_.stream_sse_style_delimited) {
+    ok = WriteString(out, "\n\n");
   } else if (streaming_ && options_.stream_newline_delimited) {
-    if (!WriteChar(&json_stream, '\n')) {
+    ok = WriteChar(out, '\n');
+  }
+  if (!ok) {
+    status_ = absl::Status(absl::StatusCode::kInternal,
+                           "Failed to build the response message.");
+  }
+  return ok;
+}
+
+bool ResponseToJsonTranslator::TranslateMessage(
+    ::google::protobuf::io::ZeroCopyInputStream* proto_in,
+    ::google::protobuf::io::ZeroCopyOutputStream* json_out) {
+  if (!WriteMessagePrefix(json_out)) {
+    return false;
+  }
+
+  // Do the actual translation.
+  if (printer_) {
+    // The message is buffered, so that it can still be printed with
+    // BinaryToJsonStream() if the printer can't print it.
+    printer_proto_.clear();
+    ReadAll(proto_in, &printer_proto_);
+    printer_json_.clear();
+    status_ = PrintMessage(printer_.get(), type_resolver_, type_url_,
+                           options_.json_print_options, printer_proto_,
+                           &printer_json_);
+    if (status_.ok() && !WriteString(json_out, printer_json_)) {
       status_ = absl::Status(absl::StatusCode::kInternal,
                              "Failed to build the response message.");
+    }
+  } else {
+    status_ = ::google::protobuf::util::BinaryToJsonStream(
+        type_resolver_, type_url_, proto_in, json_out,
+        options_.json_print_options);
+  }
+
+  // A compressed message may turn out to be invalid only while it's read,
+  // which is the cause of any translation error then.
+  if (!reader_.Status().ok()) {
+    status_ = reader_.Status();
+  }
+
+  if (!status_.ok()) {
+    return false;
+  }
+
+  return WriteMessageSuffix(json_out);
+}
+
+bool ResponseToJsonTranslator::TranslateMessagePart(
+    ::google::protobuf::io::ZeroCopyInputStream* proto_in, bool last,
+    ::google::protobuf::io::ZeroCopyOutputStream* json_out) {
+  if (!in_message_) {
+    if (!WriteMessagePrefix(json_out)) {
       return false;
     }
+    in_message_ = true;
   }
 
+  // The printer appends to a string, which is reused for all the parts.
+  printer_json_.clear();
+  status_ = printer_->Print(proto_in, last, &printer_json_);
+  if (!reader_.Status().ok()) {
+    status_ = reader_.Status();
+  }
+  if (!status_.ok()) {
+    return false;
+  }
+  if (!WriteString(json_out, printer_json_)) {
+    status_ = absl::Status(absl::StatusCode::kInternal,
+                           "Failed to build the response message.");
+    return false;
+  }
+
+  if (last) {
+    in_message_ = false;
+    return WriteMessageSuffix(json_out);
+  }
   return true;
 }
 
@@ -0,0 +1,240 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+#include "grpc_transcoding/snapshot.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+
+#include "absl/strings/str_cat.h"
+
+namespace google {
+namespace grpc {
+namespace transcoding {
+
+namespace {
+
+constexpr char kMagic[8] = {'G', 'T', 'S', 'N', 'A', 'P', 'S', 'H'};
+constexpr uint32_t kFormatVersion = 1;
+constexpr uint32_t kByteOrderMark = 0x01020304;
+
+struct Header {
+  char magic[8];
+  uint32_t format_version;
+  uint32_t byte_order_mark;
+  uint32_t section_count;
+  uint32_t reserved;
+  uint64_t size;
+  uint64_t checksum;
+};
+
+struct SectionHeader {
+  uint32_t tag;
+  uint32_t reserved;
+  uint64_t size;
+};
+
+static_assert(sizeof(Header) % 8 == 0 && sizeof(SectionHeader) % 8 == 0,
+              "the sections must stay 8-byte aligned");
+
+// FNV-1a over 64-bit words; the sections are padded to a multiple of 8 bytes.
+uint64_t Checksum(absl::string_view data) {
+  uint64_t hash = 14695981039346656037ull;
+  for (size_t i = 0; i + 8 <= data.size(); i += 8) {
+    uint64_t word;
+    memcpy(&word, data.data() + i, sizeof(word));
+    hash ^= word;
+    hash *= 1099511628211ull;
+    hash ^= hash >> 32;
+  }
+  return hash;
+}
+
+}  // namespace
+
+SnapshotWriter::SnapshotWriter()
+    : section_count_(0), section_begin_(std::string::npos) {}
+
+void SnapshotWriter::BeginSection(SnapshotSection tag) {
+  EndSection();
+  section_begin_ = sections_.size();
+  SectionHeader header = {tag, 0, 0};
+  WriteRaw(&header, sizeof(header));
+  ++section_count_;
+}
+
+void SnapshotWriter::WriteString(absl::string_view value) {
+  WriteUint64(value.size());
+  WriteRaw(value.data(), value.size());
+}
+
+void SnapshotWriter::WriteRaw(const void* data, size_t size) {
+  sections_.append(static_cast<const char*>(data), size);
+}
+
+void SnapshotWriter::Align() {
+  sections_.append((8 - sections_.size() % 8) % 8, '\0');
+}
+
+void SnapshotWriter::EndSection() {
+  if (section_begin_ == std::string::npos) {
+    return;
+  }
+  Align();
+  uint64_t size = sections_.size() - section_begin_ - sizeof(SectionHeader);
+  memcpy(&sections_[section_begin_ + offsetof(SectionHeader, size)], &size,
+         sizeof(size));
+  section_begin_ = std::string::npos;
+}
+
+std::string SnapshotWriter::Finish() {
+  EndSection();
+  Header header;
+  memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.format_version = kFormatVersion;
+  header.byte_order_mark = kByteOrderMark;
+  header.section_count = section_count_;
+  header.reserved = 0;
+  header.size = sections_.size();
+  header.checksum = Checksum(sections_);
+
+  std::string snapshot(reinterpret_cast<const char*>(&header), sizeof(header));
+  snapshot += sections_;
+  return snapshot;
+}
+
+bool SnapshotReader::ReadString(absl::string_view* value) {
+  uint64_t size;
+  if (!ReadUint64(&size) || size > data_.size()) {
+    return false;
+  }
+  *value = data_.substr(0, size);
+  data_.remove_prefix(size);
+  return true;
+}
+
+bool SnapshotReader::ReadRaw(void* value, size_t size) {
+  if (data_.size() < size) {
+    return false;
+  }
+  memcpy(value, data_.data(), size);
+  data_.remove_prefix(size);
+  return true;
+}
+
+bool SnapshotReader::Align() {
+  size_t padding = (8 - reinterpret_cast<uintptr_t>(data_.data()) % 8) % 8;
+  if (data_.size() < padding) {
+    return false;
+  }
+  data_.remove_prefix(padding);
+  return true;
+}
+
+absl::StatusOr<Snapshot> Snapshot::Open(absl::string_view data,
+                                        std::shared_ptr<const void> storage) {
+  if (reinterpret_cast<uintptr_t>(data.data()) % 8 != 0) {
+    return absl::InvalidArgumentError("The snapshot is not 8-byte aligned.");
+  }
+  Header header;
+  if (data.size() < sizeof(header)) {
+    return absl::InvalidArgumentError("The snapshot is truncated.");
+  }
+  memcpy(&header, data.data(), sizeof(header));
+  if (memcmp(header.magic, kMagic, sizeof(kMagic)) != 0) {
+    return absl::InvalidArgumentError("Not a snapshot.");
+  }
+  if (header.format_version != kFormatVersion) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Unsupported snapshot format version ",
+                     header.format_version, "."));
+  }
+  if (header.byte_order_mark != kByteOrderMark) {
+    return absl::InvalidArgumentError(
+        "The snapshot was written with another byte order.");
+  }
+  data.remove_prefix(sizeof(header));
+  if (data.size() != header.size) {
+    return absl::InvalidArgumentError("The snapshot is truncated.");
+  }
+  if (Checksum(data) != header.checksum) {
+    return absl::DataLossError("The snapshot checksum doesn't match.");
+  }
+  return Snapshot(data, std::move(storage));
+}
+
+absl::StatusOr<Snapshot> Snapshot::Copy(absl::string_view data) {
+  // Allocated as 64-bit words so that the copy is 8-byte aligned.
+  std::shared_ptr<uint64_t[]> copy(new uint64_t[data.size() / 8 + 1]);
+  memcpy(copy.get(), data.data(), data.size());
+  absl::string_view view(reinterpret_cast<const char*>(copy.get()),
+                         data.size());
+  return Open(view, std::move(copy));
+}
+
+absl::StatusOr<Snapshot> Snapshot::MapFile(const std::string& path) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return absl::NotFoundError(
+        absl::StrCat("Failed to open ", path, ": ", strerror(errno)));
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size == 0) {
+    close(fd);
+    return absl::InvalidArgumentError(
+        absl::StrCat("Failed to map ", path, "."));
+  }
+  size_t size = st.st_size;
+  void* address = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (address == MAP_FAILED) {
+    return absl::InternalError(
+        absl::StrCat("Failed to map ", path, ": ", strerror(errno)));
+  }
+  std::shared_ptr<const void> mapping(
+      address, [size](const void* address) {
+        munmap(const_cast<void*>(address), size);
+      });
+  return Open(absl::string_view(static_cast<const char*>(address), size),
+              std::move(mapping));
+}
+
+absl::StatusOr<SnapshotReader> Snapshot::Section(SnapshotSection tag) const {
+  absl::string_view data = data_;
+  while (data.size() >= sizeof(SectionHeader)) {
+    SectionHeader header;
+    memcpy(&header, data.data(), sizeof(header));
+    data.remove_prefix(sizeof(header));
+    if (header.size > data.size()) {
+      break;
+    }
+    if (header.tag == tag) {
+      return SnapshotReader(data.substr(0, header.size));
+    }
+    data.remove_prefix(header.size);
+  }
+  return absl::NotFoundError(
+      absl::StrCat("The snapshot has no section ", tag, "."));
+}
+
+}  // namespace transcoding
+}  // namespace grpc
+}  // namespace google
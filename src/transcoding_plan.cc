@@ -0,0 +1,146 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+#include "grpc_transcoding/transcoding_plan.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/strings/match.h"
+#include "absl/strings/str_split.h"
+
+namespace pb = ::google::protobuf;
+
+namespace google {
+namespace grpc {
+
+namespace transcoding {
+
+TranscodingPlan::TranscodingPlan(const TypeHelper& type_helper,
+                                 const Spec& spec)
+    : type_helper_(&type_helper),
+      request_type_(nullptr),
+      response_type_url_(spec.response_type_url),
+      response_type_(nullptr),
+      body_field_path_(spec.body_field_path),
+      reject_binding_body_field_collisions_(
+          spec.reject_binding_body_field_collisions),
+      case_insensitive_enum_parsing_(spec.case_insensitive_enum_parsing),
+      http_body_request_(false),
+      http_body_response_(false) {}
+
+namespace {
+
+const char kHttpBodyTypeName[] = "google.api.HttpBody";
+
+bool IsHttpBodyTypeUrl(const std::string& type_url) {
+  return absl::EndsWith(type_url, std::string("/") + kHttpBodyTypeName);
+}
+
+}  // namespace
+
+absl::StatusOr<std::shared_ptr<const TranscodingPlan>> TranscodingPlan::Create(
+    const TypeHelper& type_helper, const Spec& spec) {
+  std::shared_ptr<TranscodingPlan> plan(
+      new TranscodingPlan(type_helper, spec));
+
+  plan->request_type_ =
+      type_helper.Info()->GetTypeByTypeUrl(spec.request_type_url);
+  if (plan->request_type_ == nullptr) {
+    return absl::Status(
+        absl::StatusCode::kNotFound,
+        "Type '" + spec.request_type_url + "' cannot be found.");
+  }
+  plan->response_type_ =
+      type_helper.Info()->GetTypeByTypeUrl(spec.response_type_url);
+  plan->http_body_response_ = IsHttpBodyTypeUrl(spec.response_type_url);
+
+  if (spec.use_wire_encoder) {
+    absl::StatusOr<std::shared_ptr<const WireEncoderPlan>> wire_encoder_plan =
+        WireEncoderPlan::Compile(*type_helper.Info(), *plan->request_type_);
+    // Otherwise the translators fall back to ProtoStreamObjectWriter.
+    if (wire_encoder_plan.ok()) {
+      plan->wire_encoder_plan_ = std::move(*wire_encoder_plan);
+    }
+  }
+
+  // "*" means that the whole message is the body, as does an empty path.
+  if (!spec.body_field_path.empty() && spec.body_field_path != "*") {
+    absl::Status status = type_helper.ResolveFieldPath(
+        *plan->request_type_, spec.body_field_path, &plan->body_fields_);
+    if (!status.ok()) {
+      return status;
+    }
+    plan->body_prefix_ =
+        absl::StrSplit(spec.body_field_path, ".", absl::SkipEmpty());
+    const pb::Field& body_field = *plan->body_fields_.back();
+    plan->http_body_request_ =
+        body_field.kind() == pb::Field::TYPE_MESSAGE &&
+        body_field.cardinality() != pb::Field::CARDINALITY_REPEATED &&
+        IsHttpBodyTypeUrl(body_field.type_url());
+  } else {
+    plan->http_body_request_ =
+        plan->request_type_->name() == kHttpBodyTypeName;
+  }
+
+  if (!spec.http_template.empty()) {
+    std::unique_ptr<HttpTemplate> ht = HttpTemplate::Parse(spec.http_template);
+    if (ht == nullptr) {
+      return absl::Status(
+          absl::StatusCode::kInvalidArgument,
+          "Invalid HTTP template '" + spec.http_template + "'.");
+    }
+    for (const HttpTemplate::Variable& var : ht->Variables()) {
+      std::vector<const pb::Field*> fields;
+      absl::Status status =
+          type_helper.ResolveFieldPath(*plan->request_type_, var.field_path,
+                                       &fields);
+      if (!status.ok()) {
+        return status;
+      }
+      plan->variable_fields_.emplace(var.field_path, std::move(fields));
+    }
+  }
+  return plan;
+}
+
+absl::Status TranscodingPlan::ResolveBindings(
+    std::vector<VariableBinding> bindings,
+    std::vector<RequestWeaver::BindingInfo>* resolved) const {
+  resolved->reserve(resolved->size() + bindings.size());
+  for (VariableBinding& binding : bindings) {
+    RequestWeaver::BindingInfo info;
+    auto it = variable_fields_.find(binding.field_path);
+    if (it != variable_fields_.end()) {
+      info.field_path = it->second;
+    } else {
+      absl::Status status = type_helper_->ResolveFieldPath(
+          *request_type_, binding.field_path, &info.field_path);
+      if (!status.ok()) {
+        return status;
+      }
+    }
+    info.value = std::move(binding.value);
+    resolved->push_back(std::move(info));
+  }
+  return absl::OkStatus();
+}
+
+}  // namespace transcoding
+
+}  // namespace grpc
+}  // namespace google
@@ -16,11 +16,26 @@
 //
 #include "grpc_transcoding/type_helper.h"
 
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
 #include <string>
 #include <unordered_map>
-
+#include <utility>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/container/flat_hash_map.h"
+#include "absl/container/inlined_vector.h"
+#include "absl/hash/hash.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
 #include "absl/strings/str_split.h"
+#include "absl/strings/string_view.h"
 #include "absl/synchronization/mutex.h"
+#include "absl/types/span.h"
 #include "google/protobuf/type.pb.h"
 #include "google/protobuf/util/converter/type_info.h"
 #include "google/protobuf/util/type_resolver.h"
@@ -110,77 +125,491 @@ class SimpleTypeResolver : public pbutil::TypeResolver {
   SimpleTypeResolver& operator=(const SimpleTypeResolver&) = delete;
 };
 
-class LockedTypeInfo : public pbconv::TypeInfo {
+// An insert-only hash map with wait-free lookups. Writers are serialized on a
+// mutex and publish new entries (and grown tables) with release stores, so
+// readers never block and never observe a partially constructed entry. Entries
+// are never removed or modified after insertion, and the tables replaced by a
+// grow are kept alive until destruction as readers may still be probing them.
+template <typename Key, typename Value, typename Hash = absl::Hash<Key>,
+          typename Eq = std::equal_to<Key>>
+class InsertOnlyMap {
  public:
-  LockedTypeInfo(pbconv::TypeInfo* type_info) : type_info_(type_info) {}
+  InsertOnlyMap() : table_(nullptr), size_(0) {
+    tables_.emplace_back(new Table(kInitialCapacity));
+    table_.store(tables_.back().get(), std::memory_order_release);
+  }
+
+  // Returns the value for the key or nullptr if the key is not in the map.
+  // Never blocks.
+  template <typename K>
+  const Value* Find(const K& key) const {
+    const Table* table = table_.load(std::memory_order_acquire);
+    for (size_t i = Hash()(key) & table->mask;; i = (i + 1) & table->mask) {
+      const Node* node = table->slots[i].load(std::memory_order_acquire);
+      if (node == nullptr) {
+        return nullptr;
+      }
+      if (Eq()(node->key, key)) {
+        return &node->value;
+      }
+    }
+  }
+
+  // Inserts the value created by make_value() unless the key is already in the
+  // map. make_value is called under the writer lock, so concurrent inserts of
+  // the same key create the value at most once. Returns the value in the map.
+  template <typename K, typename MakeValue>
+  const Value* FindOrInsert(const K& key, MakeValue make_value) {
+    return FindOrInsertBounded(key, make_value, SIZE_MAX);
+  }
+
+  // Like FindOrInsert(), but leaves the map unchanged and returns nullptr if
+  // the key isn't in the map and the map already holds max_size entries.
+  template <typename K, typename MakeValue>
+  const Value* FindOrInsertBounded(const K& key, MakeValue make_value,
+                                   size_t max_size) {
+    absl::MutexLock lock(&mutex_);
+    const Value* existing = Find(key);
+    if (existing != nullptr || size_ >= max_size) {
+      return existing;
+    }
+    if ((size_ + 1) * 2 > table_.load(std::memory_order_relaxed)->capacity()) {
+      Grow();
+    }
+    nodes_.emplace_back(new Node{Key(key), make_value()});
+    Place(table_.load(std::memory_order_relaxed), nodes_.back().get());
+    ++size_;
+    return &nodes_.back()->value;
+  }
+
+ private:
+  static constexpr size_t kInitialCapacity = 16;
+
+  struct Node {
+    Key key;
+    Value value;
+  };
+
+  struct Table {
+    explicit Table(size_t capacity)
+        : mask(capacity - 1), slots(new std::atomic<const Node*>[capacity]()) {}
+    size_t capacity() const { return mask + 1; }
+
+    size_t mask;
+    std::unique_ptr<std::atomic<const Node*>[]> slots;
+  };
+
+  static void Place(Table* table, const Node* node) {
+    size_t i = Hash()(node->key) & table->mask;
+    while (table->slots[i].load(std::memory_order_relaxed) != nullptr) {
+      i = (i + 1) & table->mask;
+    }
+    table->slots[i].store(node, std::memory_order_release);
+  }
+
+  void Grow() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_) {
+    std::unique_ptr<Table> table(
+        new Table(table_.load(std::memory_order_relaxed)->capacity() * 2));
+    for (const auto& node : nodes_) {
+      Place(table.get(), node.get());
+    }
+    table_.store(table.get(), std::memory_order_release);
+    tables_.emplace_back(std::move(table));
+  }
+
+  std::atomic<Table*> table_;
+
+  absl::Mutex mutex_;
+  size_t size_ ABSL_GUARDED_BY(mutex_);
+  std::vector<std::unique_ptr<Node>> nodes_ ABSL_GUARDED_BY(mutex_);
+  // The current table and all the tables it replaced.
+  std::vector<std::unique_ptr<Table>> tables_ ABSL_GUARDED_BY(mutex_);
+
+  InsertOnlyMap(const InsertOnlyMap&) = delete;
+  InsertOnlyMap& operator=(const InsertOnlyMap&) = delete;
+};
+
+// Hash and equality functors for the string keyed maps that allow lookups by
+// absl::string_view without creating a std::string.
+struct StringHash {
+  size_t operator()(absl::string_view s) const {
+    return absl::Hash<absl::string_view>()(s);
+  }
+};
+
+struct StringEq {
+  bool operator()(absl::string_view a, absl::string_view b) const {
+    return a == b;
+  }
+};
+
+// The key of a cached field path resolution: the field names. Lookups use a
+// span of views, which doesn't copy the names.
+typedef absl::Span<const absl::string_view> FieldNamesView;
+
+struct FieldNamesKey {
+  explicit FieldNamesKey(FieldNamesView view)
+      : names(view.begin(), view.end()) {}
+
+  std::vector<std::string> names;
+};
+
+struct FieldNamesHash {
+  size_t operator()(FieldNamesView names) const {
+    return absl::Hash<FieldNamesView>()(names);
+  }
+  size_t operator()(const FieldNamesKey& key) const {
+    absl::InlinedVector<absl::string_view, 8> views(key.names.begin(),
+                                                   key.names.end());
+    return (*this)(absl::MakeConstSpan(views));
+  }
+};
+
+struct FieldNamesEq {
+  bool operator()(const FieldNamesKey& a, FieldNamesView b) const {
+    return std::equal(a.names.begin(), a.names.end(), b.begin(), b.end());
+  }
+};
+
+// The cached resolution of a field path. field_path is empty if status is not
+// OK.
+struct FieldPathEntry {
+  absl::Status status;
+  std::vector<const google::protobuf::Field*> field_path;
+};
+
+// The maximum numbers of cached field path resolutions and failures per type.
+// The valid field paths of a type are few unless it's recursive, so the bound
+// is rarely reached by them. The failures are bounded separately, so that
+// arbitrary query parameter names can neither grow the cache without limit nor
+// keep the valid paths from being cached. Past the bounds, the new paths are
+// resolved without being cached.
+constexpr size_t kMaxCachedFieldPathsPerType = 1024;
+constexpr size_t kMaxCachedFieldPathFailuresPerType = 1024;
+
+// A pbconv::TypeInfo implementation whose lookups are wait-free.
+//
+// When created with a TypeResolver, the types and enums are resolved lazily on
+// the first lookup of their url. The result (including a failure) is cached,
+// so each url is resolved at most once.
+//
+// When created without a TypeResolver, the index is complete after the
+// AddType()/AddEnum() calls made at construction and urls that are not in it
+// are reported as not found. In that case the added types and enums are not
+// copied and must outlive the ConcurrentTypeInfo.
+class ConcurrentTypeInfo : public pbconv::TypeInfo {
+ public:
+  explicit ConcurrentTypeInfo(pbutil::TypeResolver* type_resolver)
+      : type_resolver_(type_resolver) {}
+
+  void AddType(const std::string& type_url, const google::protobuf::Type& t) {
+    types_.FindOrInsert(type_url, [&t] { return TypeEntry(&t); });
+    AddFields(&t);
+  }
+
+  void AddEnum(const std::string& enum_url, const google::protobuf::Enum& e) {
+    enums_.FindOrInsert(enum_url, [&e] { return EnumEntry(&e); });
+  }
 
   absl::StatusOr<const google::protobuf::Type*> ResolveTypeUrl(
       absl::string_view type_url) const override {
-    absl::MutexLock lock(&mutex_);
-    return type_info_->ResolveTypeUrl(type_url);
+    const TypeEntry* entry = types_.Find(type_url);
+    if (entry == nullptr) {
+      if (type_resolver_ == nullptr) {
+        return absl::Status(
+            absl::StatusCode::kNotFound,
+            "Type '" + std::string(type_url) + "' cannot be found.");
+      }
+      entry = types_.FindOrInsert(type_url, [this, type_url] {
+        return ResolveType(std::string(type_url));
+      });
+    }
+    if (!entry->status.ok()) {
+      return entry->status;
+    }
+    return entry->type;
   }
 
   const google::protobuf::Type* GetTypeByTypeUrl(
       absl::string_view type_url) const override {
-    absl::MutexLock lock(&mutex_);
-    return type_info_->GetTypeByTypeUrl(type_url);
+    absl::StatusOr<const google::protobuf::Type*> result =
+        ResolveTypeUrl(type_url);
+    return result.ok() ? result.value() : nullptr;
   }
 
   const google::protobuf::Enum* GetEnumByTypeUrl(
-      absl::string_view type_url) const override {
-    absl::MutexLock lock(&mutex_);
-    return type_info_->GetEnumByTypeUrl(type_url);
+      absl::string_view enum_url) const override {
+    const EnumEntry* entry = enums_.Find(enum_url);
+    if (entry == nullptr) {
+      if (type_resolver_ == nullptr) {
+        return nullptr;
+      }
+      entry = enums_.FindOrInsert(enum_url, [this, enum_url] {
+        return ResolveEnum(std::string(enum_url));
+      });
+    }
+    return entry->status.ok() ? entry->enum_type : nullptr;
   }
 
+  // Looks the field up by its json_name first (if several fields share a
+  // json_name, the first one wins) and then by its proto name.
   const google::protobuf::Field* FindField(
       const google::protobuf::Type* type,
       absl::string_view camel_case_name) const override {
-    absl::MutexLock lock(&mutex_);
-    return type_info_->FindField(type, camel_case_name);
+    if (type == nullptr) {
+      return nullptr;
+    }
+    const TypeFields* fields = type_fields_.Find(type);
+    if (fields == nullptr) {
+      // Not one of the types of this TypeInfo, whose address may be reused by
+      // another type later, so it's not indexed.
+      for (const auto& field : type->fields()) {
+        if (field.json_name() == camel_case_name) {
+          return &field;
+        }
+      }
+      for (const auto& field : type->fields()) {
+        if (field.name() == camel_case_name) {
+          return &field;
+        }
+      }
+      return nullptr;
+    }
+    auto i = fields->table.find(camel_case_name);
+    return i == fields->table.end() ? nullptr : i->second;
+  }
+
+  // Returns the cached resolution of the field path starting at type or
+  // nullptr. Only the field paths of the types of this TypeInfo are cached, as
+  // they live as long as it does.
+  const FieldPathEntry* FindFieldPath(const google::protobuf::Type* type,
+                                      FieldNamesView field_names) const {
+    const TypeFields* fields = type_fields_.Find(type);
+    if (fields == nullptr) {
+      return nullptr;
+    }
+    const FieldPathEntry* entry = fields->paths.Find(field_names);
+    if (entry == nullptr) {
+      entry = fields->failures.Find(field_names);
+    }
+    return entry;
+  }
+
+  // Caches the resolution of the field path starting at type, unless type
+  // isn't one of the types of this TypeInfo or the cache of the type is full.
+  void CacheFieldPath(const google::protobuf::Type* type,
+                      FieldNamesView field_names, FieldPathEntry entry) const {
+    const TypeFields* fields = type_fields_.Find(type);
+    if (fields == nullptr) {
+      return;
+    }
+    auto make_entry = [&entry] { return std::move(entry); };
+    if (entry.status.ok()) {
+      fields->paths.FindOrInsertBounded(field_names, make_entry,
+                                        kMaxCachedFieldPathsPerType);
+    } else {
+      fields->failures.FindOrInsertBounded(field_names, make_entry,
+                                           kMaxCachedFieldPathFailuresPerType);
+    }
   }
 
  private:
-  mutable absl::Mutex mutex_;
-  std::unique_ptr<pbconv::TypeInfo> type_info_ ABSL_GUARDED_BY(mutex_);
+  // The index of the fields of a type of this TypeInfo and its cache of field
+  // path resolutions. The table maps both the json_name and the name of the
+  // fields to the fields, its keys point into the Type.
+  struct TypeFields {
+    explicit TypeFields(const google::protobuf::Type* type) {
+      for (const auto& field : type->fields()) {
+        table.emplace(field.json_name(), &field);
+      }
+      for (const auto& field : type->fields()) {
+        table.emplace(field.name(), &field);
+      }
+    }
+
+    absl::flat_hash_map<absl::string_view, const google::protobuf::Field*>
+        table;
+    mutable InsertOnlyMap<FieldNamesKey, FieldPathEntry, FieldNamesHash,
+                          FieldNamesEq>
+        paths;
+    mutable InsertOnlyMap<FieldNamesKey, FieldPathEntry, FieldNamesHash,
+                          FieldNamesEq>
+        failures;
+  };
+
+  // The resolution result of a type url. type is nullptr iff status is not OK.
+  // owned_type is set when the type was resolved by the TypeResolver.
+  struct TypeEntry {
+    explicit TypeEntry(const google::protobuf::Type* t) : type(t) {}
+    explicit TypeEntry(absl::Status s) : status(std::move(s)), type(nullptr) {}
+
+    absl::Status status;
+    const google::protobuf::Type* type;
+    std::unique_ptr<google::protobuf::Type> owned_type;
+  };
+
+  // The resolution result of an enum url. Same as TypeEntry.
+  struct EnumEntry {
+    explicit EnumEntry(const google::protobuf::Enum* e) : enum_type(e) {}
+    explicit EnumEntry(absl::Status s)
+        : status(std::move(s)), enum_type(nullptr) {}
+
+    absl::Status status;
+    const google::protobuf::Enum* enum_type;
+    std::unique_ptr<google::protobuf::Enum> owned_enum;
+  };
+
+  TypeEntry ResolveType(const std::string& type_url) const {
+    std::unique_ptr<google::protobuf::Type> type(new google::protobuf::Type());
+    absl::Status status =
+        type_resolver_->ResolveMessageType(type_url, type.get());
+    if (!status.ok()) {
+      return TypeEntry(std::move(status));
+    }
+    AddFields(type.get());
+    TypeEntry entry(type.get());
+    entry.owned_type = std::move(type);
+    return entry;
+  }
+
+  EnumEntry ResolveEnum(const std::string& enum_url) const {
+    std::unique_ptr<google::protobuf::Enum> enum_type(
+        new google::protobuf::Enum());
+    absl::Status status =
+        type_resolver_->ResolveEnumType(enum_url, enum_type.get());
+    if (!status.ok()) {
+      return EnumEntry(std::move(status));
+    }
+    EnumEntry entry(enum_type.get());
+    entry.owned_enum = std::move(enum_type);
+    return entry;
+  }
+
+  // Indexes the fields of a type of this TypeInfo.
+  void AddFields(const google::protobuf::Type* type) const {
+    type_fields_.FindOrInsert(type, [type] { return TypeFields(type); });
+  }
+
+  pbutil::TypeResolver* type_resolver_;
+
+  mutable InsertOnlyMap<std::string, TypeEntry, StringHash, StringEq> types_;
+  mutable InsertOnlyMap<std::string, EnumEntry, StringHash, StringEq> enums_;
+  // The types added or resolved, which live as long as this TypeInfo, keyed by
+  // their address.
+  mutable InsertOnlyMap<const google::protobuf::Type*, TypeFields>
+      type_fields_;
+
+  ConcurrentTypeInfo(const ConcurrentTypeInfo&) = delete;
+  ConcurrentTypeInfo& operator=(const ConcurrentTypeInfo&) = delete;
 };
 
 }  // namespace
 
 TypeHelper::TypeHelper(pbutil::TypeResolver* type_resolver)
     : type_resolver_(type_resolver),
-      type_info_(
-          new LockedTypeInfo(pbconv::TypeInfo::NewTypeInfo(type_resolver))) {}
+      type_info_(new ConcurrentTypeInfo(type_resolver)) {}
 
 TypeHelper::~TypeHelper() {
   type_info_.reset();
   delete type_resolver_;
 }
 
+absl::Status TypeHelper::WriteSnapshot(SnapshotWriter* writer) const {
+  if (dynamic_cast<SimpleTypeResolver*>(type_resolver_) == nullptr) {
+    return absl::FailedPreconditionError(
+        "A TypeHelper resolving the types lazily can't be written to a "
+        "snapshot.");
+  }
+  writer->BeginSection(kTypeHelperSection);
+  writer->WriteUint64(types_.size());
+  for (const google::protobuf::Type* t : types_) {
+    writer->WriteString(t->SerializeAsString());
+  }
+  writer->WriteUint64(enums_.size());
+  for (const google::protobuf::Enum* e : enums_) {
+    writer->WriteString(e->SerializeAsString());
+  }
+  return absl::OkStatus();
+}
+
+absl::StatusOr<std::unique_ptr<TypeHelper>> TypeHelper::LoadSnapshot(
+    const Snapshot& snapshot) {
+  absl::StatusOr<SnapshotReader> section =
+      snapshot.Section(kTypeHelperSection);
+  if (!section.ok()) {
+    return section.status();
+  }
+  SnapshotReader& reader = *section;
+  const absl::Status malformed =
+      absl::InvalidArgumentError("Malformed type helper snapshot.");
+
+  // Start from an empty collection and add the types & enums once parsed.
+  std::unique_ptr<TypeHelper> helper(
+      new TypeHelper(std::vector<google::protobuf::Type>(),
+                     std::vector<google::protobuf::Enum>()));
+  uint64_t count;
+  if (!reader.ReadUint64(&count)) {
+    return malformed;
+  }
+  for (uint64_t i = 0; i < count; ++i) {
+    absl::string_view data;
+    std::unique_ptr<google::protobuf::Type> t(new google::protobuf::Type());
+    if (!reader.ReadString(&data) ||
+        !t->ParseFromArray(data.data(), data.size())) {
+      return malformed;
+    }
+    helper->AddType(*t);
+    helper->owned_types_.push_back(std::move(t));
+  }
+  if (!reader.ReadUint64(&count)) {
+    return malformed;
+  }
+  for (uint64_t i = 0; i < count; ++i) {
+    absl::string_view data;
+    std::unique_ptr<google::protobuf::Enum> e(new google::protobuf::Enum());
+    if (!reader.ReadString(&data) ||
+        !e->ParseFromArray(data.data(), data.size())) {
+      return malformed;
+    }
+    helper->AddEnum(*e);
+    helper->owned_enums_.push_back(std::move(e));
+  }
+  return helper;
+}
+
 pbutil::TypeResolver* TypeHelper::Resolver() const { return type_resolver_; }
 
 pbconv::TypeInfo* TypeHelper::Info() const { return type_info_.get(); }
 
 void TypeHelper::Initialize() {
   type_resolver_ = new SimpleTypeResolver();
-  type_info_.reset(
-      new LockedTypeInfo(pbconv::TypeInfo::NewTypeInfo(type_resolver_)));
+  // The index is complete once all the types & enums are added, so it doesn't
+  // need to fall back to the resolver.
+  type_info_.reset(new ConcurrentTypeInfo(nullptr));
 }
 
 void TypeHelper::AddType(const google::protobuf::Type& t) {
+  types_.push_back(&t);
   reinterpret_cast<SimpleTypeResolver*>(type_resolver_)->AddType(t);
+  static_cast<ConcurrentTypeInfo*>(type_info_.get())
+      ->AddType(DEFAULT_URL_PREFIX + t.name(), t);
 }
 
 void TypeHelper::AddEnum(const google::protobuf::Enum& e) {
+  enums_.push_back(&e);
   reinterpret_cast<SimpleTypeResolver*>(type_resolver_)->AddEnum(e);
+  static_cast<ConcurrentTypeInfo*>(type_info_.get())
+      ->AddEnum(DEFAULT_URL_PREFIX + e.name(), e);
 }
 
 absl::Status TypeHelper::ResolveFieldPath(
     const google::protobuf::Type& type, const std::string& field_path_str,
     std::vector<const google::protobuf::Field*>* field_path_out) const {
-  // Split the field names & call ResolveFieldPath()
-  const std::vector<std::string> field_names =
+  // The field names are views into field_path_str.
+  const absl::InlinedVector<absl::string_view, 8> field_names =
       absl::StrSplit(field_path_str, '.', absl::SkipEmpty());
-  return ResolveFieldPath(type, field_names, field_path_out);
+  return ResolveFieldPath(type, absl::MakeConstSpan(field_names),
+                          field_path_out);
 }
 
 const google::protobuf::Field* TypeHelper::FindField(
@@ -189,10 +618,13 @@ const google::protobuf::Field* TypeHelper::FindField(
   if (field != nullptr) {
     return field;
   }
-  // The name may be UrlEscaped, try to un-escape it and lookup.
-  absl::string_view name_view(name.data(), name.size());
-  if (IsUrlEscapedString(name_view)) {
-    field = Info()->FindField(type, UrlUnescapeString(name_view));
+  // The name may be UrlEscaped, try to un-escape it and lookup. A view of the
+  // name itself means that there is nothing to un-escape.
+  std::string buffer;
+  absl::string_view unescaped = UrlUnescapeString(
+      name, UrlUnescapeSpec::kAllCharacters, false, &buffer);
+  if (unescaped.data() != name.data()) {
+    field = Info()->FindField(type, unescaped);
   }
   return field;
 }
@@ -201,6 +633,44 @@ absl::Status TypeHelper::ResolveFieldPath(
     const google::protobuf::Type& type,
     const std::vector<std::string>& field_names,
     std::vector<const google::protobuf::Field*>* field_path_out) const {
+  const absl::InlinedVector<absl::string_view, 8> views(field_names.begin(),
+                                                         field_names.end());
+  return ResolveFieldPath(type, absl::MakeConstSpan(views), field_path_out);
+}
+
+// The query parameters of each request are resolved here, so the results
+// (including the failures) are cached per type & field names. A miss is
+// resolved before taking the lock of the cache, so concurrent misses don't
+// wait for each other.
+absl::Status TypeHelper::ResolveFieldPath(
+    const google::protobuf::Type& type,
+    absl::Span<const absl::string_view> field_names,
+    std::vector<const google::protobuf::Field*>* field_path_out) const {
+  const ConcurrentTypeInfo* info =
+      static_cast<const ConcurrentTypeInfo*>(type_info_.get());
+  const FieldPathEntry* entry = info->FindFieldPath(&type, field_names);
+  if (entry != nullptr) {
+    if (!entry->status.ok()) {
+      return entry->status;
+    }
+    field_path_out->assign(entry->field_path.begin(), entry->field_path.end());
+    return absl::OkStatus();
+  }
+  FieldPathEntry resolved;
+  resolved.status =
+      ResolveFieldPathUncached(type, field_names, &resolved.field_path);
+  const absl::Status status = resolved.status;
+  if (status.ok()) {
+    *field_path_out = resolved.field_path;
+  }
+  info->CacheFieldPath(&type, field_names, std::move(resolved));
+  return status;
+}
+
+absl::Status TypeHelper::ResolveFieldPathUncached(
+    const google::protobuf::Type& type,
+    absl::Span<const absl::string_view> field_names,
+    std::vector<const google::protobuf::Field*>* field_path_out) const {
   // The type of the current message being processed (initially the type of the
   // top level message)
   auto current_type = &type;
@@ -213,7 +683,8 @@ absl::Status TypeHelper::ResolveFieldPath(
     auto field = FindField(current_type, field_names[i]);
     if (nullptr == field) {
       return absl::Status(absl::StatusCode::kInvalidArgument,
-                          "Could not find field \"" + field_names[i] +
+                          "Could not find field \"" +
+                              std::string(field_names[i]) +
                               "\" in the type \"" + current_type->name() +
                               "\".");
     }
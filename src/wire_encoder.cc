@@ -0,0 +1,900 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+#include "grpc_transcoding/wire_encoder.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <string>
+
+#include "absl/strings/ascii.h"
+#include "absl/strings/escaping.h"
+#include "absl/strings/match.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/strip.h"
+#include "google/protobuf/io/coded_stream.h"
+#include "google/protobuf/wire_format_lite.h"
+
+namespace pb = ::google::protobuf;
+namespace pbconv = ::google::protobuf::util::converter;
+
+namespace google {
+namespace grpc {
+
+namespace transcoding {
+
+namespace {
+
+using ::google::protobuf::internal::WireFormatLite;
+using ::google::protobuf::io::CodedOutputStream;
+
+// The length of the longest varint encoding of the length of a message.
+constexpr size_t kMaxSizeLength = 5;
+
+// The types that ProtoStreamObjectWriter renders from and to special JSON
+// representations all live in this package.
+const char kWellKnownTypesPrefix[] = "google.protobuf.";
+
+bool IsMapEntry(const pb::Type& type) {
+  for (const auto& option : type.options()) {
+    if (option.name() == "map_entry" ||
+        option.name() == "google.protobuf.MessageOptions.map_entry") {
+      return true;
+    }
+  }
+  return false;
+}
+
+// "foo_bar" -> "fooBar", the name TypeInfo::FindField() accepts when the
+// field has no json_name.
+std::string ToCamelCase(absl::string_view name) {
+  std::string result;
+  result.reserve(name.size());
+  bool capitalize_next = false;
+  for (char c : name) {
+    if (c == '_') {
+      capitalize_next = true;
+    } else if (capitalize_next) {
+      result.push_back(absl::ascii_toupper(c));
+      capitalize_next = false;
+    } else {
+      result.push_back(c);
+    }
+  }
+  return result;
+}
+
+void WriteVarint(uint64_t value, std::string* output) {
+  uint8_t buffer[10];
+  uint8_t* end = CodedOutputStream::WriteVarint64ToArray(value, buffer);
+  output->append(reinterpret_cast<char*>(buffer), end - buffer);
+}
+
+void WriteFixed32(uint32_t value, std::string* output) {
+  uint8_t buffer[4];
+  CodedOutputStream::WriteLittleEndian32ToArray(value, buffer);
+  output->append(reinterpret_cast<char*>(buffer), sizeof(buffer));
+}
+
+void WriteFixed64(uint64_t value, std::string* output) {
+  uint8_t buffer[8];
+  CodedOutputStream::WriteLittleEndian64ToArray(value, buffer);
+  output->append(reinterpret_cast<char*>(buffer), sizeof(buffer));
+}
+
+void WriteLengthDelimited(absl::string_view value, std::string* output) {
+  WriteVarint(value.size(), output);
+  output->append(value.data(), value.size());
+}
+
+// Strings are rejected if they have leading or trailing spaces, like in
+// DataPiece.
+bool HasSurroundingSpaces(absl::string_view value) {
+  return !value.empty() &&
+         (absl::ascii_isspace(value.front()) ||
+          absl::ascii_isspace(value.back()));
+}
+
+}  // namespace
+
+absl::StatusOr<std::shared_ptr<const WireEncoderPlan>> WireEncoderPlan::Compile(
+    const pbconv::TypeInfo& type_info, const pb::Type& type) {
+  std::shared_ptr<WireEncoderPlan> plan(new WireEncoderPlan());
+  absl::StatusOr<const Message*> root = plan->CompileMessage(type_info, type);
+  if (!root.ok()) {
+    return root.status();
+  }
+  plan->root_ = *root;
+  return plan;
+}
+
+absl::StatusOr<const WireEncoderPlan::Message*>
+WireEncoderPlan::CompileMessage(const pbconv::TypeInfo& type_info,
+                                const pb::Type& type) {
+  auto it = messages_.find(&type);
+  if (it != messages_.end()) {
+    // Already compiled, or being compiled in case of recursive types.
+    return it->second.get();
+  }
+  if (absl::StartsWith(type.name(), kWellKnownTypesPrefix)) {
+    return absl::Status(absl::StatusCode::kUnimplemented,
+                        "Well-known type '" + type.name() +
+                            "' is not supported by the WireEncoder.");
+  }
+  if (IsMapEntry(type)) {
+    return absl::Status(absl::StatusCode::kUnimplemented,
+                        "Map entry type '" + type.name() +
+                            "' is not supported by the WireEncoder.");
+  }
+
+  Message* message = new Message();
+  messages_.emplace(&type, std::unique_ptr<Message>(message));
+  message->type = &type;
+
+  for (const auto& field : type.fields()) {
+    if (field.kind() == pb::Field::TYPE_GROUP ||
+        field.kind() == pb::Field::TYPE_UNKNOWN ||
+        field.cardinality() == pb::Field::CARDINALITY_REQUIRED) {
+      return absl::Status(absl::StatusCode::kUnimplemented,
+                          "Field '" + type.name() + "." + field.name() +
+                              "' is not supported by the WireEncoder.");
+    }
+
+    Field compiled;
+    compiled.field = &field;
+    compiled.tag = WireFormatLite::MakeTag(
+        field.number(), WireFormatLite::WireTypeForFieldType(
+                            static_cast<WireFormatLite::FieldType>(
+                                field.kind())));
+    compiled.message = nullptr;
+    compiled.enum_type = nullptr;
+
+    if (field.kind() == pb::Field::TYPE_MESSAGE) {
+      const pb::Type* field_type = type_info.GetTypeByTypeUrl(field.type_url());
+      if (field_type == nullptr) {
+        return absl::Status(
+            absl::StatusCode::kNotFound,
+            "Type '" + field.type_url() + "' cannot be found.");
+      }
+      absl::StatusOr<const Message*> field_message =
+          CompileMessage(type_info, *field_type);
+      if (!field_message.ok()) {
+        return field_message.status();
+      }
+      compiled.message = *field_message;
+    } else if (field.kind() == pb::Field::TYPE_ENUM) {
+      const pb::Enum* enum_type = type_info.GetEnumByTypeUrl(field.type_url());
+      if (enum_type == nullptr) {
+        return absl::Status(
+            absl::StatusCode::kNotFound,
+            "Enum '" + field.type_url() + "' cannot be found.");
+      }
+      compiled.enum_type = CompileEnum(*enum_type);
+    }
+
+    // The names don't replace each other if they are the same.
+    message->fields.emplace(field.name(), compiled);
+    message->fields.emplace(field.json_name().empty()
+                                ? ToCamelCase(field.name())
+                                : field.json_name(),
+                            compiled);
+  }
+  return message;
+}
+
+const WireEncoderPlan::Enum* WireEncoderPlan::CompileEnum(
+    const pb::Enum& type) {
+  std::unique_ptr<Enum>& compiled = enums_[&type];
+  if (compiled == nullptr) {
+    compiled.reset(new Enum());
+    compiled->type = &type;
+    compiled->null_value = type.name() == "google.protobuf.NullValue";
+    for (const auto& value : type.enumvalue()) {
+      compiled->values.emplace(value.name(), value.number());
+      compiled->numbers.insert(value.number());
+    }
+  }
+  return compiled.get();
+}
+
+// A value of an event, before it's converted to the type of the field.
+struct WireEncoder::Value {
+  enum Type { kBool, kInt64, kUint64, kDouble, kString, kBytes };
+
+  explicit Value(bool value) : type(kBool), bool_value(value) {}
+  explicit Value(int64_t value) : type(kInt64), int64_value(value) {}
+  explicit Value(uint64_t value) : type(kUint64), uint64_value(value) {}
+  explicit Value(double value) : type(kDouble), double_value(value) {}
+  Value(Type type, absl::string_view value) : type(type), str_value(value) {}
+
+  // Signed integer types.
+  template <typename T>
+  bool ToInt(T* out) const {
+    switch (type) {
+      case kInt64:
+        return Narrow(int64_value, out);
+      case kUint64:
+        if (uint64_value > static_cast<uint64_t>(
+                               std::numeric_limits<int64_t>::max())) {
+          return false;
+        }
+        return Narrow(static_cast<int64_t>(uint64_value), out);
+      case kDouble:
+        return DoubleToInt(double_value, out);
+      case kString: {
+        if (HasSurroundingSpaces(str_value)) return false;
+        int64_t parsed;
+        if (absl::SimpleAtoi(str_value, &parsed)) {
+          return Narrow(parsed, out);
+        }
+        double parsed_double;
+        return absl::SimpleAtod(str_value, &parsed_double) &&
+               DoubleToInt(parsed_double, out);
+      }
+      default:
+        return false;
+    }
+  }
+
+  // Unsigned integer types.
+  template <typename T>
+  bool ToUint(T* out) const {
+    switch (type) {
+      case kInt64:
+        return int64_value >= 0 &&
+               Narrow(static_cast<uint64_t>(int64_value), out);
+      case kUint64:
+        return Narrow(uint64_value, out);
+      case kDouble:
+        return DoubleToInt(double_value, out);
+      case kString: {
+        if (HasSurroundingSpaces(str_value)) return false;
+        uint64_t parsed;
+        if (absl::SimpleAtoi(str_value, &parsed)) {
+          return Narrow(parsed, out);
+        }
+        double parsed_double;
+        return absl::SimpleAtod(str_value, &parsed_double) &&
+               DoubleToInt(parsed_double, out);
+      }
+      default:
+        return false;
+    }
+  }
+
+  bool ToDouble(double* out) const {
+    switch (type) {
+      case kInt64:
+        *out = static_cast<double>(int64_value);
+        return true;
+      case kUint64:
+        *out = static_cast<double>(uint64_value);
+        return true;
+      case kDouble:
+        *out = double_value;
+        return true;
+      case kString:
+        if (str_value == "Infinity") {
+          *out = std::numeric_limits<double>::infinity();
+          return true;
+        }
+        if (str_value == "-Infinity") {
+          *out = -std::numeric_limits<double>::infinity();
+          return true;
+        }
+        if (str_value == "NaN") {
+          *out = std::numeric_limits<double>::quiet_NaN();
+          return true;
+        }
+        return !HasSurroundingSpaces(str_value) &&
+               absl::SimpleAtod(str_value, out);
+      default:
+        return false;
+    }
+  }
+
+  bool ToFloat(float* out) const {
+    double value;
+    if (!ToDouble(&value)) return false;
+    if (std::isfinite(value) && (value > FLT_MAX || value < -FLT_MAX)) {
+      return false;
+    }
+    *out = static_cast<float>(value);
+    return true;
+  }
+
+  bool ToBool(bool* out) const {
+    switch (type) {
+      case kBool:
+        *out = bool_value;
+        return true;
+      case kString:
+        return absl::SimpleAtob(str_value, out);
+      default:
+        return false;
+    }
+  }
+
+  bool ToString(std::string* scratch, absl::string_view* out) const {
+    switch (type) {
+      case kString:
+        *out = str_value;
+        return true;
+      case kBytes:
+        absl::Base64Escape(str_value, scratch);
+        *out = *scratch;
+        return true;
+      default:
+        return false;
+    }
+  }
+
+  bool ToBytes(bool strict_base64, std::string* scratch,
+               absl::string_view* out) const {
+    switch (type) {
+      case kBytes:
+        *out = str_value;
+        return true;
+      case kString:
+        if (!DecodeBase64(strict_base64, scratch)) return false;
+        *out = *scratch;
+        return true;
+      default:
+        return false;
+    }
+  }
+
+  bool ToEnum(const WireEncoderPlan::Enum& enum_type, bool case_insensitive,
+              int32_t* out) const {
+    if (type != kString) {
+      // Like ProtoStreamObjectWriter, the numbers that aren't declared are
+      // kept as unknown enum values.
+      return ToInt(out);
+    }
+    auto it = enum_type.values.find(str_value);
+    if (it != enum_type.values.end()) {
+      *out = it->second;
+      return true;
+    }
+    // The number of a declared value may be sent as a string.
+    int32_t number;
+    if (ToInt(&number) && enum_type.numbers.contains(number)) {
+      *out = number;
+      return true;
+    }
+    if (case_insensitive) {
+      std::string normalized(str_value);
+      for (char& c : normalized) {
+        c = c == '-' ? '_' : absl::ascii_toupper(c);
+      }
+      it = enum_type.values.find(normalized);
+      if (it != enum_type.values.end()) {
+        *out = it->second;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // The value as shown in the error messages.
+  std::string ToDebugString() const {
+    switch (type) {
+      case kBool:
+        return bool_value ? "true" : "false";
+      case kInt64:
+        return absl::StrCat(int64_value);
+      case kUint64:
+        return absl::StrCat(uint64_value);
+      case kDouble:
+        return absl::StrCat(double_value);
+      default:
+        return absl::StrCat("\"", str_value, "\"");
+    }
+  }
+
+  Type type;
+  union {
+    bool bool_value;
+    int64_t int64_value;
+    uint64_t uint64_value;
+    double double_value;
+  };
+  absl::string_view str_value;
+
+ private:
+  template <typename From, typename To>
+  static bool Narrow(From value, To* out) {
+    if (value < static_cast<From>(std::numeric_limits<To>::min()) ||
+        value > static_cast<From>(std::numeric_limits<To>::max())) {
+      return false;
+    }
+    *out = static_cast<To>(value);
+    return true;
+  }
+
+  // Doubles must be integral and in range.
+  template <typename To>
+  static bool DoubleToInt(double value, To* out) {
+    // 2^digits is one past the largest value of To.
+    if (!std::isfinite(value) || std::trunc(value) != value ||
+        value < static_cast<double>(std::numeric_limits<To>::min()) ||
+        value >= std::ldexp(1.0, std::numeric_limits<To>::digits)) {
+      return false;
+    }
+    *out = static_cast<To>(value);
+    return true;
+  }
+
+  // Accepts both the standard and the web-safe alphabets, with or without
+  // padding. In strict mode, the value must also be the canonical encoding of
+  // the decoded bytes.
+  bool DecodeBase64(bool strict, std::string* out) const {
+    if (absl::WebSafeBase64Unescape(str_value, out)) {
+      return !strict || absl::WebSafeBase64Escape(*out) ==
+                            absl::StripSuffix(
+                                absl::StripSuffix(str_value, "="), "=");
+    }
+    if (absl::Base64Unescape(str_value, out)) {
+      return !strict || absl::Base64Escape(*out) == str_value;
+    }
+    return false;
+  }
+};
+
+class WireEncoder::Location : public pbconv::LocationTrackerInterface {
+ public:
+  explicit Location(const WireEncoder& encoder) : encoder_(encoder) {}
+
+  std::string ToString() const { return encoder_.CurrentLocation(); }
+
+ private:
+  const WireEncoder& encoder_;
+};
+
+WireEncoder::WireEncoder(const WireEncoderPlan& plan, const Options& options,
+                         std::string* output, pbconv::ErrorListener* listener)
+    : plan_(plan),
+      options_(options),
+      output_(output),
+      listener_(listener),
+      frames_(),
+      depth_(0),
+      skip_depth_(0),
+      failed_(false),
+      done_(false) {}
+
+WireEncoder::~WireEncoder() {}
+
+WireEncoder* WireEncoder::StartObject(absl::string_view name) {
+  if (skip_depth_ > 0 || failed_) {
+    ++skip_depth_;
+    return this;
+  }
+  if (depth_ == 0) {
+    // The root message
+    gaps_.clear();
+    PushFrame(&plan_.root(), nullptr, 0);
+    return this;
+  }
+  const WireEncoderPlan::Field* field = FindField(name);
+  if (field == nullptr) {
+    ++skip_depth_;
+    return this;
+  }
+  if (field->message == nullptr) {
+    InvalidName(name, "Proto field is not a message, cannot start object.");
+    ++skip_depth_;
+    return this;
+  }
+  if (!TakeOneof(*field)) {
+    ++skip_depth_;
+    return this;
+  }
+  WriteVarint(field->tag, output_);
+  // A placeholder for the length, as long as the longest one so that the
+  // nested message doesn't have to be moved once its length is known.
+  size_t size_offset = output_->size();
+  output_->append(kMaxSizeLength, '\0');
+  PushFrame(field->message, field, size_offset);
+  return this;
+}
+
+WireEncoder* WireEncoder::EndObject() {
+  if (skip_depth_ > 0) {
+    --skip_depth_;
+    return this;
+  }
+  if (depth_ == 0) {
+    return this;
+  }
+  --depth_;
+  if (depth_ == 0) {
+    done_ = true;
+    if (!failed_) {
+      RemoveGaps();
+    }
+  } else if (!failed_) {
+    WriteSize(frames_[depth_]);
+    frames_[depth_ - 1].gaps_size += frames_[depth_].gaps_size;
+  }
+  return this;
+}
+
+WireEncoder* WireEncoder::StartList(absl::string_view name) {
+  if (skip_depth_ > 0 || failed_) {
+    ++skip_depth_;
+    return this;
+  }
+  if (depth_ == 0) {
+    InvalidName(name, "Root element must be a message.");
+    ++skip_depth_;
+    return this;
+  }
+  if (frames_[depth_ - 1].message == nullptr) {
+    InvalidName(name, "Proto fields cannot contain nested lists.");
+    ++skip_depth_;
+    return this;
+  }
+  const WireEncoderPlan::Field* field = FindField(name);
+  if (field == nullptr) {
+    ++skip_depth_;
+    return this;
+  }
+  if (field->field->cardinality() != pb::Field::CARDINALITY_REPEATED) {
+    InvalidName(name, "Proto field is not repeating, cannot start list.");
+    ++skip_depth_;
+    return this;
+  }
+  PushFrame(nullptr, field, 0);
+  return this;
+}
+
+WireEncoder* WireEncoder::EndList() {
+  if (skip_depth_ > 0) {
+    --skip_depth_;
+    return this;
+  }
+  if (depth_ > 0) {
+    --depth_;
+    if (depth_ > 0) {
+      frames_[depth_ - 1].gaps_size += frames_[depth_].gaps_size;
+    }
+  }
+  return this;
+}
+
+WireEncoder* WireEncoder::RenderBool(absl::string_view name, bool value) {
+  Render(name, Value(value));
+  return this;
+}
+
+WireEncoder* WireEncoder::RenderInt32(absl::string_view name, int32_t value) {
+  Render(name, Value(static_cast<int64_t>(value)));
+  return this;
+}
+
+WireEncoder* WireEncoder::RenderUint32(absl::string_view name,
+                                       uint32_t value) {
+  Render(name, Value(static_cast<uint64_t>(value)));
+  return this;
+}
+
+WireEncoder* WireEncoder::RenderInt64(absl::string_view name, int64_t value) {
+  Render(name, Value(value));
+  return this;
+}
+
+WireEncoder* WireEncoder::RenderUint64(absl::string_view name,
+                                       uint64_t value) {
+  Render(name, Value(value));
+  return this;
+}
+
+WireEncoder* WireEncoder::RenderDouble(absl::string_view name, double value) {
+  Render(name, Value(value));
+  return this;
+}
+
+WireEncoder* WireEncoder::RenderFloat(absl::string_view name, float value) {
+  Render(name, Value(static_cast<double>(value)));
+  return this;
+}
+
+WireEncoder* WireEncoder::RenderString(absl::string_view name,
+                                       absl::string_view value) {
+  Render(name, Value(Value::kString, value));
+  return this;
+}
+
+WireEncoder* WireEncoder::RenderBytes(absl::string_view name,
+                                      absl::string_view value) {
+  Render(name, Value(Value::kBytes, value));
+  return this;
+}
+
+WireEncoder* WireEncoder::RenderNull(absl::string_view name) {
+  if (skip_depth_ > 0 || failed_ || depth_ == 0) {
+    return this;
+  }
+  // Nulls are skipped, but the field must still be known. A null
+  // google.protobuf.NullValue is written as NULL_VALUE, like
+  // ProtoStreamObjectWriter does.
+  const WireEncoderPlan::Field* field = FindField(name);
+  if (field != nullptr && field->enum_type != nullptr &&
+      field->enum_type->null_value && TakeOneof(*field)) {
+    WriteValue(*field, Value(int64_t{0}));
+  }
+  return this;
+}
+
+void WireEncoder::PushFrame(const WireEncoderPlan::Message* message,
+                            const WireEncoderPlan::Field* field,
+                            size_t size_offset) {
+  if (depth_ == frames_.size()) {
+    frames_.emplace_back();
+  }
+  Frame& frame = frames_[depth_++];
+  frame.message = message;
+  frame.field = field;
+  frame.size_offset = size_offset;
+  frame.gaps_size = 0;
+  frame.list_size = 0;
+  frame.oneofs.assign(message != nullptr ? message->type->oneofs_size() : 0,
+                      false);
+}
+
+const WireEncoderPlan::Field* WireEncoder::FindField(absl::string_view name) {
+  Frame& frame = frames_[depth_ - 1];
+  if (frame.message == nullptr) {
+    // An element of a list
+    ++frame.list_size;
+    return frame.field;
+  }
+  auto it = frame.message->fields.find(name);
+  if (it == frame.message->fields.end()) {
+    if (!options_.ignore_unknown_fields) {
+      InvalidName(name, absl::StrCat("Cannot find field: ", name,
+                                     " in message ",
+                                     frame.message->type->name()));
+    }
+    return nullptr;
+  }
+  return &it->second;
+}
+
+bool WireEncoder::TakeOneof(const WireEncoderPlan::Field& field) {
+  Frame& frame = frames_[depth_ - 1];
+  int32_t index = field.field->oneof_index();
+  if (frame.message == nullptr || index <= 0 ||
+      index > static_cast<int32_t>(frame.oneofs.size())) {
+    return true;
+  }
+  if (frame.oneofs[index - 1]) {
+    InvalidValue("oneof", absl::StrCat("oneof field '",
+                                       frame.message->type->oneofs(index - 1),
+                                       "' is already set. Cannot set '",
+                                       field.field->name(), "'"));
+    return false;
+  }
+  frame.oneofs[index - 1] = true;
+  return true;
+}
+
+void WireEncoder::Render(absl::string_view name, const Value& value) {
+  if (skip_depth_ > 0 || failed_) {
+    return;
+  }
+  if (depth_ == 0) {
+    InvalidName(name, "Root element must be a message.");
+    return;
+  }
+  const WireEncoderPlan::Field* field = FindField(name);
+  if (field == nullptr) {
+    return;
+  }
+  if (field->message != nullptr) {
+    InvalidValue("TYPE_MESSAGE", value.ToDebugString());
+    return;
+  }
+  if (!TakeOneof(*field)) {
+    return;
+  }
+  if (!WriteValue(*field, value)) {
+    InvalidValue(pb::Field_Kind_Name(field->field->kind()),
+                 value.ToDebugString());
+  }
+}
+
+bool WireEncoder::WriteValue(const WireEncoderPlan::Field& field,
+                             const Value& value) {
+  // The value is converted before anything is written, so that nothing is
+  // written if it fails.
+  std::string scratch;
+  absl::string_view str;
+  switch (field.field->kind()) {
+    case pb::Field::TYPE_INT32:
+    case pb::Field::TYPE_SINT32:
+    case pb::Field::TYPE_SFIXED32: {
+      int32_t v;
+      if (!value.ToInt(&v)) return false;
+      WriteVarint(field.tag, output_);
+      if (field.field->kind() == pb::Field::TYPE_INT32) {
+        WriteVarint(static_cast<uint64_t>(static_cast<int64_t>(v)), output_);
+      } else if (field.field->kind() == pb::Field::TYPE_SINT32) {
+        WriteVarint(WireFormatLite::ZigZagEncode32(v), output_);
+      } else {
+        WriteFixed32(static_cast<uint32_t>(v), output_);
+      }
+      return true;
+    }
+    case pb::Field::TYPE_INT64:
+    case pb::Field::TYPE_SINT64:
+    case pb::Field::TYPE_SFIXED64: {
+      int64_t v;
+      if (!value.ToInt(&v)) return false;
+      WriteVarint(field.tag, output_);
+      if (field.field->kind() == pb::Field::TYPE_INT64) {
+        WriteVarint(static_cast<uint64_t>(v), output_);
+      } else if (field.field->kind() == pb::Field::TYPE_SINT64) {
+        WriteVarint(WireFormatLite::ZigZagEncode64(v), output_);
+      } else {
+        WriteFixed64(static_cast<uint64_t>(v), output_);
+      }
+      return true;
+    }
+    case pb::Field::TYPE_UINT32:
+    case pb::Field::TYPE_FIXED32: {
+      uint32_t v;
+      if (!value.ToUint(&v)) return false;
+      WriteVarint(field.tag, output_);
+      if (field.field->kind() == pb::Field::TYPE_UINT32) {
+        WriteVarint(v, output_);
+      } else {
+        WriteFixed32(v, output_);
+      }
+      return true;
+    }
+    case pb::Field::TYPE_UINT64:
+    case pb::Field::TYPE_FIXED64: {
+      uint64_t v;
+      if (!value.ToUint(&v)) return false;
+      WriteVarint(field.tag, output_);
+      if (field.field->kind() == pb::Field::TYPE_UINT64) {
+        WriteVarint(v, output_);
+      } else {
+        WriteFixed64(v, output_);
+      }
+      return true;
+    }
+    case pb::Field::TYPE_DOUBLE: {
+      double v;
+      if (!value.ToDouble(&v)) return false;
+      WriteVarint(field.tag, output_);
+      WriteFixed64(WireFormatLite::EncodeDouble(v), output_);
+      return true;
+    }
+    case pb::Field::TYPE_FLOAT: {
+      float v;
+      if (!value.ToFloat(&v)) return false;
+      WriteVarint(field.tag, output_);
+      WriteFixed32(WireFormatLite::EncodeFloat(v), output_);
+      return true;
+    }
+    case pb::Field::TYPE_BOOL: {
+      bool v;
+      if (!value.ToBool(&v)) return false;
+      WriteVarint(field.tag, output_);
+      WriteVarint(v ? 1 : 0, output_);
+      return true;
+    }
+    case pb::Field::TYPE_ENUM: {
+      int32_t v;
+      if (!value.ToEnum(*field.enum_type,
+                        options_.case_insensitive_enum_parsing, &v)) {
+        return false;
+      }
+      WriteVarint(field.tag, output_);
+      WriteVarint(static_cast<uint64_t>(static_cast<int64_t>(v)), output_);
+      return true;
+    }
+    case pb::Field::TYPE_STRING:
+      if (!value.ToString(&scratch, &str)) return false;
+      WriteVarint(field.tag, output_);
+      WriteLengthDelimited(str, output_);
+      return true;
+    case pb::Field::TYPE_BYTES:
+      if (!value.ToBytes(use_strict_base64_decoding(), &scratch, &str)) {
+        return false;
+      }
+      WriteVarint(field.tag, output_);
+      WriteLengthDelimited(str, output_);
+      return true;
+    default:
+      return false;
+  }
+}
+
+void WireEncoder::WriteSize(Frame& frame) {
+  const size_t start = frame.size_offset + kMaxSizeLength;
+  uint32_t size =
+      static_cast<uint32_t>(output_->size() - start - frame.gaps_size);
+  uint8_t* target = reinterpret_cast<uint8_t*>(&(*output_)[frame.size_offset]);
+  size_t size_length =
+      CodedOutputStream::WriteVarint32ToArray(size, target) - target;
+  size_t gap = kMaxSizeLength - size_length;
+  if (gap > 0) {
+    gaps_.emplace_back(frame.size_offset + size_length, gap);
+    frame.gaps_size += gap;
+  }
+}
+
+void WireEncoder::RemoveGaps() {
+  if (gaps_.empty()) {
+    return;
+  }
+  // The gaps of the nested messages are added before the gaps of the messages
+  // containing them.
+  std::sort(gaps_.begin(), gaps_.end());
+  char* data = &(*output_)[0];
+  size_t to = gaps_[0].first;
+  for (size_t i = 0; i < gaps_.size(); ++i) {
+    size_t from = gaps_[i].first + gaps_[i].second;
+    size_t end = i + 1 < gaps_.size() ? gaps_[i + 1].first : output_->size();
+    memmove(data + to, data + from, end - from);
+    to += end - from;
+  }
+  output_->resize(to);
+  gaps_.clear();
+}
+
+void WireEncoder::InvalidName(absl::string_view name,
+                              absl::string_view message) {
+  failed_ = true;
+  listener_->InvalidName(Location(*this), name, message);
+}
+
+void WireEncoder::InvalidValue(absl::string_view type_name,
+                               absl::string_view value) {
+  failed_ = true;
+  listener_->InvalidValue(Location(*this), type_name, value);
+}
+
+std::string WireEncoder::CurrentLocation() const {
+  std::string location;
+  for (size_t i = 1; i < depth_; ++i) {
+    const Frame& parent = frames_[i - 1];
+    if (parent.message == nullptr) {
+      absl::StrAppend(&location, "[", parent.list_size - 1, "]");
+    } else {
+      absl::StrAppend(&location, location.empty() ? "" : ".",
+                      frames_[i].field->field->name());
+    }
+  }
+  if (depth_ > 0 && frames_[depth_ - 1].message == nullptr &&
+      frames_[depth_ - 1].list_size > 0) {
+    absl::StrAppend(&location, "[", frames_[depth_ - 1].list_size - 1, "]");
+  }
+  return location;
+}
+
+}  // namespace transcoding
+
+}  // namespace grpc
+}  // namespace google
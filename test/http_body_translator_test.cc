@@ -0,0 +1,409 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+#include "grpc_transcoding/http_body_translator.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "google/protobuf/descriptor.h"
+#include "google/protobuf/descriptor.pb.h"
+#include "google/protobuf/dynamic_message.h"
+#include "google/protobuf/text_format.h"
+#include "google/protobuf/util/message_differencer.h"
+#include "google/protobuf/util/type_resolver_util.h"
+#include "grpc_transcoding/message_reader.h"
+#include "grpc_transcoding/type_helper.h"
+#include "gtest/gtest.h"
+#include "test_common.h"
+
+namespace google {
+namespace grpc {
+
+namespace transcoding {
+namespace testing {
+namespace {
+
+namespace pb = ::google::protobuf;
+namespace pbutil = ::google::protobuf::util;
+
+// google.api.HttpBody without the extensions, and the messages of the tests.
+const char kHttpBodyFile[] = R"(
+  name: "google/api/httpbody.proto"
+  package: "google.api"
+  syntax: "proto3"
+  message_type {
+    name: "HttpBody"
+    field { name: "content_type" number: 1 type: TYPE_STRING }
+    field { name: "data" number: 2 type: TYPE_BYTES }
+  }
+)";
+
+const char kTestFile[] = R"(
+  name: "http_body_translator_test.proto"
+  package: "test"
+  syntax: "proto3"
+  dependency: "google/api/httpbody.proto"
+  message_type {
+    name: "UploadRequest"
+    field { name: "shelf" number: 1 type: TYPE_STRING }
+    field { name: "upload" number: 2 type: TYPE_MESSAGE
+            type_name: ".test.Upload" }
+  }
+  message_type {
+    name: "Upload"
+    field { name: "name" number: 1 type: TYPE_STRING }
+    field { name: "file" number: 20 type: TYPE_MESSAGE
+            type_name: ".google.api.HttpBody" }
+    field { name: "size" number: 3 type: TYPE_INT64 }
+  }
+)";
+
+class HttpBodyTranslatorTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    for (const char* text : {kHttpBodyFile, kTestFile}) {
+      pb::FileDescriptorProto file;
+      ASSERT_TRUE(pb::TextFormat::ParseFromString(text, &file));
+      ASSERT_NE(nullptr, pool_.BuildFile(file));
+    }
+    helper_.reset(new TypeHelper(pbutil::NewTypeResolverForDescriptorPool(
+        "type.googleapis.com", &pool_)));
+  }
+
+  std::shared_ptr<const TranscodingPlan> Plan(
+      const std::string& request_type, const std::string& response_type,
+      const std::string& http_template, const std::string& body_field_path) {
+    TranscodingPlan::Spec spec;
+    spec.request_type_url = "type.googleapis.com/" + request_type;
+    spec.response_type_url = "type.googleapis.com/" + response_type;
+    spec.http_template = http_template;
+    spec.body_field_path = body_field_path;
+    auto plan = TranscodingPlan::Create(*helper_, spec);
+    EXPECT_TRUE(plan.ok()) << plan.status();
+    return plan.ok() ? *plan : nullptr;
+  }
+
+  std::vector<RequestWeaver::BindingInfo> Bindings(
+      const TranscodingPlan& plan, const std::string& field_path,
+      const std::string& value) {
+    std::vector<RequestWeaver::BindingInfo> bindings;
+    EXPECT_TRUE(plan.ResolveBindings({{{field_path}, value}}, &bindings).ok());
+    return bindings;
+  }
+
+  std::unique_ptr<pb::Message> Parse(const std::string& type_name,
+                                     const std::string& text) {
+    const pb::Message* prototype =
+        factory_.GetPrototype(pool_.FindMessageTypeByName(type_name));
+    std::unique_ptr<pb::Message> message(prototype->New());
+    EXPECT_TRUE(pb::TextFormat::ParseFromString(text, message.get()));
+    return message;
+  }
+
+  // Expects the wire format message to be the message of type_name in text
+  // format.
+  void ExpectMessageEq(const std::string& type_name,
+                       const std::string& expected_text,
+                       const std::string& actual) {
+    std::unique_ptr<pb::Message> expected = Parse(type_name, expected_text);
+    std::unique_ptr<pb::Message> message(expected->New());
+    ASSERT_TRUE(message->ParseFromString(actual));
+    EXPECT_TRUE(pbutil::MessageDifferencer::Equals(*expected, *message))
+        << "Expected: " << expected->DebugString()
+        << "Actual: " << message->DebugString();
+  }
+
+  // Reads what's available from the stream.
+  static std::string ReadAvailable(pb::io::ZeroCopyInputStream* stream) {
+    std::string all;
+    const void* data = nullptr;
+    int size = 0;
+    while (stream->Next(&data, &size) && size != 0) {
+      all.append(static_cast<const char*>(data), size);
+    }
+    return all;
+  }
+
+  // Reads the gRPC messages available from the stream.
+  static std::vector<std::string> ReadMessages(TranscoderInputStream* stream) {
+    std::vector<std::string> messages;
+    MessageReader reader(stream);
+    std::unique_ptr<pb::io::ZeroCopyInputStream> message;
+    while ((message = reader.NextMessage()) != nullptr) {
+      messages.push_back(ReadAvailable(message.get()));
+    }
+    EXPECT_TRUE(reader.Status().ok()) << reader.Status();
+    return messages;
+  }
+
+  pb::DescriptorPool pool_;
+  pb::DynamicMessageFactory factory_;
+  std::unique_ptr<TypeHelper> helper_;
+};
+
+TEST_F(HttpBodyTranslatorTest, Plan) {
+  auto plan = Plan("test.UploadRequest", "google.api.HttpBody", "",
+                   "upload.file");
+  ASSERT_NE(nullptr, plan);
+  EXPECT_TRUE(plan->http_body_request());
+  EXPECT_TRUE(plan->http_body_response());
+
+  plan = Plan("google.api.HttpBody", "test.Upload", "", "*");
+  ASSERT_NE(nullptr, plan);
+  EXPECT_TRUE(plan->http_body_request());
+  EXPECT_FALSE(plan->http_body_response());
+
+  plan = Plan("test.UploadRequest", "test.Upload", "", "upload");
+  ASSERT_NE(nullptr, plan);
+  EXPECT_FALSE(plan->http_body_request());
+  EXPECT_FALSE(plan->http_body_response());
+}
+
+TEST_F(HttpBodyTranslatorTest, Request) {
+  auto plan = Plan("test.UploadRequest", "test.Upload", "/shelves/{shelf}",
+                   "upload.file");
+  ASSERT_NE(nullptr, plan);
+  TestZeroCopyInputStream body;
+  HttpBodyRequestTranslator translator(*plan, &body,
+                                       Bindings(*plan, "shelf", "1"),
+                                       "image/png", /*streaming=*/false,
+                                       /*output_delimiters=*/true);
+
+  // The length of the body isn't known until it's finished.
+  body.AddChunk("\x89PNG");
+  EXPECT_EQ(0, translator.BytesAvailable());
+  EXPECT_TRUE(ReadMessages(&translator).empty());
+  EXPECT_FALSE(translator.Finished());
+
+  body.AddChunk(std::string("\0\r\n", 3));
+  body.Finish();
+  std::vector<std::string> messages = ReadMessages(&translator);
+  ASSERT_EQ(1, messages.size());
+  ExpectMessageEq("test.UploadRequest", R"(
+    shelf: "1"
+    upload { file { content_type: "image/png" data: "\x89PNG\0\r\n" } }
+  )", messages[0]);
+  EXPECT_TRUE(translator.Finished());
+  EXPECT_TRUE(translator.Status().ok());
+}
+
+TEST_F(HttpBodyTranslatorTest, RequestWholeMessage) {
+  auto plan = Plan("google.api.HttpBody", "test.Upload", "", "*");
+  ASSERT_NE(nullptr, plan);
+  TestZeroCopyInputStream body;
+  HttpBodyRequestTranslator translator(*plan, &body, {}, "text/plain",
+                                       /*streaming=*/false,
+                                       /*output_delimiters=*/false);
+  body.AddChunk("Hello, ");
+  body.AddChunk("World!");
+  body.Finish();
+  ExpectMessageEq("google.api.HttpBody", R"(
+    content_type: "text/plain" data: "Hello, World!"
+  )", ReadAvailable(&translator));
+  EXPECT_TRUE(translator.Finished());
+}
+
+TEST_F(HttpBodyTranslatorTest, RequestEmptyBody) {
+  auto plan = Plan("google.api.HttpBody", "test.Upload", "", "*");
+  ASSERT_NE(nullptr, plan);
+  TestZeroCopyInputStream body;
+  body.Finish();
+  HttpBodyRequestTranslator translator(*plan, &body, {}, "",
+                                       /*streaming=*/false,
+                                       /*output_delimiters=*/true);
+  std::vector<std::string> messages = ReadMessages(&translator);
+  ASSERT_EQ(1, messages.size());
+  EXPECT_EQ("", messages[0]);
+  EXPECT_TRUE(translator.Finished());
+}
+
+TEST_F(HttpBodyTranslatorTest, RequestStreaming) {
+  auto plan = Plan("test.UploadRequest", "test.Upload", "/shelves/{shelf}",
+                   "upload.file");
+  ASSERT_NE(nullptr, plan);
+  TestZeroCopyInputStream body;
+  HttpBodyRequestTranslator translator(*plan, &body,
+                                       Bindings(*plan, "shelf", "1"),
+                                       "text/csv", /*streaming=*/true,
+                                       /*output_delimiters=*/true);
+
+  // Each batch of body bytes is a message, and the bindings and the
+  // content_type are only in the first one.
+  body.AddChunk("a,b\n");
+  body.AddChunk("1,2\n");
+  std::vector<std::string> messages = ReadMessages(&translator);
+  ASSERT_EQ(1, messages.size());
+  ExpectMessageEq("test.UploadRequest", R"(
+    shelf: "1"
+    upload { file { content_type: "text/csv" data: "a,b\n1,2\n" } }
+  )", messages[0]);
+  EXPECT_FALSE(translator.Finished());
+
+  body.AddChunk("3,4\n");
+  body.Finish();
+  messages = ReadMessages(&translator);
+  ASSERT_EQ(1, messages.size());
+  ExpectMessageEq("test.UploadRequest", R"(
+    upload { file { data: "3,4\n" } }
+  )", messages[0]);
+  EXPECT_TRUE(translator.Finished());
+}
+
+TEST_F(HttpBodyTranslatorTest, RequestBackUp) {
+  auto plan = Plan("google.api.HttpBody", "test.Upload", "", "*");
+  ASSERT_NE(nullptr, plan);
+  TestZeroCopyInputStream body;
+  body.AddChunk("abcdef");
+  body.Finish();
+  HttpBodyRequestTranslator translator(*plan, &body, {}, "",
+                                       /*streaming=*/false,
+                                       /*output_delimiters=*/false);
+  const void* data = nullptr;
+  int size = 0;
+  // The tag and the length of the data.
+  ASSERT_TRUE(translator.Next(&data, &size));
+  ASSERT_EQ(2, size);
+  translator.BackUp(1);
+  ASSERT_TRUE(translator.Next(&data, &size));
+  EXPECT_EQ("\x06", std::string(static_cast<const char*>(data), size));
+
+  // The body bytes, as they are in the body stream.
+  ASSERT_TRUE(translator.Next(&data, &size));
+  EXPECT_EQ("abcdef", std::string(static_cast<const char*>(data), size));
+  translator.BackUp(2);
+  EXPECT_EQ(2, translator.BytesAvailable());
+  EXPECT_EQ(6, translator.ByteCount());
+  ASSERT_TRUE(translator.Next(&data, &size));
+  EXPECT_EQ("ef", std::string(static_cast<const char*>(data), size));
+  EXPECT_FALSE(translator.Next(&data, &size));
+  EXPECT_TRUE(translator.Finished());
+}
+
+TEST_F(HttpBodyTranslatorTest, RequestInvalidBinding) {
+  auto plan = Plan("test.UploadRequest", "test.Upload", "", "upload.file");
+  ASSERT_NE(nullptr, plan);
+  std::vector<RequestWeaver::BindingInfo> bindings;
+  ASSERT_TRUE(
+      plan->ResolveBindings({{{"upload", "size"}, "large"}}, &bindings).ok());
+  TestZeroCopyInputStream body;
+  body.Finish();
+  HttpBodyRequestTranslator translator(*plan, &body, std::move(bindings), "",
+                                       /*streaming=*/false,
+                                       /*output_delimiters=*/true);
+  EXPECT_FALSE(translator.Status().ok());
+  EXPECT_TRUE(ReadMessages(&translator).empty());
+  EXPECT_TRUE(translator.Finished());
+}
+
+class HttpBodyResponseTranslatorTest : public HttpBodyTranslatorTest {
+ protected:
+  std::string GrpcMessage(const std::string& type_name,
+                          const std::string& text) {
+    std::string binary = Parse(type_name, text)->SerializeAsString();
+    return SizeToDelimiter(binary.size()) + binary;
+  }
+};
+
+TEST_F(HttpBodyResponseTranslatorTest, Response) {
+  std::string message = GrpcMessage("google.api.HttpBody", R"(
+    content_type: "image/png" data: "\x89PNG\0\r\n"
+  )");
+  TestZeroCopyInputStream in;
+  HttpBodyResponseTranslator translator(&in, /*streaming=*/false);
+
+  // The message is read once it's complete.
+  in.AddChunk(message.substr(0, 10));
+  EXPECT_EQ("", ReadAvailable(&translator));
+  EXPECT_EQ("", translator.content_type());
+  EXPECT_FALSE(translator.Finished());
+
+  in.AddChunk(message.substr(10));
+  in.Finish();
+  EXPECT_EQ(7, translator.BytesAvailable());
+  EXPECT_EQ("image/png", translator.content_type());
+  EXPECT_EQ(std::string("\x89PNG\0\r\n", 7), ReadAvailable(&translator));
+  EXPECT_TRUE(translator.Finished());
+  EXPECT_TRUE(translator.Status().ok());
+  EXPECT_EQ(7, translator.ByteCount());
+}
+
+TEST_F(HttpBodyResponseTranslatorTest, ResponseSkipsOtherFields) {
+  // The data between other fields, which aren't part of the body.
+  std::string binary =
+      std::string("\x1a\x03\x0a\x01x", 5) +
+      Parse("google.api.HttpBody", R"(data: "body")")->SerializeAsString() +
+      std::string("\x1a\x00", 2);
+  TestZeroCopyInputStream in;
+  in.AddChunk(SizeToDelimiter(binary.size()) + binary);
+  in.Finish();
+  HttpBodyResponseTranslator translator(&in, /*streaming=*/false);
+  EXPECT_EQ("body", ReadAvailable(&translator));
+  EXPECT_TRUE(translator.Finished());
+  EXPECT_TRUE(translator.Status().ok());
+}
+
+TEST_F(HttpBodyResponseTranslatorTest, ResponseStreaming) {
+  TestZeroCopyInputStream in;
+  HttpBodyResponseTranslator translator(&in, /*streaming=*/true);
+  in.AddChunk(GrpcMessage("google.api.HttpBody", R"(
+    content_type: "text/csv" data: "a,b\n"
+  )"));
+  // A message with no data, and the content_type of the first message only.
+  in.AddChunk(GrpcMessage("google.api.HttpBody", R"(
+    content_type: "text/plain"
+  )"));
+  EXPECT_EQ("a,b\n", ReadAvailable(&translator));
+  EXPECT_EQ("text/csv", translator.content_type());
+  EXPECT_FALSE(translator.Finished());
+
+  in.AddChunk(GrpcMessage("google.api.HttpBody", R"(data: "1,2\n")"));
+  in.Finish();
+  EXPECT_EQ("1,2\n", ReadAvailable(&translator));
+  EXPECT_EQ("text/csv", translator.content_type());
+  EXPECT_TRUE(translator.Finished());
+  EXPECT_TRUE(translator.Status().ok());
+}
+
+TEST_F(HttpBodyResponseTranslatorTest, ResponseInvalid) {
+  // The length of the data is larger than the message.
+  std::string binary("\x12\x05" "abc", 5);
+  TestZeroCopyInputStream in;
+  in.AddChunk(SizeToDelimiter(binary.size()) + binary);
+  in.Finish();
+  HttpBodyResponseTranslator translator(&in, /*streaming=*/false);
+  ReadAvailable(&translator);
+  EXPECT_EQ(absl::StatusCode::kInternal, translator.Status().code());
+  EXPECT_TRUE(translator.Finished());
+}
+
+TEST_F(HttpBodyResponseTranslatorTest, ResponseDataEncodedTwice) {
+  std::string binary("\x12\x01" "a" "\x12\x01" "b", 6);
+  TestZeroCopyInputStream in;
+  in.AddChunk(SizeToDelimiter(binary.size()) + binary);
+  in.Finish();
+  HttpBodyResponseTranslator translator(&in, /*streaming=*/false);
+  ReadAvailable(&translator);
+  EXPECT_EQ(absl::StatusCode::kUnimplemented, translator.Status().code());
+}
+
+}  // namespace
+}  // namespace testing
+}  // namespace transcoding
+
+}  // namespace grpc
+}  // namespace google
@@ -0,0 +1,547 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+#include "grpc_transcoding/incremental_json_printer.h"
+
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "google/protobuf/descriptor.h"
+#include "google/protobuf/descriptor.pb.h"
+#include "google/protobuf/dynamic_message.h"
+#include "google/protobuf/io/zero_copy_stream_impl_lite.h"
+#include "google/protobuf/text_format.h"
+#include "google/protobuf/timestamp.pb.h"
+#include "google/protobuf/util/json_util.h"
+#include "google/protobuf/util/type_resolver_util.h"
+#include "grpc_transcoding/type_helper.h"
+#include "gtest/gtest.h"
+#include "test_common.h"
+
+namespace google {
+namespace grpc {
+
+namespace transcoding {
+namespace testing {
+namespace {
+
+namespace pb = ::google::protobuf;
+namespace pbio = ::google::protobuf::io;
+namespace pbutil = ::google::protobuf::util;
+
+// The types of the tests, as a FileDescriptorProto to cover all the field
+// kinds without a dedicated .proto.
+const char kTestFile[] = R"(
+  name: "incremental_json_printer_test.proto"
+  package: "test"
+  syntax: "proto3"
+  dependency: "google/protobuf/timestamp.proto"
+  message_type {
+    name: "Scalars"
+    field { name: "int32_value" number: 1 type: TYPE_INT32 }
+    field { name: "sint32_value" number: 2 type: TYPE_SINT32 }
+    field { name: "sfixed32_value" number: 3 type: TYPE_SFIXED32 }
+    field { name: "uint32_value" number: 4 type: TYPE_UINT32 }
+    field { name: "fixed32_value" number: 5 type: TYPE_FIXED32 }
+    field { name: "int64_value" number: 6 type: TYPE_INT64 }
+    field { name: "sint64_value" number: 7 type: TYPE_SINT64 }
+    field { name: "sfixed64_value" number: 8 type: TYPE_SFIXED64 }
+    field { name: "uint64_value" number: 9 type: TYPE_UINT64 }
+    field { name: "fixed64_value" number: 10 type: TYPE_FIXED64 }
+    field { name: "double_value" number: 11 type: TYPE_DOUBLE }
+    field { name: "float_value" number: 12 type: TYPE_FLOAT }
+    field { name: "bool_value" number: 13 type: TYPE_BOOL }
+    field { name: "string_value" number: 14 type: TYPE_STRING }
+    field { name: "bytes_value" number: 15 type: TYPE_BYTES }
+    field { name: "color" number: 16 type: TYPE_ENUM type_name: ".test.Color" }
+  }
+  message_type {
+    name: "Lists"
+    field {
+      name: "packed" number: 1 type: TYPE_INT32 label: LABEL_REPEATED
+    }
+    field {
+      name: "unpacked" number: 2 type: TYPE_DOUBLE label: LABEL_REPEATED
+      options { packed: false }
+    }
+    field {
+      name: "strings" number: 3 type: TYPE_STRING label: LABEL_REPEATED
+    }
+    field {
+      name: "messages" number: 4 type: TYPE_MESSAGE label: LABEL_REPEATED
+      type_name: ".test.Lists"
+    }
+    field {
+      name: "colors" number: 5 type: TYPE_ENUM label: LABEL_REPEATED
+      type_name: ".test.Color"
+    }
+    field { name: "scalars" number: 6 type: TYPE_MESSAGE
+            type_name: ".test.Scalars" }
+  }
+  message_type {
+    name: "Maps"
+    field {
+      name: "by_name" number: 1 type: TYPE_MESSAGE label: LABEL_REPEATED
+      type_name: ".test.Maps.ByNameEntry"
+    }
+    field {
+      name: "by_id" number: 2 type: TYPE_MESSAGE label: LABEL_REPEATED
+      type_name: ".test.Maps.ByIdEntry"
+    }
+    nested_type {
+      name: "ByNameEntry"
+      field { name: "key" number: 1 type: TYPE_STRING }
+      field { name: "value" number: 2 type: TYPE_INT32 }
+      options { map_entry: true }
+    }
+    nested_type {
+      name: "ByIdEntry"
+      field { name: "key" number: 1 type: TYPE_INT64 }
+      field { name: "value" number: 2 type: TYPE_MESSAGE
+              type_name: ".test.Scalars" }
+      options { map_entry: true }
+    }
+  }
+  message_type {
+    name: "WithTimestamp"
+    field { name: "name" number: 1 type: TYPE_STRING }
+    field {
+      name: "time" number: 2 type: TYPE_MESSAGE
+      type_name: ".google.protobuf.Timestamp"
+    }
+  }
+  message_type {
+    name: "WithOneof"
+    field { name: "name" number: 1 type: TYPE_STRING oneof_index: 0 }
+    field { name: "id" number: 2 type: TYPE_INT64 oneof_index: 0 }
+    field { name: "note" number: 3 type: TYPE_STRING }
+    oneof_decl { name: "key" }
+  }
+  enum_type {
+    name: "Color"
+    value { name: "RED" number: 0 }
+    value { name: "GREEN" number: 1 }
+    value { name: "DARK_BLUE" number: 2 }
+  }
+)";
+
+class IncrementalJsonPrinterTest : public ::testing::Test {
+ protected:
+  IncrementalJsonPrinterTest() : pool_(pb::DescriptorPool::generated_pool()) {}
+
+  void SetUp() override {
+    // Make sure that timestamp.proto is in the generated pool.
+    pb::Timestamp::descriptor();
+
+    pb::FileDescriptorProto file;
+    ASSERT_TRUE(pb::TextFormat::ParseFromString(kTestFile, &file));
+    ASSERT_NE(nullptr, pool_.BuildFile(file));
+    helper_.reset(new TypeHelper(pbutil::NewTypeResolverForDescriptorPool(
+        "type.googleapis.com", &pool_)));
+  }
+
+  std::unique_ptr<pb::Message> Parse(const std::string& type_name,
+                                     const std::string& text) {
+    const pb::Message* prototype = factory_.GetPrototype(
+        pool_.FindMessageTypeByName("test." + type_name));
+    std::unique_ptr<pb::Message> message(prototype->New());
+    EXPECT_TRUE(pb::TextFormat::ParseFromString(text, message.get()));
+    return message;
+  }
+
+  // Returns the wire format of the message of type_name in text format.
+  std::string Serialize(const std::string& type_name, const std::string& text) {
+    return Parse(type_name, text)->SerializeAsString();
+  }
+
+  std::unique_ptr<IncrementalJsonPrinter> Printer(
+      const std::string& type_name) {
+    return IncrementalJsonPrinter::Create(
+        helper_->Resolver(), "type.googleapis.com/test." + type_name,
+        options_);
+  }
+
+  // Prints message in parts of part_size bytes.
+  absl::Status Print(IncrementalJsonPrinter* printer,
+                     const std::string& message, size_t part_size,
+                     std::string* json) {
+    size_t position = 0;
+    do {
+      size_t size = std::min(part_size, message.size() - position);
+      pbio::ArrayInputStream part(message.data() + position, size);
+      position += size;
+      absl::Status status =
+          printer->Print(&part, position == message.size(), json);
+      if (!status.ok()) {
+        return status;
+      }
+    } while (position < message.size());
+    return absl::OkStatus();
+  }
+
+  // Prints the message of type_name in text format, whole and in parts of
+  // several sizes, and expects the same JSON for all of them.
+  ::testing::AssertionResult ExpectJson(const std::string& type_name,
+                                        const std::string& text,
+                                        const std::string& expected) {
+    std::string message = Serialize(type_name, text);
+    for (size_t part_size : {message.size(), static_cast<size_t>(1),
+                             static_cast<size_t>(2), static_cast<size_t>(3),
+                             static_cast<size_t>(7), static_cast<size_t>(16)}) {
+      auto printer = Printer(type_name);
+      if (printer == nullptr) {
+        return ::testing::AssertionFailure() << "No printer";
+      }
+      std::string json;
+      absl::Status status = Print(printer.get(), message, part_size, &json);
+      if (!status.ok()) {
+        return ::testing::AssertionFailure() << status;
+      }
+      if (json != expected) {
+        return ::testing::AssertionFailure()
+               << "Part size " << part_size << ": " << json
+               << " != " << expected;
+      }
+    }
+    return ::testing::AssertionSuccess();
+  }
+
+  // Prints the message of type_name in text format, whole and in parts, and
+  // expects exactly the JSON that BinaryToJsonStream() prints.
+  ::testing::AssertionResult ExpectSameJsonAsBinaryToJsonStream(
+      const std::string& type_name, const std::string& text) {
+    std::string message = Serialize(type_name, text);
+    std::string expected;
+    {
+      pbio::ArrayInputStream input(message.data(), message.size());
+      pbio::StringOutputStream output(&expected);
+      absl::Status status = pbutil::BinaryToJsonStream(
+          Resolver(), "type.googleapis.com/test." + type_name, &input,
+          &output, options_);
+      if (!status.ok()) {
+        return ::testing::AssertionFailure() << status;
+      }
+    }
+    return ExpectJson(type_name, text, expected);
+  }
+
+  pbutil::TypeResolver* Resolver() { return helper_->Resolver(); }
+
+  pbutil::JsonPrintOptions options_;
+
+ private:
+  pb::DescriptorPool pool_;
+  pb::DynamicMessageFactory factory_;
+  std::unique_ptr<TypeHelper> helper_;
+};
+
+TEST_F(IncrementalJsonPrinterTest, Scalars) {
+  EXPECT_TRUE(ExpectJson("Scalars", R"(
+    int32_value: -1
+    sint32_value: -2
+    sfixed32_value: -3
+    uint32_value: 4294967295
+    fixed32_value: 5
+    int64_value: -6000000000
+    sint64_value: -7
+    sfixed64_value: -8
+    uint64_value: 18446744073709551615
+    fixed64_value: 10
+    double_value: 0.1
+    float_value: -2.5
+    bool_value: true
+    string_value: "a\"b\\c\n\001"
+    bytes_value: "hello"
+    color: DARK_BLUE
+  )",
+                         R"({"int32Value":-1,"sint32Value":-2,)"
+                         R"("sfixed32Value":-3,"uint32Value":4294967295,)"
+                         R"("fixed32Value":5,"int64Value":"-6000000000",)"
+                         R"("sint64Value":"-7","sfixed64Value":"-8",)"
+                         R"("uint64Value":"18446744073709551615",)"
+                         R"("fixed64Value":"10","doubleValue":0.1,)"
+                         R"("floatValue":-2.5,"boolValue":true,)"
+                         R"("stringValue":"a\"b\\c\n\u0001",)"
+                         R"("bytesValue":"aGVsbG8=","color":"DARK_BLUE"})"));
+}
+
+TEST_F(IncrementalJsonPrinterTest, SpecialValues) {
+  EXPECT_TRUE(ExpectJson("Scalars", R"(
+    double_value: inf
+    float_value: nan
+    color: 5
+  )",
+                         R"({"doubleValue":"Infinity","floatValue":"NaN",)"
+                         R"("color":5})"));
+  EXPECT_TRUE(ExpectJson("Scalars", "", "{}"));
+}
+
+TEST_F(IncrementalJsonPrinterTest, Options) {
+  options_.preserve_proto_field_names = true;
+  options_.always_print_enums_as_ints = true;
+  EXPECT_TRUE(ExpectJson("Scalars", "int32_value: 1 color: GREEN",
+                         R"({"int32_value":1,"color":1})"));
+
+  // The options that print more than the fields of the message aren't
+  // supported.
+  options_.add_whitespace = true;
+  EXPECT_EQ(nullptr, Printer("Scalars"));
+  options_.add_whitespace = false;
+  options_.always_print_primitive_fields = true;
+  EXPECT_EQ(nullptr, Printer("Scalars"));
+}
+
+TEST_F(IncrementalJsonPrinterTest, Lists) {
+  EXPECT_TRUE(ExpectJson("Lists", R"(
+    packed: [1, -2, 300]
+    unpacked: [0.5, -1]
+    strings: ["a", "", "b"]
+    messages { packed: 1 }
+    messages { }
+    messages { strings: "c" messages { packed: [] unpacked: 2 } }
+    colors: [GREEN, RED]
+    scalars { int32_value: 1 }
+  )",
+                         R"({"packed":[1,-2,300],"unpacked":[0.5,-1],)"
+                         R"("strings":["a","","b"],"messages":[)"
+                         R"({"packed":[1]},{},)"
+                         R"({"strings":["c"],"messages":[{"unpacked":[2]}]}],)"
+                         R"("colors":["GREEN","RED"],)"
+                         R"("scalars":{"int32Value":1}})"));
+}
+
+TEST_F(IncrementalJsonPrinterTest, PackedAndUnpackedValues) {
+  // The packed values of a field can come in several parts, and even mixed
+  // with unpacked ones.
+  std::string message = Serialize("Lists", "packed: [1, 2]") + "\x08\x03" +
+                        Serialize("Lists", "packed: [4]");
+  auto printer = Printer("Lists");
+  std::string json;
+  ASSERT_TRUE(Print(printer.get(), message, 1, &json).ok());
+  EXPECT_EQ(R"({"packed":[1,2,3,4]})", json);
+}
+
+TEST_F(IncrementalJsonPrinterTest, Maps) {
+  EXPECT_TRUE(ExpectJson("Maps", R"(
+    by_name { key: "a" value: 1 }
+    by_name { key: "" value: 2 }
+    by_name { key: "c" }
+    by_id { key: -5 value { string_value: "x" } }
+    by_id { key: 6 }
+  )",
+                         R"({"byName":{"a":1,"":2,"c":0},)"
+                         R"("byId":{"-5":{"stringValue":"x"},"6":{}}})"));
+}
+
+TEST_F(IncrementalJsonPrinterTest, MapEntryWithoutKey) {
+  // Only the value of the entry is encoded.
+  std::string message = Serialize("Maps", R"(by_id { key: 0 value { } })");
+  auto printer = Printer("Maps");
+  std::string json;
+  ASSERT_TRUE(Print(printer.get(), message, 1, &json).ok());
+  EXPECT_EQ(R"({"byId":{"0":{}}})", json);
+}
+
+TEST_F(IncrementalJsonPrinterTest, WellKnownTypes) {
+  EXPECT_TRUE(ExpectJson("WithTimestamp", R"(
+    name: "a"
+    time { seconds: 1 nanos: 500000000 }
+  )",
+                         R"({"name":"a","time":"1970-01-01T00:00:01.500Z"})"));
+
+  // A well-known type is printed by BinaryToJsonStream().
+  EXPECT_EQ(nullptr, IncrementalJsonPrinter::Create(
+                         Resolver(),
+                         "type.googleapis.com/google.protobuf.Timestamp",
+                         options_));
+}
+
+TEST_F(IncrementalJsonPrinterTest, UnknownFields) {
+  // Field 100 isn't in Scalars, and is skipped even if it's longer than the
+  // parts.
+  std::string message = Serialize("Scalars", "int32_value: 1") + "\xa2\x06" +
+                        std::string(1, 40) + std::string(40, 'x') +
+                        Serialize("Scalars", "bool_value: true");
+  for (size_t part_size : {1, 3, 100}) {
+    auto printer = Printer("Scalars");
+    std::string json;
+    ASSERT_TRUE(Print(printer.get(), message, part_size, &json).ok());
+    EXPECT_EQ(R"({"int32Value":1,"boolValue":true})", json);
+  }
+}
+
+TEST_F(IncrementalJsonPrinterTest, PrintsAsTheMessageArrives) {
+  std::string message;
+  for (int i = 0; i < 1000; ++i) {
+    message += Serialize(
+        "Lists", R"(messages { strings: "abcdefghijklmnopqrstuvwxyz" })");
+  }
+  auto printer = Printer("Lists");
+  std::string json;
+  size_t half = message.size() / 2;
+  pbio::ArrayInputStream first(message.data(), half);
+  ASSERT_TRUE(printer->Print(&first, false, &json).ok());
+  // Most of the first half is printed already, and none of the second one.
+  size_t element_size =
+      strlen(R"({"strings":["abcdefghijklmnopqrstuvwxyz"]},)");
+  EXPECT_GT(json.size(), 450 * element_size);
+  EXPECT_LT(json.size(), 550 * element_size);
+
+  pbio::ArrayInputStream second(message.data() + half, message.size() - half);
+  ASSERT_TRUE(printer->Print(&second, true, &json).ok());
+  EXPECT_EQ(R"({"messages":[)", json.substr(0, 13));
+  EXPECT_EQ("]}", json.substr(json.size() - 2));
+}
+
+TEST_F(IncrementalJsonPrinterTest, SeveralMessages) {
+  auto printer = Printer("Scalars");
+  for (int i = 0; i < 3; ++i) {
+    std::string json;
+    std::string message =
+        Serialize("Scalars", "int32_value: " + std::to_string(i + 1));
+    ASSERT_TRUE(Print(printer.get(), message, 2, &json).ok());
+    EXPECT_EQ(R"({"int32Value":)" + std::to_string(i + 1) + "}", json);
+  }
+}
+
+TEST_F(IncrementalJsonPrinterTest, FieldsNotEncodedOnce) {
+  // A field that isn't repeated can't be merged after it's printed.
+  std::string json;
+  absl::Status status = Print(Printer("Scalars").get(),
+                              Serialize("Scalars", "int32_value: 1") +
+                                  Serialize("Scalars", "int32_value: 2"),
+                              100, &json);
+  EXPECT_EQ(absl::StatusCode::kUnimplemented, status.code());
+
+  // Neither can a repeated field that isn't contiguous.
+  status = Print(Printer("Lists").get(),
+                 Serialize("Lists", "strings: 'a'") +
+                     Serialize("Lists", "packed: 1") +
+                     Serialize("Lists", "strings: 'b'"),
+                 100, &json);
+  EXPECT_EQ(absl::StatusCode::kUnimplemented, status.code());
+}
+
+TEST_F(IncrementalJsonPrinterTest, RequireCanonicalEncoding) {
+  const std::string out_of_order = Serialize("Scalars", "sint32_value: 2") +
+                                   Serialize("Scalars", "int32_value: 1");
+  const std::string both_of_oneof = Serialize("WithOneof", "name: 'a'") +
+                                    Serialize("WithOneof", "id: 1");
+  // By default, the fields are printed in the order in which they are
+  // encoded, and so are both fields of the oneof.
+  std::string json;
+  ASSERT_TRUE(Print(Printer("Scalars").get(), out_of_order, 100, &json).ok());
+  EXPECT_EQ(R"({"sint32Value":2,"int32Value":1})", json);
+  json.clear();
+  ASSERT_TRUE(
+      Print(Printer("WithOneof").get(), both_of_oneof, 100, &json).ok());
+  EXPECT_EQ(R"({"name":"a","id":"1"})", json);
+
+  auto scalars = Printer("Scalars");
+  scalars->set_require_canonical_encoding(true);
+  EXPECT_EQ(absl::StatusCode::kUnimplemented,
+            Print(scalars.get(), out_of_order, 100, &json).code());
+  auto with_oneof = Printer("WithOneof");
+  with_oneof->set_require_canonical_encoding(true);
+  EXPECT_EQ(absl::StatusCode::kUnimplemented,
+            Print(with_oneof.get(), both_of_oneof, 100, &json).code());
+
+  // The messages encoded the way protobuf serializers do are still printed,
+  // after a failed one.
+  json.clear();
+  ASSERT_TRUE(Print(with_oneof.get(),
+                    Serialize("WithOneof", "id: 1 note: 'b'"), 100, &json)
+                  .ok());
+  EXPECT_EQ(R"({"id":"1","note":"b"})", json);
+}
+
+TEST_F(IncrementalJsonPrinterTest, InvalidMessages) {
+  std::string message = Serialize("Lists", R"(messages { strings: "abc" })");
+  for (size_t size = 1; size < message.size(); ++size) {
+    // A truncated message.
+    std::string json;
+    absl::Status status =
+        Print(Printer("Lists").get(), message.substr(0, size), 1, &json);
+    EXPECT_EQ(absl::StatusCode::kInvalidArgument, status.code()) << size;
+  }
+
+  std::string json;
+  // A nested message longer than its parent.
+  std::string invalid = message;
+  invalid[3] = 10;
+  EXPECT_EQ(absl::StatusCode::kInvalidArgument,
+            Print(Printer("Lists").get(), invalid, 1, &json).code());
+  // The wrong wire type for a field.
+  EXPECT_EQ(absl::StatusCode::kInvalidArgument,
+            Print(Printer("Lists").get(),
+                  std::string("\x35\x00\x00\x00\x00", 5), 1, &json)
+                .code());
+  // An invalid tag.
+  EXPECT_EQ(absl::StatusCode::kInvalidArgument,
+            Print(Printer("Lists").get(), std::string("\x00\x01", 2), 1, &json)
+                .code());
+}
+
+TEST_F(IncrementalJsonPrinterTest, SameEscapingAsBinaryToJsonStream) {
+  // The characters escaped by protobuf's JSON writer: the control characters,
+  // '<' and '>', DEL, the C1 control characters, U+2028 and U+2029. '&' and
+  // the other non-ASCII characters are not.
+  EXPECT_TRUE(ExpectSameJsonAsBinaryToJsonStream("Scalars", R"(
+    string_value: "a<b>c&d\"\\/\001\t\n\177"
+  )"));
+  EXPECT_TRUE(ExpectSameJsonAsBinaryToJsonStream("Scalars", R"(
+    string_value: "\302\200\302\205\302\237\302\240 \342\200\250\342\200\251"
+  )"));
+  EXPECT_TRUE(ExpectSameJsonAsBinaryToJsonStream("Scalars", R"(
+    string_value: "\303\251 \342\202\254 \360\237\230\200 \342\200\247"
+  )"));
+  // So are the map keys.
+  EXPECT_TRUE(ExpectSameJsonAsBinaryToJsonStream("Maps", R"(
+    by_name { key: "<script>\342\200\250\302\205" value: 1 }
+  )"));
+  EXPECT_TRUE(ExpectSameJsonAsBinaryToJsonStream("Lists", R"(
+    strings: ["<", ">", "\177", "\342\200\251"]
+    messages { strings: "</script>" }
+  )"));
+}
+
+TEST_F(IncrementalJsonPrinterTest, SameJsonAsProtobuf) {
+  std::unique_ptr<pb::Message> message = Parse("Lists", R"(
+    packed: [1, 2, 3]
+    unpacked: [1e100, -0.25]
+    strings: ["é\t"]
+    messages {
+      scalars { int64_value: 1 double_value: 1.5 bytes_value: "\xff" }
+    }
+    colors: [DARK_BLUE]
+  )");
+  std::string expected;
+  ASSERT_TRUE(pbutil::MessageToJsonString(*message, &expected).ok());
+  std::string actual;
+  ASSERT_TRUE(
+      Print(Printer("Lists").get(), message->SerializeAsString(), 5, &actual)
+          .ok());
+  EXPECT_TRUE(ExpectJsonObjectEq(expected, actual));
+}
+
+}  // namespace
+}  // namespace testing
+}  // namespace transcoding
+
+}  // namespace grpc
+}  // namespace google
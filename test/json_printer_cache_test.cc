@@ -0,0 +1,129 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+#include "grpc_transcoding/json_printer_cache.h"
+
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "google/protobuf/util/json_util.h"
+#include "grpc_transcoding/type_helper.h"
+#include "gtest/gtest.h"
+#include "test_common.h"
+
+namespace google {
+namespace grpc {
+namespace transcoding {
+namespace testing {
+namespace {
+
+namespace pbutil = ::google::protobuf::util;
+
+class JsonPrinterCacheTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    ASSERT_TRUE(LoadService("bookstore_service.pb.txt", &service_));
+    type_helper_.reset(new TypeHelper(service_.types(), service_.enums()));
+  }
+
+  // The TypeHelper refers to the types of the service.
+  ::google::api::Service service_;
+  std::unique_ptr<TypeHelper> type_helper_;
+};
+
+TEST_F(JsonPrinterCacheTest, SharesPlans) {
+  JsonPrinterCache cache(type_helper_->Resolver());
+  auto plan =
+      cache.Get("type.googleapis.com/Shelf", pbutil::JsonPrintOptions());
+  ASSERT_NE(nullptr, plan);
+  EXPECT_EQ("\"name\":", plan->root().fields.at(1).key);
+  ASSERT_NE(nullptr, plan->root().fields.at(3).enum_type);
+  EXPECT_EQ("COMIC", plan->root().fields.at(3).enum_type->names.at(1));
+
+  EXPECT_EQ(plan,
+            cache.Get("type.googleapis.com/Shelf", pbutil::JsonPrintOptions()));
+  EXPECT_EQ(1, cache.size());
+
+  // The nested types are compiled with the root type.
+  auto list = cache.Get("type.googleapis.com/ListShelvesResponse",
+                        pbutil::JsonPrintOptions());
+  ASSERT_NE(nullptr, list);
+  const JsonPrinterPlan::Message* shelf = list->root().fields.at(1).message;
+  ASSERT_NE(nullptr, shelf);
+  EXPECT_EQ("\"theme\":", shelf->fields.at(2).key);
+  EXPECT_EQ(2, cache.size());
+}
+
+TEST_F(JsonPrinterCacheTest, KeyedOnOptions) {
+  JsonPrinterCache cache(type_helper_->Resolver());
+  pbutil::JsonPrintOptions options;
+  options.preserve_proto_field_names = true;
+  auto plan = cache.Get("type.googleapis.com/CreateShelfRequest",
+                        pbutil::JsonPrintOptions());
+  auto proto_names_plan =
+      cache.Get("type.googleapis.com/CreateShelfRequest", options);
+  ASSERT_NE(nullptr, plan);
+  ASSERT_NE(nullptr, proto_names_plan);
+  EXPECT_NE(plan, proto_names_plan);
+  EXPECT_TRUE(proto_names_plan->options().preserve_proto_field_names);
+  EXPECT_EQ(2, cache.size());
+}
+
+TEST_F(JsonPrinterCacheTest, CachesFailures) {
+  JsonPrinterCache cache(type_helper_->Resolver());
+  EXPECT_EQ(nullptr, cache.Get("type.googleapis.com/InvalidType",
+                               pbutil::JsonPrintOptions()));
+  // The well-known types and the fields with default values aren't supported.
+  EXPECT_EQ(nullptr, cache.Get("type.googleapis.com/google.protobuf.Struct",
+                               pbutil::JsonPrintOptions()));
+  pbutil::JsonPrintOptions options;
+  options.always_print_primitive_fields = true;
+  EXPECT_EQ(nullptr, cache.Get("type.googleapis.com/Shelf", options));
+  EXPECT_EQ(3, cache.size());
+  EXPECT_EQ(nullptr, cache.Get("type.googleapis.com/InvalidType",
+                               pbutil::JsonPrintOptions()));
+  EXPECT_EQ(3, cache.size());
+}
+
+TEST_F(JsonPrinterCacheTest, ConcurrentGet) {
+  JsonPrinterCache cache(type_helper_->Resolver());
+  std::vector<std::shared_ptr<const JsonPrinterPlan>> plans(8);
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < plans.size(); ++t) {
+    threads.emplace_back([&cache, &plans, t]() {
+      for (int i = 0; i < 100; ++i) {
+        plans[t] = cache.Get("type.googleapis.com/ListShelvesResponse",
+                             pbutil::JsonPrintOptions());
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  ASSERT_NE(nullptr, plans[0]);
+  for (const auto& plan : plans) {
+    EXPECT_EQ(plans[0], plan);
+  }
+  EXPECT_EQ(1, cache.size());
+}
+
+}  // namespace
+}  // namespace testing
+}  // namespace transcoding
+}  // namespace grpc
+}  // namespace google
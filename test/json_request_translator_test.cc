@@ -137,14 +137,22 @@ class TranslationTestCase {
   std::vector<ExpectedAt>::const_iterator next_expected_;
 };
 
-class JsonRequestTranslatorTest : public RequestTranslatorTestBase {
+// Runs each test with every JsonTokenizer implementation.
+class JsonRequestTranslatorTest
+    : public RequestTranslatorTestBase,
+      public ::testing::WithParamInterface<JsonTokenizer::Kind> {
  protected:
-  JsonRequestTranslatorTest() : streaming_(false) {}
+  JsonRequestTranslatorTest()
+      : streaming_(false), use_type_info_(false), tokenizer_(GetParam()) {}
 
   // Sets whether this is a streaming call or not. Use it before calling
   // Build(). Default is non-streaming
   void SetStreaming(bool streaming) { streaming_ = streaming; }
 
+  // Sets whether the translator is created on top of the shared TypeInfo
+  // instead of the TypeResolver. Use it before calling Build().
+  void SetUseTypeInfo(bool use_type_info) { use_type_info_ = use_type_info; }
+
   // Add an input chunk
   void AddChunk(const std::string& json) { input_->AddChunk(json); }
 
@@ -205,18 +213,26 @@ class JsonRequestTranslatorTest : public RequestTranslatorTestBase {
       google::protobuf::util::TypeResolver& type_resolver, bool delimiters,
       RequestInfo request_info) {
     input_.reset(new TestZeroCopyInputStream());
-    translator_.reset(new JsonRequestTranslator(&type_resolver, input_.get(),
-                                                std::move(request_info),
-                                                streaming_, delimiters));
+    if (use_type_info_) {
+      translator_.reset(new JsonRequestTranslator(
+          &Info(), input_.get(), std::move(request_info), streaming_,
+          delimiters, tokenizer_));
+    } else {
+      translator_.reset(new JsonRequestTranslator(
+          &type_resolver, input_.get(), std::move(request_info), streaming_,
+          delimiters, tokenizer_));
+    }
     return &translator_->Output();
   }
 
   bool streaming_;
+  bool use_type_info_;
+  JsonTokenizer::Kind tokenizer_;
   std::unique_ptr<TestZeroCopyInputStream> input_;
   std::unique_ptr<JsonRequestTranslator> translator_;
 };
 
-TEST_F(JsonRequestTranslatorTest, Simple) {
+TEST_P(JsonRequestTranslatorTest, Simple) {
   LoadService("bookstore_service.pb.txt");
   SetMessageType("Shelf");
   TranslationTestCase tc(false);
@@ -231,7 +247,7 @@ TEST_F(JsonRequestTranslatorTest, Simple) {
   EXPECT_TRUE((RunTest<Shelf>(5, 0.4, &tc)));
 }
 
-TEST_F(JsonRequestTranslatorTest, Nested) {
+TEST_P(JsonRequestTranslatorTest, Nested) {
   LoadService("bookstore_service.pb.txt");
   SetMessageType("Book");
   TranslationTestCase tc(false);
@@ -271,7 +287,7 @@ TEST_F(JsonRequestTranslatorTest, Nested) {
   EXPECT_TRUE((RunTest<Book>(3, 0.05, &tc)));
 }
 
-TEST_F(JsonRequestTranslatorTest, Prefix) {
+TEST_P(JsonRequestTranslatorTest, Prefix) {
   LoadService("bookstore_service.pb.txt");
   SetMessageType("CreateBookRequest");
   SetBodyPrefix("book");
@@ -296,7 +312,7 @@ TEST_F(JsonRequestTranslatorTest, Prefix) {
   EXPECT_TRUE((RunTest<CreateBookRequest>(3, 0.1, &tc)));
 }
 
-TEST_F(JsonRequestTranslatorTest, Bindings) {
+TEST_P(JsonRequestTranslatorTest, Bindings) {
   LoadService("bookstore_service.pb.txt");
   SetMessageType("CreateBookRequest");
   SetBodyPrefix("book");
@@ -327,7 +343,80 @@ TEST_F(JsonRequestTranslatorTest, Bindings) {
   EXPECT_TRUE((RunTest<CreateBookRequest>(3, 0.1, &tc)));
 }
 
-TEST_F(JsonRequestTranslatorTest, MorePrefixAndBindings) {
+TEST_P(JsonRequestTranslatorTest, SharedTypeInfo) {
+  LoadService("bookstore_service.pb.txt");
+  SetMessageType("CreateBookRequest");
+  SetBodyPrefix("book");
+  AddVariableBinding("book.authorInfo.firstName", "Leo");
+  SetUseTypeInfo(true);
+  TranslationTestCase tc(false);
+  tc.AddMessage(
+      R"({
+          "name" : "11",
+          "title" : "Anna Karenina",
+          "authorInfo" : { "lastName" : "Tolstoy" }
+        })",
+      R"(
+          book {
+            name : "11"
+            title : "Anna Karenina"
+            author_info : {
+              first_name : "Leo"
+              last_name : "Tolstoy"
+            }
+          }
+        )");
+  tc.Build();
+
+  EXPECT_TRUE((RunTest<CreateBookRequest>(1, 1.0, &tc)));
+  EXPECT_TRUE((RunTest<CreateBookRequest>(2, 1.0, &tc)));
+}
+
+TEST_P(JsonRequestTranslatorTest, StreamingSharedTypeInfo) {
+  LoadService("bookstore_service.pb.txt");
+  SetMessageType("Shelf");
+  SetUseTypeInfo(true);
+  TranslationTestCase tc(/*streaming*/ true);
+  tc.AddMessage(R"({ "name" : "1", "theme" : "Russian" })",
+                R"(name : "1" theme : "Russian")");
+  tc.AddMessage(R"({ "name" : "2", "theme" : "History" })",
+                R"(name : "2" theme : "History")");
+  tc.Build();
+
+  EXPECT_TRUE((RunTest<Shelf>(1, 1.0, &tc)));
+  EXPECT_TRUE((RunTest<Shelf>(2, 1.0, &tc)));
+}
+
+TEST_P(JsonRequestTranslatorTest, EscapedStrings) {
+  LoadService("bookstore_service.pb.txt");
+  SetMessageType("CreateBookRequest");
+  SetBodyPrefix("book");
+  AddVariableBinding("book.authorInfo.firstName", "Leo");
+  TranslationTestCase tc(false);
+  tc.AddMessage(
+      R"({
+          "name" : "11",
+          "title" : "Anna Karenina \u2014 \"Part \u0031\"",
+          "authorInfo" : { 'lastName' : "Tolstoy" }
+        })",
+      R"(
+          book {
+            name : "11"
+            title : "Anna Karenina \342\200\224 \"Part 1\""
+            author_info : {
+              first_name : "Leo"
+              last_name : "Tolstoy"
+            }
+          }
+        )");
+  tc.Build();
+
+  EXPECT_TRUE((RunTest<CreateBookRequest>(1, 1.0, &tc)));
+  EXPECT_TRUE((RunTest<CreateBookRequest>(2, 1.0, &tc)));
+  EXPECT_TRUE((RunTest<CreateBookRequest>(3, 0.1, &tc)));
+}
+
+TEST_P(JsonRequestTranslatorTest, MorePrefixAndBindings) {
   LoadService("bookstore_service.pb.txt");
   SetMessageType("CreateBookRequest");
   SetBodyPrefix("book.authorInfo.bio");
@@ -366,7 +455,7 @@ TEST_F(JsonRequestTranslatorTest, MorePrefixAndBindings) {
   EXPECT_TRUE((RunTest<CreateBookRequest>(3, 0.1, &tc)));
 }
 
-TEST_F(JsonRequestTranslatorTest, OnlyBindings) {
+TEST_P(JsonRequestTranslatorTest, OnlyBindings) {
   LoadService("bookstore_service.pb.txt");
   SetMessageType("Shelf");
   AddVariableBinding("name", "1");
@@ -378,7 +467,7 @@ TEST_F(JsonRequestTranslatorTest, OnlyBindings) {
   EXPECT_TRUE((RunTest<Shelf>(1, 1.0, &tc)));
 }
 
-TEST_F(JsonRequestTranslatorTest, ScalarBody) {
+TEST_P(JsonRequestTranslatorTest, ScalarBody) {
   LoadService("bookstore_service.pb.txt");
   SetMessageType("Shelf");
   SetBodyPrefix("theme");
@@ -391,7 +480,7 @@ TEST_F(JsonRequestTranslatorTest, ScalarBody) {
   EXPECT_TRUE((RunTest<Shelf>(3, 0.1, &tc)));
 }
 
-TEST_F(JsonRequestTranslatorTest, StructValueFlat) {
+TEST_P(JsonRequestTranslatorTest, StructValueFlat) {
   LoadService("bookstore_service.pb.txt");
   SetMessageType("google.protobuf.Struct");
   TranslationTestCase tc(false);
@@ -409,7 +498,7 @@ TEST_F(JsonRequestTranslatorTest, StructValueFlat) {
   EXPECT_TRUE((RunTest<::google::protobuf::Struct>(3, 0.1, &tc)));
 }
 
-TEST_F(JsonRequestTranslatorTest, StructValueNested) {
+TEST_P(JsonRequestTranslatorTest, StructValueNested) {
   LoadService("bookstore_service.pb.txt");
   SetMessageType("google.protobuf.Struct");
   TranslationTestCase tc(false);
@@ -434,7 +523,7 @@ TEST_F(JsonRequestTranslatorTest, StructValueNested) {
   EXPECT_TRUE((RunTest<::google::protobuf::Struct>(3, 0.1, &tc)));
 }
 
-TEST_F(JsonRequestTranslatorTest, Empty) {
+TEST_P(JsonRequestTranslatorTest, Empty) {
   LoadService("bookstore_service.pb.txt");
   SetMessageType("Shelf");
   Build();
@@ -444,7 +533,7 @@ TEST_F(JsonRequestTranslatorTest, Empty) {
   EXPECT_TRUE(Tester().ExpectFinishedEq(true));
 }
 
-TEST_F(JsonRequestTranslatorTest, Large) {
+TEST_P(JsonRequestTranslatorTest, Large) {
   LoadService("bookstore_service.pb.txt");
   SetMessageType("Shelf");
 
@@ -462,7 +551,7 @@ TEST_F(JsonRequestTranslatorTest, Large) {
   }
 }
 
-TEST_F(JsonRequestTranslatorTest, OneByteChunks) {
+TEST_P(JsonRequestTranslatorTest, OneByteChunks) {
   LoadService("bookstore_service.pb.txt");
   SetMessageType("Shelf");
   Build();
@@ -481,7 +570,7 @@ TEST_F(JsonRequestTranslatorTest, OneByteChunks) {
   EXPECT_TRUE(Tester().ExpectFinishedEq(true));
 }
 
-TEST_F(JsonRequestTranslatorTest, UnknownsIgnored) {
+TEST_P(JsonRequestTranslatorTest, UnknownsIgnored) {
   LoadService("bookstore_service.pb.txt");
   SetMessageType("Shelf");
   TranslationTestCase tc(false);
@@ -502,7 +591,7 @@ TEST_F(JsonRequestTranslatorTest, UnknownsIgnored) {
   EXPECT_TRUE((RunTest<Shelf>(2, 1.0, &tc)));
 }
 
-TEST_F(JsonRequestTranslatorTest, ErrorInvalidJson) {
+TEST_P(JsonRequestTranslatorTest, ErrorInvalidJson) {
   LoadService("bookstore_service.pb.txt");
   SetMessageType("Shelf");
 
@@ -533,7 +622,7 @@ TEST_F(JsonRequestTranslatorTest, ErrorInvalidJson) {
   }
 }
 
-TEST_F(JsonRequestTranslatorTest, WrongBindingType) {
+TEST_P(JsonRequestTranslatorTest, WrongBindingType) {
   LoadService("bookstore_service.pb.txt");
   SetMessageType("GetShelfRequest");
   // "shelf" field type should be integer, but set as string
@@ -546,7 +635,7 @@ TEST_F(JsonRequestTranslatorTest, WrongBindingType) {
       absl::StatusCode::kInvalidArgument));
 }
 
-TEST_F(JsonRequestTranslatorTest, StreamingSimple) {
+TEST_P(JsonRequestTranslatorTest, StreamingSimple) {
   LoadService("bookstore_service.pb.txt");
   SetMessageType("Shelf");
   TranslationTestCase tc(/*streaming*/ true);
@@ -564,7 +653,7 @@ TEST_F(JsonRequestTranslatorTest, StreamingSimple) {
   EXPECT_TRUE((RunTest<Shelf>(4, 0.1, &tc)));
 }
 
-TEST_F(JsonRequestTranslatorTest, StreamingNested) {
+TEST_P(JsonRequestTranslatorTest, StreamingNested) {
   LoadService("bookstore_service.pb.txt");
   SetMessageType("Book");
   TranslationTestCase tc(/*streaming*/ true);
@@ -631,7 +720,7 @@ TEST_F(JsonRequestTranslatorTest, StreamingNested) {
   EXPECT_TRUE((RunTest<Book>(2, 1.0, &tc)));
 }
 
-TEST_F(JsonRequestTranslatorTest, StreamingPrefixAndBindings) {
+TEST_P(JsonRequestTranslatorTest, StreamingPrefixAndBindings) {
   LoadService("bookstore_service.pb.txt");
   SetMessageType("CreateBookRequest");
   SetBodyPrefix("book.authorInfo");
@@ -689,7 +778,7 @@ TEST_F(JsonRequestTranslatorTest, StreamingPrefixAndBindings) {
   EXPECT_TRUE((RunTest<CreateBookRequest>(2, 1.0, &tc)));
 }
 
-TEST_F(JsonRequestTranslatorTest, Streaming1KMessages) {
+TEST_P(JsonRequestTranslatorTest, Streaming1KMessages) {
   LoadService("bookstore_service.pb.txt");
   SetMessageType("Shelf");
   TranslationTestCase tc(/*streaming*/ true);
@@ -705,7 +794,7 @@ TEST_F(JsonRequestTranslatorTest, Streaming1KMessages) {
   EXPECT_TRUE((RunTest<Shelf>(1, 1.0, &tc)));
 }
 
-TEST_F(JsonRequestTranslatorTest, StreamingScalars) {
+TEST_P(JsonRequestTranslatorTest, StreamingScalars) {
   LoadService("bookstore_service.pb.txt");
   SetMessageType("Shelf");
   SetBodyPrefix("theme");
@@ -720,7 +809,7 @@ TEST_F(JsonRequestTranslatorTest, StreamingScalars) {
   EXPECT_TRUE((RunTest<Shelf>(2, 1.0, &tc)));
 }
 
-TEST_F(JsonRequestTranslatorTest, StreamingArrays) {
+TEST_P(JsonRequestTranslatorTest, StreamingArrays) {
   LoadService("bookstore_service.pb.txt");
   SetMessageType("ListShelvesResponse");
   // "shelves" is a repeated field in "ListShelvesResponse"
@@ -763,7 +852,7 @@ TEST_F(JsonRequestTranslatorTest, StreamingArrays) {
   EXPECT_TRUE((RunTest<ListShelvesResponse>(2, 1.0, &tc)));
 }
 
-TEST_F(JsonRequestTranslatorTest, StreamingEmptyStream) {
+TEST_P(JsonRequestTranslatorTest, StreamingEmptyStream) {
   LoadService("bookstore_service.pb.txt");
   SetMessageType("Shelf");
   TranslationTestCase tc(/*streaming*/ true);
@@ -771,7 +860,7 @@ TEST_F(JsonRequestTranslatorTest, StreamingEmptyStream) {
   EXPECT_TRUE((RunTest<Shelf>(1, 1.0, &tc)));
 }
 
-TEST_F(JsonRequestTranslatorTest, StreamingEmptyMessages) {
+TEST_P(JsonRequestTranslatorTest, StreamingEmptyMessages) {
   LoadService("bookstore_service.pb.txt");
   SetMessageType("Shelf");
   TranslationTestCase tc(/*streaming*/ true);
@@ -782,7 +871,7 @@ TEST_F(JsonRequestTranslatorTest, StreamingEmptyMessages) {
   EXPECT_TRUE((RunTest<Shelf>(1, 1.0, &tc)));
 }
 
-TEST_F(JsonRequestTranslatorTest, StreamingErrorNotAnArray) {
+TEST_P(JsonRequestTranslatorTest, StreamingErrorNotAnArray) {
   LoadService("bookstore_service.pb.txt");
   SetMessageType("Shelf");
   SetStreaming(true);
@@ -794,6 +883,13 @@ TEST_F(JsonRequestTranslatorTest, StreamingErrorNotAnArray) {
       absl::StatusCode::kInvalidArgument));
 }
 
+INSTANTIATE_TEST_SUITE_P(
+    Tokenizers, JsonRequestTranslatorTest,
+    ::testing::Values(JsonTokenizer::kProtobuf, JsonTokenizer::kVectorized),
+    [](const ::testing::TestParamInfo<JsonTokenizer::Kind>& info) {
+      return info.param == JsonTokenizer::kProtobuf ? "Protobuf" : "Vectorized";
+    });
+
 }  // namespace
 }  // namespace testing
 }  // namespace transcoding
@@ -0,0 +1,406 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+#include "grpc_transcoding/json_tokenizer.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_format.h"
+#include "absl/strings/string_view.h"
+#include "google/protobuf/util/converter/object_writer.h"
+#include "grpc_transcoding/json_scanner.h"
+#include "gtest/gtest.h"
+
+namespace google {
+namespace grpc {
+
+namespace transcoding {
+namespace testing {
+namespace {
+
+namespace pbconv = ::google::protobuf::util::converter;
+
+// An ObjectWriter that records the events as text, one per line, e.g.
+// "StartObject(name)" or "String(name)=value".
+class RecordingObjectWriter : public pbconv::ObjectWriter {
+ public:
+  const std::string& events() const { return events_; }
+
+  RecordingObjectWriter* StartObject(absl::string_view name) override {
+    return Record(absl::StrCat("StartObject(", name, ")"));
+  }
+  RecordingObjectWriter* EndObject() override { return Record("EndObject"); }
+  RecordingObjectWriter* StartList(absl::string_view name) override {
+    return Record(absl::StrCat("StartList(", name, ")"));
+  }
+  RecordingObjectWriter* EndList() override { return Record("EndList"); }
+  RecordingObjectWriter* RenderBool(absl::string_view name,
+                                    bool value) override {
+    return Render("Bool", name, value ? "true" : "false");
+  }
+  RecordingObjectWriter* RenderInt32(absl::string_view name,
+                                     int32_t value) override {
+    return Render("Int32", name, absl::StrCat(value));
+  }
+  RecordingObjectWriter* RenderUint32(absl::string_view name,
+                                      uint32_t value) override {
+    return Render("Uint32", name, absl::StrCat(value));
+  }
+  RecordingObjectWriter* RenderInt64(absl::string_view name,
+                                     int64_t value) override {
+    return Render("Int64", name, absl::StrCat(value));
+  }
+  RecordingObjectWriter* RenderUint64(absl::string_view name,
+                                      uint64_t value) override {
+    return Render("Uint64", name, absl::StrCat(value));
+  }
+  RecordingObjectWriter* RenderDouble(absl::string_view name,
+                                      double value) override {
+    return Render("Double", name, absl::StrFormat("%.17g", value));
+  }
+  RecordingObjectWriter* RenderFloat(absl::string_view name,
+                                     float value) override {
+    return Render("Float", name, absl::StrFormat("%.9g", value));
+  }
+  RecordingObjectWriter* RenderString(absl::string_view name,
+                                      absl::string_view value) override {
+    return Render("String", name, value);
+  }
+  RecordingObjectWriter* RenderBytes(absl::string_view name,
+                                     absl::string_view value) override {
+    return Render("Bytes", name, value);
+  }
+  RecordingObjectWriter* RenderNull(absl::string_view name) override {
+    return Record(absl::StrCat("Null(", name, ")"));
+  }
+
+ private:
+  RecordingObjectWriter* Render(absl::string_view type, absl::string_view name,
+                                absl::string_view value) {
+    return Record(absl::StrCat(type, "(", name, ")=", value));
+  }
+
+  RecordingObjectWriter* Record(absl::string_view event) {
+    absl::StrAppend(&events_, event, "\n");
+    return this;
+  }
+
+  std::string events_;
+};
+
+class JsonTokenizerTest : public ::testing::Test {
+ protected:
+  JsonTokenizerTest() : kind_(JsonTokenizer::kVectorized) {}
+
+  // Parses the chunks and finishes. Returns the events, followed by the
+  // error message if parsing fails.
+  std::string Tokenize(const std::vector<absl::string_view>& chunks) {
+    RecordingObjectWriter writer;
+    auto tokenizer = JsonTokenizer::Create(kind_, &writer);
+    absl::Status status;
+    for (absl::string_view chunk : chunks) {
+      status = tokenizer->Parse(chunk);
+      if (!status.ok()) {
+        break;
+      }
+    }
+    if (status.ok()) {
+      status = tokenizer->FinishParse();
+    }
+    if (!status.ok()) {
+      EXPECT_EQ(absl::StatusCode::kInvalidArgument, status.code());
+      return absl::StrCat(writer.events(), "ERROR");
+    }
+    return writer.events();
+  }
+
+  std::string Tokenize(absl::string_view json) {
+    return Tokenize(std::vector<absl::string_view>{json});
+  }
+
+  // Tokenizes json split at each position, in two and in three chunks, and
+  // expects the same result as when it's not split.
+  void ExpectSameForAllSplits(absl::string_view json) {
+    std::string expected = Tokenize(json);
+    for (size_t i = 0; i <= json.size(); ++i) {
+      EXPECT_EQ(expected, Tokenize({json.substr(0, i), json.substr(i)}))
+          << "split at " << i << " of " << json;
+      for (size_t j = i; j <= json.size(); ++j) {
+        ASSERT_EQ(expected, Tokenize({json.substr(0, i),
+                                      json.substr(i, j - i), json.substr(j)}))
+            << "split at " << i << " and " << j << " of " << json;
+      }
+    }
+  }
+
+  JsonTokenizer::Kind kind_;
+};
+
+TEST_F(JsonTokenizerTest, Objects) {
+  EXPECT_EQ(
+      "StartObject()\n"
+      "String(a)=x\n"
+      "StartObject(b)\n"
+      "Bool(c)=true\n"
+      "Bool(d)=false\n"
+      "Null(e)\n"
+      "EndObject\n"
+      "StartObject(f)\n"
+      "EndObject\n"
+      "EndObject\n",
+      Tokenize(R"( { "a" : "x", "b": {"c":true, "d":false,"e":null},
+                     "f": {} } )"));
+}
+
+TEST_F(JsonTokenizerTest, Lists) {
+  EXPECT_EQ(
+      "StartList()\n"
+      "Uint64()=1\n"
+      "StartList()\n"
+      "EndList\n"
+      "StartObject()\n"
+      "StartList(a)\n"
+      "String()=x\n"
+      "Null()\n"
+      "EndList\n"
+      "EndObject\n"
+      "EndList\n",
+      Tokenize(R"([1, [], {"a": ["x", null]}])"));
+}
+
+TEST_F(JsonTokenizerTest, Scalars) {
+  EXPECT_EQ("String()=abc\n", Tokenize(R"("abc")"));
+  EXPECT_EQ("Uint64()=42\n", Tokenize("42"));
+  EXPECT_EQ("Bool()=true\n", Tokenize(" true "));
+  EXPECT_EQ("Null()\n", Tokenize("null"));
+}
+
+TEST_F(JsonTokenizerTest, Numbers) {
+  EXPECT_EQ(
+      "StartList()\n"
+      "Uint64()=0\n"
+      "Int64()=-5\n"
+      "Uint64()=18446744073709551615\n"
+      "Int64()=-9223372036854775808\n"
+      "Double()=1.8446744073709552e+19\n"
+      "Double()=-9.2233720368547758e+18\n"
+      "Double()=1.5\n"
+      "Double()=-0.25\n"
+      "Double()=1000\n"
+      "Double()=0.01\n"
+      "EndList\n",
+      Tokenize("[0, -5, 18446744073709551615, -9223372036854775808, "
+               "18446744073709551616, -9223372036854775809, 1.5, -0.25, "
+               "1e3, 1E-2]"));
+}
+
+TEST_F(JsonTokenizerTest, Strings) {
+  EXPECT_EQ(
+      "StartObject()\n"
+      "String(single)=quoted\n"
+      "String(unquoted)=key\n"
+      "String(_$1)=\n"
+      "String(utf8)=\xD0\x9F\xD1\x80\xD0\xB8\xE2\x82\xAC\xF0\x9F\x98\x80\n"
+      "EndObject\n",
+      Tokenize("{'single': 'quoted', unquoted: \"key\", _$1: \"\", "
+               "\"utf8\": \"\xD0\x9F\xD1\x80\xD0\xB8\xE2\x82\xAC"
+               "\xF0\x9F\x98\x80\"}"));
+}
+
+TEST_F(JsonTokenizerTest, Escapes) {
+  EXPECT_EQ(
+      "StartObject()\n"
+      "String(a\"b)=\"\\/\b\f\n\r\t'\n"
+      "String(u)=A\xC3\xA9\xE2\x82\xAC\xF0\x9F\x98\x80\n"
+      "EndObject\n",
+      Tokenize(R"({"a\"b": "\"\\\/\b\f\n\r\t\'",)"
+               R"( "u": "\u0041\u00e9\u20AC\ud83d\ude00"})"));
+}
+
+TEST_F(JsonTokenizerTest, LongStrings) {
+  // Long enough for the vectorized scans, with the special characters at
+  // different offsets.
+  std::string value(100, 'x');
+  for (size_t i = 0; i < value.size(); i += 7) {
+    std::string escaped = value;
+    escaped.replace(i, 1, "\\\"");
+    std::string expected = value;
+    expected[i] = '"';
+    EXPECT_EQ(absl::StrCat("String()=", expected, "\n"),
+              Tokenize(absl::StrCat("\"", escaped, "\"")));
+    EXPECT_EQ(absl::StrCat("String()=", value, "\n"),
+              Tokenize(absl::StrCat(std::string(i, ' '), "\"", value, "\"",
+                                    std::string(i, '\n'))));
+  }
+}
+
+TEST_F(JsonTokenizerTest, Chunks) {
+  ExpectSameForAllSplits(
+      R"({"name": "x\"y", 'n': [-12, 3.5e2, true, null], k: {}})");
+  ExpectSameForAllSplits("\"\\u00e9\\ud83d\\ude00\xE2\x82\xAC\"");
+  ExpectSameForAllSplits("[1, 23, 456]");
+  // The split errors are reported as well.
+  ExpectSameForAllSplits(R"({"a": [1, 2}})");
+  ExpectSameForAllSplits(R"({"a": tru})");
+}
+
+TEST_F(JsonTokenizerTest, LongStringInManyChunks) {
+  std::string value(10000, 'x');
+  std::string json = absl::StrCat("[\"", value, "\"]");
+  std::vector<absl::string_view> chunks;
+  for (size_t i = 0; i < json.size(); i += 3) {
+    chunks.push_back(absl::string_view(json).substr(i, 3));
+  }
+  EXPECT_EQ(absl::StrCat("StartList()\nString()=", value, "\nEndList\n"),
+            Tokenize(chunks));
+}
+
+TEST_F(JsonTokenizerTest, Errors) {
+  for (absl::string_view json :
+       {"", "  ", "{", "[1, 2", "{\"a\" 1}", "{\"a\": 1 \"b\": 2}",
+        "[1 2]", "{\"a\":}", "{1: 2}", "[1,]", "{} {}", "[] x", "01",
+        "-01", "1e", "1e400", "-", "tru", "nul", "truth", "\"abc",
+        "\"\\x\"", "\"\\u12\"", "\"\\ud83d\"", "\"\\ude00\"",
+        "\"\\ud83d\\u0041\"", "\"\xFF\"", "\"\xC0\xAF\"", "\"\xED\xA0\x80\"",
+        "\"\xE2\x82\"", "{\"a\": [}", "[}"}) {
+    std::string events = Tokenize(json);
+    EXPECT_EQ("ERROR", events.substr(events.rfind('\n') + 1)) << json;
+  }
+}
+
+TEST_F(JsonTokenizerTest, ErrorMessages) {
+  RecordingObjectWriter writer;
+  auto tokenizer = JsonTokenizer::Create(kind_, &writer);
+  absl::Status status = tokenizer->Parse("[1, 2 3]");
+  EXPECT_EQ(absl::StatusCode::kInvalidArgument, status.code());
+  EXPECT_EQ("Expected , or ] after array value.\n[1, 2 3]\n      ^",
+            status.message());
+  // The tokenizer stays failed.
+  EXPECT_EQ(status, tokenizer->Parse("]"));
+  EXPECT_EQ(status, tokenizer->FinishParse());
+
+  tokenizer = JsonTokenizer::Create(kind_, &writer);
+  EXPECT_TRUE(tokenizer->Parse("{\"a\": [").ok());
+  status = tokenizer->FinishParse();
+  EXPECT_EQ(absl::StatusCode::kInvalidArgument, status.code());
+  EXPECT_EQ("Unexpected end of string.\n\n^", status.message());
+}
+
+TEST_F(JsonTokenizerTest, MaxDepth) {
+  std::string json = absl::StrCat(std::string(100, '['), std::string(100, ']'));
+  std::string events = Tokenize(json);
+  EXPECT_EQ(std::string::npos, events.find("ERROR"));
+  json = absl::StrCat(std::string(101, '['), std::string(101, ']'));
+  events = Tokenize(json);
+  EXPECT_NE(std::string::npos, events.find("ERROR"));
+}
+
+TEST_F(JsonTokenizerTest, SameAsJsonStreamParser) {
+  for (absl::string_view json :
+       {R"({"a": "x", "b": {"c": [1, -2, 3.5, true, null]}, 'd': "\u00e9"})",
+        R"({unquoted: 'single', "e": "\"\\\/\b\f\n\r\t"})",
+        "[0, -0, 18446744073709551616, -9223372036854775809, 1e3, 1E-2]",
+        "\"\xD0\x9F\xF0\x9F\x98\x80\"", "[]", "{}", "[1, 2", "[1 2]",
+        "{} {}", "01", "tru", "\"\xFF\""}) {
+    kind_ = JsonTokenizer::kProtobuf;
+    std::string expected = Tokenize(json);
+    kind_ = JsonTokenizer::kVectorized;
+    EXPECT_EQ(expected, Tokenize(json)) << json;
+  }
+}
+
+class JsonScannerTest : public ::testing::Test {
+ protected:
+  // Expects each supported implementation to return the same result as the
+  // scalar one for all the substrings of input.
+  void ExpectSameAsScalar(const std::string& input) {
+    const JsonScanner& scalar = JsonScanner::ForIsa(JsonScanner::kScalar);
+    for (JsonScanner::Isa isa : {JsonScanner::kSse2, JsonScanner::kAvx2}) {
+      if (!JsonScanner::IsSupported(isa)) {
+        continue;
+      }
+      const JsonScanner& scanner = JsonScanner::ForIsa(isa);
+      EXPECT_EQ(isa, scanner.isa());
+      const char* data = input.data();
+      for (size_t begin = 0; begin <= input.size(); ++begin) {
+        const char* end = data + input.size();
+        for (char quote : {'"', '\''}) {
+          bool expected_non_ascii = false;
+          const char* expected = scalar.FindStringSpecial(
+              data + begin, end, quote, &expected_non_ascii);
+          bool non_ascii = false;
+          EXPECT_EQ(expected, scanner.FindStringSpecial(data + begin, end,
+                                                        quote, &non_ascii))
+              << "isa " << isa << " begin " << begin;
+          EXPECT_EQ(expected_non_ascii, non_ascii)
+              << "isa " << isa << " begin " << begin;
+        }
+        EXPECT_EQ(scalar.SkipWhitespace(data + begin, end),
+                  scanner.SkipWhitespace(data + begin, end))
+            << "isa " << isa << " begin " << begin;
+      }
+    }
+  }
+};
+
+TEST_F(JsonScannerTest, Get) {
+  EXPECT_TRUE(JsonScanner::IsSupported(JsonScanner::Get().isa()));
+  EXPECT_TRUE(JsonScanner::IsSupported(JsonScanner::kScalar));
+}
+
+TEST_F(JsonScannerTest, FindStringSpecial) {
+  const JsonScanner& scanner = JsonScanner::Get();
+  std::string input = "0123456789abcdefghijklmnopqrstuvwxyz0123456789\"";
+  bool non_ascii = false;
+  const char* end = input.data() + input.size();
+  EXPECT_EQ(end - 1,
+            scanner.FindStringSpecial(input.data(), end, '"', &non_ascii));
+  EXPECT_FALSE(non_ascii);
+  EXPECT_EQ(end, scanner.FindStringSpecial(input.data(), end, '\'',
+                                           &non_ascii));
+  EXPECT_FALSE(non_ascii);
+}
+
+TEST_F(JsonScannerTest, SameAsScalar) {
+  std::string input(80, 'a');
+  ExpectSameAsScalar(input);
+  for (char special : {'"', '\'', '\\', '\x80', '\xFF'}) {
+    for (size_t i = 0; i < input.size(); i += 5) {
+      std::string with_special = input;
+      with_special[i] = special;
+      with_special[input.size() - 1 - i / 2] = '\xC3';
+      ExpectSameAsScalar(with_special);
+    }
+  }
+  std::string whitespace(80, ' ');
+  ExpectSameAsScalar(whitespace);
+  for (size_t i = 0; i < whitespace.size(); i += 3) {
+    std::string with_other = whitespace;
+    with_other[i % 4 == 0 ? i : whitespace.size() - 1 - i] = 'x';
+    with_other[(i * 7) % whitespace.size()] = "\t\r\n"[i % 3];
+    ExpectSameAsScalar(with_other);
+  }
+}
+
+}  // namespace
+}  // namespace testing
+}  // namespace transcoding
+
+}  // namespace grpc
+}  // namespace google
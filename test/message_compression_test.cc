@@ -0,0 +1,199 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+#include "grpc_transcoding/message_compression.h"
+
+#include <memory>
+#include <string>
+
+#include "google/protobuf/io/zero_copy_stream_impl_lite.h"
+#include "gtest/gtest.h"
+#include "test_common.h"
+
+namespace google {
+namespace grpc {
+
+namespace transcoding {
+namespace testing {
+namespace {
+
+namespace pbio = ::google::protobuf::io;
+
+std::string Compress(absl::string_view encoding, const std::string& message) {
+  std::string compressed;
+  EXPECT_TRUE(
+      CreateMessageCompressor(encoding)->Compress(message, &compressed).ok());
+  return compressed;
+}
+
+// Decompresses compressed read in chunks of chunk_size bytes.
+std::string Decompress(
+    absl::string_view encoding, const std::string& compressed, int chunk_size,
+    absl::Status* status,
+    int64_t max_size = kDefaultMaxDecompressedMessageSize) {
+  auto stream = CreateMessageDecompressor(encoding, max_size)->Decompress(
+      std::unique_ptr<pbio::ZeroCopyInputStream>(new pbio::ArrayInputStream(
+          compressed.data(), compressed.size(), chunk_size)),
+      status);
+  std::string message;
+  const void* data = nullptr;
+  int size = 0;
+  while (stream->Next(&data, &size)) {
+    message.append(static_cast<const char*>(data), size);
+  }
+  EXPECT_EQ(static_cast<int64_t>(message.size()), stream->ByteCount());
+  return message;
+}
+
+TEST(MessageCompressionTest, RoundTrip) {
+  for (const char* encoding : {"gzip", "deflate"}) {
+    for (size_t size : {0, 1, 100, 100000}) {
+      std::string message = GenerateInput("abcdefghijklmn", size);
+      std::string compressed = Compress(encoding, message);
+      for (int chunk_size : {1, 7, 1000}) {
+        absl::Status status;
+        EXPECT_EQ(message,
+                  Decompress(encoding, compressed, chunk_size, &status))
+            << encoding << " " << size << " " << chunk_size;
+        EXPECT_TRUE(status.ok()) << status;
+      }
+    }
+  }
+}
+
+TEST(MessageCompressionTest, Compresses) {
+  std::string message(10000, 'a');
+  EXPECT_LT(Compress("gzip", message).size(), 100);
+  EXPECT_LT(Compress("deflate", message).size(), 100);
+  // Check the gzip magic and the zlib header.
+  EXPECT_EQ("\x1f\x8b", Compress("gzip", message).substr(0, 2));
+  EXPECT_EQ('\x78', Compress("deflate", message)[0]);
+}
+
+TEST(MessageCompressionTest, UnsupportedEncoding) {
+  EXPECT_EQ(nullptr, CreateMessageCompressor("snappy"));
+  EXPECT_EQ(nullptr, CreateMessageDecompressor("snappy"));
+  EXPECT_EQ(nullptr, CreateMessageDecompressor("identity"));
+}
+
+TEST(MessageCompressionTest, BackUpAndSkip) {
+  std::string message = GenerateInput("abcdefghijklmn", 100000);
+  std::string compressed = Compress("gzip", message);
+  absl::Status status;
+  auto stream = CreateMessageDecompressor("gzip")->Decompress(
+      std::unique_ptr<pbio::ZeroCopyInputStream>(
+          new pbio::ArrayInputStream(compressed.data(), compressed.size())),
+      &status);
+
+  const void* data = nullptr;
+  int size = 0;
+  ASSERT_TRUE(stream->Next(&data, &size));
+  ASSERT_GT(size, 10);
+  EXPECT_EQ(message.substr(0, size),
+            std::string(static_cast<const char*>(data), size));
+  stream->BackUp(10);
+  EXPECT_EQ(size - 10, stream->ByteCount());
+  ASSERT_TRUE(stream->Next(&data, &size));
+  EXPECT_EQ(10, size);
+  EXPECT_EQ(message.substr(stream->ByteCount() - 10, 10),
+            std::string(static_cast<const char*>(data), size));
+
+  ASSERT_TRUE(stream->Skip(50000));
+  ASSERT_TRUE(stream->Next(&data, &size));
+  EXPECT_EQ(message.substr(stream->ByteCount() - size, size),
+            std::string(static_cast<const char*>(data), size));
+  EXPECT_FALSE(stream->Skip(100000));
+  EXPECT_EQ(static_cast<int64_t>(message.size()), stream->ByteCount());
+  EXPECT_TRUE(status.ok());
+}
+
+TEST(MessageCompressionTest, SkipsTheRestOnDestruction) {
+  std::string compressed = Compress("gzip", std::string(100000, 'a'));
+  pbio::ArrayInputStream input(compressed.data(), compressed.size(), 10);
+  absl::Status status;
+  {
+    auto stream = CreateMessageDecompressor("gzip")->Decompress(
+        std::unique_ptr<pbio::ZeroCopyInputStream>(
+            new pbio::LimitingInputStream(&input, compressed.size())),
+        &status);
+    const void* data = nullptr;
+    int size = 0;
+    ASSERT_TRUE(stream->Next(&data, &size));
+  }
+  EXPECT_EQ(static_cast<int64_t>(compressed.size()), input.ByteCount());
+  EXPECT_TRUE(status.ok());
+}
+
+TEST(MessageCompressionTest, Truncated) {
+  std::string message = GenerateInput("abcdefghijklmn", 1000);
+  std::string compressed = Compress("deflate", message);
+  absl::Status status;
+  std::string decompressed = Decompress(
+      "deflate", compressed.substr(0, compressed.size() - 1), 10, &status);
+  EXPECT_FALSE(status.ok());
+  EXPECT_EQ("Invalid compressed gRPC message", status.message());
+}
+
+TEST(MessageCompressionTest, TooLarge) {
+  // 64 MiB that compress to about 64 KiB.
+  const std::string message(64 * 1024 * 1024, 'a');
+  for (const char* encoding : {"gzip", "deflate"}) {
+    const std::string compressed = Compress(encoding, message);
+    ASSERT_LT(compressed.size(), 100 * 1024);
+
+    absl::Status status;
+    std::string decompressed = Decompress(encoding, compressed, 1000, &status);
+    EXPECT_EQ(absl::StatusCode::kResourceExhausted, status.code()) << encoding;
+    EXPECT_EQ("The decompressed gRPC message is larger than 4194304 bytes",
+              status.message());
+    // The stream ends before the bytes past the maximum size.
+    EXPECT_LE(static_cast<int64_t>(decompressed.size()),
+              kDefaultMaxDecompressedMessageSize);
+
+    // A message of exactly the maximum size is accepted.
+    const std::string small_compressed =
+        Compress(encoding, message.substr(0, 1000));
+    status = absl::OkStatus();
+    EXPECT_EQ(1000, Decompress(encoding, small_compressed, 7, &status, 1000)
+                        .size());
+    EXPECT_TRUE(status.ok()) << status;
+    Decompress(encoding, small_compressed, 7, &status, 999);
+    EXPECT_EQ(absl::StatusCode::kResourceExhausted, status.code());
+  }
+}
+
+TEST(MessageCompressionTest, Invalid) {
+  absl::Status status;
+  // The deflate data isn't gzip.
+  Decompress("gzip", Compress("deflate", "abc"), 10, &status);
+  EXPECT_FALSE(status.ok());
+  EXPECT_EQ("Invalid compressed gRPC message: incorrect header check",
+            status.message());
+
+  status = absl::OkStatus();
+  std::string compressed = Compress("gzip", std::string(1000, 'a'));
+  // Corrupt the CRC.
+  compressed[compressed.size() - 5] ^= 1;
+  Decompress("gzip", compressed, 10, &status);
+  EXPECT_FALSE(status.ok());
+}
+
+}  // namespace
+}  // namespace testing
+}  // namespace transcoding
+
+}  // namespace grpc
+}  // namespace google
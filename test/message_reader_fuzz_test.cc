@@ -5,6 +5,7 @@
 #include <fuzzer/FuzzedDataProvider.h>
 #include <cstddef>
 #include <cstdint>
+#include <cstdlib>
 #include <string>
 
 namespace google {
@@ -13,20 +14,47 @@ namespace transcoding {
 namespace testing {
 namespace {
 
+std::string ReadAll(::google::protobuf::io::ZeroCopyInputStream* stream) {
+  std::string all;
+  const void* data = nullptr;
+  int size = 0;
+  while (stream->Next(&data, &size)) {
+    all.append(static_cast<const char*>(data), size);
+  }
+  return all;
+}
+
 extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
   FuzzedDataProvider provider(data, size);
 
   TestZeroCopyInputStream input_stream;
   MessageReader reader(&input_stream);
+  // A second reader of the same input that reads the messages with
+  // NextMessageView(), which must behave the same.
+  TestZeroCopyInputStream view_input_stream;
+  MessageReader view_reader(&view_input_stream);
 
   while (provider.remaining_bytes() > 0) {
     // Add a few chucks of data to the input stream.
     for (int i = 0; i < provider.ConsumeIntegralInRange(0, 5); i++) {
-      input_stream.AddChunk(provider.ConsumeRandomLengthString(100));
+      std::string chunk = provider.ConsumeRandomLengthString(100);
+      input_stream.AddChunk(chunk);
+      view_input_stream.AddChunk(chunk);
     }
 
     // Run the message reader to get the next message.
-    (void)reader.NextMessageAndGrpcFrame();
+    MessageAndGrpcFrame result = reader.NextMessageAndGrpcFrame();
+    auto* view = view_reader.NextMessageView();
+    if ((result.message == nullptr) != (view == nullptr) ||
+        reader.Status() != view_reader.Status()) {
+      abort();
+    }
+    if (view != nullptr) {
+      // Both messages must be read to the end before reading on.
+      if (ReadAll(result.message.get()) != ReadAll(view)) {
+        abort();
+      }
+    }
 
     // Handle end of input or error due to malformed bytes.
     if (reader.Finished()) {
@@ -62,10 +62,13 @@ class MessageReaderTestRun {
   // NOTE: Both input and expected are stored as references in the
   //       MessageReaderTestRun, so the caller must make sure they exist
   //       throughout the lifetime of MessageReaderTestRun.
+  // use_views - whether to read the messages with NextMessageView() instead of
+  //             NextMessageAndGrpcFrame()
   MessageReaderTestRun(const std::string& input,
-                       const std::vector<ExpectedAt>& expected)
+                       const std::vector<ExpectedAt>& expected, bool use_views)
       : input_(input),
         expected_(expected),
+        use_views_(use_views),
         input_stream_(new TestZeroCopyInputStream()),
         reader_(new MessageReader(input_stream_.get())),
         position_(0),
@@ -94,6 +97,13 @@ class MessageReaderTestRun {
         ADD_FAILURE() << "Finished unexpectedly" << std::endl;
         return false;
       }
+      if (use_views_) {
+        if (!TestView()) {
+          return false;
+        }
+        ++next_expected_;
+        continue;
+      }
       // Read the message
       MessageAndGrpcFrame result = reader_->NextMessageAndGrpcFrame();
       EXPECT_TRUE(reader_->Status().ok());
@@ -125,7 +135,8 @@ class MessageReaderTestRun {
     }
     // We have read all the expected messages, so NextMessage() must return
     // nullptr
-    if (reader_->NextMessage().get()) {
+    if (use_views_ ? reader_->NextMessageView() != nullptr
+                   : reader_->NextMessage() != nullptr) {
       ADD_FAILURE() << "Unexpected message" << std::endl;
       return false;
     }
@@ -139,8 +150,26 @@ class MessageReaderTestRun {
   }
 
  private:
+  // Tests the next expected message read with NextMessageView().
+  bool TestView() {
+    ::google::protobuf::io::ZeroCopyInputStream* view =
+        reader_->NextMessageView();
+    EXPECT_TRUE(reader_->Status().ok());
+    if (view == nullptr) {
+      ADD_FAILURE() << "No message available" << std::endl;
+      return false;
+    }
+    auto message = ReadAllFromStream(view);
+    if (next_expected_->message != message) {
+      EXPECT_EQ(next_expected_->message, message);
+      return false;
+    }
+    return true;
+  }
+
   const std::string& input_;
   const std::vector<ExpectedAt>& expected_;
+  bool use_views_;
 
   std::unique_ptr<TestZeroCopyInputStream> input_stream_;
   std::unique_ptr<MessageReader> reader_;
@@ -169,21 +198,30 @@ class MessageReaderTestCase {
     }
   }
 
-  std::unique_ptr<MessageReaderTestRun> NewRun() {
+  std::unique_ptr<MessageReaderTestRun> NewRun(bool use_views = false) {
     return std::unique_ptr<MessageReaderTestRun>(
-        new MessageReaderTestRun(input_, expected_));
+        new MessageReaderTestRun(input_, expected_, use_views));
   }
 
-  // Runs the test for different partitions of the input.
+  // Runs the test for different partitions of the input, reading the messages
+  // with both NextMessageAndGrpcFrame() and NextMessageView().
   // chunk_count - the number of chunks (parts) per partition
   // partitioning_coefficient - defines how exhaustive the test should be. See
   //                            the comment on RunTestForInputPartitions() in
   //                            test_common.h for more details.
   bool Test(size_t chunk_count, double partitioning_coefficient) {
+    return Test(chunk_count, partitioning_coefficient, false) &&
+           Test(chunk_count, partitioning_coefficient, true);
+  }
+
+ private:
+  bool Test(size_t chunk_count, double partitioning_coefficient,
+            bool use_views) {
     return RunTestForInputPartitions(chunk_count, partitioning_coefficient,
                                      input_,
-                                     [this](const std::vector<size_t>& t) {
-                                       auto run = NewRun();
+                                     [this, use_views](
+                                         const std::vector<size_t>& t) {
+                                       auto run = NewRun(use_views);
 
                                        // Feed the chunks according to the
                                        // partition defined by tuple t and
@@ -203,7 +241,6 @@ class MessageReaderTestCase {
                                      });
   }
 
- private:
   std::string input_;
   std::vector<ExpectedAt> expected_;
 };
@@ -300,6 +337,76 @@ TEST_F(MessageReaderTest, OneByteChunks) {
   EXPECT_TRUE(tr->Test());
 }
 
+TEST_F(MessageReaderTest, OneByteChunksViews) {
+  AddMessage("Message1");
+  AddMessage("Message2");
+  AddMessage("Message3");
+
+  auto tc = Build();
+  auto tr = tc->NewRun(true);
+
+  for (size_t i = 0; i < tr->TotalInputSize(); ++i) {
+    tr->AddChunk(1);
+    EXPECT_TRUE(tr->Test());
+  }
+  tr->FinishInputStream();
+  EXPECT_TRUE(tr->Test());
+}
+
+TEST_F(MessageReaderTest, ViewsAndMessages) {
+  TestZeroCopyInputStream input_stream;
+  MessageReader reader(&input_stream);
+
+  std::string input;
+  for (absl::string_view message : {"Message1", "Message2", "Message3"}) {
+    input += SizeToDelimiter(message.size());
+    input.append(message.data(), message.size());
+  }
+  // All the messages are in one chunk, so the views read past them.
+  input_stream.AddChunk(input);
+  input_stream.Finish();
+
+  auto* view = reader.NextMessageView();
+  ASSERT_NE(nullptr, view);
+  EXPECT_EQ("Message1", ReadAllFromStream(view));
+  // The view is the same object for the next message.
+  EXPECT_EQ(view, reader.NextMessageView());
+  EXPECT_EQ("Message2", ReadAllFromStream(view));
+  auto message = reader.NextMessage();
+  ASSERT_NE(nullptr, message);
+  EXPECT_EQ("Message3", ReadAllFromStream(message.get()));
+  message.reset();
+  EXPECT_EQ(nullptr, reader.NextMessageView());
+  EXPECT_TRUE(reader.Finished());
+  EXPECT_TRUE(reader.Status().ok());
+}
+
+TEST_F(MessageReaderTest, ReleaseMessageView) {
+  TestZeroCopyInputStream input_stream;
+  MessageReader reader(&input_stream);
+
+  const std::string second = SizeToDelimiter(8) + "Message2";
+  input_stream.AddChunk(SizeToDelimiter(8) + "Message1" + second);
+  input_stream.Finish();
+
+  auto* view = reader.NextMessageView();
+  ASSERT_NE(nullptr, view);
+  EXPECT_EQ("Message1", ReadAllFromStream(view));
+  // The view has read the chunk past the message, until it's released.
+  EXPECT_EQ(0, input_stream.BytesAvailable());
+  reader.ReleaseMessageView();
+  EXPECT_EQ(static_cast<int64_t>(second.size()),
+            input_stream.BytesAvailable());
+
+  view = reader.NextMessageView();
+  ASSERT_NE(nullptr, view);
+  EXPECT_EQ("Message2", ReadAllFromStream(view));
+  reader.ReleaseMessageView();
+  EXPECT_EQ(0, input_stream.BytesAvailable());
+  EXPECT_EQ(nullptr, reader.NextMessageView());
+  EXPECT_TRUE(reader.Finished());
+}
+
 TEST_F(MessageReaderTest, DirectTest) {
   TestZeroCopyInputStream input_stream;
   MessageReader reader(&input_stream);
@@ -404,6 +511,109 @@ TEST_F(MessageReaderTest, InvalidFrameFlag) {
   EXPECT_EQ(reader.Status().message(), "Unsupported gRPC frame flag: 10");
 }
 
+// Returns a gRPC frame of message compressed with the encoding.
+std::string CompressedFrame(absl::string_view encoding,
+                            const std::string& message) {
+  std::string compressed;
+  EXPECT_TRUE(
+      CreateMessageCompressor(encoding)->Compress(message, &compressed).ok());
+  std::string frame = SizeToDelimiter(compressed.size());
+  frame[0] = 1;
+  return frame + compressed;
+}
+
+TEST_F(MessageReaderTest, CompressedFrames) {
+  auto decompressor = CreateMessageDecompressor("gzip");
+  TestZeroCopyInputStream input_stream;
+  MessageReader reader(&input_stream, decompressor.get());
+
+  std::string message1 = GenerateInput("Compressed message ", 100000);
+  std::string message2 = "Uncompressed message";
+  std::string message3 = GenerateInput("Another compressed message ", 1000);
+  std::string frame1 = CompressedFrame("gzip", message1);
+  input_stream.AddChunk(frame1);
+  input_stream.AddChunk(SizeToDelimiter(message2.size()) + message2);
+  input_stream.AddChunk(CompressedFrame("gzip", message3));
+  input_stream.Finish();
+
+  MessageAndGrpcFrame result = reader.NextMessageAndGrpcFrame();
+  ASSERT_NE(nullptr, result.message);
+  EXPECT_EQ(message1, ReadAllFromStream(result.message.get()));
+  // The frame is the one received, i.e. of the compressed message.
+  EXPECT_EQ(frame1.substr(0, kGrpcDelimiterByteSize),
+            std::string(reinterpret_cast<const char*>(result.grpc_frame),
+                        kGrpcDelimiterByteSize));
+  EXPECT_EQ(frame1.size() - kGrpcDelimiterByteSize, result.message_size);
+  result.message.reset();
+
+  auto message = reader.NextMessage();
+  ASSERT_NE(nullptr, message);
+  EXPECT_EQ(message2, ReadAllFromStream(message.get()));
+  message.reset();
+
+  // The message is only partially read, the rest is skipped.
+  message = reader.NextMessage();
+  ASSERT_NE(nullptr, message);
+  EXPECT_TRUE(message->Skip(10));
+  message.reset();
+
+  EXPECT_EQ(nullptr, reader.NextMessage());
+  EXPECT_TRUE(reader.Status().ok());
+  EXPECT_TRUE(reader.Finished());
+}
+
+TEST_F(MessageReaderTest, CompressedFrameViews) {
+  auto decompressor = CreateMessageDecompressor("deflate");
+  TestZeroCopyInputStream input_stream;
+  MessageReader reader(&input_stream, decompressor.get());
+
+  std::string message1 = GenerateInput("Compressed message ", 10000);
+  std::string message2 = "Uncompressed message";
+  input_stream.AddChunk(CompressedFrame("deflate", message1) +
+                        SizeToDelimiter(message2.size()) + message2);
+  input_stream.Finish();
+
+  auto* view = reader.NextMessageView();
+  ASSERT_NE(nullptr, view);
+  EXPECT_EQ(message1, ReadAllFromStream(view));
+  view = reader.NextMessageView();
+  ASSERT_NE(nullptr, view);
+  EXPECT_EQ(message2, ReadAllFromStream(view));
+  EXPECT_EQ(nullptr, reader.NextMessageView());
+  EXPECT_TRUE(reader.Status().ok());
+}
+
+TEST_F(MessageReaderTest, CompressedFrameWithoutDecompressor) {
+  TestZeroCopyInputStream input_stream;
+  MessageReader reader(&input_stream);
+
+  input_stream.AddChunk(CompressedFrame("gzip", "message"));
+  input_stream.Finish();
+
+  EXPECT_EQ(nullptr, reader.NextMessage().get());
+  EXPECT_FALSE(reader.Status().ok());
+  EXPECT_EQ(reader.Status().message(), "Unsupported gRPC frame flag: 1");
+}
+
+TEST_F(MessageReaderTest, InvalidCompressedFrame) {
+  auto decompressor = CreateMessageDecompressor("gzip");
+  TestZeroCopyInputStream input_stream;
+  MessageReader reader(&input_stream, decompressor.get());
+
+  // The message is compressed with deflate, not gzip.
+  input_stream.AddChunk(CompressedFrame("deflate", "message"));
+  input_stream.Finish();
+
+  auto message = reader.NextMessage();
+  ASSERT_NE(nullptr, message);
+  EXPECT_TRUE(reader.Status().ok());
+  EXPECT_EQ("", ReadAllFromStream(message.get()));
+  EXPECT_FALSE(reader.Status().ok());
+  EXPECT_EQ(reader.Status().message(),
+            "Invalid compressed gRPC message: incorrect header check");
+  EXPECT_TRUE(reader.Finished());
+}
+
 TEST_F(MessageReaderTest, IncompleteFrame) {
   TestZeroCopyInputStream input_stream;
   MessageReader reader(&input_stream);
@@ -417,6 +627,86 @@ TEST_F(MessageReaderTest, IncompleteFrame) {
             "Incomplete gRPC frame expected size: 5 actual size: 1");
 }
 
+TEST_F(MessageReaderTest, MessageParts) {
+  TestZeroCopyInputStream input_stream;
+  MessageReader reader(&input_stream);
+
+  std::string message1 = GenerateInput("First message ", 1000);
+  std::string message2 = "Second message";
+  std::string input = SizeToDelimiter(message1.size()) + message1 +
+                      SizeToDelimiter(0) + SizeToDelimiter(message2.size()) +
+                      message2;
+
+  // Each chunk of the input is returned as soon as it's added.
+  std::vector<std::string> parts;
+  std::string part;
+  bool last = false;
+  for (size_t position = 0; position < input.size(); position += 100) {
+    input_stream.AddChunk(input.substr(position, 100));
+    ::google::protobuf::io::ZeroCopyInputStream* stream = nullptr;
+    while ((stream = reader.NextMessagePart(&last)) != nullptr) {
+      part += ReadAllFromStream(stream);
+      if (last) {
+        parts.push_back(part);
+        part.clear();
+      }
+    }
+    ASSERT_TRUE(reader.Status().ok());
+    if (position < message1.size()) {
+      // The part of the first message received so far.
+      EXPECT_EQ(message1.substr(0, position + 100 - kGrpcDelimiterByteSize),
+                part);
+    }
+  }
+  input_stream.Finish();
+  EXPECT_EQ(nullptr, reader.NextMessagePart(&last));
+  EXPECT_TRUE(reader.Status().ok());
+  EXPECT_TRUE(reader.Finished());
+
+  ASSERT_EQ(3, parts.size());
+  EXPECT_EQ(message1, parts[0]);
+  EXPECT_EQ("", parts[1]);
+  EXPECT_EQ(message2, parts[2]);
+}
+
+TEST_F(MessageReaderTest, CompressedMessageParts) {
+  auto decompressor = CreateMessageDecompressor("gzip");
+  TestZeroCopyInputStream input_stream;
+  MessageReader reader(&input_stream, decompressor.get());
+
+  std::string message = GenerateInput("Compressed message ", 10000);
+  std::string frame = CompressedFrame("gzip", message);
+  input_stream.AddChunk(frame.substr(0, 10));
+  bool last = false;
+  EXPECT_EQ(nullptr, reader.NextMessagePart(&last));
+
+  // A compressed message is returned once it's complete.
+  input_stream.AddChunk(frame.substr(10));
+  auto* part = reader.NextMessagePart(&last);
+  ASSERT_NE(nullptr, part);
+  EXPECT_TRUE(last);
+  EXPECT_EQ(message, ReadAllFromStream(part));
+  EXPECT_TRUE(reader.Status().ok());
+}
+
+TEST_F(MessageReaderTest, IncompleteFrameParts) {
+  TestZeroCopyInputStream input_stream;
+  MessageReader reader(&input_stream);
+
+  input_stream.AddChunk(std::string("\x00\x00\x00\x00\x05\x00\x01", 7));
+  bool last = true;
+  auto* part = reader.NextMessagePart(&last);
+  ASSERT_NE(nullptr, part);
+  EXPECT_FALSE(last);
+  EXPECT_EQ(std::string("\x00\x01", 2), ReadAllFromStream(part));
+
+  input_stream.Finish();
+  EXPECT_EQ(nullptr, reader.NextMessagePart(&last));
+  EXPECT_FALSE(reader.Status().ok());
+  EXPECT_EQ(reader.Status().message(),
+            "Incomplete gRPC frame expected size: 3 actual size: 0");
+}
+
 }  // namespace
 }  // namespace testing
 }  // namespace transcoding
@@ -0,0 +1,184 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+#include "grpc_transcoding/path_matcher_cache.h"
+
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace google {
+namespace grpc {
+namespace transcoding {
+namespace {
+
+std::shared_ptr<const PathMatcherLookupCache::Entry> MakeEntry(
+    const void* method_data, const std::string& value) {
+  std::shared_ptr<PathMatcherLookupCache::Entry> entry(
+      new PathMatcherLookupCache::Entry());
+  entry->method_data = method_data;
+  entry->path_bindings.push_back(VariableBinding{{"x"}, value});
+  return entry;
+}
+
+TEST(PathMatcherLookupCacheTest, GetAndPut) {
+  PathMatcherLookupCache cache(10, 1);
+  int data = 0;
+
+  EXPECT_EQ(nullptr, cache.Get("GET", "/a"));
+  cache.Put("GET", "/a", MakeEntry(&data, "a"));
+
+  auto entry = cache.Get("GET", "/a");
+  ASSERT_NE(nullptr, entry);
+  EXPECT_EQ(&data, entry->method_data);
+  ASSERT_EQ(1, entry->path_bindings.size());
+  EXPECT_EQ("a", entry->path_bindings[0].value);
+
+  // The method is part of the key.
+  EXPECT_EQ(nullptr, cache.Get("POST", "/a"));
+  EXPECT_EQ(nullptr, cache.Get("GE", "T/a"));
+
+  PathMatcherLookupCache::Stats stats = cache.GetStats();
+  EXPECT_EQ(1, stats.hits);
+  EXPECT_EQ(3, stats.misses);
+  EXPECT_EQ(0, stats.evictions);
+  EXPECT_EQ(1, stats.size);
+}
+
+TEST(PathMatcherLookupCacheTest, PutReplaces) {
+  PathMatcherLookupCache cache(10, 1);
+  int data = 0;
+
+  cache.Put("GET", "/a", MakeEntry(&data, "1"));
+  cache.Put("GET", "/a", MakeEntry(&data, "2"));
+
+  auto entry = cache.Get("GET", "/a");
+  ASSERT_NE(nullptr, entry);
+  EXPECT_EQ("2", entry->path_bindings[0].value);
+  EXPECT_EQ(1, cache.GetStats().size);
+}
+
+TEST(PathMatcherLookupCacheTest, EvictsLeastRecentlyUsed) {
+  PathMatcherLookupCache cache(2, 1);
+  int data = 0;
+
+  cache.Put("GET", "/a", MakeEntry(&data, "a"));
+  cache.Put("GET", "/b", MakeEntry(&data, "b"));
+  // Marks /a as recently used, which spares it from the next eviction.
+  EXPECT_NE(nullptr, cache.Get("GET", "/a"));
+  cache.Put("GET", "/c", MakeEntry(&data, "c"));
+
+  EXPECT_NE(nullptr, cache.Get("GET", "/a"));
+  EXPECT_EQ(nullptr, cache.Get("GET", "/b"));
+  EXPECT_NE(nullptr, cache.Get("GET", "/c"));
+
+  PathMatcherLookupCache::Stats stats = cache.GetStats();
+  EXPECT_EQ(1, stats.evictions);
+  EXPECT_EQ(2, stats.size);
+}
+
+TEST(PathMatcherLookupCacheTest, EvictsWithSecondChance) {
+  PathMatcherLookupCache cache(3, 1);
+  int data = 0;
+
+  cache.Put("GET", "/a", MakeEntry(&data, "a"));
+  cache.Put("GET", "/b", MakeEntry(&data, "b"));
+  cache.Put("GET", "/c", MakeEntry(&data, "c"));
+  EXPECT_NE(nullptr, cache.Get("GET", "/b"));
+  // Evicts /a, the first entry not used since it was cached.
+  cache.Put("GET", "/d", MakeEntry(&data, "d"));
+  // Skips /b, which was hit, clearing its reference, and evicts /c.
+  cache.Put("GET", "/e", MakeEntry(&data, "e"));
+
+  EXPECT_EQ(nullptr, cache.Get("GET", "/a"));
+  EXPECT_NE(nullptr, cache.Get("GET", "/b"));
+  EXPECT_EQ(nullptr, cache.Get("GET", "/c"));
+  EXPECT_NE(nullptr, cache.Get("GET", "/d"));
+  EXPECT_NE(nullptr, cache.Get("GET", "/e"));
+  EXPECT_EQ(2, cache.GetStats().evictions);
+}
+
+TEST(PathMatcherLookupCacheTest, IsBounded) {
+  PathMatcherLookupCache cache(64, 8);
+  int data = 0;
+
+  for (int i = 0; i < 1000; ++i) {
+    cache.Put("GET", "/" + std::to_string(i), MakeEntry(&data, ""));
+  }
+
+  PathMatcherLookupCache::Stats stats = cache.GetStats();
+  EXPECT_LE(stats.size, 64);
+  EXPECT_EQ(1000, stats.size + stats.evictions);
+}
+
+TEST(PathMatcherLookupCacheTest, ConcurrentGetAndPut) {
+  PathMatcherLookupCache cache(32, 4);
+  int data = 0;
+
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 8; ++t) {
+    threads.emplace_back([&cache, &data, t]() {
+      for (int i = 0; i < 2000; ++i) {
+        std::string path = "/" + std::to_string((i * 7 + t) % 50);
+        auto entry = cache.Get("GET", path);
+        if (entry == nullptr) {
+          cache.Put("GET", path, MakeEntry(&data, path));
+        } else {
+          EXPECT_EQ(path, entry->path_bindings[0].value);
+        }
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  PathMatcherLookupCache::Stats stats = cache.GetStats();
+  EXPECT_EQ(8 * 2000, stats.hits + stats.misses);
+  EXPECT_LE(stats.size, 32);
+}
+
+TEST(PathMatcherLookupCacheTest, ConcurrentHitsOfTheSamePath) {
+  PathMatcherLookupCache cache(8, 1);
+  int data = 0;
+  cache.Put("GET", "/hot", MakeEntry(&data, "hot"));
+
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 8; ++t) {
+    threads.emplace_back([&cache, &data]() {
+      for (int i = 0; i < 2000; ++i) {
+        auto entry = cache.Get("GET", "/hot");
+        ASSERT_NE(nullptr, entry);
+        EXPECT_EQ(&data, entry->method_data);
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  PathMatcherLookupCache::Stats stats = cache.GetStats();
+  EXPECT_EQ(8 * 2000, stats.hits);
+  EXPECT_EQ(0, stats.misses);
+}
+
+}  // namespace
+}  // namespace transcoding
+}  // namespace grpc
+}  // namespace google
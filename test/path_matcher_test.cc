@@ -16,12 +16,21 @@
 //
 #include "grpc_transcoding/path_matcher.h"
 
+#include <atomic>
+#include <map>
 #include <memory>
 #include <ostream>
 #include <string>
+#include <thread>
 #include <vector>
 
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
 #include "grpc_transcoding/http_template.h"
+#include "grpc_transcoding/path_matcher_node.h"
+#include "grpc_transcoding/path_matcher_trie.h"
+#include "grpc_transcoding/snapshot.h"
 
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
@@ -125,6 +134,23 @@ class PathMatcherTest : public ::testing::Test {
     builder_.SetFailRegistrationOnDuplicate(fail_registration_on_duplicate);
   }
 
+  void SetLookupCache(size_t capacity, size_t num_shards) {
+    builder_.SetLookupCache(capacity, num_shards);
+  }
+
+  PathMatcherLookupCache::Stats GetLookupCacheStats() {
+    return matcher_->GetLookupCacheStats();
+  }
+
+  // Returns a new method to register with an update.
+  MethodInfo* NewMethod() {
+    stored_methods_.emplace_back(new MethodInfo());
+    return stored_methods_.back().get();
+  }
+
+  const PathMatcher<MethodInfo*>& matcher() { return *matcher_; }
+  PathMatcherPtr<MethodInfo*> TakeMatcher() { return std::move(matcher_); }
+
   void Build() { matcher_ = builder_.Build(); }
 
   MethodInfo* LookupWithBodyFieldPath(std::string method, std::string path,
@@ -146,6 +172,15 @@ class PathMatcherTest : public ::testing::Test {
                             &body_field_path);
   }
 
+  MethodInfo* LookupStringViews(absl::string_view method,
+                                absl::string_view path,
+                                absl::string_view query_params,
+                                VariableBindings* bindings) {
+    std::string body_field_path;
+    return matcher_->Lookup(method, path, query_params, bindings,
+                            &body_field_path);
+  }
+
   MethodInfo* LookupNoBindings(std::string method, std::string path) {
     VariableBindings bindings;
     std::string body_field_path;
@@ -924,6 +959,49 @@ TEST_F(PathMatcherTest, VariableBindingsWithQueryParamsAndSystemParams) {
       bindings);
 }
 
+TEST_F(PathMatcherTest, LookupStringViewsIntoLargerBuffer) {
+  std::unordered_set<std::string> system_params{"api_key"};
+  MethodInfo* shelves_books_verb = AddPathWithSystemParams(
+      "POST", "/shelves/{shelf}/books/{book=**}:archive", &system_params);
+  MethodInfo* shelves_books = AddPath("GET", "/shelves/{shelf}/books/{book}");
+  Build();
+
+  EXPECT_NE(nullptr, shelves_books_verb);
+  EXPECT_NE(nullptr, shelves_books);
+
+  // The views are not null-terminated and point into a shared buffer.
+  const std::string buffer =
+      "POST|/shelves/88/books/a%2Fb/c:archive|x.y=1&api_key=k|GET|";
+  absl::string_view view(buffer);
+  absl::string_view post = view.substr(0, 4);
+  absl::string_view path = view.substr(5, 33);
+  absl::string_view query = view.substr(39, 15);
+  absl::string_view get = view.substr(55, 3);
+  ASSERT_EQ("/shelves/88/books/a%2Fb/c:archive", path);
+  ASSERT_EQ("x.y=1&api_key=k", query);
+
+  VariableBindings bindings;
+  EXPECT_EQ(LookupStringViews(post, path, query, &bindings),
+            shelves_books_verb);
+  EXPECT_EQ(VariableBindings({
+                VariableBinding{FieldPath{"shelf"}, "88"},
+                VariableBinding{FieldPath{"book"}, "a%2Fb/c"},
+                VariableBinding{FieldPath{"x", "y"}, "1"},
+            }),
+            bindings);
+
+  // The custom verb is not part of the GET template.
+  EXPECT_EQ(LookupStringViews(get, path, query, &bindings), nullptr);
+  EXPECT_EQ(LookupStringViews(get, path.substr(0, 24), absl::string_view(),
+                              &bindings),
+            shelves_books);
+  EXPECT_EQ(VariableBindings({
+                VariableBinding{FieldPath{"shelf"}, "88"},
+                VariableBinding{FieldPath{"book"}, "a/b"},
+            }),
+            bindings);
+}
+
 TEST_F(PathMatcherTest, WildCardMatchesManyWithoutStackOverflow) {
   MethodInfo* a = AddGetPath("/a/**/x");
   Build();
@@ -958,6 +1036,504 @@ TEST_F(PathMatcherTest, RegisterFailsOnDuplicateIfOptIn) {
   EXPECT_EQ(LookupNoBindings("GET", "/a/b"), nullptr);
 }
 
+TEST_F(PathMatcherTest, LookupCacheReturnsSameResults) {
+  SetLookupCache(100, 4);
+  std::unordered_set<std::string> system_params{"key"};
+  MethodInfo* shelf = AddPathWithSystemParams("GET", "/shelves/{shelf=*}",
+                                              &system_params);
+  MethodInfo* book = AddPath("GET", "/shelves/{shelf}/books/{book=**}");
+  MethodInfo* verb = AddPath("POST", "/shelves/{shelf}:clear");
+  Build();
+
+  for (int i = 0; i < 3; ++i) {
+    VariableBindings bindings;
+    EXPECT_EQ(LookupWithParams("GET", "/shelves/a%2Fb", "x.y=1&key=k",
+                               &bindings),
+              shelf);
+    EXPECT_EQ(VariableBindings({
+                  VariableBinding{FieldPath{"shelf"}, "a/b"},
+                  VariableBinding{FieldPath{"x", "y"}, "1"},
+              }),
+              bindings);
+    // The query string of the path is not part of the key.
+    EXPECT_EQ(LookupWithParams("GET", "/shelves/a%2Fb?z=1",
+                               "z=" + std::to_string(i), &bindings),
+              shelf);
+    EXPECT_EQ(VariableBindings({
+                  VariableBinding{FieldPath{"shelf"}, "a/b"},
+                  VariableBinding{FieldPath{"z"}, std::to_string(i)},
+              }),
+              bindings);
+    EXPECT_EQ(Lookup("GET", "/shelves/1/books/2/3", &bindings), book);
+    EXPECT_EQ(VariableBindings({
+                  VariableBinding{FieldPath{"shelf"}, "1"},
+                  VariableBinding{FieldPath{"book"}, "2/3"},
+              }),
+              bindings);
+    EXPECT_EQ(Lookup("POST", "/shelves/1:clear", &bindings), verb);
+    EXPECT_EQ(VariableBindings({
+                  VariableBinding{FieldPath{"shelf"}, "1"},
+              }),
+              bindings);
+    EXPECT_EQ(LookupNoBindings("GET", "/shelves/1:clear"), nullptr);
+    EXPECT_EQ(LookupNoBindings("GET", "/unknown"), nullptr);
+  }
+
+  PathMatcherLookupCache::Stats stats = GetLookupCacheStats();
+  // The lookups with and without "?z=1" share an entry.
+  EXPECT_EQ(3, stats.size);
+  EXPECT_EQ(1 + 4 * 2, stats.hits);
+  // The failed lookups are not cached.
+  EXPECT_EQ(3 + 2 * 3, stats.misses);
+  EXPECT_EQ(0, stats.evictions);
+}
+
+TEST_F(PathMatcherTest, LookupCacheEvicts) {
+  SetLookupCache(2, 1);
+  MethodInfo* a = AddGetPath("/a/{x}");
+  Build();
+
+  VariableBindings bindings;
+  for (const char* path : {"/a/1", "/a/2", "/a/3", "/a/1"}) {
+    EXPECT_EQ(Lookup("GET", path, &bindings), a);
+    EXPECT_EQ(VariableBindings({
+                  VariableBinding{FieldPath{"x"}, std::string(path + 3)},
+              }),
+              bindings);
+  }
+
+  PathMatcherLookupCache::Stats stats = GetLookupCacheStats();
+  EXPECT_EQ(0, stats.hits);
+  EXPECT_EQ(4, stats.misses);
+  EXPECT_EQ(2, stats.evictions);
+  EXPECT_EQ(2, stats.size);
+}
+
+TEST_F(PathMatcherTest, LookupCacheDisabledByDefault) {
+  MethodInfo* a = AddGetPath("/a");
+  Build();
+
+  EXPECT_EQ(LookupNoBindings("GET", "/a"), a);
+  PathMatcherLookupCache::Stats stats = GetLookupCacheStats();
+  EXPECT_EQ(0, stats.hits + stats.misses + stats.size);
+}
+
+TEST_F(PathMatcherTest, LookupCacheFromManyThreads) {
+  SetLookupCache(16, 4);
+  MethodInfo* a = AddGetPath("/a/{x}/{y=**}");
+  Build();
+
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 8; ++t) {
+    threads.emplace_back([this, a, t]() {
+      for (int i = 0; i < 1000; ++i) {
+        std::string x = std::to_string((i + t) % 40);
+        VariableBindings bindings;
+        EXPECT_EQ(Lookup("GET", "/a/" + x + "/b/c", &bindings), a);
+        EXPECT_EQ(VariableBindings({
+                      VariableBinding{FieldPath{"x"}, x},
+                      VariableBinding{FieldPath{"y"}, "b/c"},
+                  }),
+                  bindings);
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  PathMatcherLookupCache::Stats stats = GetLookupCacheStats();
+  EXPECT_EQ(8 * 1000, stats.hits + stats.misses);
+  EXPECT_LE(stats.size, 16);
+}
+
+TEST_F(PathMatcherTest, UpdateRegistersAndUnregisters) {
+  MethodInfo* a = AddGetPath("/a");
+  MethodInfo* b = AddGetPath("/b/{x}");
+  Build();
+
+  MethodInfo* c = NewMethod();
+  PathMatcherUpdate<MethodInfo*> update;
+  EXPECT_TRUE(update.Unregister("GET", "/a"));
+  EXPECT_TRUE(update.Register("GET", "/c/{y=**}", "", c));
+  EXPECT_FALSE(update.Register("GET", "/c/{", "", c));
+  EXPECT_FALSE(update.Unregister("GET", "a"));
+  PathMatcherPtr<MethodInfo*> next = matcher().Update(update);
+  ASSERT_NE(nullptr, next);
+  EXPECT_EQ(1, matcher().version());
+  EXPECT_EQ(2, next->version());
+
+  VariableBindings bindings;
+  EXPECT_EQ(nullptr, next->Lookup("GET", "/a"));
+  EXPECT_EQ(b, next->Lookup("GET", "/b/1", "", &bindings, nullptr));
+  EXPECT_EQ(VariableBindings({VariableBinding{FieldPath{"x"}, "1"}}),
+            bindings);
+  EXPECT_EQ(c, next->Lookup("GET", "/c/1/2", "", &bindings, nullptr));
+  EXPECT_EQ(VariableBindings({VariableBinding{FieldPath{"y"}, "1/2"}}),
+            bindings);
+
+  // The base version is unchanged.
+  EXPECT_EQ(a, LookupNoBindings("GET", "/a"));
+  EXPECT_EQ(b, Lookup("GET", "/b/1", &bindings));
+  EXPECT_EQ(nullptr, LookupNoBindings("GET", "/c/1/2"));
+}
+
+TEST_F(PathMatcherTest, UpdateUnregistersMatchingTemplate) {
+  MethodInfo* a = AddGetPath("/a/{x}/b");
+  MethodInfo* post = AddPath("POST", "/a/{x}/b");
+  Build();
+
+  PathMatcherUpdate<MethodInfo*> update;
+  update.Unregister("GET", "/a/{y}/b");
+  // Unregistering what isn't registered does nothing.
+  update.Unregister("GET", "/a/{x}");
+  update.Unregister("PUT", "/a/{x}/b");
+  PathMatcherPtr<MethodInfo*> next = matcher().Update(update);
+  ASSERT_NE(nullptr, next);
+
+  EXPECT_NE(nullptr, a);
+  EXPECT_EQ(nullptr, next->Lookup("GET", "/a/1/b"));
+  EXPECT_EQ(post, next->Lookup("POST", "/a/1/b"));
+}
+
+TEST_F(PathMatcherTest, UpdateCustomVerbs) {
+  MethodInfo* cancel = AddGetPath("/x/{id}:cancel");
+  MethodInfo* y = AddGetPath("/y/{id}");
+  Build();
+
+  EXPECT_NE(nullptr, cancel);
+  EXPECT_EQ(nullptr, LookupNoBindings("GET", "/y/1:cancel"));
+
+  PathMatcherUpdate<MethodInfo*> update;
+  update.Unregister("GET", "/x/{id}:cancel");
+  PathMatcherPtr<MethodInfo*> next = matcher().Update(update);
+  ASSERT_NE(nullptr, next);
+
+  // "cancel" is no longer a custom verb.
+  VariableBindings bindings;
+  EXPECT_EQ(y, next->Lookup("GET", "/y/1:cancel", "", &bindings, nullptr));
+  EXPECT_EQ(VariableBindings({VariableBinding{FieldPath{"id"}, "1:cancel"}}),
+            bindings);
+
+  MethodInfo* cancel_y = NewMethod();
+  PathMatcherUpdate<MethodInfo*> update2;
+  update2.Register("GET", "/y/{id}:cancel", "", cancel_y);
+  next = next->Update(update2);
+  ASSERT_NE(nullptr, next);
+  EXPECT_EQ(3, next->version());
+  EXPECT_EQ(cancel_y, next->Lookup("GET", "/y/1:cancel"));
+  EXPECT_EQ(y, next->Lookup("GET", "/y/1"));
+}
+
+TEST_F(PathMatcherTest, UpdateDuplicates) {
+  AddGetPath("/a");
+  Build();
+
+  MethodInfo* a2 = NewMethod();
+  PathMatcherUpdate<MethodInfo*> duplicate;
+  duplicate.Register("GET", "/a", "", a2);
+  PathMatcherPtr<MethodInfo*> next = matcher().Update(duplicate);
+  ASSERT_NE(nullptr, next);
+  EXPECT_EQ(nullptr, next->Lookup("GET", "/a"));
+
+  // Replacing is unregistering and registering again.
+  PathMatcherUpdate<MethodInfo*> replace;
+  replace.Unregister("GET", "/a");
+  replace.Register("GET", "/a", "", a2);
+  next = matcher().Update(replace);
+  ASSERT_NE(nullptr, next);
+  EXPECT_EQ(a2, next->Lookup("GET", "/a"));
+}
+
+TEST_F(PathMatcherTest, UpdateFailsOnDuplicateIfOptIn) {
+  SetFailRegistrationOnDuplicate(true);
+  MethodInfo* a = AddGetPath("/a");
+  Build();
+
+  PathMatcherUpdate<MethodInfo*> update;
+  update.Register("GET", "/b", "", NewMethod());
+  update.Register("GET", "/a", "", NewMethod());
+  EXPECT_EQ(nullptr, matcher().Update(update));
+  EXPECT_EQ(a, LookupNoBindings("GET", "/a"));
+}
+
+TEST_F(PathMatcherTest, UpdateCarriesOverLookupCache) {
+  SetLookupCache(16, 2);
+  MethodInfo* a = AddGetPath("/a/{x}");
+  MethodInfo* b = AddGetPath("/b/{x}");
+  MethodInfo* c = AddGetPath("/c");
+  Build();
+
+  VariableBindings bindings;
+  EXPECT_EQ(a, Lookup("GET", "/a/1", &bindings));
+  EXPECT_EQ(a, Lookup("GET", "/a/2", &bindings));
+  EXPECT_EQ(b, Lookup("GET", "/b/1", &bindings));
+  EXPECT_EQ(c, LookupNoBindings("GET", "/c"));
+  EXPECT_EQ(4, GetLookupCacheStats().size);
+
+  MethodInfo* a1 = NewMethod();
+  MethodInfo* b2 = NewMethod();
+  PathMatcherUpdate<MethodInfo*> update;
+  update.Register("GET", "/a/1", "", a1);
+  update.Register("POST", "/b/{x}", "", b2);
+  update.Unregister("GET", "/c");
+  PathMatcherPtr<MethodInfo*> next = matcher().Update(update);
+  ASSERT_NE(nullptr, next);
+
+  // The paths matching a changed template are looked up again, the others
+  // are served by the entries of the previous version.
+  EXPECT_EQ(a1, next->Lookup("GET", "/a/1", "", &bindings, nullptr));
+  EXPECT_TRUE(bindings.empty());
+  EXPECT_EQ(a, next->Lookup("GET", "/a/2", "", &bindings, nullptr));
+  EXPECT_EQ(VariableBindings({VariableBinding{FieldPath{"x"}, "2"}}),
+            bindings);
+  EXPECT_EQ(b, next->Lookup("GET", "/b/1", "", &bindings, nullptr));
+  EXPECT_EQ(b2, next->Lookup("POST", "/b/1", "", &bindings, nullptr));
+  EXPECT_EQ(nullptr, next->Lookup("GET", "/c"));
+  EXPECT_EQ(4, next->GetLookupCacheStats().size);
+
+  // The previous version's cache is only read.
+  PathMatcherLookupCache::Stats stats = GetLookupCacheStats();
+  EXPECT_EQ(0, stats.hits);
+  EXPECT_EQ(4, stats.misses);
+  EXPECT_EQ(4, stats.size);
+  EXPECT_EQ(a, matcher().Lookup("GET", "/a/1"));
+  EXPECT_EQ(c, matcher().Lookup("GET", "/c"));
+}
+
+TEST_F(PathMatcherTest, UpdateOfCustomVerbsDropsLookupCache) {
+  SetLookupCache(16, 2);
+  MethodInfo* y = AddGetPath("/y/{id}");
+  Build();
+
+  VariableBindings bindings;
+  EXPECT_EQ(y, Lookup("GET", "/y/1:cancel", &bindings));
+
+  // Registering the "cancel" verb changes how the path is split, so that it
+  // no longer matches "/y/{id}", even though the template isn't changed.
+  PathMatcherUpdate<MethodInfo*> update;
+  update.Register("GET", "/x:cancel", "", NewMethod());
+  PathMatcherPtr<MethodInfo*> next = matcher().Update(update);
+  ASSERT_NE(nullptr, next);
+  EXPECT_EQ(nullptr, next->Lookup("GET", "/y/1:cancel"));
+  EXPECT_EQ(y, next->Lookup("GET", "/y/1"));
+}
+
+TEST_F(PathMatcherTest, HandlePublishesUpdates) {
+  SetLookupCache(16, 2);
+  MethodInfo* stable = AddGetPath("/stable/{x}");
+  Build();
+  MethodInfo* toggled = NewMethod();
+
+  PathMatcherHandle<MethodInfo*> handle(TakeMatcher());
+  EXPECT_EQ(1, handle.Get()->version());
+
+  std::atomic<bool> done(false);
+  std::vector<std::thread> readers;
+  for (int t = 0; t < 4; ++t) {
+    readers.emplace_back([&handle, &done, stable, toggled]() {
+      while (!done.load()) {
+        // The "/toggled" route is registered in the even versions.
+        std::shared_ptr<const PathMatcher<MethodInfo*>> matcher = handle.Get();
+        EXPECT_EQ(stable, matcher->Lookup("GET", "/stable/1"));
+        EXPECT_EQ(matcher->version() % 2 == 0 ? toggled : nullptr,
+                  matcher->Lookup("GET", "/toggled"));
+      }
+    });
+  }
+
+  for (int i = 0; i < 100; ++i) {
+    PathMatcherUpdate<MethodInfo*> update;
+    if (i % 2 == 0) {
+      update.Register("GET", "/toggled", "", toggled);
+    } else {
+      update.Unregister("GET", "/toggled");
+    }
+    EXPECT_TRUE(handle.Update(update));
+  }
+  done = true;
+  for (auto& reader : readers) {
+    reader.join();
+  }
+
+  EXPECT_EQ(101, handle.Get()->version());
+  EXPECT_EQ(nullptr, handle.Get()->Lookup("GET", "/toggled"));
+}
+
+TEST_F(PathMatcherTest, SnapshotRoundTrip) {
+  SetQueryParamUnescapePlus(true);
+  SetLookupCache(16, 2);
+  MethodInfo* a = AddPathWithBodyFieldPath("POST", "/a/{x.y}/{z=**}", "b.c");
+  std::unordered_set<std::string> system_params{"key"};
+  MethodInfo* b = AddPathWithSystemParams("GET", "/b/{id}:cancel",
+                                          &system_params);
+  MethodInfo* any = AddPath("*", "/any");
+  Build();
+
+  std::map<const MethodInfo*, std::string> names{
+      {a, "a"}, {b, "b"}, {any, "any"}};
+  SnapshotWriter writer;
+  matcher().WriteSnapshot(
+      [&names](MethodInfo* const& method) { return names[method]; },
+      &writer);
+  absl::StatusOr<Snapshot> snapshot = Snapshot::Copy(writer.Finish());
+  ASSERT_TRUE(snapshot.ok()) << snapshot.status();
+
+  auto find_method =
+      [&names](absl::string_view name) -> absl::StatusOr<MethodInfo*> {
+    for (const auto& entry : names) {
+      if (entry.second == name) {
+        return const_cast<MethodInfo*>(entry.first);
+      }
+    }
+    return absl::NotFoundError(name);
+  };
+  auto loaded = PathMatcher<MethodInfo*>::LoadSnapshot(*snapshot, find_method);
+  ASSERT_TRUE(loaded.ok()) << loaded.status();
+  PathMatcherPtr<MethodInfo*> next = std::move(*loaded);
+  EXPECT_EQ(matcher().version(), next->version());
+
+  VariableBindings bindings;
+  std::string body_field_path;
+  EXPECT_EQ(a, next->Lookup("POST", "/a/1/2/3", "q=x+y", &bindings,
+                            &body_field_path));
+  EXPECT_EQ(VariableBindings({VariableBinding{FieldPath{"x", "y"}, "1"},
+                              VariableBinding{FieldPath{"z"}, "2/3"},
+                              VariableBinding{FieldPath{"q"}, "x y"}}),
+            bindings);
+  EXPECT_EQ("b.c", body_field_path);
+  EXPECT_EQ(b, next->Lookup("GET", "/b/1:cancel", "key=k&n=1", &bindings,
+                            &body_field_path));
+  EXPECT_EQ(VariableBindings({VariableBinding{FieldPath{"id"}, "1"},
+                              VariableBinding{FieldPath{"n"}, "1"}}),
+            bindings);
+  EXPECT_EQ(any, next->Lookup("PATCH", "/any"));
+  EXPECT_EQ(nullptr, next->Lookup("GET", "/b/1"));
+  EXPECT_EQ(3, next->GetLookupCacheStats().size);
+
+  // A loaded matcher can be updated.
+  MethodInfo* c = NewMethod();
+  PathMatcherUpdate<MethodInfo*> update;
+  update.Unregister("POST", "/a/{x.y}/{z=**}");
+  update.Register("GET", "/c", "", c);
+  next = next->Update(update);
+  ASSERT_NE(nullptr, next);
+  EXPECT_EQ(nullptr, next->Lookup("POST", "/a/1/2/3"));
+  EXPECT_EQ(b, next->Lookup("GET", "/b/1:cancel"));
+  EXPECT_EQ(c, next->Lookup("GET", "/c"));
+}
+
+TEST_F(PathMatcherTest, SnapshotLoadFails) {
+  MethodInfo* a = AddGetPath("/a");
+  Build();
+
+  SnapshotWriter writer;
+  matcher().WriteSnapshot([](MethodInfo* const&) { return "a"; }, &writer);
+  std::string blob = writer.Finish();
+  absl::StatusOr<Snapshot> snapshot = Snapshot::Copy(blob);
+  ASSERT_TRUE(snapshot.ok()) << snapshot.status();
+
+  // The method isn't known anymore.
+  auto loaded = PathMatcher<MethodInfo*>::LoadSnapshot(
+      *snapshot, [](absl::string_view name) -> absl::StatusOr<MethodInfo*> {
+        return absl::NotFoundError(name);
+      });
+  EXPECT_EQ(absl::StatusCode::kNotFound, loaded.status().code());
+
+  loaded = PathMatcher<MethodInfo*>::LoadSnapshot(
+      *snapshot,
+      [a](absl::string_view) -> absl::StatusOr<MethodInfo*> { return a; });
+  ASSERT_TRUE(loaded.ok()) << loaded.status();
+  EXPECT_EQ(a, (*loaded)->Lookup("GET", "/a"));
+
+  // No path matcher section.
+  SnapshotWriter empty;
+  snapshot = Snapshot::Copy(empty.Finish());
+  ASSERT_TRUE(snapshot.ok()) << snapshot.status();
+  loaded = PathMatcher<MethodInfo*>::LoadSnapshot(
+      *snapshot,
+      [a](absl::string_view) -> absl::StatusOr<MethodInfo*> { return a; });
+  EXPECT_EQ(absl::StatusCode::kNotFound, loaded.status().code());
+}
+
+// Returns a snapshot of "/a/{x}" registered for GET with the given segment
+// range of the variable, which a parsed template wouldn't have.
+std::string SnapshotWithVariableSegments(uint32_t start_segment,
+                                         uint32_t end_segment) {
+  int data = 0;
+  PathMatcherNode root;
+  PathMatcherNode::PathInfo::Builder path;
+  path.AppendLiteralNode("a").AppendSingleParameterNode();
+  root.InsertPath(path.Build(), "GET", &data, true);
+  PathMatcherTrie trie(root);
+
+  SnapshotWriter writer;
+  writer.BeginSection(kPathMatcherSection);
+  // The settings, no custom verbs and the method data.
+  writer.WriteUint32(
+      static_cast<uint32_t>(UrlUnescapeSpec::kAllCharactersExceptReserved));
+  writer.WriteUint32(0);
+  writer.WriteUint32(0);
+  writer.WriteUint32(0);
+  writer.WriteUint64(0);
+  writer.WriteUint64(0);
+  writer.WriteUint64(1);
+  writer.WriteUint64(0);
+  writer.WriteUint64(1);
+  writer.WriteString("a");
+  writer.WriteUint64(1);
+  writer.WriteUint32(start_segment);
+  writer.WriteUint32(end_segment);
+  writer.WriteUint32(0);
+  writer.WriteUint64(1);
+  writer.WriteString("x");
+  writer.WriteString("");
+  writer.WriteUint64(0);
+  trie.WriteSnapshot(&writer);
+  return writer.Finish();
+}
+
+TEST_F(PathMatcherTest, SnapshotLoadValidatesVariableSegments) {
+  MethodInfo* a = AddGetPath("/a");
+  Build();
+  auto find_method = [a](absl::string_view) -> absl::StatusOr<MethodInfo*> {
+    return a;
+  };
+  auto load = [&find_method](uint32_t start_segment, uint32_t end_segment) {
+    absl::StatusOr<Snapshot> snapshot = Snapshot::Copy(
+        SnapshotWithVariableSegments(start_segment, end_segment));
+    EXPECT_TRUE(snapshot.ok()) << snapshot.status();
+    return PathMatcher<MethodInfo*>::LoadSnapshot(*snapshot, find_method);
+  };
+
+  absl::StatusOr<PathMatcherPtr<MethodInfo*>> loaded = load(1, 2);
+  ASSERT_TRUE(loaded.ok()) << loaded.status();
+  VariableBindings bindings;
+  EXPECT_EQ(a, (*loaded)->Lookup("GET", "/a/1", "", &bindings, nullptr));
+  EXPECT_EQ(VariableBindings({VariableBinding{FieldPath{"x"}, "1"}}),
+            bindings);
+
+  // A negative start or an end before the start.
+  EXPECT_EQ(absl::StatusCode::kInvalidArgument,
+            load(static_cast<uint32_t>(-1), 2).status().code());
+  EXPECT_EQ(absl::StatusCode::kInvalidArgument, load(2, 1).status().code());
+
+  // The ranges past the end of the path are clamped to it.
+  loaded = load(1, 100);
+  ASSERT_TRUE(loaded.ok()) << loaded.status();
+  EXPECT_EQ(a, (*loaded)->Lookup("GET", "/a/1", "", &bindings, nullptr));
+  EXPECT_EQ(VariableBindings({VariableBinding{FieldPath{"x"}, "1"}}),
+            bindings);
+  loaded = load(100, static_cast<uint32_t>(-1));
+  ASSERT_TRUE(loaded.ok()) << loaded.status();
+  EXPECT_EQ(a, (*loaded)->Lookup("GET", "/a/1", "", &bindings, nullptr));
+  EXPECT_EQ(VariableBindings({VariableBinding{FieldPath{"x"}, ""}}), bindings);
+  loaded = load(1, static_cast<uint32_t>(-100));
+  ASSERT_TRUE(loaded.ok()) << loaded.status();
+  EXPECT_EQ(a, (*loaded)->Lookup("GET", "/a/1", "", &bindings, nullptr));
+  EXPECT_EQ(VariableBindings({VariableBinding{FieldPath{"x"}, ""}}), bindings);
+}
+
 }  // namespace
 
 }  // namespace transcoding
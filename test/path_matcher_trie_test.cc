@@ -0,0 +1,324 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+#include "grpc_transcoding/path_matcher_trie.h"
+
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "absl/strings/str_split.h"
+#include "grpc_transcoding/http_template.h"
+#include "grpc_transcoding/path_matcher_node.h"
+#include "gtest/gtest.h"
+
+namespace google {
+namespace grpc {
+namespace transcoding {
+namespace {
+
+// Checks that the compiled tries, in a single block and in blocks of a few
+// nodes compiled incrementally, find the same results as the node trie they
+// were compiled from.
+class PathMatcherTrieTest : public ::testing::Test {
+ protected:
+  PathMatcherTrieTest() : root_(new PathMatcherNode()) {}
+
+  // Registers the template and returns the data it's registered with.
+  void* Register(const std::string& http_method,
+                 const std::string& http_template) {
+    std::unique_ptr<HttpTemplate> ht(HttpTemplate::Parse(http_template));
+    EXPECT_NE(nullptr, ht) << http_template;
+    if (ht == nullptr) {
+      return nullptr;
+    }
+    data_.emplace_back(new int(data_.size()));
+    void* replaced_data = nullptr;
+    root_ = PathMatcherNode::InsertPathCopy(
+        root_, PathInfo(*ht), http_method + ht->verb(), data_.back().get(),
+        true, &replaced_data);
+    return data_.back().get();
+  }
+
+  // Unregisters the template and returns the data it was registered with.
+  void* Unregister(const std::string& http_method,
+                   const std::string& http_template) {
+    std::unique_ptr<HttpTemplate> ht(HttpTemplate::Parse(http_template));
+    EXPECT_NE(nullptr, ht) << http_template;
+    if (ht == nullptr) {
+      return nullptr;
+    }
+    void* removed_data = nullptr;
+    root_ = PathMatcherNode::RemovePathCopy(
+        root_, PathInfo(*ht), http_method + ht->verb(), &removed_data);
+    return removed_data;
+  }
+
+  // Compiles the current version, the blocks from the previous version's.
+  void Build() {
+    trie_.reset(new PathMatcherTrie(*root_));
+    blocks_ = PathMatcherTrie::Compile(root_, blocks_, kMaxBlockNodes);
+  }
+
+  // Looks the path up in both tries, expects them to agree and returns the
+  // result.
+  void* Lookup(const std::string& http_method, const std::string& path,
+               const std::string& verb = "") {
+    PathMatcherNode::RequestPathParts parts;
+    if (!path.empty()) {
+      absl::string_view parts_str = absl::string_view(path).substr(1);
+      for (absl::string_view part : absl::StrSplit(parts_str, '/')) {
+        parts.push_back(part);
+      }
+    }
+    RequestMethod method(http_method, verb);
+
+    PathMatcherLookupResult expected;
+    root_->LookupPath(parts.begin(), parts.end(), method, &expected);
+    PathMatcherLookupResult actual;
+    trie_->LookupPath(parts, method, &actual);
+    PathMatcherLookupResult actual_blocks;
+    blocks_->LookupPath(parts, method, &actual_blocks);
+
+    EXPECT_EQ(expected.data, actual.data)
+        << http_method << " " << path << ":" << verb;
+    EXPECT_EQ(expected.is_multiple, actual.is_multiple)
+        << http_method << " " << path << ":" << verb;
+    EXPECT_EQ(expected.data, actual_blocks.data)
+        << http_method << " " << path << ":" << verb;
+    EXPECT_EQ(expected.is_multiple, actual_blocks.is_multiple)
+        << http_method << " " << path << ":" << verb;
+    return actual.data;
+  }
+
+  std::shared_ptr<const PathMatcherNode> root() const { return root_; }
+  std::shared_ptr<const PathMatcherTrie> blocks() const { return blocks_; }
+
+ private:
+  // Small enough for most tests to link blocks.
+  static constexpr size_t kMaxBlockNodes = 3;
+
+  static PathMatcherNode::PathInfo PathInfo(const HttpTemplate& ht) {
+    PathMatcherNode::PathInfo::Builder builder;
+    for (const std::string& part : ht.segments()) {
+      builder.AppendLiteralNode(part);
+    }
+    return builder.Build();
+  }
+
+  std::shared_ptr<const PathMatcherNode> root_;
+  std::unique_ptr<PathMatcherTrie> trie_;
+  std::shared_ptr<const PathMatcherTrie> blocks_;
+  std::vector<std::unique_ptr<int>> data_;
+};
+
+TEST_F(PathMatcherTrieTest, Empty) {
+  Build();
+  EXPECT_EQ(nullptr, Lookup("GET", ""));
+  EXPECT_EQ(nullptr, Lookup("GET", "/a"));
+}
+
+TEST_F(PathMatcherTrieTest, LiteralsAndVariables) {
+  void* shelves = Register("GET", "/shelves");
+  void* shelf = Register("GET", "/shelves/{shelf}");
+  void* books = Register("GET", "/shelves/{shelf}/books");
+  void* create = Register("POST", "/shelves/{shelf}/books");
+  void* book = Register("GET", "/shelves/{shelf}/books/{book=**}");
+  void* any = Register("*", "/any/{x}");
+  Build();
+
+  EXPECT_EQ(shelves, Lookup("GET", "/shelves"));
+  EXPECT_EQ(shelf, Lookup("GET", "/shelves/1"));
+  EXPECT_EQ(books, Lookup("GET", "/shelves/1/books"));
+  EXPECT_EQ(create, Lookup("POST", "/shelves/1/books"));
+  EXPECT_EQ(book, Lookup("GET", "/shelves/1/books/2/3"));
+  EXPECT_EQ(nullptr, Lookup("PUT", "/shelves/1/books"));
+  EXPECT_EQ(any, Lookup("PATCH", "/any/1"));
+  EXPECT_EQ(nullptr, Lookup("PATCH", "/any/1/2"));
+}
+
+TEST_F(PathMatcherTrieTest, CustomVerbs) {
+  void* get = Register("GET", "/a/{x}");
+  void* verb = Register("GET", "/a/{x}:verb");
+  void* any_verb = Register("*", "/b:verb");
+  Build();
+
+  EXPECT_EQ(get, Lookup("GET", "/a/1"));
+  EXPECT_EQ(verb, Lookup("GET", "/a/1", "verb"));
+  EXPECT_EQ(nullptr, Lookup("GET", "/a/1", "other"));
+  EXPECT_EQ(nullptr, Lookup("GET", "/b", "verb"));
+  EXPECT_EQ(nullptr, Lookup("GET", "/b"));
+  (void)any_verb;
+}
+
+TEST_F(PathMatcherTrieTest, WildCards) {
+  void* root = Register("GET", "/**");
+  void* middle = Register("GET", "/a/**/b");
+  void* part = Register("GET", "/a/*/c");
+  Build();
+
+  EXPECT_EQ(root, Lookup("GET", ""));
+  EXPECT_EQ(root, Lookup("GET", "/x/y"));
+  EXPECT_EQ(middle, Lookup("GET", "/a/1/2/3/b"));
+  EXPECT_EQ(part, Lookup("GET", "/a/1/c"));
+  EXPECT_EQ(root, Lookup("GET", "/a/1/d"));
+  // Request parts that are literally the wildcard keys.
+  EXPECT_EQ(part, Lookup("GET", "/a/*/c"));
+  EXPECT_EQ(middle, Lookup("GET", "/a/**/b"));
+}
+
+TEST_F(PathMatcherTrieTest, ManyLiteralChildren) {
+  std::vector<void*> data;
+  for (int i = 0; i < 100; ++i) {
+    data.push_back(Register("GET", "/c" + std::to_string(i) + "/x"));
+  }
+  Build();
+
+  for (int i = 0; i < 100; ++i) {
+    EXPECT_EQ(data[i], Lookup("GET", "/c" + std::to_string(i) + "/x"));
+  }
+  EXPECT_EQ(nullptr, Lookup("GET", "/c100/x"));
+  EXPECT_EQ(nullptr, Lookup("GET", "/c1/y"));
+}
+
+TEST_F(PathMatcherTrieTest, Duplicates) {
+  Register("GET", "/a/b");
+  Register("GET", "/a/b");
+  Build();
+
+  Lookup("GET", "/a/b");
+}
+
+TEST_F(PathMatcherTrieTest, RandomTemplates) {
+  const std::vector<std::string> segments = {"a", "b", "c", "{x}", "*", "**"};
+  const std::vector<std::string> methods = {"GET", "POST", "*"};
+  std::mt19937 random(1234);
+  auto pick = [&random](const std::vector<std::string>& v) {
+    return v[random() % v.size()];
+  };
+
+  for (int i = 0; i < 200; ++i) {
+    std::string path;
+    int size = 1 + random() % 4;
+    bool has_wild_card_path = false;
+    for (int j = 0; j < size; ++j) {
+      std::string segment = pick(segments);
+      if (segment == "**") {
+        // Only one "**" per template.
+        if (has_wild_card_path) {
+          continue;
+        }
+        has_wild_card_path = true;
+      }
+      if (segment == "{x}") {
+        segment = "{x" + std::to_string(j) + "}";
+      }
+      path += "/" + segment;
+    }
+    if (random() % 4 == 0) {
+      path += ":verb";
+    }
+    std::unique_ptr<HttpTemplate> ht(HttpTemplate::Parse(path));
+    if (ht != nullptr) {
+      Register(pick(methods), path);
+    }
+  }
+  Build();
+
+  const std::vector<std::string> parts = {"a", "b", "c", "d", "*", ""};
+  for (int i = 0; i < 2000; ++i) {
+    std::string path;
+    int size = random() % 6;
+    for (int j = 0; j < size; ++j) {
+      path += "/" + pick(parts);
+    }
+    Lookup(pick(methods), path, random() % 4 == 0 ? "verb" : "");
+  }
+}
+
+TEST_F(PathMatcherTrieTest, UpdatesReuseTheBlocks) {
+  void* a = Register("GET", "/a/{x}/b");
+  Register("GET", "/c/d/e");
+  Build();
+  std::shared_ptr<const PathMatcherTrie> first = blocks();
+
+  // Compiling the same version again reuses all the blocks.
+  EXPECT_EQ(first, PathMatcherTrie::Compile(root(), first, 3));
+
+  void* f = Register("POST", "/c/d/f");
+  EXPECT_EQ(nullptr, Unregister("GET", "/c/x"));
+  Build();
+  EXPECT_NE(first, blocks());
+  EXPECT_EQ(a, Lookup("GET", "/a/1/b"));
+  EXPECT_EQ(f, Lookup("POST", "/c/d/f"));
+
+  EXPECT_EQ(a, Unregister("GET", "/a/{y}/b"));
+  Build();
+  EXPECT_EQ(nullptr, Lookup("GET", "/a/1/b"));
+  EXPECT_EQ(f, Lookup("POST", "/c/d/f"));
+}
+
+TEST_F(PathMatcherTrieTest, RandomUpdates) {
+  const std::vector<std::string> segments = {"a", "b", "{x}", "*", "**"};
+  const std::vector<std::string> methods = {"GET", "POST", "*"};
+  std::mt19937 random(4321);
+  auto pick = [&random](const std::vector<std::string>& v) {
+    return v[random() % v.size()];
+  };
+  auto random_template = [&]() {
+    std::string path;
+    int size = 1 + random() % 4;
+    for (int j = 0; j < size; ++j) {
+      std::string segment = pick(segments);
+      if (segment == "**") {
+        // Only at the end, so that the template is valid.
+        path += "/**";
+        break;
+      }
+      path += "/" + segment;
+    }
+    return path;
+  };
+
+  for (int version = 0; version < 50; ++version) {
+    // Each version registers and unregisters a few templates, so that the
+    // subtries grow past and shrink back under the size of a block.
+    for (int i = 0; i < 4; ++i) {
+      if (random() % 3 == 0) {
+        Unregister(pick(methods), random_template());
+      } else {
+        Register(pick(methods), random_template());
+      }
+    }
+    Build();
+
+    const std::vector<std::string> parts = {"a", "b", "c", ""};
+    for (int i = 0; i < 100; ++i) {
+      std::string path;
+      int size = random() % 5;
+      for (int j = 0; j < size; ++j) {
+        path += "/" + pick(parts);
+      }
+      Lookup(pick(methods), path);
+    }
+  }
+}
+
+}  // namespace
+}  // namespace transcoding
+}  // namespace grpc
+}  // namespace google
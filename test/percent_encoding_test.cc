@@ -0,0 +1,147 @@
+// Copyright 2022 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+#include "grpc_transcoding/percent_encoding.h"
+
+#include <string>
+#include <vector>
+
+#include "absl/strings/string_view.h"
+#include "gtest/gtest.h"
+
+namespace google {
+namespace grpc {
+
+namespace transcoding {
+namespace testing {
+namespace {
+
+const UrlUnescapeSpec kSpecs[] = {
+    UrlUnescapeSpec::kAllCharactersExceptReserved,
+    UrlUnescapeSpec::kAllCharactersExceptSlash,
+    UrlUnescapeSpec::kAllCharacters,
+};
+
+// The byte-at-a-time unescaping, for reference.
+std::string ReferenceUnescape(absl::string_view part, UrlUnescapeSpec spec,
+                              bool unescape_plus) {
+  std::string unescaped;
+  for (size_t i = 0; i < part.size();) {
+    char ch = '\0';
+    int skip = GetEscapedChar(part, i, spec, unescape_plus, &ch);
+    if (skip > 0) {
+      unescaped.push_back(ch);
+      i += skip;
+    } else {
+      unescaped.push_back(part[i]);
+      i += 1;
+    }
+  }
+  return unescaped;
+}
+
+// Expects all the unescaping functions to agree with ReferenceUnescape() for
+// all specs.
+void ExpectSameAsReference(absl::string_view part) {
+  for (UrlUnescapeSpec spec : kSpecs) {
+    for (bool unescape_plus : {false, true}) {
+      std::string expected = ReferenceUnescape(part, spec, unescape_plus);
+      bool escaped = expected != part;
+      SCOPED_TRACE(::testing::Message()
+                   << "part: " << part << " spec: " << static_cast<int>(spec)
+                   << " unescape_plus: " << unescape_plus);
+
+      EXPECT_EQ(escaped, IsUrlEscapedString(part, spec, unescape_plus));
+      EXPECT_EQ(expected, UrlUnescapeString(part, spec, unescape_plus));
+
+      std::string appended = "prefix";
+      UrlUnescapeAppend(part, spec, unescape_plus, &appended);
+      EXPECT_EQ("prefix" + expected, appended);
+
+      std::string buffer = "stale";
+      absl::string_view view =
+          UrlUnescapeString(part, spec, unescape_plus, &buffer);
+      EXPECT_EQ(expected, view);
+      if (escaped) {
+        EXPECT_EQ(buffer.data(), view.data());
+      } else {
+        // Nothing to unescape, the view refers to the input.
+        EXPECT_EQ(part.data(), view.data());
+      }
+    }
+  }
+}
+
+TEST(PercentEncodingTest, Unescape) {
+  EXPECT_EQ("a b", UrlUnescapeString("a%20b"));
+  EXPECT_EQ("a+b", UrlUnescapeString("a+b"));
+  EXPECT_EQ("a b", UrlUnescapeString(
+                       "a+b", UrlUnescapeSpec::kAllCharacters, true));
+  EXPECT_EQ("%2F%2f:",
+            UrlUnescapeString("%2F%2f%3A",
+                              UrlUnescapeSpec::kAllCharactersExceptSlash,
+                              false));
+  EXPECT_EQ("%2F %3f",
+            UrlUnescapeString("%2F%20%3f",
+                              UrlUnescapeSpec::kAllCharactersExceptReserved,
+                              false));
+  EXPECT_EQ("%", UrlUnescapeString("%"));
+  EXPECT_EQ("%2", UrlUnescapeString("%2"));
+  EXPECT_EQ("%zz", UrlUnescapeString("%zz"));
+}
+
+TEST(PercentEncodingTest, SameAsReference) {
+  const std::vector<std::string> escapes = {
+      "%20", "%2F", "%2f", "%3A", "%41", "%", "%2", "%zz", "+", "%25", "%%41"};
+  // Long enough for the vectorized scans, with the escapes at different
+  // offsets.
+  for (size_t length : {0, 1, 15, 16, 17, 31, 32, 33, 70}) {
+    std::string base(length, 'a');
+    ExpectSameAsReference(base);
+    for (const std::string& escape : escapes) {
+      for (size_t i = 0; i <= length; ++i) {
+        std::string part = base;
+        part.insert(i, escape);
+        ExpectSameAsReference(part);
+        part.insert(part.size() - i / 2, escape);
+        ExpectSameAsReference(part);
+      }
+    }
+  }
+}
+
+TEST(PercentEncodingTest, FindUrlEscapeCandidate) {
+  std::string part(100, 'a');
+  const char* begin = part.data();
+  const char* end = begin + part.size();
+  EXPECT_EQ(end, FindUrlEscapeCandidate(begin, end, true));
+  for (size_t i = 0; i < part.size(); ++i) {
+    part[i] = '+';
+    EXPECT_EQ(begin + i, FindUrlEscapeCandidate(begin, end, true));
+    EXPECT_EQ(end, FindUrlEscapeCandidate(begin, end, false));
+    part[i] = '%';
+    EXPECT_EQ(begin + i, FindUrlEscapeCandidate(begin, end, false));
+    EXPECT_EQ(begin + i, FindUrlEscapeCandidate(begin, end, true));
+    part[i] = 'a';
+  }
+}
+
+}  // namespace
+}  // namespace testing
+}  // namespace transcoding
+
+}  // namespace grpc
+}  // namespace google
@@ -19,6 +19,7 @@
 #include <cstdint>
 #include <memory>
 #include <string>
+#include <vector>
 
 #include "google/protobuf/util/converter/expecting_objectwriter.h"
 #include "gtest/gtest.h"
@@ -202,6 +203,23 @@ TEST_F(PrefixWriterTest, ThreeLevelPrefix) {
   w->EndObject();  // C, B, A, ""
 }
 
+TEST_F(PrefixWriterTest, SplitPrefix) {
+  expect_.StartObject("");
+  expect_.StartObject("A");
+  expect_.StartObject("B");
+  expect_.RenderString("x", "a");
+  expect_.EndObject();  // B
+  expect_.EndObject();  // A
+  expect_.EndObject();  // ""
+
+  const std::vector<std::string> prefix = {"A", "B"};
+  PrefixWriter w(absl::MakeConstSpan(prefix), &mock_);
+
+  w.StartObject("");
+  w.RenderString("x", "a");
+  w.EndObject();  // B, A, ""
+}
+
 }  // namespace
 }  // namespace testing
 }  // namespace transcoding
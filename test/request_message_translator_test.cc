@@ -19,8 +19,10 @@
 #include <memory>
 #include <string>
 
+#include "google/protobuf/io/zero_copy_stream_impl_lite.h"
 #include "google/protobuf/struct.pb.h"
 #include "google/protobuf/type.pb.h"
+#include "grpc_transcoding/message_compression.h"
 #include "gtest/gtest.h"
 #include "request_translator_test_base.h"
 #include "test/bookstore.pb.h"
@@ -49,7 +51,14 @@ class RequestMessageTranslatorTest : public RequestTranslatorTestBase {
     return translator_->Input();
   }
 
+  void Reset() { translator_->Reset(); }
+
+  RequestMessageTranslator& Translator() { return *translator_; }
+
   bool case_insensitive_enum_parsing_ = false;
+  bool use_type_info_ = false;
+  bool use_plan_ = false;
+  bool use_wire_encoder_ = false;
 
  private:
   // RequestTranslatorTestBase::Create()
@@ -57,11 +66,31 @@ class RequestMessageTranslatorTest : public RequestTranslatorTestBase {
       google::protobuf::util::TypeResolver& type_resolver,
       bool output_delimiters, RequestInfo request_info) {
     request_info.case_insensitive_enum_parsing = case_insensitive_enum_parsing_;
-    translator_.reset(new RequestMessageTranslator(
-        type_resolver, output_delimiters, std::move(request_info)));
+    if (use_plan_) {
+      TranscodingPlan::Spec spec;
+      spec.request_type_url =
+          "type.googleapis.com/" + request_info.message_type->name();
+      spec.body_field_path = request_info.body_field_path;
+      spec.case_insensitive_enum_parsing = case_insensitive_enum_parsing_;
+      spec.use_wire_encoder = use_wire_encoder_;
+      auto plan = TranscodingPlan::Create(Helper(), spec);
+      EXPECT_TRUE(plan.ok()) << plan.status();
+      plan_ = std::move(*plan);
+      EXPECT_EQ(use_wire_encoder_, plan_->wire_encoder_plan() != nullptr);
+      translator_.reset(new RequestMessageTranslator(
+          *plan_, output_delimiters,
+          std::move(request_info.variable_bindings)));
+    } else if (use_type_info_) {
+      translator_.reset(new RequestMessageTranslator(
+          Info(), output_delimiters, std::move(request_info)));
+    } else {
+      translator_.reset(new RequestMessageTranslator(
+          type_resolver, output_delimiters, std::move(request_info)));
+    }
     return translator_.get();
   }
 
+  std::shared_ptr<const TranscodingPlan> plan_;
   std::unique_ptr<RequestMessageTranslator> translator_;
 };
 
@@ -350,6 +379,191 @@ TEST_F(RequestMessageTranslatorTest, PrefixAndBinding) {
   EXPECT_TRUE(ExpectMessageEq<CreateBookRequest>(expected));
 }
 
+TEST_F(RequestMessageTranslatorTest, SharedTypeInfo) {
+  LoadService("bookstore_service.pb.txt");
+  SetMessageType("CreateBookRequest");
+  SetBodyPrefix("book");
+  AddVariableBinding("shelf", "99");
+  AddVariableBinding("book.authorInfo.firstName", "Leo");
+  SetOutputDelimiters(true);
+  use_type_info_ = true;
+  Build();
+  Input()
+      .StartObject("")
+      // book { <-- prefix
+      ->RenderString("name", "777")
+      ->RenderString("title", "War and Peace")
+      ->StartObject("authorInfo")
+      ->RenderString("lastName", "Tolstoy")
+      // first_name : "Leo" <-- weaved
+      ->EndObject()  // authorInfo
+      // } <-- end of prefix
+      // shelf : 99 <-- weaved
+      ->EndObject();  // ""
+
+  auto expected = R"(
+    shelf : 99
+    book {
+      name : "777"
+      title : "War and Peace"
+      author_info {
+        first_name : "Leo"
+        last_name : "Tolstoy"
+      }
+    }
+  )";
+
+  EXPECT_TRUE(ExpectMessageEq<CreateBookRequest>(expected));
+}
+
+TEST_F(RequestMessageTranslatorTest, Plan) {
+  LoadService("bookstore_service.pb.txt");
+  SetMessageType("CreateBookRequest");
+  SetBodyPrefix("book.authorInfo");
+  AddVariableBinding("shelf", "99");
+  AddVariableBinding("book.title", "War and Peace");
+  SetOutputDelimiters(true);
+  use_plan_ = true;
+  Build();
+  Input()
+      .StartObject("")
+      // book { authorInfo { <-- prefix
+      ->RenderString("firstName", "Leo")
+      ->RenderString("lastName", "Tolstoy")
+      // }} <-- end of prefix
+      // shelf : 99, book.title <-- weaved
+      ->EndObject();  // ""
+
+  auto expected = R"(
+    shelf : 99
+    book {
+      title : "War and Peace"
+      author_info {
+        first_name : "Leo"
+        last_name : "Tolstoy"
+      }
+    }
+  )";
+
+  EXPECT_TRUE(ExpectMessageEq<CreateBookRequest>(expected));
+}
+
+TEST_F(RequestMessageTranslatorTest, WireEncoder) {
+  LoadService("bookstore_service.pb.txt");
+  SetMessageType("CreateBookRequest");
+  SetBodyPrefix("book");
+  AddVariableBinding("shelf", "99");
+  SetOutputDelimiters(true);
+  use_plan_ = true;
+  use_wire_encoder_ = true;
+  Build();
+  Input()
+      .StartObject("")
+      ->RenderString("title", "War and Peace")
+      ->StartObject("authorInfo")
+      ->RenderString("firstName", "Leo")
+      ->StartObject("bio")
+      ->RenderString("yearBorn", "1828")
+      ->RenderInt64("year_died", 1910)
+      ->EndObject()
+      ->EndObject()
+      ->RenderString("unknown", "ignored")
+      ->EndObject();
+
+  auto expected = R"(
+    shelf : 99
+    book {
+      title : "War and Peace"
+      author_info {
+        first_name : "Leo"
+        bio { year_born : 1828 year_died : 1910 }
+      }
+    }
+  )";
+
+  EXPECT_TRUE(ExpectMessageEq<CreateBookRequest>(expected));
+}
+
+TEST_F(RequestMessageTranslatorTest, Reset) {
+  LoadService("bookstore_service.pb.txt");
+  SetMessageType("CreateBookRequest");
+  SetBodyPrefix("book.authorInfo");
+  AddVariableBinding("shelf", "99");
+  SetOutputDelimiters(true);
+  Build();
+  Input()
+      .StartObject("")
+      ->RenderString("firstName", "Leo")
+      ->EndObject();
+  EXPECT_TRUE(ExpectMessageEq<CreateBookRequest>(R"(
+    shelf : 99
+    book { author_info { first_name : "Leo" } }
+  )"));
+
+  // The prefix is still written, but the bindings aren't.
+  Reset();
+  Input()
+      .StartObject("")
+      ->RenderString("firstName", "Fyodor")
+      ->RenderString("lastName", "Dostoevsky")
+      ->EndObject();
+  EXPECT_TRUE(ExpectMessageEq<CreateBookRequest>(R"(
+    book { author_info { first_name : "Fyodor" last_name : "Dostoevsky" } }
+  )"));
+}
+
+TEST_F(RequestMessageTranslatorTest, Compressor) {
+  LoadService("bookstore_service.pb.txt");
+  SetMessageType("CreateBookRequest");
+  SetOutputDelimiters(true);
+  Build();
+  auto compressor = CreateMessageCompressor("gzip");
+  Translator().set_compressor(compressor.get());
+  std::string title = GenerateInput("Anna Karenina ", 10000);
+  Input()
+      .StartObject("")
+      ->RenderString("shelf", "7")
+      ->StartObject("book")
+      ->RenderString("title", title)
+      ->EndObject()   // book
+      ->EndObject();  // ""
+
+  std::string message;
+  ASSERT_TRUE(Translator().NextMessage(&message));
+  ASSERT_GT(message.size(), 5);
+  // The compression flag is set and the message is much smaller.
+  EXPECT_EQ(1, message[0]);
+  unsigned size =
+      DelimiterToSize(reinterpret_cast<const unsigned char*>(message.data()));
+  EXPECT_EQ(message.size() - 5, size);
+  EXPECT_LT(size, 1000);
+
+  absl::Status status;
+  auto decompressed = CreateMessageDecompressor("gzip")->Decompress(
+      std::unique_ptr<google::protobuf::io::ZeroCopyInputStream>(
+          new google::protobuf::io::ArrayInputStream(message.data() + 5,
+                                                     size)),
+      &status);
+  CreateBookRequest request;
+  ASSERT_TRUE(request.ParseFromZeroCopyStream(decompressed.get()));
+  EXPECT_TRUE(status.ok());
+  EXPECT_EQ(7, request.shelf());
+  EXPECT_EQ(title, request.book().title());
+}
+
+TEST_F(RequestMessageTranslatorTest, CompressorSmallMessage) {
+  LoadService("bookstore_service.pb.txt");
+  SetMessageType("CreateBookRequest");
+  SetOutputDelimiters(true);
+  Build();
+  auto compressor = CreateMessageCompressor("gzip");
+  Translator().set_compressor(compressor.get());
+  Input().StartObject("")->RenderString("shelf", "7")->EndObject();
+
+  // The message isn't compressed, as it would only get bigger.
+  EXPECT_TRUE(ExpectMessageEq<CreateBookRequest>("shelf : 7"));
+}
+
 TEST_F(RequestMessageTranslatorTest, ScalarBody) {
   LoadService("bookstore_service.pb.txt");
   SetMessageType("CreateShelfRequest");
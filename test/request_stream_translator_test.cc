@@ -39,13 +39,20 @@ class RequestStreamTranslatorTest : public RequestTranslatorTestBase {
     return *translator_;
   }
 
+  bool use_type_info_ = false;
+
  private:
   // RequestTranslatorTestBase::Create()
   virtual MessageStream* Create(
       google::protobuf::util::TypeResolver& type_resolver,
       bool output_delimiters, RequestInfo request_info) {
-    translator_.reset(new RequestStreamTranslator(
-        type_resolver, output_delimiters, std::move(request_info)));
+    if (use_type_info_) {
+      translator_.reset(new RequestStreamTranslator(
+          Info(), output_delimiters, std::move(request_info)));
+    } else {
+      translator_.reset(new RequestStreamTranslator(
+          type_resolver, output_delimiters, std::move(request_info)));
+    }
     return translator_.get();
   }
 
@@ -101,6 +108,34 @@ TEST_F(RequestStreamTranslatorTest, Two) {
   EXPECT_TRUE(Tester().ExpectFinishedEq(true));
 }
 
+TEST_F(RequestStreamTranslatorTest, SharedTypeInfo) {
+  LoadService("bookstore_service.pb.txt");
+  SetMessageType("Shelf");
+  use_type_info_ = true;
+  Build();
+  Input()
+      .StartList("")
+      ->StartObject("")
+      ->RenderString("name", "1")
+      ->RenderString("theme", "History")
+      ->EndObject();  // ""
+
+  EXPECT_TRUE(Tester().ExpectNextEq<Shelf>(R"(name : "1" theme : "History")"));
+  EXPECT_TRUE(Tester().ExpectFinishedEq(false));
+
+  Input()
+      .StartObject("")
+      ->RenderString("name", "2")
+      ->RenderString("theme", "Mistery")
+      ->EndObject();  // ""
+
+  EXPECT_TRUE(Tester().ExpectNextEq<Shelf>(R"(name : "2" theme : "Mistery")"));
+  EXPECT_TRUE(Tester().ExpectFinishedEq(false));
+
+  Input().EndList();  // ""
+  EXPECT_TRUE(Tester().ExpectFinishedEq(true));
+}
+
 TEST_F(RequestStreamTranslatorTest, OneHundred) {
   LoadService("bookstore_service.pb.txt");
   SetMessageType("Shelf");
@@ -59,6 +59,16 @@ class RequestTranslatorTestBase : public ::testing::Test {
   // ProtoStreamTester that the tests can use to validate the output
   ProtoStreamTester& Tester() { return *tester_; }
 
+  // TypeInfo of the test service types for the tests that build translators
+  // on top of a shared TypeInfo instead of the TypeResolver.
+  const google::protobuf::util::converter::TypeInfo& Info() const {
+    return *type_helper_->Info();
+  }
+
+  // TypeHelper of the test service types for the tests that build
+  // TranscodingPlans.
+  const TypeHelper& Helper() const { return *type_helper_; }
+
  private:
   // Virtual Create() function that each test class must override to create the
   // translator and return the output MessageStream.
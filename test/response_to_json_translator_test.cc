@@ -16,13 +16,19 @@
 //
 #include "grpc_transcoding/response_to_json_translator.h"
 
+#include <condition_variable>
+#include <deque>
 #include <functional>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include "google/protobuf/io/zero_copy_stream.h"
+#include "google/protobuf/io/zero_copy_stream_impl_lite.h"
 #include "google/protobuf/text_format.h"
+#include "grpc_transcoding/message_compression.h"
 #include "grpc_transcoding/type_helper.h"
 #include "gtest/gtest.h"
 #include "test/bookstore.pb.h"
@@ -1087,6 +1093,117 @@ TEST_F(ResponseToJsonTranslatorTest, InvalidFrameFlag) {
   EXPECT_EQ(translator.Status().message(), "Unsupported gRPC frame flag: 10");
 }
 
+// Returns a gRPC frame of the message compressed with gzip.
+std::string GzipGrpcFrame(const std::string& grpc_message) {
+  std::string compressed;
+  EXPECT_TRUE(CreateMessageCompressor("gzip")
+                  ->Compress(grpc_message.substr(kGrpcDelimiterByteSize),
+                             &compressed)
+                  .ok());
+  std::string frame = SizeToDelimiter(compressed.size());
+  frame[0] = 1;
+  return frame + compressed;
+}
+
+TEST_F(ResponseToJsonTranslatorTest, CompressedFrames) {
+  // Load the service config
+  ::google::api::Service service;
+  ASSERT_TRUE(
+      transcoding::testing::LoadService("bookstore_service.pb.txt", &service));
+
+  // Create a TypeHelper using the service config
+  TypeHelper type_helper(service.types(), service.enums());
+
+  auto decompressor = CreateMessageDecompressor("gzip");
+  JsonResponseTranslateOptions options;
+  options.decompressor = decompressor.get();
+  TestZeroCopyInputStream input_stream;
+  ResponseToJsonTranslator translator(type_helper.Resolver(),
+                                      "type.googleapis.com/Shelf", true,
+                                      &input_stream, options);
+
+  // A compressed message, then an uncompressed one.
+  input_stream.AddChunk(
+      GzipGrpcFrame(GenerateGrpcMessage<Shelf>(R"(name : "1" theme : "A")")));
+  input_stream.AddChunk(
+      GenerateGrpcMessage<Shelf>(R"(name : "2" theme : "B")"));
+  input_stream.Finish();
+
+  std::string actual;
+  ASSERT_TRUE(translator.NextMessage(&actual));
+  EXPECT_TRUE(ExpectJsonObjectEq(R"({"name" : "1", "theme" : "A"})",
+                                 actual.substr(1)));
+  ASSERT_TRUE(translator.NextMessage(&actual));
+  EXPECT_TRUE(ExpectJsonObjectEq(R"({"name" : "2", "theme" : "B"})",
+                                 actual.substr(1)));
+  ASSERT_TRUE(translator.NextMessage(&actual));
+  EXPECT_EQ("]", actual);
+  EXPECT_TRUE(translator.Status().ok());
+}
+
+TEST_F(ResponseToJsonTranslatorTest, ReleasesTheMessage) {
+  // Load the service config
+  ::google::api::Service service;
+  ASSERT_TRUE(
+      transcoding::testing::LoadService("bookstore_service.pb.txt", &service));
+
+  // Create a TypeHelper using the service config
+  TypeHelper type_helper(service.types(), service.enums());
+
+  TestZeroCopyInputStream input_stream;
+  ResponseToJsonTranslator translator(type_helper.Resolver(),
+                                      "type.googleapis.com/Shelf", true,
+                                      &input_stream);
+
+  // Both messages in one chunk, which the first message reads past.
+  const std::string second =
+      GenerateGrpcMessage<Shelf>(R"(name : "2" theme : "B")");
+  input_stream.AddChunk(
+      GenerateGrpcMessage<Shelf>(R"(name : "1" theme : "A")") + second);
+
+  // Once a message is translated, the input is at the start of the next one.
+  std::string actual;
+  ASSERT_TRUE(translator.NextMessage(&actual));
+  EXPECT_EQ(static_cast<int64_t>(second.size()),
+            input_stream.BytesAvailable());
+  ASSERT_TRUE(translator.NextMessage(&actual));
+  EXPECT_EQ(0, input_stream.BytesAvailable());
+  EXPECT_TRUE(translator.Status().ok());
+}
+
+TEST_F(ResponseToJsonTranslatorTest, InvalidCompressedFrame) {
+  // Load the service config
+  ::google::api::Service service;
+  ASSERT_TRUE(
+      transcoding::testing::LoadService("bookstore_service.pb.txt", &service));
+
+  // Create a TypeHelper using the service config
+  TypeHelper type_helper(service.types(), service.enums());
+
+  auto decompressor = CreateMessageDecompressor("gzip");
+  JsonResponseTranslateOptions options;
+  options.decompressor = decompressor.get();
+  TestZeroCopyInputStream input_stream;
+  ResponseToJsonTranslator translator(type_helper.Resolver(),
+                                      "type.googleapis.com/Shelf", true,
+                                      &input_stream, options);
+
+  // The compressed message is truncated.
+  std::string frame =
+      GzipGrpcFrame(GenerateGrpcMessage<Shelf>(R"(name : "1" theme : "A")"));
+  frame.resize(frame.size() - 4);
+  frame.replace(0, kGrpcDelimiterByteSize,
+                SizeToDelimiter(frame.size() - kGrpcDelimiterByteSize));
+  frame[0] = 1;
+  input_stream.AddChunk(frame);
+  input_stream.Finish();
+
+  std::string actual;
+  EXPECT_FALSE(translator.NextMessage(&actual));
+  EXPECT_FALSE(translator.Status().ok());
+  EXPECT_EQ(translator.Status().message(), "Invalid compressed gRPC message");
+}
+
 TEST_F(ResponseToJsonTranslatorTest, IncompleteFrame) {
   // Load the service config
   ::google::api::Service service;
@@ -1110,6 +1227,480 @@ TEST_F(ResponseToJsonTranslatorTest, IncompleteFrame) {
             "Incomplete gRPC frame expected size: 5 actual size: 1");
 }
 
+TEST_F(ResponseToJsonTranslatorTest, OutputStream) {
+  // Load the service config
+  ::google::api::Service service;
+  ASSERT_TRUE(
+      transcoding::testing::LoadService("bookstore_service.pb.txt", &service));
+
+  // Create a TypeHelper using the service config
+  TypeHelper type_helper(service.types(), service.enums());
+
+  TestZeroCopyInputStream input_stream;
+  ResponseToJsonTranslator translator(type_helper.Resolver(),
+                                      "type.googleapis.com/Shelf", true,
+                                      &input_stream);
+
+  // The output buffer is handed out in blocks of 3 bytes, so that the JSON
+  // and the delimiters are split across the blocks.
+  char buffer[100];
+  ::google::protobuf::io::ArrayOutputStream output_stream(buffer,
+                                                          sizeof(buffer), 3);
+  EXPECT_FALSE(translator.NextMessage(&output_stream));
+  EXPECT_EQ(0, output_stream.ByteCount());
+
+  input_stream.AddChunk(
+      GenerateGrpcMessage<Shelf>(R"(name : "1" theme : "Fiction")"));
+  input_stream.AddChunk(
+      GenerateGrpcMessage<Shelf>(R"(name : "2" theme : "Fantasy")"));
+  input_stream.Finish();
+  EXPECT_TRUE(translator.NextMessage(&output_stream));
+  EXPECT_TRUE(translator.NextMessage(&output_stream));
+  EXPECT_TRUE(translator.NextMessage(&output_stream));
+  EXPECT_TRUE(translator.Finished());
+  EXPECT_TRUE(translator.Status().ok());
+
+  std::string json(buffer, output_stream.ByteCount());
+  EXPECT_TRUE(ExpectJsonArrayEq(
+      R"([{"name":"1","theme":"Fiction"},{"name":"2","theme":"Fantasy"}])",
+      json));
+}
+
+TEST_F(ResponseToJsonTranslatorTest, JsonPrinterCache) {
+  // Load the service config
+  ::google::api::Service service;
+  ASSERT_TRUE(
+      transcoding::testing::LoadService("bookstore_service.pb.txt", &service));
+
+  // Create a TypeHelper using the service config
+  TypeHelper type_helper(service.types(), service.enums());
+
+  // The translators of both calls print with the same cached plan.
+  JsonPrinterCache cache(type_helper.Resolver());
+  JsonResponseTranslateOptions options;
+  options.json_printer_cache = &cache;
+  for (int call = 0; call < 2; ++call) {
+    TestZeroCopyInputStream input_stream;
+    ResponseToJsonTranslator translator(type_helper.Resolver(),
+                                        "type.googleapis.com/Shelf", true,
+                                        &input_stream, options);
+    input_stream.AddChunk(GenerateGrpcMessage<Shelf>(
+        R"(name : "1" theme : "Fiction" type : COMIC)"));
+    input_stream.AddChunk(
+        GenerateGrpcMessage<Shelf>(R"(name : "2" theme : "Fantasy")"));
+    input_stream.Finish();
+
+    std::string json;
+    std::string message;
+    while (translator.NextMessage(&message)) {
+      json += message;
+    }
+    EXPECT_TRUE(translator.Status().ok()) << translator.Status();
+    EXPECT_TRUE(translator.Finished());
+    EXPECT_EQ(
+        R"([{"name":"1","theme":"Fiction","type":"COMIC"},)"
+        R"({"name":"2","theme":"Fantasy"}])",
+        json);
+  }
+  EXPECT_EQ(1, cache.size());
+}
+
+TEST_F(ResponseToJsonTranslatorTest, JsonPrinterCacheSameJson) {
+  // Load the service config
+  ::google::api::Service service;
+  ASSERT_TRUE(
+      transcoding::testing::LoadService("bookstore_service.pb.txt", &service));
+
+  // Create a TypeHelper using the service config
+  TypeHelper type_helper(service.types(), service.enums());
+
+  auto serialize = [](const std::string& proto_text) {
+    Shelf shelf;
+    EXPECT_TRUE(
+        ::google::protobuf::TextFormat::ParseFromString(proto_text, &shelf));
+    return shelf.SerializeAsString();
+  };
+  // The fields of the message ordered by their numbers, out of order, and
+  // encoded more than once, at the top level and in a nested message, and
+  // strings with the characters that are escaped.
+  const std::string canonical =
+      serialize(R"(name : "1" theme : "Fiction" type : COMIC)");
+  const std::string escaped = serialize(
+      R"(name : "<b>&\"\177\302\205" theme : "\342\200\250\342\200\251")");
+  const std::string out_of_order =
+      serialize(R"(theme : "Fiction")") + serialize(R"(name : "1")");
+  const std::string duplicated =
+      serialize(R"(name : "1")") + serialize(R"(name : "2")");
+  const std::string shelf_in_list =
+      '\x0a' + std::string(1, static_cast<char>(out_of_order.size())) +
+      out_of_order;
+  const std::vector<std::pair<std::string, std::string>> messages = {
+      {"type.googleapis.com/Shelf", canonical},
+      {"type.googleapis.com/Shelf", escaped},
+      {"type.googleapis.com/Shelf", out_of_order},
+      {"type.googleapis.com/Shelf", duplicated},
+      {"type.googleapis.com/ListShelvesResponse", shelf_in_list},
+      {"type.googleapis.com/ListShelvesResponse",
+       shelf_in_list + shelf_in_list},
+  };
+
+  // Translates the message with the printer of the cache, or with
+  // BinaryToJsonStream() without a cache.
+  auto translate = [&type_helper](const std::string& type_url,
+                                  const std::string& proto,
+                                  JsonPrinterCache* cache, std::string* json) {
+    JsonResponseTranslateOptions options;
+    options.json_printer_cache = cache;
+    TestZeroCopyInputStream input_stream;
+    ResponseToJsonTranslator translator(type_helper.Resolver(), type_url,
+                                        false, &input_stream, options);
+    input_stream.AddChunk(SizeToDelimiter(proto.size()) + proto);
+    input_stream.Finish();
+    translator.NextMessage(json);
+    return translator.Status();
+  };
+
+  JsonPrinterCache cache(type_helper.Resolver());
+  for (const auto& message : messages) {
+    std::string expected;
+    absl::Status expected_status =
+        translate(message.first, message.second, nullptr, &expected);
+    std::string actual;
+    absl::Status status =
+        translate(message.first, message.second, &cache, &actual);
+    EXPECT_EQ(expected_status.code(), status.code()) << status;
+    EXPECT_EQ(expected, actual);
+  }
+  EXPECT_EQ(2, cache.size());
+}
+
+TEST_F(ResponseToJsonTranslatorTest, IncrementalTranslation) {
+  // Load the service config
+  ::google::api::Service service;
+  ASSERT_TRUE(
+      transcoding::testing::LoadService("bookstore_service.pb.txt", &service));
+
+  // Create a TypeHelper using the service config
+  TypeHelper type_helper(service.types(), service.enums());
+
+  // A large message with 1000 shelves.
+  std::string proto_text;
+  std::string expected_json = R"({"shelves":[)";
+  for (int i = 0; i < 1000; ++i) {
+    std::string id = std::to_string(i);
+    proto_text += "shelves { name : \"" + id + "\" theme : \"Theme " + id +
+                  "\" } ";
+    expected_json += std::string(i == 0 ? "" : ",") + R"({"name":")" + id +
+                     R"(","theme":"Theme )" + id + R"("})";
+  }
+  expected_json += "]}";
+  auto test_message = GenerateGrpcMessage<ListShelvesResponse>(proto_text);
+
+  JsonResponseTranslateOptions options;
+  options.incremental_translation = true;
+  TestZeroCopyInputStream input_stream;
+  ResponseToJsonTranslator translator(
+      type_helper.Resolver(), "type.googleapis.com/ListShelvesResponse", false,
+      &input_stream, options);
+
+  // The JSON is translated as the message arrives, in chunks of 1000 bytes.
+  std::string json;
+  for (size_t pos = 0; pos < test_message.size(); pos += 1000) {
+    input_stream.AddChunk(test_message.substr(pos, 1000));
+    std::string message;
+    while (translator.NextMessage(&message)) {
+      json += message;
+    }
+    ASSERT_TRUE(translator.Status().ok()) << translator.Status();
+    if (pos + 1000 < test_message.size()) {
+      EXPECT_FALSE(translator.Finished());
+      EXPECT_LT(json.size(), expected_json.size());
+      EXPECT_GT(json.size(), pos / 2);
+    }
+  }
+  EXPECT_TRUE(translator.Finished());
+  EXPECT_EQ(expected_json, json);
+}
+
+TEST_F(ResponseToJsonTranslatorTest, IncrementalStreamingTranslation) {
+  // Load the service config
+  ::google::api::Service service;
+  ASSERT_TRUE(
+      transcoding::testing::LoadService("bookstore_service.pb.txt", &service));
+
+  // Create a TypeHelper using the service config
+  TypeHelper type_helper(service.types(), service.enums());
+
+  auto test_message1 =
+      GenerateGrpcMessage<Shelf>(R"(name : "1" theme : "Fiction")");
+  auto test_message2 =
+      GenerateGrpcMessage<Shelf>(R"(name : "2" theme : "Fantasy")");
+
+  JsonResponseTranslateOptions options;
+  options.incremental_translation = true;
+  TestZeroCopyInputStream input_stream;
+  ResponseToJsonTranslator translator(type_helper.Resolver(),
+                                      "type.googleapis.com/Shelf", true,
+                                      &input_stream, options);
+
+  // Feed the messages byte by byte.
+  std::string json;
+  std::string message;
+  for (char c : test_message1 + test_message2) {
+    input_stream.AddChunk(std::string(1, c));
+    while (translator.NextMessage(&message)) {
+      json += message;
+    }
+  }
+  EXPECT_FALSE(translator.Finished());
+  input_stream.Finish();
+  while (translator.NextMessage(&message)) {
+    json += message;
+  }
+  EXPECT_TRUE(translator.Status().ok()) << translator.Status();
+  EXPECT_TRUE(translator.Finished());
+  EXPECT_EQ(
+      R"([{"name":"1","theme":"Fiction"},{"name":"2","theme":"Fantasy"}])",
+      json);
+}
+
+TEST_F(ResponseToJsonTranslatorTest, IncrementalTranslationFallback) {
+  // Load the service config
+  ::google::api::Service service;
+  ASSERT_TRUE(
+      transcoding::testing::LoadService("bookstore_service.pb.txt", &service));
+
+  // Create a TypeHelper using the service config
+  TypeHelper type_helper(service.types(), service.enums());
+
+  // The fields with default values can't be printed incrementally, so the
+  // message is translated once it's complete.
+  JsonResponseTranslateOptions options;
+  options.incremental_translation = true;
+  options.json_print_options.always_print_primitive_fields = true;
+  auto test_message = GenerateGrpcMessage<Shelf>(R"(name : "1")");
+  TestZeroCopyInputStream input_stream;
+  ResponseToJsonTranslator translator(type_helper.Resolver(),
+                                      "type.googleapis.com/Shelf", false,
+                                      &input_stream, options);
+
+  std::string message;
+  input_stream.AddChunk(test_message.substr(0, 8));
+  EXPECT_FALSE(translator.NextMessage(&message));
+  input_stream.AddChunk(test_message.substr(8));
+  EXPECT_TRUE(translator.NextMessage(&message));
+  EXPECT_TRUE(ExpectJsonObjectEq(R"({ "name":"1", "theme":"" })", message));
+}
+
+// Keeps the tasks until the test runs them.
+class QueueExecutor : public TranslationExecutor {
+ public:
+  void Execute(std::function<void()> task) { tasks_.push_back(task); }
+
+  // Runs the tasks, the last scheduled first.
+  void RunInReverse() {
+    while (!tasks_.empty()) {
+      std::function<void()> task = tasks_.back();
+      tasks_.pop_back();
+      task();
+    }
+  }
+
+  size_t size() const { return tasks_.size(); }
+
+ private:
+  std::vector<std::function<void()>> tasks_;
+};
+
+// Runs the tasks on a few threads.
+class ThreadPoolExecutor : public TranslationExecutor {
+ public:
+  explicit ThreadPoolExecutor(int num_threads) : done_(false) {
+    for (int i = 0; i < num_threads; ++i) {
+      threads_.emplace_back([this]() { Work(); });
+    }
+  }
+
+  ~ThreadPoolExecutor() {
+    {
+      std::lock_guard<std::mutex> lock(mu_);
+      done_ = true;
+    }
+    cv_.notify_all();
+    for (auto& thread : threads_) {
+      thread.join();
+    }
+  }
+
+  void Execute(std::function<void()> task) {
+    {
+      std::lock_guard<std::mutex> lock(mu_);
+      tasks_.push_back(std::move(task));
+    }
+    cv_.notify_one();
+  }
+
+ private:
+  void Work() {
+    std::unique_lock<std::mutex> lock(mu_);
+    while (true) {
+      cv_.wait(lock, [this]() { return done_ || !tasks_.empty(); });
+      if (tasks_.empty()) {
+        return;
+      }
+      std::function<void()> task = std::move(tasks_.front());
+      tasks_.pop_front();
+      lock.unlock();
+      task();
+      lock.lock();
+    }
+  }
+
+  std::mutex mu_;
+  std::condition_variable cv_;
+  std::deque<std::function<void()>> tasks_;
+  bool done_;
+  std::vector<std::thread> threads_;
+};
+
+TEST_F(ResponseToJsonTranslatorTest, ParallelTranslation) {
+  // Load the service config
+  ::google::api::Service service;
+  ASSERT_TRUE(
+      transcoding::testing::LoadService("bookstore_service.pb.txt", &service));
+
+  // Create a TypeHelper using the service config
+  TypeHelper type_helper(service.types(), service.enums());
+
+  QueueExecutor executor;
+  JsonResponseTranslateOptions options;
+  options.executor = &executor;
+  TestZeroCopyInputStream input_stream;
+  ResponseToJsonTranslator translator(type_helper.Resolver(),
+                                      "type.googleapis.com/Shelf", true,
+                                      &input_stream, options);
+
+  for (int i = 1; i <= 5; ++i) {
+    input_stream.AddChunk(GenerateGrpcMessage<Shelf>(
+        R"(name : ")" + std::to_string(i) + R"(" theme : "Fiction")"));
+  }
+  input_stream.Finish();
+
+  // All the messages are scheduled, and the first one is translated by
+  // NextMessage() as no task has started it.
+  std::string message;
+  ASSERT_TRUE(translator.NextMessage(&message));
+  EXPECT_EQ(R"([{"name":"1","theme":"Fiction"})", message);
+  EXPECT_EQ(5, executor.size());
+
+  // The tasks translate the other messages out of order, and they are still
+  // returned in order.
+  executor.RunInReverse();
+  for (int i = 2; i <= 5; ++i) {
+    ASSERT_TRUE(translator.NextMessage(&message));
+    EXPECT_EQ(R"(,{"name":")" + std::to_string(i) + R"(","theme":"Fiction"})",
+              message);
+  }
+  ASSERT_TRUE(translator.NextMessage(&message));
+  EXPECT_EQ("]", message);
+  EXPECT_TRUE(translator.Finished());
+  EXPECT_TRUE(translator.Status().ok());
+}
+
+TEST_F(ResponseToJsonTranslatorTest, ParallelTranslationBoundsInFlightBytes) {
+  // Load the service config
+  ::google::api::Service service;
+  ASSERT_TRUE(
+      transcoding::testing::LoadService("bookstore_service.pb.txt", &service));
+
+  // Create a TypeHelper using the service config
+  TypeHelper type_helper(service.types(), service.enums());
+
+  QueueExecutor executor;
+  JsonResponseTranslateOptions options;
+  options.executor = &executor;
+  options.max_in_flight_bytes = 1;
+  options.stream_newline_delimited = true;
+  TestZeroCopyInputStream input_stream;
+  ResponseToJsonTranslator translator(type_helper.Resolver(),
+                                      "type.googleapis.com/Shelf", true,
+                                      &input_stream, options);
+
+  std::string test_message =
+      GenerateGrpcMessage<Shelf>(R"(name : "1" theme : "Fiction")");
+  for (int i = 0; i < 3; ++i) {
+    input_stream.AddChunk(test_message);
+  }
+
+  // A single message is scheduled at a time, and the others are left in the
+  // input.
+  std::string message;
+  for (int i = 0; i < 3; ++i) {
+    ASSERT_TRUE(translator.NextMessage(&message));
+    EXPECT_EQ(R"({"name":"1","theme":"Fiction"})"
+              "\n",
+              message);
+    EXPECT_EQ(i + 1, executor.size());
+    EXPECT_EQ(static_cast<int64_t>((2 - i) * test_message.size()),
+              input_stream.BytesAvailable());
+  }
+  EXPECT_FALSE(translator.NextMessage(&message));
+  EXPECT_FALSE(translator.Finished());
+
+  // The tasks of the translated messages do nothing.
+  executor.RunInReverse();
+  input_stream.Finish();
+  EXPECT_TRUE(translator.NextMessage(&message));
+  EXPECT_TRUE(translator.Finished());
+}
+
+TEST_F(ResponseToJsonTranslatorTest, ParallelTranslationOnThreads) {
+  // Load the service config
+  ::google::api::Service service;
+  ASSERT_TRUE(
+      transcoding::testing::LoadService("bookstore_service.pb.txt", &service));
+
+  // Create a TypeHelper using the service config
+  TypeHelper type_helper(service.types(), service.enums());
+
+  std::string input;
+  std::string expected;
+  for (int i = 0; i < 1000; ++i) {
+    std::string name = std::to_string(i);
+    input += GenerateGrpcMessage<Shelf>(R"(name : ")" + name +
+                                        R"(" theme : "Theme )" + name + R"(")");
+    expected += R"(data: {"name":")" + name + R"(","theme":"Theme )" + name +
+                "\"}\n\n";
+  }
+
+  ThreadPoolExecutor executor(4);
+  JsonResponseTranslateOptions options;
+  options.executor = &executor;
+  options.max_in_flight_bytes = 1000;
+  options.stream_sse_style_delimited = true;
+  TestZeroCopyInputStream input_stream;
+  ResponseToJsonTranslator translator(type_helper.Resolver(),
+                                      "type.googleapis.com/Shelf", true,
+                                      &input_stream, options);
+
+  // Feed the input in chunks of 777 bytes.
+  std::string json;
+  std::string message;
+  for (size_t pos = 0; pos < input.size(); pos += 777) {
+    input_stream.AddChunk(input.substr(pos, 777));
+    while (translator.NextMessage(&message)) {
+      json += message;
+    }
+  }
+  input_stream.Finish();
+  while (translator.NextMessage(&message)) {
+    json += message;
+  }
+  EXPECT_TRUE(translator.Status().ok()) << translator.Status();
+  EXPECT_TRUE(translator.Finished());
+  EXPECT_EQ(expected, json);
+}
+
 }  // namespace
 }  // namespace testing
 }  // namespace transcoding
@@ -0,0 +1,137 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+#include "grpc_transcoding/snapshot.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace google {
+namespace grpc {
+namespace transcoding {
+namespace {
+
+std::string WriteTestSnapshot() {
+  SnapshotWriter writer;
+  writer.BeginSection(kTypeHelperSection);
+  writer.WriteString("abc");
+  writer.BeginSection(kPathMatcherSection);
+  writer.WriteUint32(7);
+  std::vector<uint64_t> values = {1, 2, 3};
+  writer.WriteArray(absl::Span<const uint64_t>(values));
+  writer.WriteUint64(42);
+  return writer.Finish();
+}
+
+void ExpectTestSnapshot(const Snapshot& snapshot) {
+  absl::StatusOr<SnapshotReader> reader = snapshot.Section(kPathMatcherSection);
+  ASSERT_TRUE(reader.ok()) << reader.status();
+  uint32_t u32;
+  ASSERT_TRUE(reader->ReadUint32(&u32));
+  EXPECT_EQ(7, u32);
+  absl::Span<const uint64_t> values;
+  ASSERT_TRUE(reader->ReadArray(&values));
+  EXPECT_EQ(std::vector<uint64_t>({1, 2, 3}),
+            std::vector<uint64_t>(values.begin(), values.end()));
+  // The array is used in place.
+  EXPECT_EQ(0, reinterpret_cast<uintptr_t>(values.data()) % 8);
+  uint64_t u64;
+  ASSERT_TRUE(reader->ReadUint64(&u64));
+  EXPECT_EQ(42, u64);
+  EXPECT_TRUE(reader->AtEnd());
+  EXPECT_FALSE(reader->ReadUint64(&u64));
+
+  reader = snapshot.Section(kTypeHelperSection);
+  ASSERT_TRUE(reader.ok()) << reader.status();
+  absl::string_view s;
+  ASSERT_TRUE(reader->ReadString(&s));
+  EXPECT_EQ("abc", s);
+  EXPECT_TRUE(reader->AtEnd());
+}
+
+TEST(SnapshotTest, RoundTrip) {
+  absl::StatusOr<Snapshot> snapshot = Snapshot::Copy(WriteTestSnapshot());
+  ASSERT_TRUE(snapshot.ok()) << snapshot.status();
+  ExpectTestSnapshot(*snapshot);
+}
+
+TEST(SnapshotTest, MissingSection) {
+  SnapshotWriter writer;
+  writer.BeginSection(kTypeHelperSection);
+  absl::StatusOr<Snapshot> snapshot = Snapshot::Copy(writer.Finish());
+  ASSERT_TRUE(snapshot.ok()) << snapshot.status();
+  EXPECT_EQ(absl::StatusCode::kNotFound,
+            snapshot->Section(kPathMatcherSection).status().code());
+}
+
+TEST(SnapshotTest, RejectsCorruptedSnapshots) {
+  const std::string blob = WriteTestSnapshot();
+
+  EXPECT_EQ(absl::StatusCode::kInvalidArgument,
+            Snapshot::Copy("").status().code());
+  EXPECT_EQ(absl::StatusCode::kInvalidArgument,
+            Snapshot::Copy(blob.substr(0, blob.size() - 8)).status().code());
+  EXPECT_EQ(absl::StatusCode::kInvalidArgument,
+            Snapshot::Copy(blob + "12345678").status().code());
+
+  std::string bad_magic = blob;
+  bad_magic[0] = 'X';
+  EXPECT_EQ(absl::StatusCode::kInvalidArgument,
+            Snapshot::Copy(bad_magic).status().code());
+
+  std::string bad_payload = blob;
+  bad_payload[bad_payload.size() - 1] ^= 1;
+  EXPECT_EQ(absl::StatusCode::kDataLoss,
+            Snapshot::Copy(bad_payload).status().code());
+}
+
+TEST(SnapshotTest, RejectsUnalignedData) {
+  const std::string blob = WriteTestSnapshot();
+  std::vector<uint64_t> buffer(blob.size() / 8 + 2);
+  char* unaligned = reinterpret_cast<char*>(buffer.data()) + 1;
+  memcpy(unaligned, blob.data(), blob.size());
+  EXPECT_EQ(absl::StatusCode::kInvalidArgument,
+            Snapshot::Open(absl::string_view(unaligned, blob.size()), nullptr)
+                .status()
+                .code());
+}
+
+TEST(SnapshotTest, MapFile) {
+  const std::string path =
+      ::testing::TempDir() + "/snapshot_test_map_file.snapshot";
+  {
+    std::ofstream file(path, std::ios::binary);
+    file << WriteTestSnapshot();
+  }
+
+  absl::StatusOr<Snapshot> snapshot = Snapshot::MapFile(path);
+  std::remove(path.c_str());
+  ASSERT_TRUE(snapshot.ok()) << snapshot.status();
+  ExpectTestSnapshot(*snapshot);
+
+  EXPECT_EQ(absl::StatusCode::kNotFound,
+            Snapshot::MapFile(path).status().code());
+}
+
+}  // namespace
+}  // namespace transcoding
+}  // namespace grpc
+}  // namespace google
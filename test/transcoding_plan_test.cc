@@ -0,0 +1,138 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+#include "grpc_transcoding/transcoding_plan.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "google/api/service.pb.h"
+#include "gtest/gtest.h"
+#include "test_common.h"
+
+namespace google {
+namespace grpc {
+
+namespace transcoding {
+namespace {
+
+class TranscodingPlanTest : public ::testing::Test {
+ protected:
+  TranscodingPlanTest() {}
+
+  void SetUp() override {
+    ASSERT_TRUE(transcoding::testing::LoadService("bookstore_service.pb.txt",
+                                                  &service_));
+    helper_.reset(new TypeHelper(service_.types(), service_.enums()));
+  }
+
+  absl::StatusOr<std::shared_ptr<const TranscodingPlan>> Create(
+      const std::string& request_type, const std::string& http_template,
+      const std::string& body_field_path) {
+    TranscodingPlan::Spec spec;
+    spec.request_type_url = "type.googleapis.com/" + request_type;
+    spec.response_type_url = "type.googleapis.com/Book";
+    spec.http_template = http_template;
+    spec.body_field_path = body_field_path;
+    return TranscodingPlan::Create(*helper_, spec);
+  }
+
+  static std::vector<std::string> FieldNames(
+      const std::vector<const google::protobuf::Field*>& fields) {
+    std::vector<std::string> names;
+    for (const auto* field : fields) {
+      names.push_back(field->name());
+    }
+    return names;
+  }
+
+ private:
+  ::google::api::Service service_;
+  std::unique_ptr<TypeHelper> helper_;
+};
+
+TEST_F(TranscodingPlanTest, ResolvesMethod) {
+  auto plan =
+      Create("CreateBookRequest", "/shelves/{shelf}/books", "book.authorInfo");
+  ASSERT_TRUE(plan.ok()) << plan.status();
+
+  EXPECT_EQ("CreateBookRequest", (*plan)->request_type().name());
+  EXPECT_EQ("type.googleapis.com/Book", (*plan)->response_type_url());
+  ASSERT_NE(nullptr, (*plan)->response_type());
+  EXPECT_EQ("Book", (*plan)->response_type()->name());
+  EXPECT_EQ("book.authorInfo", (*plan)->body_field_path());
+  EXPECT_EQ(std::vector<std::string>({"book", "author_info"}),
+            FieldNames((*plan)->body_fields()));
+  EXPECT_EQ(std::vector<std::string>({"book", "authorInfo"}),
+            (*plan)->body_prefix());
+}
+
+TEST_F(TranscodingPlanTest, WholeMessageBody) {
+  auto plan = Create("Shelf", "", "*");
+  ASSERT_TRUE(plan.ok()) << plan.status();
+  EXPECT_TRUE((*plan)->body_fields().empty());
+  EXPECT_TRUE((*plan)->body_prefix().empty());
+
+  plan = Create("Shelf", "", "");
+  ASSERT_TRUE(plan.ok()) << plan.status();
+  EXPECT_TRUE((*plan)->body_prefix().empty());
+}
+
+TEST_F(TranscodingPlanTest, ResolveBindings) {
+  auto plan = Create("GetBookRequest", "/shelves/{shelf}/books/{book}", "");
+  ASSERT_TRUE(plan.ok()) << plan.status();
+
+  std::vector<RequestWeaver::BindingInfo> resolved;
+  // "book" is a variable of the template, "shelf" is a query parameter.
+  ASSERT_TRUE((*plan)
+                  ->ResolveBindings({VariableBinding{{"shelf"}, "1"},
+                                     VariableBinding{{"book"}, "2"}},
+                                    &resolved)
+                  .ok());
+  ASSERT_EQ(2, resolved.size());
+  EXPECT_EQ(std::vector<std::string>({"shelf"}),
+            FieldNames(resolved[0].field_path));
+  EXPECT_EQ("1", resolved[0].value);
+  EXPECT_EQ(std::vector<std::string>({"book"}),
+            FieldNames(resolved[1].field_path));
+  EXPECT_EQ("2", resolved[1].value);
+
+  EXPECT_EQ(absl::StatusCode::kInvalidArgument,
+            (*plan)
+                ->ResolveBindings({VariableBinding{{"unknown"}, "1"}},
+                                  &resolved)
+                .code());
+}
+
+TEST_F(TranscodingPlanTest, Errors) {
+  EXPECT_EQ(absl::StatusCode::kNotFound,
+            Create("Unknown", "", "").status().code());
+  EXPECT_EQ(absl::StatusCode::kInvalidArgument,
+            Create("CreateBookRequest", "", "book.unknown").status().code());
+  EXPECT_EQ(absl::StatusCode::kInvalidArgument,
+            Create("CreateBookRequest", "/shelves/{unknown}", "")
+                .status()
+                .code());
+  EXPECT_EQ(absl::StatusCode::kInvalidArgument,
+            Create("CreateBookRequest", "/shelves/{shelf", "").status().code());
+}
+
+}  // namespace
+}  // namespace transcoding
+
+}  // namespace grpc
+}  // namespace google
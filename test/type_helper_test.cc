@@ -16,14 +16,19 @@
 //
 #include "grpc_transcoding/type_helper.h"
 
+#include <atomic>
 #include <fstream>
+#include <map>
 #include <memory>
 #include <sstream>
+#include <thread>
 #include <vector>
 
 #include "google/api/service.pb.h"
+#include "grpc_transcoding/snapshot.h"
 #include "google/protobuf/text_format.h"
 #include "google/protobuf/type.pb.h"
+#include "google/protobuf/util/type_resolver.h"
 #include "gtest/gtest.h"
 #include "test_common.h"
 
@@ -122,6 +127,176 @@ TEST_F(TypeHelperTest, UrlMismatch) {
   EXPECT_EQ(nullptr, GetEnum("type.other.com/ShelfType"));
 }
 
+TEST_F(TypeHelperTest, FindFieldJsonNamePrecedence) {
+  google::protobuf::Type t;
+  t.set_name("Shelf");
+  auto* f = t.add_fields();
+  f->set_name("name");
+  f->set_json_name("theme");
+  f = t.add_fields();
+  f->set_name("theme");
+  f->set_json_name("theme");
+  f = t.add_fields();
+  f->set_name("id");
+  f->set_json_name("name");
+  std::vector<google::protobuf::Type> types = {t};
+  std::vector<google::protobuf::Enum> enums;
+  TypeHelper helper(types, enums);
+
+  auto* type = helper.Info()->GetTypeByTypeUrl("type.googleapis.com/Shelf");
+  ASSERT_NE(nullptr, type);
+  // The json_name takes precedence over the name & the first field with a
+  // given json_name wins.
+  ASSERT_NE(nullptr, helper.Info()->FindField(type, "theme"));
+  EXPECT_EQ("name", helper.Info()->FindField(type, "theme")->name());
+  ASSERT_NE(nullptr, helper.Info()->FindField(type, "name"));
+  EXPECT_EQ("id", helper.Info()->FindField(type, "name")->name());
+  ASSERT_NE(nullptr, helper.Info()->FindField(type, "id"));
+  EXPECT_EQ("id", helper.Info()->FindField(type, "id")->name());
+  EXPECT_EQ(nullptr, helper.Info()->FindField(type, "unknown"));
+}
+
+// A TypeResolver with a fixed set of types and enums that counts the
+// resolution calls.
+class CountingTypeResolver : public google::protobuf::util::TypeResolver {
+ public:
+  explicit CountingTypeResolver(std::atomic<int>* calls) : calls_(calls) {}
+
+  void AddType(google::protobuf::Type t) {
+    types_.emplace("type.googleapis.com/" + t.name(), std::move(t));
+  }
+
+  void AddEnum(google::protobuf::Enum e) {
+    enums_.emplace("type.googleapis.com/" + e.name(), std::move(e));
+  }
+
+  absl::Status ResolveMessageType(const std::string& type_url,
+                                  google::protobuf::Type* type) override {
+    ++*calls_;
+    auto i = types_.find(type_url);
+    if (i == types_.end()) {
+      return absl::Status(absl::StatusCode::kNotFound, type_url);
+    }
+    *type = i->second;
+    return absl::Status();
+  }
+
+  absl::Status ResolveEnumType(const std::string& type_url,
+                               google::protobuf::Enum* enum_type) override {
+    ++*calls_;
+    auto i = enums_.find(type_url);
+    if (i == enums_.end()) {
+      return absl::Status(absl::StatusCode::kNotFound, type_url);
+    }
+    *enum_type = i->second;
+    return absl::Status();
+  }
+
+ private:
+  std::atomic<int>* calls_;
+  std::map<std::string, google::protobuf::Type> types_;
+  std::map<std::string, google::protobuf::Enum> enums_;
+};
+
+TEST(LazyTypeHelperTest, ResolvesOnce) {
+  std::atomic<int> calls(0);
+  auto* resolver = new CountingTypeResolver(&calls);
+  google::protobuf::Type t;
+  t.set_name("Shelf");
+  auto* f = t.add_fields();
+  f->set_name("shelf_theme");
+  f->set_json_name("shelfTheme");
+  resolver->AddType(t);
+  google::protobuf::Enum e;
+  e.set_name("ShelfType");
+  resolver->AddEnum(e);
+  TypeHelper helper(resolver);
+
+  auto* type = helper.Info()->GetTypeByTypeUrl("type.googleapis.com/Shelf");
+  ASSERT_NE(nullptr, type);
+  EXPECT_EQ("Shelf", type->name());
+  EXPECT_EQ(type, helper.Info()->GetTypeByTypeUrl("type.googleapis.com/Shelf"));
+  EXPECT_EQ(1, calls);
+
+  ASSERT_NE(nullptr, helper.Info()->FindField(type, "shelfTheme"));
+  EXPECT_EQ("shelf_theme",
+            helper.Info()->FindField(type, "shelfTheme")->name());
+
+  ASSERT_NE(nullptr,
+            helper.Info()->GetEnumByTypeUrl("type.googleapis.com/ShelfType"));
+  EXPECT_EQ(2, calls);
+
+  // Failures are cached too.
+  auto missing = helper.Info()->ResolveTypeUrl("type.googleapis.com/Book");
+  EXPECT_EQ(absl::StatusCode::kNotFound, missing.status().code());
+  EXPECT_EQ(nullptr,
+            helper.Info()->GetTypeByTypeUrl("type.googleapis.com/Book"));
+  EXPECT_EQ(nullptr,
+            helper.Info()->GetEnumByTypeUrl("type.googleapis.com/Book"));
+  EXPECT_EQ(nullptr,
+            helper.Info()->GetEnumByTypeUrl("type.googleapis.com/Book"));
+  EXPECT_EQ(4, calls);
+}
+
+TEST(LazyTypeHelperTest, NoSnapshot) {
+  std::atomic<int> calls(0);
+  TypeHelper helper(new CountingTypeResolver(&calls));
+  SnapshotWriter writer;
+  EXPECT_EQ(absl::StatusCode::kFailedPrecondition,
+            helper.WriteSnapshot(&writer).code());
+
+  absl::StatusOr<Snapshot> snapshot = Snapshot::Copy(writer.Finish());
+  ASSERT_TRUE(snapshot.ok()) << snapshot.status();
+  EXPECT_EQ(absl::StatusCode::kNotFound,
+            TypeHelper::LoadSnapshot(*snapshot).status().code());
+}
+
+TEST(LazyTypeHelperTest, ConcurrentLookups) {
+  constexpr int kNumTypes = 200;
+  constexpr int kNumThreads = 8;
+
+  std::atomic<int> calls(0);
+  auto* resolver = new CountingTypeResolver(&calls);
+  for (int i = 0; i < kNumTypes; ++i) {
+    google::protobuf::Type t;
+    t.set_name("Type" + std::to_string(i));
+    auto* f = t.add_fields();
+    f->set_name("field_" + std::to_string(i));
+    f->set_json_name("field" + std::to_string(i));
+    resolver->AddType(std::move(t));
+  }
+  TypeHelper helper(resolver);
+
+  std::atomic<int> failures(0);
+  std::vector<std::thread> threads;
+  for (int n = 0; n < kNumThreads; ++n) {
+    threads.emplace_back([&helper, &failures, n] {
+      for (int j = 0; j < kNumTypes; ++j) {
+        // Each thread walks the types in a different order.
+        int i = (j * (n + 1)) % kNumTypes;
+        auto* type = helper.Info()->GetTypeByTypeUrl(
+            "type.googleapis.com/Type" + std::to_string(i));
+        if (type == nullptr || type->name() != "Type" + std::to_string(i)) {
+          ++failures;
+          continue;
+        }
+        auto* field =
+            helper.Info()->FindField(type, "field" + std::to_string(i));
+        if (field == nullptr || field->name() != "field_" + std::to_string(i)) {
+          ++failures;
+        }
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  EXPECT_EQ(0, failures);
+  // Each type is resolved exactly once regardless of the number of threads.
+  EXPECT_EQ(kNumTypes, calls);
+}
+
 class ServiceConfigBasedTypeHelperTest : public ::testing::Test {
  protected:
   ServiceConfigBasedTypeHelperTest() {}
@@ -134,6 +309,20 @@ class ServiceConfigBasedTypeHelperTest : public ::testing::Test {
     return true;
   }
 
+  // Replaces the helper with one loaded from its snapshot.
+  void ReloadFromSnapshot() {
+    SnapshotWriter writer;
+    ASSERT_TRUE(helper_->WriteSnapshot(&writer).ok());
+    absl::StatusOr<Snapshot> snapshot = Snapshot::Copy(writer.Finish());
+    ASSERT_TRUE(snapshot.ok()) << snapshot.status();
+    // The loaded helper doesn't refer to the service config.
+    service_.Clear();
+    helper_.reset();
+    auto loaded = TypeHelper::LoadSnapshot(*snapshot);
+    ASSERT_TRUE(loaded.ok()) << loaded.status();
+    helper_ = std::move(*loaded);
+  }
+
   const google::protobuf::Type* GetType(const std::string& url) {
     return helper_->Info()->GetTypeByTypeUrl(url);
   }
@@ -169,6 +358,12 @@ class ServiceConfigBasedTypeHelperTest : public ::testing::Test {
     return true;
   }
 
+  bool ResolveFieldPath(
+      const google::protobuf::Type& type, const std::string& field_path_str,
+      std::vector<const google::protobuf::Field*>* field_path) {
+    return helper_->ResolveFieldPath(type, field_path_str, field_path).ok();
+  }
+
  private:
   ::google::api::Service service_;
   std::unique_ptr<TypeHelper> helper_;
@@ -206,6 +401,25 @@ TEST_F(ServiceConfigBasedTypeHelperTest, FullTypeTests) {
   EXPECT_EQ("theme", t->fields(1).name());
 }
 
+TEST_F(ServiceConfigBasedTypeHelperTest, SnapshotTests) {
+  ASSERT_TRUE(LoadService("bookstore_service.pb.txt"));
+  ReloadFromSnapshot();
+
+  auto t = GetType("type.googleapis.com/Shelf");
+  ASSERT_NE(nullptr, t);
+  EXPECT_EQ("Shelf", t->name());
+  EXPECT_EQ(3, t->fields_size());
+  EXPECT_EQ("theme", t->fields(1).name());
+
+  std::vector<const google::protobuf::Field*> field_path;
+  EXPECT_TRUE(ResolveFieldPath("CreateShelfRequest", "shelf.theme",
+                               &field_path));
+  ASSERT_EQ(2, field_path.size());
+  EXPECT_EQ("theme", field_path[1]->name());
+
+  EXPECT_EQ(nullptr, GetType("type.googleapis.com/Library"));
+}
+
 TEST_F(ServiceConfigBasedTypeHelperTest, AllTypesTests) {
   ASSERT_TRUE(LoadService("bookstore_service.pb.txt"));
 
@@ -334,6 +548,60 @@ TEST_F(ServiceConfigBasedTypeHelperTest, ResolveFieldPathTests) {
   EXPECT_EQ("year_born", field_path[3]->name());
 }
 
+TEST_F(ServiceConfigBasedTypeHelperTest, ResolveFieldPathCachedTests) {
+  ASSERT_TRUE(LoadService("bookstore_service.pb.txt"));
+
+  std::vector<const google::protobuf::Field*> first, second;
+  EXPECT_TRUE(ResolveFieldPath("CreateBookRequest", "book.authorInfo", &first));
+  EXPECT_TRUE(
+      ResolveFieldPath("CreateBookRequest", "book.authorInfo", &second));
+  EXPECT_EQ(first, second);
+
+  // The failures are cached too.
+  EXPECT_FALSE(ResolveFieldPath("CreateBookRequest", "book.x", &first));
+  EXPECT_FALSE(ResolveFieldPath("CreateBookRequest", "book.x", &first));
+
+  // Past the cache size of the failures, the field paths are still resolved,
+  // and the valid ones still cached.
+  for (int i = 0; i < 20000; ++i) {
+    EXPECT_FALSE(ResolveFieldPath("CreateBookRequest",
+                                  "junk" + std::to_string(i), &first));
+  }
+  EXPECT_TRUE(ResolveFieldPath("CreateBookRequest", "book.title", &first));
+  ASSERT_EQ(2, first.size());
+  EXPECT_EQ("title", first[1]->name());
+  EXPECT_TRUE(ResolveFieldPath("CreateBookRequest", "book.title", &second));
+  EXPECT_EQ(first, second);
+  EXPECT_TRUE(ResolveFieldPath("CreateBookRequest", "book.authorInfo", &first));
+  EXPECT_TRUE(
+      ResolveFieldPath("CreateBookRequest", "book.authorInfo", &second));
+  EXPECT_EQ(first, second);
+}
+
+TEST_F(ServiceConfigBasedTypeHelperTest, ResolveFieldPathOfOtherTypes) {
+  ASSERT_TRUE(LoadService("bookstore_service.pb.txt"));
+  const google::protobuf::Type* book = GetType("type.googleapis.com/Book");
+  ASSERT_NE(nullptr, book);
+
+  // The field paths of types that the TypeHelper doesn't own resolve to the
+  // fields of those types, even if a type later reuses the address of another.
+  std::vector<const google::protobuf::Field*> field_path;
+  for (int i = 0; i < 2; ++i) {
+    std::unique_ptr<google::protobuf::Type> copy(
+        new google::protobuf::Type(*book));
+    copy->mutable_fields(0)->set_name("name" + std::to_string(i));
+    copy->mutable_fields(0)->set_json_name("name" + std::to_string(i));
+    for (int j = 0; j < 2; ++j) {
+      ASSERT_TRUE(
+          ResolveFieldPath(*copy, "name" + std::to_string(i), &field_path));
+      ASSERT_EQ(1, field_path.size());
+      EXPECT_EQ(&copy->fields(0), field_path[0]);
+    }
+    EXPECT_FALSE(
+        ResolveFieldPath(*copy, "name" + std::to_string(1 - i), &field_path));
+  }
+}
+
 TEST_F(ServiceConfigBasedTypeHelperTest, ResolveFieldEncodedPathTests) {
   ASSERT_TRUE(LoadService("bookstore_service.pb.txt"));
 
@@ -0,0 +1,553 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+#include "grpc_transcoding/wire_encoder.h"
+
+#include <functional>
+#include <memory>
+#include <string>
+
+#include "google/protobuf/descriptor.h"
+#include "google/protobuf/descriptor.pb.h"
+#include "google/protobuf/dynamic_message.h"
+#include "google/protobuf/struct.pb.h"
+#include "google/protobuf/stubs/bytestream.h"
+#include "google/protobuf/text_format.h"
+#include "google/protobuf/timestamp.pb.h"
+#include "google/protobuf/util/converter/protostream_objectwriter.h"
+#include "google/protobuf/util/message_differencer.h"
+#include "google/protobuf/util/type_resolver_util.h"
+#include "grpc_transcoding/status_error_listener.h"
+#include "grpc_transcoding/type_helper.h"
+#include "gtest/gtest.h"
+
+namespace google {
+namespace grpc {
+
+namespace transcoding {
+namespace {
+
+namespace pb = ::google::protobuf;
+namespace pbconv = ::google::protobuf::util::converter;
+
+// The types of the tests, as a FileDescriptorProto to cover all the field
+// kinds without a dedicated .proto.
+const char kTestFile[] = R"(
+  name: "wire_encoder_test.proto"
+  package: "test"
+  syntax: "proto3"
+  dependency: "google/protobuf/struct.proto"
+  dependency: "google/protobuf/timestamp.proto"
+  message_type {
+    name: "Scalars"
+    field { name: "int32_value" number: 1 type: TYPE_INT32 }
+    field { name: "sint32_value" number: 2 type: TYPE_SINT32 }
+    field { name: "sfixed32_value" number: 3 type: TYPE_SFIXED32 }
+    field { name: "uint32_value" number: 4 type: TYPE_UINT32 }
+    field { name: "fixed32_value" number: 5 type: TYPE_FIXED32 }
+    field { name: "int64_value" number: 6 type: TYPE_INT64 }
+    field { name: "sint64_value" number: 7 type: TYPE_SINT64 }
+    field { name: "sfixed64_value" number: 8 type: TYPE_SFIXED64 }
+    field { name: "uint64_value" number: 9 type: TYPE_UINT64 }
+    field { name: "fixed64_value" number: 10 type: TYPE_FIXED64 }
+    field { name: "double_value" number: 11 type: TYPE_DOUBLE }
+    field { name: "float_value" number: 12 type: TYPE_FLOAT }
+    field { name: "bool_value" number: 13 type: TYPE_BOOL }
+    field { name: "string_value" number: 14 type: TYPE_STRING }
+    field { name: "bytes_value" number: 15 type: TYPE_BYTES }
+    field { name: "color" number: 16 type: TYPE_ENUM type_name: ".test.Color" }
+    field {
+      name: "int32_list" number: 17 type: TYPE_INT32 label: LABEL_REPEATED
+    }
+    field {
+      name: "nested" number: 18 type: TYPE_MESSAGE
+      type_name: ".test.Scalars"
+    }
+    field {
+      name: "nested_list" number: 19 type: TYPE_MESSAGE label: LABEL_REPEATED
+      type_name: ".test.Scalars"
+    }
+    field {
+      name: "choice_a" number: 20 type: TYPE_STRING oneof_index: 0
+    }
+    field {
+      name: "choice_b" number: 21 type: TYPE_INT32 oneof_index: 0
+    }
+    field {
+      name: "null_value" number: 22 type: TYPE_ENUM
+      type_name: ".google.protobuf.NullValue"
+    }
+    oneof_decl { name: "choice" }
+  }
+  message_type {
+    name: "WithMap"
+    field {
+      name: "map" number: 1 type: TYPE_MESSAGE label: LABEL_REPEATED
+      type_name: ".test.WithMap.MapEntry"
+    }
+    nested_type {
+      name: "MapEntry"
+      field { name: "key" number: 1 type: TYPE_STRING }
+      field { name: "value" number: 2 type: TYPE_STRING }
+      options { map_entry: true }
+    }
+  }
+  message_type {
+    name: "WithTimestamp"
+    field {
+      name: "time" number: 1 type: TYPE_MESSAGE
+      type_name: ".google.protobuf.Timestamp"
+    }
+  }
+  enum_type {
+    name: "Color"
+    value { name: "RED" number: 0 }
+    value { name: "GREEN" number: 1 }
+    value { name: "DARK_BLUE" number: 2 }
+  }
+)";
+
+class WireEncoderTest : public ::testing::Test {
+ protected:
+  WireEncoderTest() : pool_(pb::DescriptorPool::generated_pool()) {}
+
+  void SetUp() override {
+    // Make sure that struct.proto and timestamp.proto are in the generated
+    // pool.
+    pb::Value::descriptor();
+    pb::Timestamp::descriptor();
+
+    pb::FileDescriptorProto file;
+    ASSERT_TRUE(pb::TextFormat::ParseFromString(kTestFile, &file));
+    ASSERT_NE(nullptr, pool_.BuildFile(file));
+    helper_.reset(new TypeHelper(pb::util::NewTypeResolverForDescriptorPool(
+        "type.googleapis.com", &pool_)));
+  }
+
+  absl::StatusOr<std::shared_ptr<const WireEncoderPlan>> Compile(
+      const std::string& type_name) {
+    const pb::Type* type = helper_->Info()->GetTypeByTypeUrl(
+        "type.googleapis.com/test." + type_name);
+    EXPECT_NE(nullptr, type);
+    return WireEncoderPlan::Compile(*helper_->Info(), *type);
+  }
+
+  // Starts encoding a Scalars message.
+  WireEncoder& Encoder() {
+    if (encoder_ == nullptr) {
+      auto plan = Compile("Scalars");
+      EXPECT_TRUE(plan.ok()) << plan.status();
+      plan_ = std::move(*plan);
+      encoder_.reset(new WireEncoder(*plan_, options_, &output_, &listener_));
+      encoder_->set_use_strict_base64_decoding(false);
+    }
+    return *encoder_;
+  }
+
+  // Checks that the encoded message is done and is equal to the expected one.
+  // If the fields are rendered in the order of their numbers, the encoding can
+  // be compared byte by byte as well.
+  ::testing::AssertionResult ExpectMessage(const std::string& expected_text,
+                                           bool same_encoding = true) {
+    if (!listener_.status().ok()) {
+      return ::testing::AssertionFailure() << listener_.status();
+    }
+    if (!encoder_->done()) {
+      return ::testing::AssertionFailure() << "Not done";
+    }
+    const pb::Message* prototype =
+        factory_.GetPrototype(pool_.FindMessageTypeByName("test.Scalars"));
+    std::unique_ptr<pb::Message> expected(prototype->New());
+    std::unique_ptr<pb::Message> actual(prototype->New());
+    if (!pb::TextFormat::ParseFromString(expected_text, expected.get())) {
+      return ::testing::AssertionFailure() << "Invalid expected message";
+    }
+    if (!actual->ParseFromString(output_)) {
+      return ::testing::AssertionFailure() << "Invalid wire format";
+    }
+    if (!pb::util::MessageDifferencer::Equals(*expected, *actual)) {
+      return ::testing::AssertionFailure()
+             << "Expected:\n"
+             << expected->DebugString() << "Actual:\n"
+             << actual->DebugString();
+    }
+    if (same_encoding && expected->SerializeAsString() != output_) {
+      return ::testing::AssertionFailure() << "Different encoding";
+    }
+    return ::testing::AssertionSuccess();
+  }
+
+  // Returns the wire format of the Scalars message in text format.
+  std::string Serialize(const std::string& text) {
+    const pb::Message* prototype =
+        factory_.GetPrototype(pool_.FindMessageTypeByName("test.Scalars"));
+    std::unique_ptr<pb::Message> message(prototype->New());
+    EXPECT_TRUE(pb::TextFormat::ParseFromString(text, message.get()));
+    return message->SerializeAsString();
+  }
+
+  // Expects an InvalidArgument error mentioning message.
+  ::testing::AssertionResult ExpectError(const std::string& message) {
+    if (listener_.status().code() != absl::StatusCode::kInvalidArgument) {
+      return ::testing::AssertionFailure() << listener_.status();
+    }
+    if (listener_.status().message().find(message) == absl::string_view::npos) {
+      return ::testing::AssertionFailure()
+             << listener_.status() << " doesn't contain " << message;
+    }
+    return ::testing::AssertionSuccess();
+  }
+
+  // Writes the events of a Scalars message with both a
+  // ProtoStreamObjectWriter and a WireEncoder, and checks that they produce
+  // the same status and, if OK, the same bytes.
+  ::testing::AssertionResult ExpectSameAsProtoStreamObjectWriter(
+      const std::function<void(pbconv::ObjectWriter*)>& write_events) {
+    auto plan = Compile("Scalars");
+    if (!plan.ok()) {
+      return ::testing::AssertionFailure() << plan.status();
+    }
+
+    auto writer_options = pbconv::ProtoStreamObjectWriter::Options::Defaults();
+    writer_options.ignore_unknown_fields = options_.ignore_unknown_fields;
+    writer_options.case_insensitive_enum_parsing =
+        options_.case_insensitive_enum_parsing;
+    std::string expected;
+    pb::strings::StringByteSink sink(&expected);
+    StatusErrorListener expected_listener;
+    pbconv::ProtoStreamObjectWriter writer(
+        helper_->Resolver(),
+        *helper_->Info()->GetTypeByTypeUrl("type.googleapis.com/test.Scalars"),
+        &sink, &expected_listener, writer_options);
+    writer.set_use_strict_base64_decoding(false);
+    write_events(&writer);
+
+    std::string actual;
+    StatusErrorListener actual_listener;
+    WireEncoder encoder(**plan, options_, &actual, &actual_listener);
+    encoder.set_use_strict_base64_decoding(false);
+    write_events(&encoder);
+
+    if (expected_listener.status().code() !=
+        actual_listener.status().code()) {
+      return ::testing::AssertionFailure()
+             << "Expected status " << expected_listener.status()
+             << ", actual status " << actual_listener.status();
+    }
+    if (expected_listener.status().ok() && expected != actual) {
+      return ::testing::AssertionFailure() << "Different encoding";
+    }
+    return ::testing::AssertionSuccess();
+  }
+
+  WireEncoder::Options options_;
+
+ private:
+  pb::DescriptorPool pool_;
+  pb::DynamicMessageFactory factory_;
+  std::unique_ptr<TypeHelper> helper_;
+  std::shared_ptr<const WireEncoderPlan> plan_;
+  std::string output_;
+  StatusErrorListener listener_;
+  std::unique_ptr<WireEncoder> encoder_;
+};
+
+TEST_F(WireEncoderTest, Scalars) {
+  Encoder()
+      .StartObject("")
+      ->RenderInt32("int32_value", -1)
+      ->RenderInt64("sint32Value", -2)
+      ->RenderUint64("sfixed32_value", 3)
+      ->RenderDouble("uint32_value", 4)
+      ->RenderString("fixed32_value", "5")
+      ->RenderString("int64_value", "-6000000000")
+      ->RenderInt64("sint64_value", -7)
+      ->RenderInt64("sfixed64_value", -8)
+      ->RenderString("uint64Value", "18446744073709551615")
+      ->RenderUint64("fixed64_value", 10)
+      ->RenderDouble("double_value", 1.5)
+      ->RenderString("float_value", "-2.5")
+      ->RenderBool("bool_value", true)
+      ->RenderString("stringValue", "abc")
+      ->RenderString("bytes_value", "aGVsbG8")
+      ->RenderString("color", "DARK_BLUE")
+      ->EndObject();
+
+  EXPECT_TRUE(ExpectMessage(R"(
+    int32_value: -1
+    sint32_value: -2
+    sfixed32_value: 3
+    uint32_value: 4
+    fixed32_value: 5
+    int64_value: -6000000000
+    sint64_value: -7
+    sfixed64_value: -8
+    uint64_value: 18446744073709551615
+    fixed64_value: 10
+    double_value: 1.5
+    float_value: -2.5
+    bool_value: true
+    string_value: "abc"
+    bytes_value: "hello"
+    color: DARK_BLUE
+  )"));
+}
+
+TEST_F(WireEncoderTest, SpecialValues) {
+  Encoder()
+      .StartObject("")
+      ->RenderDouble("int32_value", 1e3)
+      ->RenderString("int64_value", "1e3")
+      ->RenderString("double_value", "-Infinity")
+      ->RenderString("bool_value", "true")
+      ->RenderString("bytes_value", "_-8")
+      ->RenderInt32("color", 1)
+      ->RenderNull("string_value")
+      ->EndObject();
+
+  EXPECT_TRUE(ExpectMessage(R"(
+    int32_value: 1000
+    int64_value: 1000
+    double_value: -inf
+    bool_value: true
+    bytes_value: "\xff\xef"
+    color: GREEN
+  )"));
+}
+
+TEST_F(WireEncoderTest, CaseInsensitiveEnums) {
+  options_.case_insensitive_enum_parsing = true;
+  Encoder().StartObject("")->RenderString("color", "dark-blue")->EndObject();
+  EXPECT_TRUE(ExpectMessage("color: DARK_BLUE"));
+}
+
+TEST_F(WireEncoderTest, SameAsProtoStreamObjectWriter) {
+  // The strings sent for enum, int32 & int64 fields.
+  const struct {
+    const char* field;
+    const char* value;
+  } kStringValues[] = {
+      {"color", "GREEN"},
+      {"color", "DARK_BLUE"},
+      {"color", "dark_blue"},
+      {"color", "dark-blue"},
+      {"color", "PURPLE"},
+      {"color", "1"},
+      {"color", "2"},
+      {"color", "7"},
+      {"color", "-1"},
+      {"color", " 1"},
+      {"color", "1.0"},
+      {"color", ""},
+      {"int32_value", "5"},
+      {"int32_value", "-5"},
+      {"int32_value", "2147483647"},
+      {"int32_value", "2147483648"},
+      {"int32_value", "1e3"},
+      {"int32_value", "1.5"},
+      {"int32_value", " 5"},
+      {"int32_value", "five"},
+      {"int64_value", "-6000000000"},
+      {"int64_value", "9223372036854775807"},
+      {"int64_value", "9223372036854775808"},
+      {"int64_value", "1e3"},
+      {"int64_value", "0x10"},
+  };
+  for (bool case_insensitive : {false, true}) {
+    options_.case_insensitive_enum_parsing = case_insensitive;
+    for (const auto& value : kStringValues) {
+      EXPECT_TRUE(ExpectSameAsProtoStreamObjectWriter(
+          [&value](pbconv::ObjectWriter* writer) {
+            writer->StartObject("")
+                ->RenderString(value.field, value.value)
+                ->EndObject();
+          }))
+          << value.field << ": \"" << value.value << "\""
+          << (case_insensitive ? " (case insensitive)" : "");
+    }
+  }
+
+  // The enum numbers, declared or not, that aren't sent as strings.
+  for (int32_t number : {0, 2, 7, -1}) {
+    EXPECT_TRUE(ExpectSameAsProtoStreamObjectWriter(
+        [number](pbconv::ObjectWriter* writer) {
+          writer->StartObject("")->RenderInt32("color", number)->EndObject();
+        }))
+        << "color: " << number;
+  }
+}
+
+TEST_F(WireEncoderTest, NestedAndRepeated) {
+  std::string long_string(300, 'x');
+  Encoder()
+      .StartObject("")
+      ->StartList("int32List")
+      ->RenderInt32("", 1)
+      ->RenderInt32("", 2)
+      ->EndList()
+      ->StartObject("nested")
+      ->StartObject("nested")
+      ->RenderString("string_value", long_string)
+      ->EndObject()
+      ->EndObject()
+      ->StartList("nested_list")
+      ->StartObject("")
+      ->RenderInt32("int32_value", 1)
+      ->EndObject()
+      ->StartObject("")
+      ->EndObject()
+      ->EndList()
+      ->RenderString("choice_a", "a")
+      ->EndObject();
+
+  EXPECT_TRUE(ExpectMessage(R"(
+    int32_list: 1
+    int32_list: 2
+    nested { nested { string_value: ")" +
+                            long_string + R"(" } }
+    nested_list { int32_value: 1 }
+    nested_list {}
+    choice_a: "a"
+  )",
+                            // The repeated fields are not packed, like with
+                            // ProtoStreamObjectWriter.
+                            /*same_encoding=*/false));
+}
+
+TEST_F(WireEncoderTest, NestedMessageLengths) {
+  auto plan = Compile("Scalars");
+  ASSERT_TRUE(plan.ok()) << plan.status();
+  // The lengths of the nested messages take one to three bytes, at several
+  // depths, and are followed by other fields.
+  for (int depth = 1; depth <= 4; ++depth) {
+    for (size_t size : {1, 100, 121, 125, 126, 127, 128, 200, 16370, 20000}) {
+      std::string value(size, 'x');
+      std::string actual;
+      StatusErrorListener listener;
+      WireEncoder encoder(**plan, options_, &actual, &listener);
+      std::string text;
+      encoder.StartObject("");
+      for (int i = 0; i < depth; ++i) {
+        encoder.RenderString("string_value", "a")->StartObject("nested");
+        text += R"(string_value: "a" nested { )";
+      }
+      encoder.RenderString("string_value", value);
+      text += R"(string_value: ")" + value + R"(")";
+      for (int i = 0; i < depth; ++i) {
+        encoder.EndObject()
+            ->StartList("nested_list")
+            ->StartObject("")
+            ->RenderInt32("int32_value", i + 1)
+            ->EndObject()
+            ->EndList();
+        text += " } nested_list { int32_value: " + std::to_string(i + 1) + " }";
+      }
+      encoder.EndObject();
+
+      EXPECT_TRUE(listener.status().ok()) << listener.status();
+      EXPECT_TRUE(encoder.done());
+      EXPECT_TRUE(Serialize(text) == actual)
+          << "Depth " << depth << ", size " << size;
+    }
+  }
+}
+
+TEST_F(WireEncoderTest, NullValue) {
+  // A null is NULL_VALUE for a google.protobuf.NullValue field, and is
+  // skipped for the other fields.
+  auto write_events = [](pbconv::ObjectWriter* writer) {
+    writer->StartObject("")
+        ->RenderNull("null_value")
+        ->RenderNull("int32_value")
+        ->EndObject();
+  };
+  auto plan = Compile("Scalars");
+  ASSERT_TRUE(plan.ok()) << plan.status();
+  std::string actual;
+  StatusErrorListener listener;
+  WireEncoder encoder(**plan, options_, &actual, &listener);
+  write_events(&encoder);
+  EXPECT_TRUE(listener.status().ok()) << listener.status();
+  // The tag of field 22 and the value 0.
+  EXPECT_EQ(std::string("\xb0\x01\x00", 3), actual);
+  EXPECT_TRUE(ExpectSameAsProtoStreamObjectWriter(write_events));
+}
+
+TEST_F(WireEncoderTest, UnknownFields) {
+  options_.ignore_unknown_fields = true;
+  Encoder()
+      .StartObject("")
+      ->RenderString("unknown", "a")
+      ->StartObject("unknown_object")
+      ->RenderString("string_value", "b")
+      ->EndObject()
+      ->StartList("unknown_list")
+      ->EndList()
+      ->RenderString("string_value", "c")
+      ->EndObject();
+  EXPECT_TRUE(ExpectMessage("string_value: \"c\""));
+}
+
+TEST_F(WireEncoderTest, UnknownFieldError) {
+  Encoder().StartObject("")->RenderString("unknown", "a")->EndObject();
+  EXPECT_TRUE(ExpectError("Cannot find field: unknown in message"));
+}
+
+TEST_F(WireEncoderTest, InvalidValues) {
+  Encoder()
+      .StartObject("")
+      ->StartList("nested_list")
+      ->StartObject("")
+      ->RenderInt64("int32_value", int64_t{1} << 40)
+      ->EndObject()
+      ->EndList()
+      ->EndObject();
+  EXPECT_TRUE(ExpectError("nested_list[0]"));
+  EXPECT_TRUE(ExpectError("TYPE_INT32"));
+}
+
+TEST_F(WireEncoderTest, InvalidValueTypes) {
+  Encoder().StartObject("")->RenderString("color", "PURPLE")->EndObject();
+  EXPECT_TRUE(ExpectError("TYPE_ENUM"));
+}
+
+TEST_F(WireEncoderTest, OneofAlreadySet) {
+  Encoder()
+      .StartObject("")
+      ->RenderString("choice_a", "a")
+      ->RenderInt32("choice_b", 1)
+      ->EndObject();
+  EXPECT_TRUE(ExpectError("oneof field 'choice' is already set"));
+}
+
+TEST_F(WireEncoderTest, NotRepeated) {
+  Encoder().StartObject("")->StartList("int32_value")->EndList()->EndObject();
+  EXPECT_TRUE(ExpectError("not repeating"));
+}
+
+TEST_F(WireEncoderTest, UnsupportedTypes) {
+  EXPECT_TRUE(Compile("Scalars").ok());
+  EXPECT_EQ(absl::StatusCode::kUnimplemented,
+            Compile("WithMap").status().code());
+  EXPECT_EQ(absl::StatusCode::kUnimplemented,
+            Compile("WithTimestamp").status().code());
+}
+
+}  // namespace
+}  // namespace transcoding
+
+}  // namespace grpc
+}  // namespace google